@@ -8,41 +8,318 @@
  */
 
 #include <cctype>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include "accounting.h"
+#include "budget.h"
+#include "checkpoint.h"
+#include "compiler.h"
 #include "console.h"
 #include "exp.h"
+#include "inputsource.h"
+#include "matrix.h"
+#include "optimizer.h"
+#include "output.h"
 #include "parser.h"
+#include "perfcounters.h"
+#include "profiler.h"
 #include "program.h"
+#include "stats.h"
 #include "tokenscanner.h"
+#include "threadpool.h"
+#include "tiering.h"
+#include "transpiler.h"
 #include "simpio.h"
 #include "strlib.h"
 #include "statement.h"
 using namespace std;
 
+/* Command-line settings */
+
+static string statsFormat;
+static PerfCounters *perfCounters = NULL;
+static string cppFilename;
+
 /* Function prototypes */
 
+string processArguments(int argc, char *argv[]);
+int runFile(string filename, Program & program, EvalState & state);
+void loadFile(string filename, Program & program, EvalState & state);
 void processLine(string line, Program & program, EvalState & state);
+void runProgram(int lineNumber, Program & program, EvalState & state);
+void reportSuspension(Program & program);
+void finish();
+void checkpointCommand(istringstream & args, Program & program);
 void help();
 
 /* Main program */
 
-int main() {
+int main(int argc, char *argv[]) {
    EvalState state;
    Program program;
-   cout << "Welcome to BASIC!" << endl;
+   string filename = processArguments(argc, argv);
+   if (filename != "") return runFile(filename, program, state);
+   printLine("Welcome to BASIC!");
    while (true) {
       try {
+           //makes pending output visible before waiting for a command
+         flushBeforeInput();
            //processes the line
          processLine(getLine(), program, state);
       } catch (ErrorException & ex) {
            //expressions thrown within the program are handled
+         flushOutput();
+         cerr << "Error: " << ex.getMessage() << endl;
+      }
+   }
+   return 0;
+}
+
+/*
+ * Function: processArguments
+ * Usage: string filename = processArguments(argc, argv);
+ * ------------------------------------------------------
+ * Applies the command-line options and returns the name of the program
+ * file to run in batch mode, or the empty string for the interactive
+ * interpreter.  The options are:
+ *
+ *   --flush=policy  Sets the output flush policy (see output.h)
+ *   --input=file    Reads INPUT values from file, or stdin if file is -
+ *   --stats=format  Writes the counters to stderr on exit as json or text
+ *   --profile=file[:hz]  Samples the running program hz times a second
+ *                   (default 1000) and writes folded stacks to file
+ *   --perf          Reports hardware performance counters for each run
+ *   --no-optimize   Compiles programs without the expression optimizations
+ *   --tier-up=n     Optimizes a program in the background once a loop has
+ *                   jumped back n times (default 1000; 0 optimizes first)
+ *   --emit-cpp=file Translates the program file to C++ instead of running
+ *                   it ("-" writes to stdout)
+ *   --max-statements=n  Limits each run to about n statements
+ *   --deadline=ms   Limits each run to ms milliseconds
+ *   --on-limit=action  Stops a run over either limit with an error (the
+ *                   default) or, with yield, suspends it; CONT continues
+ *                   a suspended run, and batch runs continue it at once
+ *   --suspend-on-wait  Suspends a run instead of waiting for input or for
+ *                   the output writer; batch runs continue it once the
+ *                   wait is over
+ *   --gosub-depth=n Limits how deeply GOSUB calls may nest (default
+ *                   10000)
+ *   --memory-limit=n  Limits the memory of the whole session to n bytes
+ *                   (K, M and G suffixes allowed)
+ *   --program-memory-limit=n  Limits the memory of the program's lines,
+ *                   statements and compiled code to n bytes
+ *   --mat-kernels=set  Runs MAT statements with the avx2, sse2 or scalar
+ *                   kernels instead of the fastest the processor supports
+ *   --threads=n     Runs PARALLEL FOR loops on n threads (default: one
+ *                   per processor)
+ */
+
+string processArguments(int argc, char *argv[]) {
+   string filename;
+   for (int i = 1; i < argc; i++) {
+      string arg = argv[i];
+      try {
+         if (startsWith(arg, "--flush=")) {
+            setFlushPolicy(arg.substr(8));
+         } else if (startsWith(arg, "--stats=")) {
+            statsFormat = arg.substr(8);
+            if (statsFormat != "json" && statsFormat != "text") {
+               error("Unknown stats format " + statsFormat);
+            }
+         } else if (startsWith(arg, "--profile=")) {
+            string spec = arg.substr(10);
+            size_t colon = spec.rfind(':');
+            if (colon == string::npos) {
+               startProfiler(spec);
+            } else {
+               startProfiler(spec.substr(0, colon),
+                             stringToInteger(spec.substr(colon + 1)));
+            }
+         } else if (arg == "--perf") {
+            perfCounters = new PerfCounters();
+         } else if (startsWith(arg, "--emit-cpp=")) {
+            cppFilename = arg.substr(11);
+         } else if (startsWith(arg, "--tier-up=")) {
+            setTierUpThreshold(stringToInteger(arg.substr(10)));
+         } else if (arg == "--no-optimize") {
+            setOptimizing(false);
+         } else if (startsWith(arg, "--max-statements=")) {
+            setStatementBudget(stringToInteger(arg.substr(17)));
+         } else if (startsWith(arg, "--deadline=")) {
+            setRunDeadline(stringToInteger(arg.substr(11)));
+         } else if (startsWith(arg, "--on-limit=")) {
+            string action = arg.substr(11);
+            if (action == "error") {
+               setBudgetAction(BUDGET_ERROR);
+            } else if (action == "yield") {
+               setBudgetAction(BUDGET_YIELD);
+            } else {
+               error("Unknown limit action " + action);
+            }
+         } else if (startsWith(arg, "--gosub-depth=")) {
+            setReturnStackLimit(stringToInteger(arg.substr(14)));
+         } else if (arg == "--suspend-on-wait") {
+            setSuspendOnWait(true);
+         } else if (startsWith(arg, "--memory-limit=")) {
+            setSessionMemoryLimit(parseMemorySize(arg.substr(15)));
+         } else if (startsWith(arg, "--program-memory-limit=")) {
+            setProgramMemoryLimit(parseMemorySize(arg.substr(23)));
+         } else if (startsWith(arg, "--mat-kernels=")) {
+            setMatrixKernels(arg.substr(14));
+         } else if (startsWith(arg, "--threads=")) {
+            setThreadCount(stringToInteger(arg.substr(10)));
+         } else if (startsWith(arg, "--input=")) {
+            setInputSource(new StreamInputSource(arg.substr(8)));
+         } else if (!startsWith(arg, "-") && filename == "") {
+            filename = arg;
+         } else {
+            error("Unknown option " + arg);
+         }
+      } catch (ErrorException & ex) {
          cerr << "Error: " << ex.getMessage() << endl;
+         exit(1);
+      }
+   }
+   return filename;
+}
+
+/*
+ * Function: runFile
+ * Usage: int status = runFile(filename, program, state);
+ * ------------------------------------------------------
+ * Loads the numbered lines in the named file, runs the program (or with
+ * --emit-cpp translates it) and returns the exit status for main.
+ */
+
+int runFile(string filename, Program & program, EvalState & state) {
+   try {
+      loadFile(filename, program, state);
+      if (cppFilename == "") {
+         if (program.isEmpty()) error("Program cannot be run");
+         runProgram(program.getFirstLineNumber(), program, state);
+         //with nothing else to schedule, a suspended run goes on at once,
+         //or once the reader or writer thread lets it, sleeping until then
+         while (program.isSuspended()) {
+            if (program.getSuspendReason() == SUSPEND_INPUT) {
+               state.getInputSource().waitUntilReady();
+            } else if (program.getSuspendReason() == SUSPEND_OUTPUT) {
+               waitForOutput();
+            }
+            runProgram(program.getSuspendedLine(), program, state);
+         }
+      } else if (cppFilename == "-") {
+         emitCpp(program, cout, filename);
+      } else {
+         ofstream out(cppFilename.c_str());
+         if (out.fail()) error("Cannot open " + cppFilename);
+         emitCpp(program, out, filename);
       }
+   } catch (ErrorException & ex) {
+      flushOutput();
+      cerr << "Error: " << ex.getMessage() << endl;
+      finish();
+      return 1;
    }
+   finish();
    return 0;
 }
 
+/*
+ * Function: loadFile
+ * Usage: loadFile(filename, program, state);
+ * ------------------------------------------
+ * Adds the numbered lines in the named file to the program.  Blank
+ * lines are skipped; any other line must start with a line number.
+ */
+
+void loadFile(string filename, Program & program, EvalState & state) {
+   ifstream in(filename.c_str());
+   string line;
+   int lineCount = 0;
+   if (in.fail()) error("Cannot open " + filename);
+   while (getline(in, line)) {
+      lineCount++;
+      if (trim(line) == "") continue;
+      if (!isdigit(trim(line)[0])) {
+         error(filename + ":" + integerToString(lineCount)
+               + ": Line number required");
+      }
+      processLine(line, program, state);
+   }
+}
+
+/*
+ * Function: runProgram
+ * Usage: runProgram(lineNumber, program, state);
+ * ----------------------------------------------
+ * Runs the program from lineNumber.  With --perf, the run is measured
+ * with the performance counters and the report goes to stderr, even if
+ * the program stops with an error.
+ */
+
+void runProgram(int lineNumber, Program & program, EvalState & state) {
+   if (perfCounters == NULL) {
+      program.run(lineNumber, state);
+      return;
+   }
+   unsigned long long statements = getStatementCount();
+   perfCounters->start();
+   try {
+      program.run(lineNumber, state);
+   } catch (...) {
+      perfCounters->stop();
+      flushOutput();
+      cerr << perfCounters->toString(getStatementCount() - statements);
+      throw;
+   }
+   perfCounters->stop();
+   flushOutput();
+   cerr << perfCounters->toString(getStatementCount() - statements);
+}
+
+/*
+ * Function: reportSuspension
+ * Usage: reportSuspension(program);
+ * ---------------------------------
+ * Tells the user where and why a suspended run stopped.  Batch runs
+ * continue such a run themselves and do not call this.
+ */
+
+void reportSuspension(Program & program) {
+   if (!program.isSuspended()) return;
+   string reason;
+   if (program.getSuspendReason() == SUSPEND_INPUT) reason = " waiting for input";
+   if (program.getSuspendReason() == SUSPEND_OUTPUT) reason = " waiting for output";
+   printLine("Suspended at line " + integerToString(program.getSuspendedLine())
+             + reason + " (CONT continues)");
+}
+
+/*
+ * Function: finish
+ * Usage: finish();
+ * ----------------
+ * Writes the profile if --profile was given and the counters if
+ * --stats was given, and stops the --input reader thread.
+ */
+
+void finish() {
+   try {
+      stopProfiler();
+   } catch (ErrorException & ex) {
+      cerr << "Error: " << ex.getMessage() << endl;
+   }
+   setInputSource(NULL);
+   if (statsFormat == "") return;
+   flushOutput();
+   if (statsFormat == "json") {
+      cerr << statsToString(true) << endl;
+   } else {
+      cerr << statsToString(false);
+   }
+}
+
 /*
  * Function: processLine
  * Usage: processLine(line, program, state);
@@ -59,8 +336,7 @@ int main() {
 void processLine(string line, Program & program, EvalState & state) {
     //creates a scanner that takes in input
    TokenScanner scanner;
-   scanner.ignoreWhitespace();
-   scanner.scanNumbers();
+   configureScanner(scanner);
    scanner.setInput(line);
    //ensures that the token is uppercase
    string next = toUpperCase(scanner.nextToken());
@@ -75,8 +351,20 @@ void processLine(string line, Program & program, EvalState & state) {
        }
        //stores the source line in the list
        program.addSourceLine(nextNumber,line);
-       //sets the statement
-       program.setParsedStatement(nextNumber,parseStatement(scanner));
+       //sets the statement, charging its nodes to the parsed statements
+       Statement *stmt;
+       {
+           MemoryScope scope(MEM_AST);
+           stmt = parseStatement(scanner);
+       }
+       program.setParsedStatement(nextNumber,stmt);
+       //a line that would go over a memory limit is not kept
+       try {
+           checkMemoryLimits();
+       } catch (ErrorException & ex) {
+           program.removeSourceLine(nextNumber);
+           throw;
+       }
    }
    else if (next == "RUN") {
        //error if there is nothing to run
@@ -87,8 +375,75 @@ void processLine(string line, Program & program, EvalState & state) {
        int firstLineNumber = program.getFirstLineNumber();
        //sets the state line number to what is assigned
        state.setCurrentLineNumber(firstLineNumber);
+       //starts with no variables and outside any subroutine, even if the
+       //last run left values or a suspended run was inside one
+       state.clear();
        //runs the program
-       program.run(firstLineNumber, state);
+       runProgram(firstLineNumber, program, state);
+       reportSuspension(program);
+   }
+   else if (next == "CONT") {
+       //continues a run that was suspended by its budget or a wait
+       runProgram(program.getSuspendedLine(), program, state);
+       reportSuspension(program);
+   }
+   else if (next == "CHECKPOINT" || next == "RESUME") {
+       //reads the arguments after the command word
+       istringstream args(line);
+       args >> next;
+       if (toUpperCase(next) == "CHECKPOINT") {
+           checkpointCommand(args, program);
+           return;
+       }
+       string filename;
+       if (!(args >> filename)) error("Checkpoint file required");
+       if (program.isEmpty()) error("Program cannot be run");
+       //restores the variables and the line to continue from
+       loadCheckpoint(filename, state, program.getFingerprint());
+       runProgram(state.getCurrentLineNumber(), program, state);
+       reportSuspension(program);
+   }
+   else if (next == "STATS") {
+       //STATS RESET starts the counters again
+       if (toUpperCase(scanner.nextToken()) == "RESET") {
+           resetStats();
+       } else {
+           printText(statsToString(false));
+       }
+   }
+   else if (next == "CHECKS") {
+       //lists the variable reads that still check for undefined variables
+       if (program.isEmpty()) error("Program is empty");
+       for (string check : program.compile().getKeptChecks()) {
+           printLine(check + " is checked");
+       }
+   }
+   else if (next == "CACHES") {
+       //lists the subexpressions whose values the optimizer reuses
+       if (program.isEmpty()) error("Program is empty");
+       for (string cached : program.compile().getCachedExpressions()) {
+           printLine(cached + " is cached");
+       }
+   }
+   else if (next == "MEMORY") {
+       //shows the bytes in use by category, then what the parsed
+       //statements take with and without sharing
+       printText(memoryToString());
+       HashConsTable & table = program.getSharedTrees();
+       printLine("Without sharing: " + integerToString(table.getUnsharedNodeCount())
+                 + " nodes, " + integerToString(table.getUnsharedByteCount()) + " bytes");
+       printLine("With sharing:    " + integerToString(table.getNodeCount())
+                 + " nodes, " + integerToString(table.getByteCount()) + " bytes");
+   }
+   else if (next == "LOAD") {
+       //replaces the program with the one in the file
+       istringstream args(line);
+       string filename;
+       args >> next;
+       if (!(args >> filename)) error("File name required");
+       program.clear();
+       state.clear();
+       loadFile(filename, program, state);
    }
    else if (next == "LIST") program.list();
    else if (next == "HELP") help();
@@ -98,23 +453,73 @@ void processLine(string line, Program & program, EvalState & state) {
        //clears the state map
        state.clear();
    }
-   else if (next == "QUIT") exit(0);
+   else if (next == "QUIT") {
+       finish();
+       exit(0);
+   }
    else {
        if (next == "REM") {
-           cout << "Line number required" << endl;
+           printLine("Line number required");
            return;
        }
        //restores the first token
        scanner.saveToken(next);
-       parseStatement(scanner)->execute(state);
+       //runs the statement once and frees it, even if it fails
+       Statement *stmt = parseStatement(scanner);
+       try {
+           stmt->execute(state);
+       } catch (...) {
+           delete stmt;
+           throw;
+       }
+       delete stmt;
    }
 }
 
+/*
+ * Function: checkpointCommand
+ * Usage: checkpointCommand(args, program);
+ * ----------------------------------------
+ * Handles CHECKPOINT file [statements [millis]] and CHECKPOINT OFF.
+ * With no interval, snapshots are taken only when SIGUSR1 arrives.
+ */
+
+void checkpointCommand(istringstream & args, Program & program) {
+    string filename;
+    int statements = 0;
+    int millis = 0;
+    if (!(args >> filename)) {
+        if (program.getCheckpoint().isEnabled()) {
+            printLine("Checkpointing is on");
+        } else {
+            printLine("Checkpointing is off");
+        }
+        return;
+    }
+    if (toUpperCase(filename) == "OFF") {
+        program.getCheckpoint().disable();
+        return;
+    }
+    if (args >> statements) args >> millis;
+    if (args.fail() && !args.eof()) error("Illegal checkpoint interval");
+    program.getCheckpoint().enable(filename, statements, millis);
+}
+
 void help() {
-    cout << "Available commands:" << endl;
-    cout << "  RUN - Runs the program" << endl;
-    cout << "  LIST - Lists the program" << endl;
-    cout << "  CLEAR - Clears the program" << endl;
-    cout << "  HELP -- Prints this message" << endl;
-    cout << "  QUIT - Exits from the BASIC interpreter" << endl;
+    printLine("Available commands:");
+    printLine("  RUN - Runs the program");
+    printLine("  LIST - Lists the program");
+    printLine("  CLEAR - Clears the program");
+    printLine("  LOAD file - Replaces the program with the one in the file");
+    printLine("  CHECKPOINT file [n [ms]] - Saves the running state every n"
+              " statements or ms milliseconds (OFF to stop)");
+    printLine("  RESUME file - Continues a program from a checkpoint");
+    printLine("  CONT - Continues a run suspended by --on-limit=yield or"
+              " --suspend-on-wait");
+    printLine("  STATS [RESET] - Shows or resets the instrumentation counters");
+    printLine("  CHECKS - Lists reads that still check for undefined variables");
+    printLine("  CACHES - Lists subexpressions whose values are reused");
+    printLine("  MEMORY - Shows the memory in use and the memory limits");
+    printLine("  HELP -- Prints this message");
+    printLine("  QUIT - Exits from the BASIC interpreter");
 }
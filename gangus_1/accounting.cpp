@@ -0,0 +1,230 @@
+/*
+ * File: accounting.cpp
+ * --------------------
+ * This file implements the accounting.h interface.  It replaces the
+ * global operator new and operator delete, so every heap allocation
+ * made by the interpreter is both counted in the stats and charged to
+ * a memory category.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <string>
+#include "accounting.h"
+#include "error.h"
+#include "stats.h"
+#include "strlib.h"
+using namespace std;
+
+/*
+ * Type: BlockHeader
+ * -----------------
+ * The bookkeeping in front of every block: the size that was asked
+ * for, the category it was charged to and the distance back to the
+ * start of the underlying malloc block, which is larger than the
+ * header only for over-aligned types.  The header is 16 bytes, so the
+ * block keeps malloc's alignment.
+ */
+
+struct BlockHeader {
+   size_t size;
+   int category;
+   int offset;
+};
+
+/* Private state */
+
+static atomic<long long> usage[NUM_MEMORY_CATEGORIES];
+static thread_local int currentCategory = MEM_OTHER;
+static long long sessionLimit = 0;
+static long long programLimit = 0;
+bool memoryLimited = false;
+
+/* Private function prototypes */
+
+static string categoryName(int category);
+static string limitToString(long long limit);
+
+MemoryScope::MemoryScope(MemoryCategory category) {
+   saved = MemoryCategory(currentCategory);
+   currentCategory = category;
+}
+
+MemoryScope::~MemoryScope() {
+   currentCategory = saved;
+}
+
+long long getMemoryUsage(MemoryCategory category) {
+   return usage[category].load(memory_order_relaxed);
+}
+
+long long getSessionMemory() {
+   long long total = 0;
+   for (int i = 0; i < NUM_MEMORY_CATEGORIES; i++) {
+      total += getMemoryUsage(MemoryCategory(i));
+   }
+   return total;
+}
+
+long long getProgramMemory() {
+   return getMemoryUsage(MEM_LINES) + getMemoryUsage(MEM_AST)
+        + getMemoryUsage(MEM_CODE);
+}
+
+void setSessionMemoryLimit(long long bytes) {
+   sessionLimit = bytes;
+   memoryLimited = sessionLimit > 0 || programLimit > 0;
+}
+
+void setProgramMemoryLimit(long long bytes) {
+   programLimit = bytes;
+   memoryLimited = sessionLimit > 0 || programLimit > 0;
+}
+
+long long parseMemorySize(string spec) {
+   long long scale = 1;
+   char suffix = spec.empty() ? ' ' : toupper(spec[spec.length() - 1]);
+   if (suffix == 'K') scale = 1LL << 10;
+   if (suffix == 'M') scale = 1LL << 20;
+   if (suffix == 'G') scale = 1LL << 30;
+   if (scale > 1) spec = spec.substr(0, spec.length() - 1);
+   if (spec.empty() || spec.find_first_not_of("0123456789") != string::npos) {
+      error("Illegal memory size " + spec);
+   }
+   return stoll(spec) * scale;
+}
+
+void enforceMemoryLimits() {
+   long long program = getProgramMemory();
+   if (programLimit > 0 && program > programLimit) {
+      error("Program memory limit exceeded (" + to_string(program)
+            + " bytes in use, limit " + to_string(programLimit) + ")");
+   }
+   long long session = getSessionMemory();
+   if (sessionLimit > 0 && session > sessionLimit) {
+      error("Session memory limit exceeded (" + to_string(session)
+            + " bytes in use, limit " + to_string(sessionLimit) + ")");
+   }
+}
+
+void enforceMemoryRequest(long long bytes) {
+   long long session = getSessionMemory();
+   if (sessionLimit > 0 && session + bytes > sessionLimit) {
+      error("Session memory limit exceeded (" + to_string(session)
+            + " bytes in use, " + to_string(bytes) + " more requested, limit "
+            + to_string(sessionLimit) + ")");
+   }
+}
+
+string memoryToString() {
+   ostringstream out;
+   for (int i = 0; i < NUM_MEMORY_CATEGORIES; i++) {
+      out << left << setw(22) << categoryName(i) << right << setw(14)
+          << getMemoryUsage(MemoryCategory(i)) << endl;
+   }
+   out << left << setw(22) << "program total" << right << setw(14)
+       << getProgramMemory() << limitToString(programLimit) << endl;
+   out << left << setw(22) << "session total" << right << setw(14)
+       << getSessionMemory() << limitToString(sessionLimit) << endl;
+   return out.str();
+}
+
+static string categoryName(int category) {
+   switch (category) {
+    case MEM_LINES: return "lines";
+    case MEM_AST: return "statements";
+    case MEM_CODE: return "compiledCode";
+    case MEM_SYMBOLS: return "variables";
+    case MEM_OUTPUT: return "outputBuffers";
+    case MEM_NUMBERS: return "bigIntegers";
+    case MEM_STRINGS: return "strings";
+    case MEM_OTHER: return "other";
+   }
+   return "?";
+}
+
+static string limitToString(long long limit) {
+   if (limit == 0) return "";
+   return " (limit " + to_string(limit) + ")";
+}
+
+/*
+ * Implementation notes: operator new and operator delete
+ * ------------------------------------------------------
+ * The replacements count the allocation, charge it and then defer to
+ * malloc and free.  The aligned forms are needed by types with extended
+ * alignment; their header sits just in front of the aligned block.
+ */
+
+static void *allocate(size_t size, size_t align) {
+   countStat(STAT_ALLOCATIONS);
+   countStat(STAT_ALLOCATED_BYTES, size);
+   size_t offset = sizeof(BlockHeader);
+   void *base;
+   if (align <= alignof(max_align_t)) {
+      base = malloc(offset + size);
+   } else {
+      offset = align;
+      if (posix_memalign(&base, align, offset + size) != 0) base = NULL;
+   }
+   if (base == NULL) return NULL;
+   char *ptr = (char *) base + offset;
+   BlockHeader *header = (BlockHeader *) ptr - 1;
+   header->size = size;
+   header->category = currentCategory;
+   header->offset = offset;
+   usage[currentCategory].fetch_add(size, memory_order_relaxed);
+   return ptr;
+}
+
+static void deallocate(void *ptr) {
+   if (ptr == NULL) return;
+   BlockHeader *header = (BlockHeader *) ptr - 1;
+   usage[header->category].fetch_sub(header->size, memory_order_relaxed);
+   free((char *) ptr - header->offset);
+}
+
+void *operator new(size_t size) {
+   void *ptr = allocate(size, 0);
+   if (ptr == NULL) throw bad_alloc();
+   return ptr;
+}
+
+void *operator new[](size_t size) {
+   void *ptr = allocate(size, 0);
+   if (ptr == NULL) throw bad_alloc();
+   return ptr;
+}
+
+void *operator new(size_t size, const nothrow_t &) noexcept {
+   return allocate(size, 0);
+}
+
+void *operator new[](size_t size, const nothrow_t &) noexcept {
+   return allocate(size, 0);
+}
+
+void *operator new(size_t size, align_val_t alignment) {
+   void *ptr = allocate(size, size_t(alignment));
+   if (ptr == NULL) throw bad_alloc();
+   return ptr;
+}
+
+void *operator new[](size_t size, align_val_t alignment) {
+   void *ptr = allocate(size, size_t(alignment));
+   if (ptr == NULL) throw bad_alloc();
+   return ptr;
+}
+
+void operator delete(void *ptr) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, align_val_t) noexcept { deallocate(ptr); }
+void operator delete(void *ptr, size_t, align_val_t) noexcept { deallocate(ptr); }
+void operator delete[](void *ptr, size_t, align_val_t) noexcept { deallocate(ptr); }
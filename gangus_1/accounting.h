@@ -0,0 +1,144 @@
+/*
+ * File: accounting.h
+ * ------------------
+ * This interface exports the interpreter's memory accounting.  Every
+ * heap allocation goes through the replacement operator new in
+ * accounting.cpp, which charges it to the category that the allocating
+ * thread is working in, and operator delete gives the bytes back to
+ * the same category.  Limits on the totals protect the host from one
+ * runaway session.
+ */
+
+#ifndef _accounting_h
+#define _accounting_h
+
+#include <string>
+
+/*
+ * Type: MemoryCategory
+ * ------------------------
+ * The parts of the interpreter whose memory is reported separately.
+ * Allocations made outside any MemoryScope count as MEM_OTHER.
+ */
+
+enum MemoryCategory {
+   MEM_LINES,       /* the stored program text                       */
+   MEM_AST,         /* the parsed statements and expressions          */
+   MEM_CODE,        /* the compiled tiers                             */
+   MEM_SYMBOLS,     /* the variables of the EvalState                 */
+   MEM_OUTPUT,      /* the output buffers                             */
+   MEM_NUMBERS,     /* the digits of big integers                     */
+   MEM_STRINGS,     /* the characters of long strings                 */
+   MEM_OTHER,
+   NUM_MEMORY_CATEGORIES
+};
+
+/*
+ * Class: MemoryScope
+ * ----------------------
+ * While a MemoryScope exists, the allocations of the thread that made
+ * it are charged to its category.  Scopes nest; the destructor puts
+ * back the category that was in effect before.
+ */
+
+class MemoryScope {
+
+public:
+
+   MemoryScope(MemoryCategory category);
+   ~MemoryScope();
+
+private:
+
+   MemoryCategory saved;
+
+};
+
+/*
+ * Function: getMemoryUsage
+ * Usage: long long bytes = getMemoryUsage(MEM_AST);
+ * -----------------------------------------------------
+ * Returns the number of bytes currently allocated in the category.
+ */
+
+long long getMemoryUsage(MemoryCategory category);
+
+/*
+ * Functions: getSessionMemory, getProgramMemory
+ * Usage: long long bytes = getProgramMemory();
+ * ------------------------------------------------
+ * Return the bytes in use by the whole session and by the program,
+ * which is the line store, the parsed statements and the compiled code.
+ */
+
+long long getSessionMemory();
+long long getProgramMemory();
+
+/*
+ * Functions: setSessionMemoryLimit, setProgramMemoryLimit
+ * Usage: setProgramMemoryLimit(bytes);
+ * ----------------------------------------
+ * Set the hard limits that checkMemoryLimits enforces.  A limit of 0,
+ * the default, means no limit.
+ */
+
+void setSessionMemoryLimit(long long bytes);
+void setProgramMemoryLimit(long long bytes);
+
+/*
+ * Function: parseMemorySize
+ * Usage: long long bytes = parseMemorySize("64M");
+ * ----------------------------------------------------
+ * Converts a byte count with an optional K, M or G suffix.
+ */
+
+long long parseMemorySize(std::string spec);
+
+/*
+ * Function: checkMemoryLimits
+ * Usage: checkMemoryLimits();
+ * -------------------------------
+ * Raises an error if either total is over its limit.  The allocator
+ * itself never fails for a limit, since it cannot know whether its
+ * caller can recover; the interpreter calls this function instead
+ * where it can stop cleanly: after a line is entered, after the
+ * program is compiled, and on every backward jump while it runs.
+ * Without limits the check is a single load.
+ */
+
+extern bool memoryLimited;
+
+void enforceMemoryLimits();
+
+inline void checkMemoryLimits() {
+   if (memoryLimited) enforceMemoryLimits();
+}
+
+/*
+ * Function: checkMemoryRequest
+ * Usage: checkMemoryRequest(bytes);
+ * ---------------------------------
+ * Raises an error if allocating bytes more would take the session over
+ * its limit.  The code that makes blocks whose size the program picks,
+ * the arrays and the arena chunks behind strings and big integers, calls
+ * this function before it allocates, so a request that is too large
+ * fails before any of it is committed.
+ */
+
+void enforceMemoryRequest(long long bytes);
+
+inline void checkMemoryRequest(long long bytes) {
+   if (memoryLimited) enforceMemoryRequest(bytes);
+}
+
+/*
+ * Function: memoryToString
+ * Usage: string report = memoryToString();
+ * --------------------------------------------
+ * Returns a table of the bytes in use by category, with the totals and
+ * their limits.
+ */
+
+std::string memoryToString();
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * File: analysis.cpp
+ * ------------------
+ * This file implements the analysis.h interface.
+ */
+
+#include <string>
+#include <vector>
+#include "analysis.h"
+#include "cfg.h"
+#include "exp.h"
+#include "flatexp.h"
+#include "hashmap.h"
+#include "statement.h"
+#include "strlib.h"
+#include "vector.h"
+using namespace std;
+
+/*
+ * Type: VarSet
+ * ------------
+ * A set of variables represented as a bit vector indexed by the number
+ * that the analysis assigns to each variable name.
+ */
+
+typedef vector<unsigned long long> VarSet;
+
+/* Private function prototypes */
+
+static void collectReads(Expression *exp, Vector<IdentifierExp *> & reads);
+static bool contains(const VarSet & set, int var);
+static void add(VarSet & set, int var);
+
+/*
+ * Implementation notes: eliminateUndefinedChecks
+ * ----------------------------------------------
+ * This is the classic forward "must" analysis.  The set of variables
+ * assigned on exit from a node is the set on entry plus the variable the
+ * node assigns, and the set on entry is the intersection over all
+ * predecessors.  Exit sets start full so that the intersection over a
+ * loop's back edge does not lose facts, and the entry node starts empty.
+ * Visiting nodes in reverse postorder makes the iteration converge in a
+ * few passes even for programs with many loops.
+ */
+
+Vector<string> eliminateUndefinedChecks(ControlFlowGraph & graph, int entry) {
+   Vector<string> kept;
+   if (entry < 0) return kept;
+   Vector<int> order = reversePostorder(graph, entry);
+   HashMap<string,int> numbers;
+   for (int index : order) {
+      Vector<IdentifierExp *> vars;
+      getReads(graph.getNode(index), vars);
+      IdentifierExp *def = getDefinition(graph.getNode(index));
+      if (def != NULL) vars.add(def);
+      for (IdentifierExp *var : vars) {
+         if (!numbers.containsKey(var->getName())) {
+            numbers.put(var->getName(), numbers.size());
+         }
+      }
+   }
+   int words = (numbers.size() + 63) / 64;
+   VarSet empty(words, 0);
+   VarSet full(words, ~0ULL);
+   Vector<VarSet> out(graph.size(), full);
+   Vector<VarSet> in(graph.size(), empty);
+   Vector<Vector<int> > preds = graph.getPredecessors();
+   bool changed = true;
+   while (changed) {
+      changed = false;
+      for (int index : order) {
+         VarSet set = (index == entry) ? empty : full;
+         for (int pred : preds[index]) {
+            if (!graph.getNode(pred).reachable) continue;
+            for (int w = 0; w < words; w++) set[w] &= out[pred][w];
+         }
+         in[index] = set;
+         IdentifierExp *def = getDefinition(graph.getNode(index));
+         if (def != NULL) add(set, numbers.get(def->getName()));
+         if (set != out[index]) {
+            out[index] = set;
+            changed = true;
+         }
+      }
+   }
+   for (int index = 0; index < graph.size(); index++) {
+      CfgNode & node = graph.getNode(index);
+      if (!node.reachable) continue;
+      Vector<IdentifierExp *> reads;
+      getReads(node, reads);
+      for (IdentifierExp *var : reads) {
+         bool assigned = contains(in[index], numbers.get(var->getName()));
+         var->setChecked(!assigned);
+         if (!assigned) {
+            kept.add(integerToString(node.lineNumber) + ": " + var->getName());
+         }
+      }
+   }
+   return kept;
+}
+
+/*
+ * Implementation notes: inferIntegerVariables
+ * -------------------------------------------
+ * This is an optimistic fixpoint.  Every assigned variable starts out as
+ * an integer, except those read by INPUT and string variables, which
+ * could otherwise pass as integers by being copied only from each other.
+ * A variable drops out when some LET assigns it an expression that is
+ * not an integer with what is currently assumed.  Dropping a variable
+ * can only make more expressions non-integer, so the iteration stops
+ * after at most one pass for each variable.
+ */
+
+Vector<string> inferIntegerVariables(ControlFlowGraph & graph) {
+   HashMap<string,bool> integer;
+   Vector<string> names;
+   for (int index = 0; index < graph.size(); index++) {
+      CfgNode & node = graph.getNode(index);
+      IdentifierExp *def = getDefinition(node);
+      if (def == NULL) continue;
+      string name = def->getName();
+      if (!integer.containsKey(name)) {
+         integer.put(name, true);
+         names.add(name);
+      }
+      if (node.type == INPUT_STMT || isStringName(name)) {
+         integer.put(name, false);
+      }
+   }
+   bool changed = true;
+   while (changed) {
+      changed = false;
+      for (int index = 0; index < graph.size(); index++) {
+         Vector<IdentifierExp *> reads;
+         getReads(graph.getNode(index), reads);
+         for (IdentifierExp *var : reads) {
+            string name = var->getName();
+            var->setInteger(integer.containsKey(name) && integer.get(name));
+         }
+      }
+      for (int index = 0; index < graph.size(); index++) {
+         CfgNode & node = graph.getNode(index);
+         if (node.type != LET_STMT) continue;
+         IdentifierExp *def = getDefinition(node);
+         if (def == NULL || !integer.get(def->getName())) continue;
+         if (!isIntegerExpression(((LetStmt *) node.stmt)->getExp())) {
+            integer.put(def->getName(), false);
+            changed = true;
+         }
+      }
+   }
+   Vector<string> result;
+   for (string name : names) {
+      if (integer.get(name)) result.add(name);
+   }
+   return result;
+}
+
+bool isIntegerExpression(Expression *exp) {
+   switch (exp->getType()) {
+    case CONSTANT: {
+      Value value = ((ConstantExp *) exp)->getValue();
+      return value.isInteger() || value.isBig();
+    }
+    case IDENTIFIER:
+      return ((IdentifierExp *) exp)->isInteger();
+    case INDEX: case ARRAY:
+      return true;
+    case COMPOUND: {
+      CompoundExp *compound = (CompoundExp *) exp;
+      string op = compound->getOp();
+      if (op != "+" && op != "-" && op != "*" && op != "/") return false;
+      return isIntegerExpression(compound->getLHS())
+          && isIntegerExpression(compound->getRHS());
+    }
+    case CACHED:
+      return isIntegerExpression(((CachedExp *) exp)->getExp());
+    case FLAT:
+      return isIntegerExpression(((FlatExp *) exp)->getTree());
+    default:
+      return false;
+   }
+}
+
+/*
+ * Implementation notes: collectReads, getReads, getDefinition
+ * -----------------------------------------------------------
+ * These functions know which statements read and assign variables.  The
+ * variable on the left of LET and in INPUT is a write, not a read, but
+ * the subscripts of an element on the left of LET are reads, and so is
+ * the base of a LET that appends to a string.
+ */
+
+static void collectReads(Expression *exp, Vector<IdentifierExp *> & reads) {
+   if (exp == NULL) return;
+   if (exp->getType() == IDENTIFIER) {
+      reads.add((IdentifierExp *) exp);
+   } else if (exp->getType() == INDEX) {
+      collectReads(((IndexExp *) exp)->getSubscript(), reads);
+   } else if (exp->getType() == ARRAY) {
+      collectReads(((ArrayExp *) exp)->getFirst(), reads);
+      collectReads(((ArrayExp *) exp)->getSecond(), reads);
+   } else if (exp->getType() == COMPOUND) {
+      collectReads(((CompoundExp *) exp)->getLHS(), reads);
+      collectReads(((CompoundExp *) exp)->getRHS(), reads);
+   } else if (exp->getType() == CALL) {
+      CallExp *call = (CallExp *) exp;
+      for (int i = 0; i < call->getArgCount(); i++) {
+         collectReads(call->getArg(i), reads);
+      }
+   } else if (exp->getType() == CACHED) {
+      collectReads(((CachedExp *) exp)->getExp(), reads);
+   } else if (exp->getType() == FLAT) {
+      collectReads(((FlatExp *) exp)->getTree(), reads);
+   }
+}
+
+void getReads(CfgNode & node, Vector<IdentifierExp *> & reads) {
+   switch (node.type) {
+    case PRINT_STMT:
+      collectReads(((PrintStmt *) node.stmt)->getExp(), reads);
+      break;
+    case LET_STMT:
+      collectReads(((LetStmt *) node.stmt)->getBase(), reads);
+      collectReads(((LetStmt *) node.stmt)->getExp(), reads);
+      collectReads(((LetStmt *) node.stmt)->getElement(), reads);
+      break;
+    case DIM_STMT:
+      collectReads(((DimStmt *) node.stmt)->getFirst(), reads);
+      collectReads(((DimStmt *) node.stmt)->getSecond(), reads);
+      break;
+    case MAT_STMT:
+      collectReads(((MatStmt *) node.stmt)->getScale(), reads);
+      collectReads(((MatStmt *) node.stmt)->getFirst(), reads);
+      collectReads(((MatStmt *) node.stmt)->getSecond(), reads);
+      break;
+    case PARALLEL_FOR_STMT:
+      collectReads(((ParallelForStmt *) node.stmt)->getFirst(), reads);
+      collectReads(((ParallelForStmt *) node.stmt)->getLast(), reads);
+      break;
+    case ON_GOTO_STMT:
+    case ON_GOSUB_STMT:
+      collectReads(((OnStmt *) node.stmt)->getExp(), reads);
+      break;
+    case IF_STMT:
+      collectReads(((IfStmt *) node.stmt)->getLHS(), reads);
+      collectReads(((IfStmt *) node.stmt)->getRHS(), reads);
+      break;
+    default:
+      break;
+   }
+}
+
+IdentifierExp *getDefinition(CfgNode & node) {
+   if (node.type == LET_STMT) return ((LetStmt *) node.stmt)->getVariable();
+   if (node.type == INPUT_STMT) return ((InputStmt *) node.stmt)->getVariable();
+   if (node.type == PARALLEL_FOR_STMT) {
+      return ((ParallelForStmt *) node.stmt)->getVariable();
+   }
+   return NULL;
+}
+
+/*
+ * Implementation notes: getElementsKey, getShapeKey, getArrayWrites
+ * -----------------------------------------------------------------
+ * The keys contain characters that a variable name cannot.
+ */
+
+string getElementsKey(string array) {
+   return array + "()";
+}
+
+string getShapeKey(string array) {
+   return "DIM " + array;
+}
+
+void getArrayWrites(CfgNode & node, Vector<string> & keys) {
+   if (node.type == LET_STMT) {
+      ArrayExp *element = ((LetStmt *) node.stmt)->getElement();
+      if (element != NULL) keys.add(getElementsKey(element->getName()));
+   } else if (node.type == DIM_STMT) {
+      string name = ((DimStmt *) node.stmt)->getName();
+      keys.add(getElementsKey(name));
+      keys.add(getShapeKey(name));
+   } else if (node.type == MAT_STMT) {
+      string name = ((MatStmt *) node.stmt)->getName();
+      keys.add(getElementsKey(name));
+      keys.add(getShapeKey(name));
+   }
+}
+
+/*
+ * Implementation notes: reversePostorder
+ * --------------------------------------
+ * The depth-first search keeps, for each node on its stack, how many of
+ * the node's successors it has visited, which avoids recursion.
+ */
+
+Vector<int> reversePostorder(ControlFlowGraph & graph, int entry) {
+   Vector<int> postorder;
+   Vector<bool> visited(graph.size(), false);
+   Vector<int> stack;
+   Vector<int> position;
+   stack.add(entry);
+   position.add(0);
+   visited[entry] = true;
+   while (!stack.isEmpty()) {
+      int top = stack.size() - 1;
+      Vector<int> succ = graph.getSuccessors(stack[top]);
+      if (position[top] < succ.size()) {
+         int next = succ[position[top]++];
+         if (!visited[next]) {
+            visited[next] = true;
+            stack.add(next);
+            position.add(0);
+         }
+      } else {
+         postorder.add(stack[top]);
+         stack.remove(top);
+         position.remove(top);
+      }
+   }
+   Vector<int> order;
+   for (int i = postorder.size() - 1; i >= 0; i--) {
+      order.add(postorder[i]);
+   }
+   return order;
+}
+
+static bool contains(const VarSet & set, int var) {
+   return (set[var / 64] >> (var % 64)) & 1;
+}
+
+static void add(VarSet & set, int var) {
+   set[var / 64] |= 1ULL << (var % 64);
+}
@@ -0,0 +1,117 @@
+/*
+ * File: analysis.h
+ * ----------------
+ * This interface exports the dataflow analyses that the compiler runs
+ * over the control-flow graph of a program.
+ */
+
+#ifndef _analysis_h
+#define _analysis_h
+
+#include <string>
+#include "cfg.h"
+#include "exp.h"
+#include "vector.h"
+
+/*
+ * Function: eliminateUndefinedChecks
+ * Usage: Vector<string> kept = eliminateUndefinedChecks(graph, entry);
+ * --------------------------------------------------------------------
+ * Runs definite-assignment analysis over the nodes reachable from entry
+ * and clears the checked flag of every variable read that is preceded
+ * by a LET or INPUT of that variable on every path from the entry.  The
+ * reads that keep their check are returned as strings such as "20: X".
+ *
+ * The analysis assumes that no variable is defined when the program
+ * starts, which is always safe: a variable defined before RUN simply
+ * keeps a check that it will pass.
+ */
+
+Vector<std::string> eliminateUndefinedChecks(ControlFlowGraph & graph,
+                                             int entry);
+
+/*
+ * Function: inferIntegerVariables
+ * Usage: Vector<string> integers = inferIntegerVariables(graph);
+ * --------------------------------------------------------------
+ * Finds the variables that can only ever hold integers in the program:
+ * those that every LET assigns an integer expression, that no INPUT
+ * reads, whose names do not end in $ and that are assigned at least
+ * once.  The loop variable of a
+ * PARALLEL FOR counts as assigned an integer.  Every read of such a
+ * variable is marked with setInteger, and their names are returned.
+ *
+ * The analysis ignores the order of the statements and looks at every
+ * line, reachable or not, so the result holds for any run of the
+ * program that starts with the variables holding integers.
+ */
+
+Vector<std::string> inferIntegerVariables(ControlFlowGraph & graph);
+
+/*
+ * Function: isIntegerExpression
+ * Usage: if (isIntegerExpression(exp)) . . .
+ * ------------------------------------------
+ * Returns true if exp can only produce an integer: it is built from
+ * integer constants, variables marked with setInteger and array
+ * elements by the four arithmetic operators.
+ */
+
+bool isIntegerExpression(Expression *exp);
+
+/*
+ * Function: reversePostorder
+ * Usage: Vector<int> order = reversePostorder(graph, entry);
+ * ----------------------------------------------------------
+ * Returns the nodes reachable from entry in reverse postorder, which
+ * visits every node before its successors except along back edges.
+ */
+
+Vector<int> reversePostorder(ControlFlowGraph & graph, int entry);
+
+/*
+ * Function: getReads
+ * Usage: getReads(node, reads);
+ * -----------------------------
+ * Adds to reads every variable that the node's expressions read.
+ */
+
+void getReads(CfgNode & node, Vector<IdentifierExp *> & reads);
+
+/*
+ * Function: getDefinition
+ * Usage: IdentifierExp *var = getDefinition(node);
+ * ------------------------------------------------
+ * Returns the variable that the node's LET or INPUT assigns, or the loop
+ * variable of a PARALLEL FOR, which is always assigned, or NULL if the
+ * node assigns no variable.  What the body of a PARALLEL FOR assigns is
+ * not a definition, since the loop may not run at all.
+ */
+
+IdentifierExp *getDefinition(CfgNode & node);
+
+/*
+ * Functions: getElementsKey, getShapeKey
+ * Usage: string key = getElementsKey(name);
+ * -----------------------------------------
+ * Return the names under which the optimizer tracks the elements and
+ * the dimensions of an array as if they were variables.  Neither can be
+ * the name of a real variable.
+ */
+
+std::string getElementsKey(std::string array);
+std::string getShapeKey(std::string array);
+
+/*
+ * Function: getArrayWrites
+ * Usage: getArrayWrites(node, keys);
+ * ----------------------------------
+ * Adds to keys what the node changes in arrays: the elements of the
+ * array that a LET assigns an element of, and both the elements and the
+ * dimensions of the array that a DIM gives new storage or that a MAT
+ * stores its result in.
+ */
+
+void getArrayWrites(CfgNode & node, Vector<std::string> & keys);
+
+#endif
@@ -0,0 +1,554 @@
+/*
+ * File: bigint.cpp
+ * ----------------
+ * This file implements the bigint.h interface.
+ */
+
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <string>
+#include "accounting.h"
+#include "bigint.h"
+#include "blockarena.h"
+#include "value.h"
+#include "vector.h"
+using namespace std;
+
+/* Constants */
+
+static const int KARATSUBA_THRESHOLD = 32;
+static const unsigned long long BASE = 1ULL << 32;
+static const unsigned DECIMAL_BASE = 1000000000;
+static const int DECIMAL_DIGITS = 9;
+
+/*
+ * Type: BigInt
+ * ------------
+ * The header of a big integer.  Its limbs follow it in the same block,
+ * and capacity records how many fit, which also tells the arena the size
+ * of the block when it comes back.  The magnitude has no leading zero
+ * limbs.
+ */
+
+struct BigInt {
+   atomic<int> refs;
+   int length;
+   int capacity;
+   bool negative;
+};
+
+/* Private state */
+
+static BlockArena arena(MEM_NUMBERS);
+
+/*
+ * Type: Operand
+ * -------------
+ * A view of an integer as a sign and a magnitude.  The magnitude of an
+ * ordinary integer is built in the small array, so an Operand must not
+ * be copied.
+ */
+
+struct Operand {
+   const unsigned *limbs;
+   int length;
+   bool negative;
+   unsigned small[2];
+};
+
+/*
+ * Type: Scratch
+ * -------------
+ * A temporary magnitude, freed when it goes out of scope.
+ */
+
+struct Scratch {
+   Scratch(int limbs);
+   ~Scratch();
+   operator unsigned *();
+   BigInt *big;
+};
+
+/* Private function prototypes */
+
+static BigInt *newBig(int limbs);
+static void freeBig(BigInt *big);
+static unsigned *limbsOf(BigInt *big);
+static const unsigned *limbsOf(const BigInt *big);
+static void getOperand(const Value & value, Operand & op);
+static Value makeResult(BigInt *big, int length, bool negative);
+static int trim(const unsigned *limbs, int length);
+static int compareMagnitudes(const unsigned *a, int na,
+                             const unsigned *b, int nb);
+static int addMagnitudes(unsigned *r, const unsigned *a, int na,
+                         const unsigned *b, int nb);
+static int subtractMagnitudes(unsigned *r, const unsigned *a, int na,
+                              const unsigned *b, int nb);
+static void addInto(unsigned *r, int nr, const unsigned *b, int nb);
+static void multiplyMagnitudes(unsigned *r, const unsigned *a, int na,
+                               const unsigned *b, int nb);
+static void multiplySchoolbook(unsigned *r, const unsigned *a, int na,
+                               const unsigned *b, int nb);
+static int divideMagnitudes(unsigned *q, const unsigned *a, int na,
+                            const unsigned *b, int nb);
+static unsigned divideBySmall(unsigned *q, const unsigned *a, int na,
+                              unsigned divisor);
+
+/*
+ * Implementation notes: combineIntegers
+ * -------------------------------------
+ * Subtraction is addition with the sign of y flipped.  Addition adds the
+ * magnitudes when the signs agree and otherwise subtracts the smaller
+ * magnitude from the larger, taking the sign of the larger.  The result
+ * block is sized for the largest possible result and trimmed after.
+ */
+
+Value combineIntegers(char op, const Value & x, const Value & y) {
+   Operand left, right;
+   getOperand(x, left);
+   getOperand(y, right);
+   Operand *a = &left;
+   Operand *b = &right;
+   if (op == '-') {
+      b->negative = !b->negative;
+      op = '+';
+   }
+   if (op == '+') {
+      if (a->negative == b->negative) {
+         if (a->length < b->length) swap(a, b);
+         BigInt *big = newBig(a->length + 1);
+         int n = addMagnitudes(limbsOf(big), a->limbs, a->length,
+                               b->limbs, b->length);
+         return makeResult(big, n, a->negative);
+      }
+      int cmp = compareMagnitudes(a->limbs, a->length, b->limbs, b->length);
+      if (cmp == 0) return Value(0);
+      if (cmp < 0) swap(a, b);
+      BigInt *big = newBig(a->length);
+      int n = subtractMagnitudes(limbsOf(big), a->limbs, a->length,
+                                 b->limbs, b->length);
+      return makeResult(big, n, a->negative);
+   }
+   bool negative = a->negative != b->negative;
+   if (op == '*') {
+      if (a->length == 0 || b->length == 0) return Value(0);
+      int n = a->length + b->length;
+      BigInt *big = newBig(n);
+      multiplyMagnitudes(limbsOf(big), a->limbs, a->length,
+                         b->limbs, b->length);
+      return makeResult(big, n, negative);
+   }
+   if (compareMagnitudes(a->limbs, a->length, b->limbs, b->length) < 0) {
+      return Value(0);
+   }
+   BigInt *big = newBig(a->length - b->length + 1);
+   int n = divideMagnitudes(limbsOf(big), a->limbs, a->length,
+                            b->limbs, b->length);
+   return makeResult(big, n, negative);
+}
+
+int compareIntegers(const Value & x, const Value & y) {
+   if (x.isInteger() && y.isInteger()) {
+      return (x.getInteger() < y.getInteger()) ? -1
+           : (x.getInteger() > y.getInteger()) ? 1 : 0;
+   }
+   Operand a, b;
+   getOperand(x, a);
+   getOperand(y, b);
+   if (a.negative != b.negative) return a.negative ? -1 : 1;
+   int cmp = compareMagnitudes(a.limbs, a.length, b.limbs, b.length);
+   return a.negative ? -cmp : cmp;
+}
+
+/*
+ * Implementation notes: bigToReal
+ * -------------------------------
+ * The top three limbs hold more than the 53 bits a double keeps, so the
+ * rest are scaled in by the exponent alone.
+ */
+
+double bigToReal(const BigInt *big) {
+   const unsigned *limbs = limbsOf(big);
+   int low = (big->length > 3) ? big->length - 3 : 0;
+   double real = 0;
+   for (int i = big->length - 1; i >= low; i--) {
+      real = real * (double) BASE + limbs[i];
+   }
+   real = ldexp(real, 32 * low);
+   return big->negative ? -real : real;
+}
+
+/*
+ * Implementation notes: bigToString
+ * ---------------------------------
+ * The magnitude is divided by 10^9 repeatedly, which yields nine decimal
+ * digits at a time from the right.
+ */
+
+string bigToString(const BigInt *big) {
+   Scratch copy(big->length);
+   unsigned *limbs = copy;
+   memcpy(limbs, limbsOf(big), big->length * sizeof(unsigned));
+   int n = big->length;
+   Vector<unsigned> groups;
+   while (n > 0) {
+      groups.add(divideBySmall(limbs, limbs, n, DECIMAL_BASE));
+      n = trim(limbs, n);
+   }
+   string str = big->negative ? "-" : "";
+   str += to_string(groups[groups.size() - 1]);
+   for (int i = groups.size() - 2; i >= 0; i--) {
+      string digits = to_string(groups[i]);
+      str += string(DECIMAL_DIGITS - digits.length(), '0') + digits;
+   }
+   return str;
+}
+
+/*
+ * Implementation notes: scanBigInteger
+ * ------------------------------------
+ * The digits are taken nine at a time, each group multiplying the number
+ * so far by a power of ten and adding itself in.  Nine digits hold fewer
+ * than 30 bits, which bounds the number of limbs needed.
+ */
+
+Value scanBigInteger(const char *start, const char *end) {
+   bool negative = *start == '-';
+   if (negative) start++;
+   int digits = end - start;
+   BigInt *big = newBig(digits / DECIMAL_DIGITS + 2);
+   unsigned *limbs = limbsOf(big);
+   int n = 0;
+   int count = digits % DECIMAL_DIGITS;
+   if (count == 0) count = DECIMAL_DIGITS;
+   while (start < end) {
+      unsigned scale = 1;
+      unsigned long long carry = 0;
+      for (int i = 0; i < count; i++) {
+         scale *= 10;
+         carry = carry * 10 + (*start++ - '0');
+      }
+      for (int i = 0; i < n; i++) {
+         carry += (unsigned long long) limbs[i] * scale;
+         limbs[i] = (unsigned) carry;
+         carry >>= 32;
+      }
+      if (carry != 0) limbs[n++] = (unsigned) carry;
+      count = DECIMAL_DIGITS;
+   }
+   return makeResult(big, n, negative);
+}
+
+/*
+ * Implementation notes: retainBig, releaseBig
+ * -------------------------------------------
+ * The release that drops the last reference must see every write made
+ * through the other references, hence the acquire-release ordering.
+ */
+
+void retainBig(BigInt *big) {
+   big->refs.fetch_add(1, memory_order_relaxed);
+}
+
+void releaseBig(BigInt *big) {
+   if (big->refs.fetch_sub(1, memory_order_acq_rel) == 1) freeBig(big);
+}
+
+/* Implementation of Scratch */
+
+Scratch::Scratch(int limbs) {
+   big = newBig(limbs);
+}
+
+Scratch::~Scratch() {
+   freeBig(big);
+}
+
+Scratch::operator unsigned *() {
+   return limbsOf(big);
+}
+
+/*
+ * Implementation notes: newBig, freeBig
+ * -------------------------------------
+ * The arena may hand out a larger block than was asked for, so capacity
+ * is worked out from the size it reports.
+ */
+
+static BigInt *newBig(int limbs) {
+   size_t bytes = sizeof(BigInt) + limbs * sizeof(unsigned);
+   void *block = arena.allocate(bytes);
+   BigInt *big = new (block) BigInt;
+   big->refs.store(1, memory_order_relaxed);
+   big->length = 0;
+   big->capacity = (bytes - sizeof(BigInt)) / sizeof(unsigned);
+   big->negative = false;
+   return big;
+}
+
+static void freeBig(BigInt *big) {
+   size_t bytes = sizeof(BigInt) + big->capacity * sizeof(unsigned);
+   big->~BigInt();
+   arena.release(big, bytes);
+}
+
+static unsigned *limbsOf(BigInt *big) {
+   return (unsigned *) (big + 1);
+}
+
+static const unsigned *limbsOf(const BigInt *big) {
+   return (const unsigned *) (big + 1);
+}
+
+static void getOperand(const Value & value, Operand & op) {
+   if (value.isBig()) {
+      BigInt *big = value.getBig();
+      op.limbs = limbsOf(big);
+      op.length = big->length;
+      op.negative = big->negative;
+      return;
+   }
+   long long integer = value.getInteger();
+   unsigned long long magnitude = integer;
+   if (integer < 0) magnitude = 0 - magnitude;
+   op.small[0] = (unsigned) magnitude;
+   op.small[1] = (unsigned) (magnitude >> 32);
+   op.limbs = op.small;
+   op.length = trim(op.small, 2);
+   op.negative = integer < 0;
+}
+
+/*
+ * Implementation notes: makeResult
+ * --------------------------------
+ * Takes over big, which holds length limbs, and returns it as a Value,
+ * giving the block back if the result fits in 64 bits.  The most
+ * negative long long has a magnitude one beyond LLONG_MAX.
+ */
+
+static Value makeResult(BigInt *big, int length, bool negative) {
+   unsigned *limbs = limbsOf(big);
+   length = trim(limbs, length);
+   if (length <= 2) {
+      unsigned long long magnitude = 0;
+      if (length > 0) magnitude = limbs[0];
+      if (length > 1) magnitude |= (unsigned long long) limbs[1] << 32;
+      unsigned long long limit = (unsigned long long) LLONG_MAX + negative;
+      if (magnitude <= limit) {
+         freeBig(big);
+         if (negative) return Value((long long) (0 - magnitude));
+         return Value((long long) magnitude);
+      }
+   }
+   big->length = length;
+   big->negative = negative;
+   return Value(big);
+}
+
+static int trim(const unsigned *limbs, int length) {
+   while (length > 0 && limbs[length - 1] == 0) {
+      length--;
+   }
+   return length;
+}
+
+static int compareMagnitudes(const unsigned *a, int na,
+                             const unsigned *b, int nb) {
+   if (na != nb) return (na < nb) ? -1 : 1;
+   for (int i = na - 1; i >= 0; i--) {
+      if (a[i] != b[i]) return (a[i] < b[i]) ? -1 : 1;
+   }
+   return 0;
+}
+
+/*
+ * Implementation notes: addMagnitudes, subtractMagnitudes, addInto
+ * ----------------------------------------------------------------
+ * addMagnitudes and subtractMagnitudes need na >= nb, and subtraction
+ * also needs a >= b; both return the length of the result, and r may be
+ * a.  addInto adds b into the nr limbs at r, which must have room for
+ * the sum.
+ */
+
+static int addMagnitudes(unsigned *r, const unsigned *a, int na,
+                         const unsigned *b, int nb) {
+   unsigned long long carry = 0;
+   for (int i = 0; i < na; i++) {
+      carry += a[i];
+      if (i < nb) carry += b[i];
+      r[i] = (unsigned) carry;
+      carry >>= 32;
+   }
+   if (carry == 0) return na;
+   r[na] = (unsigned) carry;
+   return na + 1;
+}
+
+static int subtractMagnitudes(unsigned *r, const unsigned *a, int na,
+                              const unsigned *b, int nb) {
+   unsigned long long borrow = 0;
+   for (int i = 0; i < na; i++) {
+      unsigned long long sub = borrow + ((i < nb) ? b[i] : 0);
+      borrow = (a[i] < sub) ? 1 : 0;
+      r[i] = (unsigned) (a[i] - sub);
+   }
+   return trim(r, na);
+}
+
+static void addInto(unsigned *r, int nr, const unsigned *b, int nb) {
+   unsigned long long carry = 0;
+   for (int i = 0; i < nr && (i < nb || carry != 0); i++) {
+      carry += r[i];
+      if (i < nb) carry += b[i];
+      r[i] = (unsigned) carry;
+      carry >>= 32;
+   }
+}
+
+/*
+ * Implementation notes: multiplyMagnitudes
+ * ----------------------------------------
+ * The product is written to the na + nb limbs at r.  Below the threshold
+ * the schoolbook method is fastest.  Above it, an operand much longer
+ * than the other is cut into slices as long as the shorter one, and
+ * operands of similar length are split at m limbs into a1 B^m + a0 and
+ * b1 B^m + b0, so that with z0 = a0 b0 and z2 = a1 b1 the product is
+ *
+ *    z2 B^2m + ((a0 + a1)(b0 + b1) - z0 - z2) B^m + z0
+ *
+ * which takes three half-size multiplications instead of four.  z0 and
+ * z2 are computed straight into the two halves of r.
+ */
+
+static void multiplyMagnitudes(unsigned *r, const unsigned *a, int na,
+                               const unsigned *b, int nb) {
+   if (na < nb) {
+      swap(a, b);
+      swap(na, nb);
+   }
+   if (nb < KARATSUBA_THRESHOLD) {
+      multiplySchoolbook(r, a, na, b, nb);
+      return;
+   }
+   if (na >= 2 * nb) {
+      memset(r, 0, (na + nb) * sizeof(unsigned));
+      Scratch product(2 * nb);
+      for (int i = 0; i < na; i += nb) {
+         int n = (na - i < nb) ? na - i : nb;
+         multiplyMagnitudes(product, a + i, n, b, nb);
+         addInto(r + i, na + nb - i, product, n + nb);
+      }
+      return;
+   }
+   int m = na / 2;
+   multiplyMagnitudes(r, a, m, b, m);
+   multiplyMagnitudes(r + 2 * m, a + m, na - m, b + m, nb - m);
+   Scratch sumA(na - m + 1);
+   Scratch sumB(nb + 1);
+   int nsa = addMagnitudes(sumA, a + m, na - m, a, m);
+   int nsb = (nb - m >= m) ? addMagnitudes(sumB, b + m, nb - m, b, m)
+                           : addMagnitudes(sumB, b, m, b + m, nb - m);
+   Scratch middle(nsa + nsb);
+   multiplyMagnitudes(middle, sumA, nsa, sumB, nsb);
+   int n = trim(middle, nsa + nsb);
+   n = subtractMagnitudes(middle, middle, n, r, trim(r, 2 * m));
+   n = subtractMagnitudes(middle, middle, n, r + 2 * m,
+                          trim(r + 2 * m, na + nb - 2 * m));
+   addInto(r + m, na + nb - m, middle, n);
+}
+
+static void multiplySchoolbook(unsigned *r, const unsigned *a, int na,
+                               const unsigned *b, int nb) {
+   memset(r, 0, (na + nb) * sizeof(unsigned));
+   for (int i = 0; i < na; i++) {
+      unsigned long long digit = a[i];
+      if (digit == 0) continue;
+      unsigned long long carry = 0;
+      for (int j = 0; j < nb; j++) {
+         carry += digit * b[j] + r[i + j];
+         r[i + j] = (unsigned) carry;
+         carry >>= 32;
+      }
+      r[i + nb] = (unsigned) carry;
+   }
+}
+
+/*
+ * Implementation notes: divideMagnitudes
+ * --------------------------------------
+ * This is algorithm D from Knuth, volume 2, section 4.3.1, in the form
+ * given by Warren in Hacker's Delight.  Both operands are shifted left
+ * until the top bit of the divisor is set, which makes each estimated
+ * quotient limb at most two too large; the estimate is corrected against
+ * the second divisor limb and, rarely, by adding the divisor back.  The
+ * quotient goes to the na - nb + 1 limbs at q and its length is returned.
+ */
+
+static int divideMagnitudes(unsigned *q, const unsigned *a, int na,
+                            const unsigned *b, int nb) {
+   if (nb == 1) {
+      divideBySmall(q, a, na, b[0]);
+      return trim(q, na);
+   }
+   int s = __builtin_clz(b[nb - 1]);
+   Scratch un(na + 1);
+   Scratch vn(nb);
+   for (int i = nb - 1; i > 0; i--) {
+      vn[i] = (b[i] << s) | (s == 0 ? 0 : b[i - 1] >> (32 - s));
+   }
+   vn[0] = b[0] << s;
+   un[na] = (s == 0) ? 0 : a[na - 1] >> (32 - s);
+   for (int i = na - 1; i > 0; i--) {
+      un[i] = (a[i] << s) | (s == 0 ? 0 : a[i - 1] >> (32 - s));
+   }
+   un[0] = a[0] << s;
+   for (int j = na - nb; j >= 0; j--) {
+      unsigned long long top = ((unsigned long long) un[j + nb] << 32)
+                             | un[j + nb - 1];
+      unsigned long long qhat = top / vn[nb - 1];
+      unsigned long long rhat = top % vn[nb - 1];
+      while (qhat >= BASE
+             || qhat * vn[nb - 2] > ((rhat << 32) | un[j + nb - 2])) {
+         qhat--;
+         rhat += vn[nb - 1];
+         if (rhat >= BASE) break;
+      }
+      long long borrow = 0;
+      long long t;
+      for (int i = 0; i < nb; i++) {
+         unsigned long long p = qhat * vn[i];
+         t = un[i + j] - borrow - (long long) (p & 0xFFFFFFFF);
+         un[i + j] = (unsigned) t;
+         borrow = (long long) (p >> 32) - (t >> 32);
+      }
+      t = un[j + nb] - borrow;
+      un[j + nb] = (unsigned) t;
+      q[j] = (unsigned) qhat;
+      if (t < 0) {
+         q[j]--;
+         unsigned long long carry = 0;
+         for (int i = 0; i < nb; i++) {
+            carry += (unsigned long long) un[i + j] + vn[i];
+            un[i + j] = (unsigned) carry;
+            carry >>= 32;
+         }
+         un[j + nb] += (unsigned) carry;
+      }
+   }
+   return trim(q, na - nb + 1);
+}
+
+static unsigned divideBySmall(unsigned *q, const unsigned *a, int na,
+                              unsigned divisor) {
+   unsigned long long remainder = 0;
+   for (int i = na - 1; i >= 0; i--) {
+      unsigned long long current = (remainder << 32) | a[i];
+      q[i] = (unsigned) (current / divisor);
+      remainder = current % divisor;
+   }
+   return (unsigned) remainder;
+}
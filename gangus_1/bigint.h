@@ -0,0 +1,82 @@
+/*
+ * File: bigint.h
+ * --------------
+ * This interface exports the big integers that integer arithmetic moves
+ * to when a result does not fit in 64 bits.  A big integer is a sign and
+ * a magnitude held in 32-bit limbs, least significant first.  It never
+ * changes once made, so the Values that hold it share it and count the
+ * references; copying one never copies its digits.
+ *
+ * The limbs come from an arena that keeps freed blocks for reuse and is
+ * charged to MEM_NUMBERS.  A result that fits in 64 bits is returned as
+ * an ordinary integer, so the functions here are only reached once a
+ * computation has actually outgrown 64 bits.
+ */
+
+#ifndef _bigint_h
+#define _bigint_h
+
+#include <string>
+#include "value.h"
+
+/*
+ * Function: combineIntegers
+ * Usage: Value product = combineIntegers('*', x, y);
+ * --------------------------------------------------
+ * Applies the operator +, -, * or / to two integers, either of which may
+ * be big, and returns the exact result.  Division truncates toward zero
+ * and the divisor must not be zero.  Multiplication is done by the
+ * schoolbook method on short operands and by Karatsuba's method above
+ * KARATSUBA_THRESHOLD limbs, and division by Knuth's algorithm D.
+ */
+
+Value combineIntegers(char op, const Value & x, const Value & y);
+
+/*
+ * Function: compareIntegers
+ * Usage: int sign = compareIntegers(x, y);
+ * ----------------------------------------
+ * Returns a negative number, zero or a positive number as the integer x
+ * is less than, equal to or greater than the integer y.  value.h also
+ * declares this function, since its comparisons call it.
+ */
+
+int compareIntegers(const Value & x, const Value & y);
+
+/*
+ * Functions: bigToReal, bigToString
+ * Usage: double x = bigToReal(big);
+ *        string str = bigToString(big);
+ * --------------------------------------
+ * Convert a big integer to the nearest double, which is infinite beyond
+ * the range of double, or to its decimal digits.  value.h also declares
+ * bigToReal, which Value::toReal calls.
+ */
+
+double bigToReal(const BigInt *big);
+std::string bigToString(const BigInt *big);
+
+/*
+ * Function: scanBigInteger
+ * Usage: Value value = scanBigInteger(start, end);
+ * ------------------------------------------------
+ * Returns the integer written from start up to end, which must be
+ * decimal digits after an optional minus sign.
+ */
+
+Value scanBigInteger(const char *start, const char *end);
+
+/*
+ * Functions: retainBig, releaseBig
+ * Usage: retainBig(big);
+ *        releaseBig(big);
+ * -----------------------
+ * Add a reference to a big integer, or drop one, freeing the integer when
+ * the last reference goes.  Value calls these as it is copied and
+ * destroyed; they may be called from any thread.
+ */
+
+void retainBig(BigInt *big);
+void releaseBig(BigInt *big);
+
+#endif
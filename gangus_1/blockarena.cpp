@@ -0,0 +1,74 @@
+/*
+ * File: blockarena.cpp
+ * --------------------
+ * This file implements the blockarena.h interface.
+ */
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include "accounting.h"
+#include "blockarena.h"
+using namespace std;
+
+/*
+ * Implementation notes: allocate, release
+ * ---------------------------------------
+ * When a chunk is too short for the next block, what is left of it is
+ * split into blocks for the free lists rather than thrown away.  Every
+ * block size is a multiple of MIN_BLOCK, so the remainder always is.
+ * The memory limit is checked before a chunk or a large block is
+ * allocated, and before the old chunk is split, so a string or a number
+ * too large for the limit fails with the arena unchanged.
+ */
+
+void *BlockArena::allocate(size_t & bytes) {
+   int cls = getClass(bytes);
+   if (cls == NUM_CLASSES) {
+      checkMemoryRequest(bytes);
+      MemoryScope scope(category);
+      return operator new(bytes);
+   }
+   bytes = MIN_BLOCK << cls;
+   lock_guard<mutex> guard(lock);
+   void *block = freeLists[cls];
+   if (block != NULL) {
+      freeLists[cls] = *(void **) block;
+      return block;
+   }
+   if ((size_t) (end - next) < bytes) {
+      checkMemoryRequest(CHUNK_SIZE);
+      for (int k = NUM_CLASSES - 1; k >= 0; k--) {
+         while ((size_t) (end - next) >= MIN_BLOCK << k) {
+            *(void **) next = freeLists[k];
+            freeLists[k] = next;
+            next += MIN_BLOCK << k;
+         }
+      }
+      MemoryScope scope(category);
+      next = new char[CHUNK_SIZE];
+      end = next + CHUNK_SIZE;
+   }
+   block = next;
+   next += bytes;
+   return block;
+}
+
+void BlockArena::release(void *block, size_t bytes) {
+   if (bytes > MAX_BLOCK) {
+      operator delete(block);
+      return;
+   }
+   int cls = getClass(bytes);
+   lock_guard<mutex> guard(lock);
+   *(void **) block = freeLists[cls];
+   freeLists[cls] = block;
+}
+
+int BlockArena::getClass(size_t bytes) {
+   int cls = 0;
+   while (cls < NUM_CLASSES && (MIN_BLOCK << cls) < bytes) {
+      cls++;
+   }
+   return cls;
+}
@@ -0,0 +1,83 @@
+/*
+ * File: blockarena.h
+ * ------------------
+ * This interface exports BlockArena, the allocator behind the values
+ * whose size is only known at run time: the digits of big integers and
+ * the characters of long strings.  These values are made and dropped at
+ * the rate the program computes, so the arena keeps every block it has
+ * handed out and gives it to the next request of the same size, and a
+ * loop that keeps making values of similar sizes soon stops allocating.
+ */
+
+#ifndef _blockarena_h
+#define _blockarena_h
+
+#include <cstddef>
+#include <mutex>
+#include "accounting.h"
+
+/*
+ * Class: BlockArena
+ * -----------------
+ * The blocks of an arena come in power-of-two sizes from MIN_BLOCK to
+ * MAX_BLOCK bytes.  A freed block goes on the free list of its size and
+ * is handed out again; new blocks are carved from chunks of CHUNK_SIZE
+ * bytes that the arena keeps and charges to its memory category.  Larger
+ * blocks are allocated and freed on their own.  One lock guards the
+ * arena, since PARALLEL workers and the background compiler make values
+ * too.
+ */
+
+class BlockArena {
+
+public:
+
+/*
+ * Constructor: BlockArena
+ * Usage: static BlockArena arena(MEM_NUMBERS);
+ * --------------------------------------------
+ * Creates an empty arena whose chunks are charged to category.  The
+ * constructor is constexpr so that an arena declared at file scope is
+ * ready before any other file's static initialization can use it.
+ */
+
+   constexpr BlockArena(MemoryCategory category)
+      : category(category), freeLists(), next(NULL), end(NULL) { }
+
+/*
+ * Method: allocate
+ * Usage: void *block = arena.allocate(bytes);
+ * -------------------------------------------
+ * Returns a block of at least bytes bytes and sets bytes to its actual
+ * size, which the caller passes back to release.
+ */
+
+   void *allocate(size_t & bytes);
+
+/*
+ * Method: release
+ * Usage: arena.release(block, bytes);
+ * -----------------------------------
+ * Gives back a block that allocate returned with the size it reported.
+ */
+
+   void release(void *block, size_t bytes);
+
+private:
+
+   static const size_t MIN_BLOCK = 32;
+   static const int NUM_CLASSES = 14;
+   static const size_t MAX_BLOCK = MIN_BLOCK << (NUM_CLASSES - 1);
+   static const size_t CHUNK_SIZE = 1 << 20;
+
+   static int getClass(size_t bytes);
+
+   MemoryCategory category;
+   std::mutex lock;
+   void *freeLists[NUM_CLASSES];
+   char *next;
+   char *end;
+
+};
+
+#endif
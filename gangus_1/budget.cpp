@@ -0,0 +1,120 @@
+/*
+ * File: budget.cpp
+ * ----------------
+ * This file implements the budget.h interface.
+ */
+
+#include <chrono>
+#include <climits>
+#include <string>
+#include "accounting.h"
+#include "budget.h"
+#include "error.h"
+#include "strlib.h"
+using namespace std;
+
+static long long statementBudget = 0;
+static long long runDeadline = 0;
+static BudgetAction budgetAction = BUDGET_ERROR;
+static bool suspendOnWait = false;
+static int returnStackLimit = DEFAULT_RETURN_STACK_LIMIT;
+
+void setStatementBudget(long long statements) {
+   statementBudget = statements;
+}
+
+long long getStatementBudget() {
+   return statementBudget;
+}
+
+void setRunDeadline(long long millis) {
+   runDeadline = millis;
+}
+
+long long getRunDeadline() {
+   return runDeadline;
+}
+
+void setBudgetAction(BudgetAction action) {
+   budgetAction = action;
+}
+
+BudgetAction getBudgetAction() {
+   return budgetAction;
+}
+
+void setSuspendOnWait(bool flag) {
+   suspendOnWait = flag;
+}
+
+bool isSuspendingOnWait() {
+   return suspendOnWait;
+}
+
+void setReturnStackLimit(int depth) {
+   if (depth < 1) error("Illegal GOSUB depth limit");
+   returnStackLimit = depth;
+}
+
+int getReturnStackLimit() {
+   return returnStackLimit;
+}
+
+bool isBudgeted() {
+   return statementBudget > 0 || runDeadline > 0;
+}
+
+/*
+ * Implementation notes: RunMeter
+ * ------------------------------
+ * The limits are copied when the run starts, so a run keeps the limits
+ * it started with.  The deadline is only read when it is set.
+ */
+
+RunMeter::RunMeter() {
+   budget = statementBudget;
+   millis = runDeadline;
+   deadline = chrono::steady_clock::now() + chrono::milliseconds(millis);
+   executed = 0;
+}
+
+long long RunMeter::getExecuted() {
+   return executed.load(memory_order_relaxed);
+}
+
+void RunMeter::setExecuted(long long statements) {
+   executed.store(statements, memory_order_relaxed);
+}
+
+bool RunMeter::isWatching() {
+   return budget > 0 || millis > 0 || memoryLimited;
+}
+
+bool RunMeter::isOverBudget() {
+   return budget > 0 && getExecuted() >= budget;
+}
+
+long long RunMeter::getStatementsLeft() {
+   if (budget <= 0) return LLONG_MAX;
+   return budget - getExecuted();
+}
+
+bool RunMeter::isPastDeadline() {
+   return millis > 0 && chrono::steady_clock::now() >= deadline;
+}
+
+void RunMeter::enforce(long long statements, chrono::steady_clock::time_point start,
+                       int lineNumber) {
+   checkMemoryLimits();
+   string reason;
+   bool yield = budgetAction == BUDGET_YIELD;
+   if (budget > 0 && (yield ? statements >= budget : isOverBudget())) {
+      reason = "Statement budget exhausted";
+   } else if (millis > 0) {
+      chrono::steady_clock::time_point now = chrono::steady_clock::now();
+      if (yield ? now - start >= chrono::milliseconds(millis) : now >= deadline) {
+         reason = "Deadline exceeded";
+      }
+   }
+   if (reason != "") error(reason + " at line " + integerToString(lineNumber));
+}
@@ -0,0 +1,220 @@
+/*
+ * File: budget.h
+ * --------------
+ * This interface exports the limits on a single run of a program: a
+ * budget of statements and a wall-clock deadline.  Program::run checks
+ * them when a program jumps backward, since a program cannot run for
+ * long without doing so, and after the statements that do a lot of work
+ * in one step, MAT and PARALLEL FOR, which charge that work to the run
+ * through a RunMeter.  A run over a limit either stops with an error or
+ * is suspended so that the caller can resume it later.  A run
+ * can also be suspended instead of waiting for input or output, which
+ * lets one thread take turns among many programs.  The last limit is on
+ * how deeply GOSUB calls may nest.
+ */
+
+#ifndef _budget_h
+#define _budget_h
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/*
+ * Type: BudgetAction
+ * ------------------
+ * What happens when a run goes over a limit.
+ */
+
+enum BudgetAction {
+   BUDGET_ERROR,    /* the run stops with an error                     */
+   BUDGET_YIELD     /* the run is suspended and can be continued        */
+};
+
+/*
+ * Type: SuspendReason
+ * -------------------
+ * Why a run returned before the program ended.
+ */
+
+enum SuspendReason {
+   SUSPEND_NONE,    /* the run is not suspended                        */
+   SUSPEND_LIMIT,   /* the run reached its statement budget or deadline */
+   SUSPEND_INPUT,   /* an INPUT statement has no value to read          */
+   SUSPEND_OUTPUT   /* a PRINT statement would wait for the writer      */
+};
+
+/*
+ * Functions: setStatementBudget, getStatementBudget
+ * Usage: setStatementBudget(n);
+ * -----------------------------
+ * Set and return the number of statements one run may execute.  The
+ * count is checked at backward jumps, so a run can go over it by at
+ * most the length of the program.  A MAT statement counts one statement
+ * for each element it computes, or each multiplication of a product,
+ * and a PARALLEL FOR counts the statements of all its iterations.  A
+ * budget of 0 means no limit.
+ */
+
+void setStatementBudget(long long statements);
+long long getStatementBudget();
+
+/*
+ * Functions: setRunDeadline, getRunDeadline
+ * Usage: setRunDeadline(millis);
+ * ------------------------------
+ * Set and return the number of milliseconds one run may take.  The
+ * clock is read only every few hundred backward jumps.  A deadline of
+ * 0 means no limit.
+ */
+
+void setRunDeadline(long long millis);
+long long getRunDeadline();
+
+/*
+ * Functions: setBudgetAction, getBudgetAction
+ * Usage: setBudgetAction(BUDGET_YIELD);
+ * -------------------------------------
+ * Set and return what happens when a limit is reached.  The default is
+ * BUDGET_ERROR.
+ */
+
+void setBudgetAction(BudgetAction action);
+BudgetAction getBudgetAction();
+
+/*
+ * Functions: setSuspendOnWait, isSuspendingOnWait
+ * Usage: setSuspendOnWait(true);
+ * ------------------------------
+ * Set and return whether a run suspends itself before an INPUT or a
+ * PRINT statement that would otherwise wait.  The statement has not
+ * started, so continuing from the suspended line runs it again once
+ * the data or the buffer space is there.  The default is false.
+ */
+
+void setSuspendOnWait(bool flag);
+bool isSuspendingOnWait();
+
+/*
+ * Functions: setReturnStackLimit, getReturnStackLimit
+ * Usage: setReturnStackLimit(depth);
+ * ----------------------------------
+ * Set and return how many GOSUB calls may be active at once.  The
+ * return stack is allocated at this size once, so calls never allocate;
+ * a GOSUB beyond it stops the program with an error.  The default is
+ * DEFAULT_RETURN_STACK_LIMIT.
+ */
+
+const int DEFAULT_RETURN_STACK_LIMIT = 10000;
+
+void setReturnStackLimit(int depth);
+int getReturnStackLimit();
+
+/*
+ * Function: isBudgeted
+ * Usage: if (isBudgeted()) . . .
+ * ------------------------------
+ * Returns true if either limit is set.
+ */
+
+bool isBudgeted();
+
+/*
+ * Class: RunMeter
+ * ---------------
+ * The progress of one run against its limits.  Program::run keeps one
+ * for each run and makes it available to the statements through the
+ * state.  A statement that does a lot of work in one step charges the
+ * work as it goes, from any thread, and calls enforce between pieces of
+ * it.  The piece of work that is going on, a whole MAT or one iteration
+ * of a PARALLEL FOR, cannot be suspended halfway, so under BUDGET_YIELD
+ * it goes on to its end and the run is suspended after it.  A MAT always
+ * ends, so under BUDGET_YIELD it does not call enforce; an iteration
+ * with a loop in it may never end, so enforce stops it once it alone is
+ * over the whole budget or deadline of a run, which no later run could
+ * finish either.
+ */
+
+class RunMeter {
+
+public:
+
+/*
+ * Constructor: RunMeter
+ * Usage: RunMeter meter;
+ * ----------------------
+ * Starts a meter with no statements charged, taking the limits that are
+ * set now and starting the clock of the deadline.
+ */
+
+   RunMeter();
+
+/*
+ * Methods: charge, getExecuted, setExecuted
+ * Usage: meter.charge(statements);
+ * --------------------------------
+ * Add to, return and set the number of statements the run has executed.
+ * Program::run counts its own statements and sets the total here before
+ * a statement that charges more.
+ */
+
+   void charge(long long statements) {
+      executed.fetch_add(statements, std::memory_order_relaxed);
+   }
+
+   long long getExecuted();
+   void setExecuted(long long statements);
+
+/*
+ * Method: isWatching
+ * Usage: if (meter.isWatching()) . . .
+ * ------------------------------------
+ * Returns true if a limit of budget.h or a memory limit is set, which is
+ * when enforce has anything to check.
+ */
+
+   bool isWatching();
+
+/*
+ * Methods: isOverBudget, isPastDeadline
+ * Usage: if (meter.isPastDeadline()) . . .
+ * ----------------------------------------
+ * Return true if the run has used up its statement budget or its time.
+ */
+
+   bool isOverBudget();
+   bool isPastDeadline();
+
+/*
+ * Method: getStatementsLeft
+ * Usage: long long left = meter.getStatementsLeft();
+ * --------------------------------------------------
+ * Returns how many statements the run may still execute, or LLONG_MAX
+ * if it has no budget.
+ */
+
+   long long getStatementsLeft();
+
+/*
+ * Method: enforce
+ * Usage: meter.enforce(statements, start, lineNumber);
+ * ----------------------------------------------------
+ * Checks the memory limits and the limits of the run in the middle of a
+ * step that began at start and has executed statements so far, and
+ * raises the error for lineNumber if the step must stop, as the class
+ * comment describes.
+ */
+
+   void enforce(long long statements, std::chrono::steady_clock::time_point start,
+                int lineNumber);
+
+private:
+
+   long long budget;
+   long long millis;
+   std::chrono::steady_clock::time_point deadline;
+   std::atomic<long long> executed;
+
+};
+
+#endif
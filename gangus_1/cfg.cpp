@@ -0,0 +1,259 @@
+/*
+ * File: cfg.cpp
+ * -------------
+ * This file implements the cfg.h interface.
+ */
+
+#include <string>
+#include "cfg.h"
+#include "error.h"
+#include "parser.h"
+#include "statement.h"
+#include "tokenscanner.h"
+#include "vector.h"
+using namespace std;
+
+/*
+ * Implementation notes: ControlFlowGraph constructor
+ * --------------------------------------------------
+ * Each source line is scanned exactly as the command loop scans it,
+ * skipping the line number.  The edges are filled in once all nodes
+ * exist, since a GOTO can refer to a later line.
+ */
+
+ControlFlowGraph::ControlFlowGraph(const Vector<SourceLine> & source,
+                                   HashConsTable *shared) {
+   this->shared = shared;
+   skippingComments = false;
+   collapsingJumps = false;
+   for (int i = 0; i < source.size(); i++) {
+      TokenScanner scanner;
+      configureScanner(scanner);
+      scanner.setInput(source[i].text);
+      scanner.nextToken();
+      CfgNode node;
+      node.lineNumber = source[i].lineNumber;
+      if (shared == NULL) {
+         node.stmt = parseStatement(scanner);
+      } else {
+         node.stmt = parseStatement(scanner, *shared);
+      }
+      node.type = node.stmt->getType();
+      node.next = EXIT_NODE;
+      node.target = EXIT_NODE;
+      node.reachable = false;
+      nodes.add(node);
+   }
+   sourceNodes = nodes.size();
+   for (int i = 0; i < nodes.size(); i++) {
+      CfgNode & node = nodes[i];
+      int fallthrough = (i + 1 < nodes.size()) ? i + 1 : EXIT_NODE;
+      node.next = fallthrough;
+      node.target = EXIT_NODE;
+      if (node.type == GOTO_STMT) {
+         node.next = EXIT_NODE;
+         node.target = getIndex(((GotoStmt *) node.stmt)->getTarget());
+      } else if (node.type == IF_STMT) {
+         node.target = getIndex(((IfStmt *) node.stmt)->getTarget());
+      } else if (node.type == END_STMT || node.type == RETURN_STMT) {
+         node.next = EXIT_NODE;
+      } else if (node.type == GOSUB_STMT) {
+         node.target = getIndex(((GosubStmt *) node.stmt)->getTarget());
+         calls.add(i);
+      } else if (node.type == ON_GOTO_STMT || node.type == ON_GOSUB_STMT) {
+         for (int target : ((OnStmt *) node.stmt)->getTargets()) {
+            node.table.add(getIndex(target));
+         }
+         if (node.type == ON_GOSUB_STMT) calls.add(i);
+      } else if (node.type == PARALLEL_FOR_STMT) {
+         string variable = ((ParallelForStmt *) node.stmt)->getVariable()->getName();
+         for (int j = i + 1; j < nodes.size(); j++) {
+            if (nodes[j].type == NEXT_STMT
+                && ((NextStmt *) nodes[j].stmt)->getName() == variable) {
+               loopEnds.put(i, j);
+               node.next = (j + 1 < nodes.size()) ? j + 1 : EXIT_NODE;
+               break;
+            }
+         }
+      }
+   }
+}
+
+ControlFlowGraph::~ControlFlowGraph() {
+   for (int i = 0; i < nodes.size(); i++) {
+      if (shared != NULL && i < sourceNodes) {
+         shared->release(nodes[i].stmt);
+      } else {
+         delete nodes[i].stmt;
+      }
+   }
+}
+
+int ControlFlowGraph::size() {
+   return nodes.size();
+}
+
+CfgNode & ControlFlowGraph::getNode(int index) {
+   return nodes[index];
+}
+
+/*
+ * Implementation notes: getIndex
+ * ------------------------------
+ * The nodes are sorted by line number, so a binary search finds them.
+ */
+
+int ControlFlowGraph::getIndex(int lineNumber) {
+   int lh = 0;
+   int rh = sourceNodes - 1;
+   while (lh <= rh) {
+      int mid = (lh + rh) / 2;
+      if (nodes[mid].lineNumber == lineNumber) return mid;
+      if (nodes[mid].lineNumber < lineNumber) {
+         lh = mid + 1;
+      } else {
+         rh = mid - 1;
+      }
+   }
+   return MISSING_NODE;
+}
+
+int ControlFlowGraph::addNode(const CfgNode & node) {
+   nodes.add(node);
+   return nodes.size() - 1;
+}
+
+bool ControlFlowGraph::isSourceNode(int index) {
+   return index < sourceNodes;
+}
+
+int ControlFlowGraph::getLoopEnd(int index) {
+   return loopEnds.containsKey(index) ? loopEnds.get(index) : MISSING_NODE;
+}
+
+/*
+ * Implementation notes: getSuccessors
+ * -----------------------------------
+ * The return lines are read from the GOSUB nodes each time, since the
+ * passes rewrite their next fields.  A repeated successor only makes
+ * the analyses do some work twice, so only adjacent repeats are dropped,
+ * which keeps a long ON table linear.
+ */
+
+Vector<int> ControlFlowGraph::getSuccessors(int index) {
+   Vector<int> result;
+   CfgNode & node = nodes[index];
+   if (node.type == RETURN_STMT) {
+      for (int call : calls) {
+         int next = nodes[call].next;
+         if (next >= 0 && (result.isEmpty() || result[result.size() - 1] != next)) {
+            result.add(next);
+         }
+      }
+      return result;
+   }
+   if (node.type == GOSUB_STMT) {
+      if (node.target >= 0) result.add(node.target);
+      return result;
+   }
+   if (node.next >= 0) result.add(node.next);
+   if (node.target >= 0 && node.target != node.next) result.add(node.target);
+   for (int target : node.table) {
+      if (target >= 0 && (result.isEmpty() || result[result.size() - 1] != target)) {
+         result.add(target);
+      }
+   }
+   return result;
+}
+
+Vector<Vector<int> > ControlFlowGraph::getPredecessors() {
+   Vector<Vector<int> > preds(nodes.size());
+   for (int i = 0; i < nodes.size(); i++) {
+      for (int succ : getSuccessors(i)) {
+         preds[succ].add(i);
+      }
+   }
+   return preds;
+}
+
+int ControlFlowGraph::resolve(int index) {
+   return forward(index);
+}
+
+/*
+ * Implementation notes: skipComments, collapseJumps
+ * -------------------------------------------------
+ * Both passes turn on a rule in forward and then rewrite every edge to
+ * point at the node that forward finds.
+ */
+
+void ControlFlowGraph::skipComments() {
+   skippingComments = true;
+   forwardEdges();
+}
+
+void ControlFlowGraph::collapseJumps() {
+   collapsingJumps = true;
+   forwardEdges();
+}
+
+void ControlFlowGraph::forwardEdges() {
+   for (int i = 0; i < nodes.size(); i++) {
+      nodes[i].next = forward(nodes[i].next);
+      nodes[i].target = forward(nodes[i].target);
+      for (int & target : nodes[i].table) {
+         target = forward(target);
+      }
+   }
+}
+
+/*
+ * Implementation notes: markReachable
+ * -----------------------------------
+ * This method is an iterative depth-first search using an explicit
+ * stack, so that very long programs cannot overflow the C++ stack.
+ */
+
+void ControlFlowGraph::markReachable(int entry) {
+   for (int i = 0; i < nodes.size(); i++) {
+      nodes[i].reachable = false;
+   }
+   if (entry < 0) return;
+   Vector<int> stack;
+   stack.add(entry);
+   nodes[entry].reachable = true;
+   while (!stack.isEmpty()) {
+      int index = stack[stack.size() - 1];
+      stack.remove(stack.size() - 1);
+      for (int succ : getSuccessors(index)) {
+         if (!nodes[succ].reachable) {
+            nodes[succ].reachable = true;
+            stack.add(succ);
+         }
+      }
+   }
+}
+
+/*
+ * Implementation notes: forward
+ * -----------------------------
+ * A chain that is longer than the graph must revisit a node, which means
+ * the chain is a cycle of comments and GOTOs that never does anything.
+ * Such a chain is left as it is so that the program still loops.
+ */
+
+int ControlFlowGraph::forward(int index) {
+   int start = index;
+   for (int steps = 0; steps <= nodes.size(); steps++) {
+      if (index < 0) return index;
+      CfgNode & node = nodes[index];
+      if (skippingComments && node.type == REM_STMT) {
+         index = node.next;
+      } else if (collapsingJumps && node.type == GOTO_STMT) {
+         index = node.target;
+      } else {
+         return index;
+      }
+   }
+   return start;
+}
@@ -0,0 +1,234 @@
+/*
+ * File: cfg.h
+ * -----------
+ * This interface exports the ControlFlowGraph class, which gives the
+ * compiler a global view of a BASIC program.  Each line of the program
+ * is a node, and each node has at most two successors: the line it
+ * falls through to and the line it jumps to.  The exceptions are ON,
+ * which jumps through a table of lines, and RETURN, which can go back
+ * to the line after any GOSUB.
+ */
+
+#ifndef _cfg_h
+#define _cfg_h
+
+#include <string>
+#include "hashcons.h"
+#include "hashmap.h"
+#include "statement.h"
+#include "vector.h"
+
+/*
+ * Type: SourceLine
+ * ----------------
+ * One numbered line of program text.  A vector of these is a snapshot of
+ * a program that a compiler can work from on another thread while the
+ * program itself is edited.
+ */
+
+struct SourceLine {
+   int lineNumber;
+   std::string text;
+};
+
+/*
+ * Constants: EXIT_NODE, MISSING_NODE
+ * ----------------------------------
+ * These special successor values mean that control leaves the program
+ * and that control jumps to a line that does not exist.
+ */
+
+const int EXIT_NODE = -1;
+const int MISSING_NODE = -2;
+
+/*
+ * Type: CfgNode
+ * -------------
+ * One line of the program.  The next field is the successor when the
+ * statement falls through and the target field is the successor when a
+ * GOTO or IF jumps.  END has neither and GOTO never falls through, so
+ * the unused field of those nodes is EXIT_NODE.  A GOSUB jumps to its
+ * target, and its next field is the line its subroutine returns to;
+ * RETURN has neither field, since where it goes depends on the call.
+ * ON keeps its lines in the table field, in order, and falls through
+ * to next when its value is outside the table; the ON GOSUB form also
+ * returns to next.  A PARALLEL FOR falls through to the line after its
+ * NEXT, which leaves its body out of the paths of the program; the
+ * body is run by the loop, as described in parallel.h.
+ */
+
+struct CfgNode {
+   int lineNumber;
+   Statement *stmt;
+   StatementType type;
+   int next;
+   int target;
+   Vector<int> table;
+   bool reachable;
+};
+
+/*
+ * Class: ControlFlowGraph
+ * -----------------------
+ * The graph is built from the source lines of a program, which are
+ * parsed again so that the graph owns statements that the compiler is
+ * free to rewrite.  A graph that will not be rewritten can instead take
+ * its statements from a HashConsTable.  The nodes are in line-number order.  The passes
+ * rewrite the edges in place; the nodes themselves are never removed,
+ * so a node index stays valid for the life of the graph.
+ */
+
+class ControlFlowGraph {
+
+public:
+
+/*
+ * Constructor: ControlFlowGraph
+ * Usage: ControlFlowGraph graph(program.getSource());
+ *        ControlFlowGraph graph(program.getSource(), &table);
+ * -------------------------------------------------------
+ * Builds the graph for the source lines, which must be in line-number
+ * order, with fallthrough, GOTO, IF and END edges.  If shared is not
+ * NULL, the statements are interned in it and must not be changed.
+ */
+
+   ControlFlowGraph(const Vector<SourceLine> & source,
+                    HashConsTable *shared = NULL);
+
+/*
+ * Destructor: ~ControlFlowGraph
+ * Usage: usually implicit
+ * -----------------------
+ * Frees the statements owned by the graph and releases those it shares.
+ */
+
+   ~ControlFlowGraph();
+
+/*
+ * Methods: size, getNode, getIndex
+ * Usage: for (int i = 0; i < graph.size(); i++) . . .
+ *        CfgNode & node = graph.getNode(i);
+ *        int index = graph.getIndex(lineNumber);
+ * -----------------------------------------------
+ * These methods give access to the nodes.  getIndex returns the node
+ * for a line number, or MISSING_NODE if the program has no such line.
+ */
+
+   int size();
+   CfgNode & getNode(int index);
+   int getIndex(int lineNumber);
+
+/*
+ * Method: addNode
+ * Usage: int index = graph.addNode(node);
+ * ---------------------------------------
+ * Adds a node that has no source line of its own, such as the loop
+ * entry nodes that the optimizer inserts, and returns its index.  Added
+ * nodes come after the source nodes, getIndex never returns them, and
+ * the graph frees their statements like any other.
+ */
+
+   int addNode(const CfgNode & node);
+
+/*
+ * Method: isSourceNode
+ * Usage: if (graph.isSourceNode(index)) . . .
+ * -------------------------------------------
+ * Returns true if the node was built from a source line rather than
+ * added with addNode.
+ */
+
+   bool isSourceNode(int index);
+
+/*
+ * Method: getLoopEnd
+ * Usage: int end = graph.getLoopEnd(index);
+ * -----------------------------------------
+ * Returns the NEXT node that ends the PARALLEL FOR at index, which is
+ * the first NEXT after it with the same variable, or MISSING_NODE if
+ * there is none.  The body is the nodes strictly between the two.
+ */
+
+   int getLoopEnd(int index);
+
+/*
+ * Method: getSuccessors
+ * Usage: Vector<int> succ = graph.getSuccessors(index);
+ * -----------------------------------------------------
+ * Returns the successors of a node that are nodes of the graph, which
+ * leaves out EXIT_NODE and MISSING_NODE.  The successors of a GOSUB are
+ * its subroutine alone, and those of a RETURN are the return lines of
+ * every GOSUB and ON GOSUB, which covers every path the program can
+ * take.
+ */
+
+   Vector<int> getSuccessors(int index);
+
+/*
+ * Method: getPredecessors
+ * Usage: Vector<Vector<int> > preds = graph.getPredecessors();
+ * ------------------------------------------------------------
+ * Returns the predecessor lists of all nodes, computed from the current
+ * edges.
+ */
+
+   Vector<Vector<int> > getPredecessors();
+
+/*
+ * Method: resolve
+ * Usage: int index = graph.resolve(graph.getIndex(lineNumber));
+ * -------------------------------------------------------------
+ * Returns the node that actually executes when control reaches index,
+ * following the edges that skipComments and collapseJumps have made
+ * redundant.  Before those passes run, resolve returns index itself.
+ */
+
+   int resolve(int index);
+
+/*
+ * Method: skipComments
+ * Usage: graph.skipComments();
+ * ----------------------------
+ * Redirects every edge that leads to a REM line to the line after it,
+ * which takes comments off the execution path.
+ */
+
+   void skipComments();
+
+/*
+ * Method: collapseJumps
+ * Usage: graph.collapseJumps();
+ * -----------------------------
+ * Redirects every edge that leads to a GOTO to that GOTO's target, so a
+ * chain of GOTOs costs a single jump.  A cycle made only of GOTOs is an
+ * infinite loop and is left intact.
+ */
+
+   void collapseJumps();
+
+/*
+ * Method: markReachable
+ * Usage: graph.markReachable(entry);
+ * ----------------------------------
+ * Sets the reachable flag of exactly the nodes that can execute when
+ * the program starts at the entry node.
+ */
+
+   void markReachable(int entry);
+
+private:
+
+   Vector<CfgNode> nodes;
+   Vector<int> calls;
+   HashMap<int,int> loopEnds;
+   int sourceNodes;
+   HashConsTable *shared;
+   bool skippingComments;
+   bool collapsingJumps;
+
+   int forward(int index);
+   void forwardEdges();
+
+};
+
+#endif
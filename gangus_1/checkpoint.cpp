@@ -0,0 +1,361 @@
+/*
+ * File: checkpoint.cpp
+ * --------------------
+ * This file implements the checkpoint.h interface.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "budget.h"
+#include "checkpoint.h"
+#include "error.h"
+#include "evalstate.h"
+#include "exp.h"
+#include "vector.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+/* Constants */
+
+static const char MAGIC[4] = { 'B', 'S', 'N', 'P' };
+static const int VERSION = 6;
+static const long TIME_QUANTUM = 4096;
+static const long NEVER = 1L << 30;
+
+volatile sig_atomic_t checkpointRequested = 0;
+
+/* Private function prototypes */
+
+static long long currentTimeMillis();
+static void signalHandler(int sig);
+
+/*
+ * Implementation notes: Checkpoint policy
+ * ---------------------------------------
+ * The countdown field counts statements down to the next call to poll.
+ * When only a statement trigger is set, poll runs exactly when the
+ * snapshot is due.  When a time trigger is set, poll also runs every
+ * TIME_QUANTUM statements to look at the clock, which keeps clock reads
+ * out of the per-statement path.
+ */
+
+Checkpoint::Checkpoint() {
+   statements = 0;
+   millis = 0;
+   countdown = NEVER;
+   quantum = NEVER;
+   pending = 0;
+   lastWrite = 0;
+   writer = -1;
+}
+
+Checkpoint::~Checkpoint() {
+   reap(true);
+}
+
+void Checkpoint::enable(string filename, int statements, int millis) {
+   if (filename == "") error("Checkpoint file required");
+   if (statements < 0 || millis < 0) error("Illegal checkpoint interval");
+   this->filename = filename;
+   this->statements = statements;
+   this->millis = millis;
+   pending = 0;
+   lastWrite = currentTimeMillis();
+   rearm();
+#ifdef SIGUSR1
+   signal(SIGUSR1, signalHandler);
+#endif
+}
+
+void Checkpoint::disable() {
+   filename = "";
+   statements = 0;
+   millis = 0;
+   rearm();
+}
+
+bool Checkpoint::isEnabled() {
+   return filename != "";
+}
+
+/*
+ * Implementation notes: poll
+ * --------------------------
+ * This method runs only when the countdown expires or a signal arrives.
+ * If the previous snapshot is still being written, the request is kept
+ * and retried a quantum later rather than stalling the program.
+ */
+
+bool Checkpoint::poll() {
+   pending += quantum - countdown;
+   if (filename == "") {
+      checkpointRequested = 0;
+      rearm();
+      return false;
+   }
+   bool due = checkpointRequested
+           || (statements > 0 && pending >= statements)
+           || (millis > 0 && currentTimeMillis() - lastWrite >= millis);
+   reap(false);
+   if (due && writer != -1) {
+      quantum = countdown = TIME_QUANTUM;
+      return false;
+   }
+   if (!due) rearm();
+   return due;
+}
+
+void Checkpoint::write(EvalState & state, unsigned long long fingerprint) {
+   checkpointRequested = 0;
+   pending = 0;
+   lastWrite = currentTimeMillis();
+   rearm();
+#ifndef _WIN32
+   reap(true);
+   int pid = fork();
+   if (pid == 0) {
+      try {
+         saveCheckpoint(filename, state, fingerprint);
+      } catch (...) {
+         _exit(1);
+      }
+      _exit(0);
+   }
+   if (pid > 0) {
+      writer = pid;
+      return;
+   }
+#endif
+   saveCheckpoint(filename, state, fingerprint);
+}
+
+void Checkpoint::rearm() {
+   quantum = NEVER;
+   if (statements > 0) quantum = statements - pending;
+   if (millis > 0 && quantum > TIME_QUANTUM) quantum = TIME_QUANTUM;
+   if (quantum < 1) quantum = 1;
+   countdown = quantum;
+}
+
+void Checkpoint::reap(bool wait) {
+#ifndef _WIN32
+   if (writer == -1) return;
+   if (waitpid(writer, NULL, wait ? 0 : WNOHANG) != 0) writer = -1;
+#endif
+}
+
+/*
+ * Implementation notes: saveCheckpoint, loadCheckpoint
+ * ----------------------------------------------------
+ * The snapshot is a flat sequence of fixed-size fields, which keeps the
+ * file small and lets loadCheckpoint validate it field by field.  The
+ * active calls are saved by line number, and the run that continues
+ * from the snapshot finds them in its own compiled code.  A big integer
+ * is saved as its digits and a string as its characters, each after its
+ * length.  A value whose type does not go with its name, such as a
+ * number in a string variable, is rejected, since the compiled code
+ * relies on names to tell strings from numbers.  Each array is saved as
+ * its bounds, as DIM gives them, and its elements in order.
+ */
+
+void saveCheckpoint(string filename, EvalState & state,
+                    unsigned long long fingerprint) {
+   string temp = filename + ".tmp";
+   ofstream out(temp.c_str(), ios::binary | ios::trunc);
+   if (out.fail()) error("Cannot open checkpoint file " + filename);
+   Vector<string> names = state.getVariables();
+   int version = VERSION;
+   int line = state.getCurrentLineNumber();
+   int count = names.size();
+   out.write(MAGIC, sizeof MAGIC);
+   out.write((char *) &version, sizeof version);
+   out.write((char *) &fingerprint, sizeof fingerprint);
+   out.write((char *) &line, sizeof line);
+   out.write((char *) &count, sizeof count);
+   for (int i = 0; i < count; i++) {
+      unsigned short length = names[i].length();
+      Value value = state.getValue(names[i]);
+      unsigned char type = value.getType();
+      long long integer = value.getInteger();
+      double real = value.getReal();
+      out.write((char *) &length, sizeof length);
+      out.write(names[i].data(), length);
+      out.write((char *) &type, sizeof type);
+      if (value.isInteger()) {
+         out.write((char *) &integer, sizeof integer);
+      } else if (value.isReal()) {
+         out.write((char *) &real, sizeof real);
+      } else {
+         string digits = value.toString();
+         int size = digits.length();
+         out.write((char *) &size, sizeof size);
+         out.write(digits.data(), size);
+      }
+   }
+   int depth = state.getReturnDepth();
+   out.write((char *) &depth, sizeof depth);
+   for (int i = 0; i < depth; i++) {
+      int callLine = state.getReturn(i).callLine;
+      out.write((char *) &callLine, sizeof callLine);
+   }
+   Vector<string> arrays = state.getArrays();
+   int arrayCount = arrays.size();
+   out.write((char *) &arrayCount, sizeof arrayCount);
+   for (int i = 0; i < arrayCount; i++) {
+      ArrayStorage & array = state.getArray(state.getArraySlot(arrays[i]));
+      unsigned short length = arrays[i].length();
+      int first = array.extent[SUBSCRIPT_VECTOR] - 1;
+      int second = -1;
+      if (first == -1) {
+         first = array.extent[SUBSCRIPT_ROW] - 1;
+         second = array.extent[SUBSCRIPT_COLUMN] - 1;
+      }
+      out.write((char *) &length, sizeof length);
+      out.write(arrays[i].data(), length);
+      out.write((char *) &first, sizeof first);
+      out.write((char *) &second, sizeof second);
+      out.write((char *) array.data, array.size * sizeof(int));
+   }
+   out.close();
+   if (out.fail() || rename(temp.c_str(), filename.c_str()) != 0) {
+      remove(temp.c_str());
+      error("Cannot write checkpoint file " + filename);
+   }
+}
+
+void loadCheckpoint(string filename, EvalState & state,
+                    unsigned long long fingerprint) {
+   ifstream in(filename.c_str(), ios::binary);
+   if (in.fail()) error("Cannot open checkpoint file " + filename);
+   char magic[sizeof MAGIC];
+   int version, line, count;
+   unsigned long long saved;
+   in.read(magic, sizeof magic);
+   in.read((char *) &version, sizeof version);
+   in.read((char *) &saved, sizeof saved);
+   in.read((char *) &line, sizeof line);
+   in.read((char *) &count, sizeof count);
+   if (in.fail() || memcmp(magic, MAGIC, sizeof MAGIC) != 0
+                 || version != VERSION || count < 0) {
+      error(filename + " is not a checkpoint file");
+   }
+   if (saved != fingerprint) {
+      error("Checkpoint was taken from a different program");
+   }
+   EvalState restored;
+   for (int i = 0; i < count; i++) {
+      unsigned short length;
+      unsigned char type;
+      long long integer;
+      double real;
+      int size = 0;
+      string digits;
+      in.read((char *) &length, sizeof length);
+      string name(length, ' ');
+      in.read(&name[0], length);
+      in.read((char *) &type, sizeof type);
+      if (type == INTEGER_VALUE) {
+         in.read((char *) &integer, sizeof integer);
+      } else if (type == REAL_VALUE) {
+         in.read((char *) &real, sizeof real);
+      } else {
+         in.read((char *) &size, sizeof size);
+         if (!in.fail() && size > 0) {
+            digits = string(size, ' ');
+            in.read(&digits[0], size);
+         }
+      }
+      if (in.fail() || type > STRING_VALUE || size < 0
+                    || (type == BIG_VALUE && size == 0)) {
+         error("Checkpoint file " + filename + " is truncated");
+      }
+      if (isStringName(name) != (type == STRING_VALUE)) {
+         error("Checkpoint file " + filename + " does not match the program");
+      }
+      if (type == INTEGER_VALUE) {
+         restored.setValue(name, Value(integer));
+      } else if (type == REAL_VALUE) {
+         restored.setValue(name, Value(real));
+      } else if (type == STRING_VALUE) {
+         restored.setValue(name, Value(digits.data(), size));
+      } else {
+         restored.setValue(name, stringToValue(digits));
+      }
+   }
+   int depth;
+   in.read((char *) &depth, sizeof depth);
+   if (in.fail() || depth < 0) error("Checkpoint file " + filename + " is truncated");
+   Vector<int> calls;
+   for (int i = 0; i < depth; i++) {
+      int callLine;
+      in.read((char *) &callLine, sizeof callLine);
+      if (in.fail()) error("Checkpoint file " + filename + " is truncated");
+      calls.add(callLine);
+   }
+   if (depth > getReturnStackLimit()) {
+      error("Checkpoint has GOSUB calls nested deeper than the limit");
+   }
+   int arrayCount;
+   in.read((char *) &arrayCount, sizeof arrayCount);
+   if (in.fail() || arrayCount < 0) error("Checkpoint file " + filename + " is truncated");
+   for (int i = 0; i < arrayCount; i++) {
+      unsigned short length;
+      int first, second;
+      in.read((char *) &length, sizeof length);
+      string name(length, ' ');
+      in.read(&name[0], length);
+      in.read((char *) &first, sizeof first);
+      in.read((char *) &second, sizeof second);
+      if (in.fail()) error("Checkpoint file " + filename + " is truncated");
+      int slot = restored.getArraySlot(name);
+      restored.dimArray(slot, first, second);
+      ArrayStorage & array = restored.getArray(slot);
+      in.read((char *) array.data, array.size * sizeof(int));
+      if (in.fail()) error("Checkpoint file " + filename + " is truncated");
+   }
+   state.clear();
+   for (string name : restored.getVariables()) {
+      state.setValue(name, restored.getValue(name));
+   }
+   for (string name : restored.getArrays()) {
+      ArrayStorage & saved = restored.getArray(restored.getArraySlot(name));
+      int slot = state.getArraySlot(name);
+      if (saved.extent[SUBSCRIPT_VECTOR] > 0) {
+         state.dimArray(slot, saved.extent[SUBSCRIPT_VECTOR] - 1, -1);
+      } else {
+         state.dimArray(slot, saved.extent[SUBSCRIPT_ROW] - 1,
+                        saved.extent[SUBSCRIPT_COLUMN] - 1);
+      }
+      ArrayStorage & array = state.getArray(slot);
+      for (int i = 0; i < array.size; i++) {
+         array.data[i] = saved.data[i];
+      }
+   }
+   state.reserveReturns(getReturnStackLimit());
+   for (int callLine : calls) {
+      state.pushReturn(-1, callLine);
+   }
+   state.setCurrentLineNumber(line);
+}
+
+/*
+ * Implementation notes: currentTimeMillis, signalHandler
+ * ------------------------------------------------------
+ * The signal handler only sets a flag; the snapshot itself is taken by
+ * the run loop at the next statement boundary.
+ */
+
+static long long currentTimeMillis() {
+   return chrono::duration_cast<chrono::milliseconds>(
+             chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void signalHandler(int) {
+   checkpointRequested = 1;
+}
@@ -0,0 +1,175 @@
+/*
+ * File: checkpoint.h
+ * ------------------
+ * This interface exports the Checkpoint class, which saves the complete
+ * interpreter state of a running BASIC program to a compact binary file
+ * and restores it later so that the program can be resumed at exactly
+ * the statement where the snapshot was taken.
+ */
+
+#ifndef _checkpoint_h
+#define _checkpoint_h
+
+#include <csignal>
+#include <string>
+#include "evalstate.h"
+
+/*
+ * Variable: checkpointRequested
+ * -----------------------------
+ * Set by the SIGUSR1 handler to request a snapshot at the next
+ * statement boundary.
+ */
+
+extern volatile sig_atomic_t checkpointRequested;
+
+/*
+ * Class: Checkpoint
+ * -----------------
+ * A Checkpoint object holds the checkpoint policy for a program: the
+ * name of the snapshot file and how often a snapshot should be taken.
+ * Snapshots can be triggered by a statement count, by elapsed wall time
+ * or by the SIGUSR1 signal.  The run loop calls tick at every statement
+ * boundary, which is cheap enough to leave in the hot path.
+ *
+ * Snapshot files have the following layout, all in host byte order:
+ *
+ *    "BSNP"            4-byte magic number
+ *    version           32-bit format version
+ *    fingerprint       64-bit hash of the program source
+ *    currentLine       32-bit line number of the next statement
+ *    count             32-bit number of variables
+ *    count entries     16-bit name length, name bytes, 8-bit type
+ *                      (0 for an integer, 1 for a real, 2 for a big
+ *                      integer, 3 for a string), then the 64-bit
+ *                      integer, the double, or a 32-bit length
+ *                      followed by the decimal digits or the string's
+ *                      bytes
+ *    depth             32-bit number of active GOSUB calls
+ *    depth entries     32-bit line number of each call, oldest first
+ *    arrays            32-bit number of dimensioned arrays
+ *    arrays entries    16-bit name length, name bytes, 32-bit bounds
+ *                      as DIM gives them (the second -1 for one
+ *                      subscript), then the 32-bit elements in
+ *                      row-major order
+ */
+
+class Checkpoint {
+
+public:
+
+/*
+ * Constructor: Checkpoint
+ * Usage: Checkpoint checkpoint;
+ * -----------------------------
+ * Creates a checkpoint policy that is initially disabled.
+ */
+
+   Checkpoint();
+
+/*
+ * Destructor: ~Checkpoint
+ * Usage: usually implicit
+ * -----------------------
+ * Waits for any snapshot that is still being written.
+ */
+
+   ~Checkpoint();
+
+/*
+ * Method: enable
+ * Usage: checkpoint.enable(filename, statements, millis);
+ * -------------------------------------------------------
+ * Enables periodic snapshots to the named file.  A snapshot is taken
+ * every statements executed statements and every millis milliseconds
+ * of wall time; a value of 0 disables the corresponding trigger.
+ * Sending SIGUSR1 to the process requests a snapshot at the next
+ * statement boundary as long as a file has been set.
+ */
+
+   void enable(std::string filename, int statements, int millis);
+
+/*
+ * Method: disable
+ * Usage: checkpoint.disable();
+ * ----------------------------
+ * Turns off all snapshot triggers.
+ */
+
+   void disable();
+
+/*
+ * Method: isEnabled
+ * Usage: if (checkpoint.isEnabled()) . . .
+ * ----------------------------------------
+ * Returns true if a snapshot file has been set.
+ */
+
+   bool isEnabled();
+
+/*
+ * Method: tick
+ * Usage: if (checkpoint.tick()) checkpoint.write(state, fingerprint);
+ * -------------------------------------------------------------------
+ * Counts one executed statement and returns true if a snapshot is due.
+ * The common case is a single decrement and compare.
+ */
+
+   bool tick() {
+      if (--countdown > 0 && !checkpointRequested) return false;
+      return poll();
+   }
+
+/*
+ * Method: write
+ * Usage: checkpoint.write(state, fingerprint);
+ * --------------------------------------------
+ * Writes a snapshot of state to the checkpoint file.  Where the
+ * platform supports it, the snapshot is written by a forked child
+ * process that sees a copy-on-write image of the interpreter, so the
+ * running program only pays for the fork.  The file is written under
+ * a temporary name and renamed, so a crash never leaves a torn file.
+ */
+
+   void write(EvalState & state, unsigned long long fingerprint);
+
+private:
+
+   std::string filename;
+   int statements;
+   int millis;
+   long countdown;
+   long quantum;
+   long pending;
+   long long lastWrite;
+   int writer;
+
+   bool poll();
+   void rearm();
+   void reap(bool wait);
+
+};
+
+/*
+ * Function: saveCheckpoint
+ * Usage: saveCheckpoint(filename, state, fingerprint);
+ * ----------------------------------------------------
+ * Synchronously writes a snapshot of state to the named file.
+ */
+
+void saveCheckpoint(std::string filename, EvalState & state,
+                    unsigned long long fingerprint);
+
+/*
+ * Function: loadCheckpoint
+ * Usage: loadCheckpoint(filename, state, fingerprint);
+ * ----------------------------------------------------
+ * Replaces the contents of state with the snapshot in the named file.
+ * This function raises an error if the file is not a valid snapshot or
+ * was taken from a program whose fingerprint differs from the one given.
+ */
+
+void loadCheckpoint(std::string filename, EvalState & state,
+                    unsigned long long fingerprint);
+
+#endif
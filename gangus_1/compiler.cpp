@@ -0,0 +1,205 @@
+/*
+ * File: compiler.cpp
+ * ------------------
+ * This file implements the compiler.h interface.
+ */
+
+#include <string>
+#include "analysis.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "error.h"
+#include "parallel.h"
+#include "vector.h"
+using namespace std;
+
+/*
+ * Implementation notes: CompiledProgram constructor
+ * -------------------------------------------------
+ * After the passes, the reachable nodes are numbered in line order and
+ * every edge is translated from a node index to a compiled index, and
+ * the ON tables of all lines are laid out in one array.  The entries
+ * map records, for every source line, where execution starting at that
+ * line begins, which is what RUN and RESUME need.
+ */
+
+CompiledProgram::CompiledProgram(const Vector<SourceLine> & source,
+                                 bool optimize, HashConsTable *shared)
+      : graph(source, shared) {
+   if (optimize && shared != NULL) error("Optimized code cannot be shared");
+   optimized = optimize;
+   linked = NULL;
+   checkParallelLoops(graph);
+   graph.skipComments();
+   graph.collapseJumps();
+   int start = (graph.size() > 0) ? graph.resolve(0) : EXIT_NODE;
+   graph.markReachable(start);
+   buildParallelLoops(optimize);
+   int entry = start;
+   if (optimize) {
+      if (isOptimizing()) foldConstants(graph);
+      keptChecks = eliminateUndefinedChecks(graph, start);
+      integerVariables = inferIntegerVariables(graph);
+   }
+   if (optimize && isOptimizing()) {
+      entry = hoistLoopInvariants(graph, start, cache, cachedExpressions);
+      shareCommonSubexpressions(graph, entry, cache, cachedExpressions);
+      flattenExpressions(graph, flats, slots, elements);
+      for (int header : loops) {
+         flattenExpressions(graph, loops.get(header)->getNodes(), flats, slots,
+                            elements);
+      }
+   }
+   Vector<int> index(graph.size(), MISSING_NODE);
+   count = 0;
+   for (int i = 0; i < graph.size(); i++) {
+      if (!graph.isSourceNode(i)) break;
+      for (int j = i + 1; j < graph.size(); j++) {
+         if (!graph.isSourceNode(j) && graph.getNode(j).next == i) {
+            index[j] = count++;
+         }
+      }
+      if (graph.getNode(i).reachable) index[i] = count++;
+   }
+   lines = new CompiledLine[count > 0 ? count : 1];
+   int tableEntries = 0;
+   for (int i = 0; i < graph.size(); i++) {
+      if (graph.getNode(i).reachable) tableEntries += graph.getNode(i).table.size();
+   }
+   tables = new int[tableEntries > 0 ? tableEntries : 1];
+   int *table = tables;
+   for (int i = 0; i < graph.size(); i++) {
+      CfgNode & node = graph.getNode(i);
+      if (!node.reachable) continue;
+      CompiledLine & line = lines[index[i]];
+      line.stmt = node.stmt;
+      line.type = node.type;
+      line.lineNumber = node.lineNumber;
+      line.next = (node.next < 0) ? node.next : index[node.next];
+      line.target = (node.target < 0) ? node.target : index[node.target];
+      line.heat = 0;
+      line.table = table;
+      line.tableSize = node.table.size();
+      line.loop = loops.containsKey(i) ? loops.get(i) : NULL;
+      for (int target : node.table) {
+         *table++ = (target < 0) ? target : index[target];
+      }
+   }
+   for (int i = 0; i < graph.size() && graph.isSourceNode(i); i++) {
+      int first = graph.resolve(i);
+      if (first == start) first = entry;
+      if (first < 0) {
+         entries.put(graph.getNode(i).lineNumber, first);
+      } else if (graph.getNode(first).reachable) {
+         entries.put(graph.getNode(i).lineNumber, index[first]);
+      }
+   }
+}
+
+CompiledProgram::~CompiledProgram() {
+   delete[] lines;
+   delete[] tables;
+   deleteParallelLoops();
+}
+
+/*
+ * Implementation notes: buildParallelLoops
+ * ----------------------------------------
+ * The constructor of CompiledProgram has not finished when a loop fails
+ * to build, so the destructor will not run and the loops built so far
+ * are freed here.  Only the optimized tier records the writes of a
+ * loop, since the baseline tier may share its statements.
+ */
+
+void CompiledProgram::buildParallelLoops(bool optimize) {
+   try {
+      for (int i = 0; i < graph.size() && graph.isSourceNode(i); i++) {
+         CfgNode & node = graph.getNode(i);
+         if (node.reachable && node.type == PARALLEL_FOR_STMT) {
+            loops.put(i, new ParallelLoop(graph, i, optimize));
+         }
+      }
+   } catch (ErrorException & ex) {
+      deleteParallelLoops();
+      throw;
+   }
+}
+
+void CompiledProgram::deleteParallelLoops() {
+   for (int header : loops) {
+      delete loops.get(header);
+   }
+   loops.clear();
+}
+
+int CompiledProgram::getEntry(int lineNumber) {
+   if (!entries.containsKey(lineNumber)) error("Cannot access key");
+   return entries.get(lineNumber);
+}
+
+int CompiledProgram::size() {
+   return count;
+}
+
+CompiledLine *CompiledProgram::getLines() {
+   return lines;
+}
+
+ControlFlowGraph & CompiledProgram::getGraph() {
+   return graph;
+}
+
+Vector<string> CompiledProgram::getKeptChecks() {
+   return keptChecks;
+}
+
+Vector<string> CompiledProgram::getCachedExpressions() {
+   return cachedExpressions;
+}
+
+void CompiledProgram::invalidateCaches() {
+   cache.invalidate();
+}
+
+void CompiledProgram::link(EvalState & state) {
+   if (linked == &state) return;
+   for (SlotExp *slot : slots) {
+      slot->link(state);
+   }
+   for (ArrayExp *element : elements) {
+      element->link(state);
+   }
+   for (FlatExp *flat : flats) {
+      flat->link(state);
+   }
+   integerSlots.clear();
+   for (string name : integerVariables) {
+      integerSlots.add(state.getSlot(name));
+   }
+   linked = &state;
+}
+
+Vector<string> CompiledProgram::getIntegerVariables() {
+   return integerVariables;
+}
+
+/*
+ * Implementation notes: admits
+ * ----------------------------
+ * The test is a pass over the slots of the integer variables, which is
+ * cheap next to a run.
+ */
+
+bool CompiledProgram::admits(EvalState & state) {
+   link(state);
+   for (int slot : integerSlots) {
+      if (state.isSlotDefined(slot) && state.getSlotValue(slot).isReal()) {
+         return false;
+      }
+   }
+   return true;
+}
+
+bool CompiledProgram::isOptimized() {
+   return optimized;
+}
@@ -0,0 +1,245 @@
+/*
+ * File: compiler.h
+ * ----------------
+ * This interface exports the CompiledProgram class, which is the form
+ * of a BASIC program that Program::run executes.  The source lines and
+ * their parsed statements stay in the Program for LIST and editing; the
+ * compiled form is rebuilt from them whenever the program changes.
+ */
+
+#ifndef _compiler_h
+#define _compiler_h
+
+#include <string>
+#include "cfg.h"
+#include "hashmap.h"
+#include "optimizer.h"
+#include "statement.h"
+#include "vector.h"
+
+/*
+ * Type: CompiledLine
+ * ------------------
+ * One executable line.  The next and target fields are indices into the
+ * compiled program rather than line numbers, so following them needs no
+ * lookup.  As in CfgNode, they may also be EXIT_NODE or MISSING_NODE.
+ * The heat field counts the jumps back to the line, which is how the run
+ * loop finds hot loops.  An ON line's table holds tableSize indices, so
+ * it picks its target with one bounds check and one load.  A PARALLEL
+ * FOR line has its loop, which is NULL on every other line.
+ */
+
+class ParallelLoop;
+
+struct CompiledLine {
+   Statement *stmt;
+   StatementType type;
+   int lineNumber;
+   int next;
+   int target;
+   int heat;
+   int *table;
+   int tableSize;
+   ParallelLoop *loop;
+};
+
+/*
+ * Class: CompiledProgram
+ * ----------------------
+ * The compiler builds the control-flow graph of the program and then
+ * runs these passes over it:
+ *
+ *  1. skipComments   -- REM lines leave the execution path
+ *  2. collapseJumps  -- GOTO-to-GOTO chains become one jump
+ *  3. markReachable  -- lines that can never run are dropped
+ *
+ * That is the baseline tier.  The optimized tier goes on with:
+ *
+ *  4. foldConstants  -- arithmetic on constants is done once
+ *  5. eliminateUndefinedChecks -- variable reads that must follow an
+ *                       assignment skip the undefined-variable check
+ *  6. inferIntegerVariables -- variables that only ever hold integers
+ *                       are marked, so their expressions run on ints
+ *  7. hoistLoopInvariants -- subexpressions that do not change inside a
+ *                       loop are evaluated once per entry to the loop
+ *  8. shareCommonSubexpressions -- repeated subexpressions in a basic
+ *                       block are evaluated once
+ *  9. flattenExpressions -- expression trees become arrays of nodes
+ *                       and variables and arrays become slots
+ *
+ * Passes 4, 7, 8 and 9 are skipped when the optimizer is turned off.
+ * The surviving lines are laid out in line-number order, with the loop
+ * entry nodes that pass 7 adds placed just before their loop headers.
+ *
+ * Before the passes, checkParallelLoops checks the body of every
+ * PARALLEL FOR, and after pass 3 each reachable PARALLEL FOR gets its
+ * ParallelLoop.  The bodies are not on any path of the graph, so of the
+ * optimized passes they only go through passes 6 and 9.
+ */
+
+class CompiledProgram {
+
+public:
+
+/*
+ * Constructor: CompiledProgram
+ * Usage: CompiledProgram *code = new CompiledProgram(source, optimize);
+ *        CompiledProgram *code = new CompiledProgram(source, false, &table);
+ * ---------------------------------------------------------------------
+ * Compiles the source lines, which may come from another thread's
+ * snapshot of a program.  If optimize is false, the result is the
+ * baseline tier, which leaves its statements alone and so can share
+ * them through a HashConsTable.
+ */
+
+   CompiledProgram(const Vector<SourceLine> & source, bool optimize,
+                   HashConsTable *shared = NULL);
+
+/*
+ * Destructor: ~CompiledProgram
+ * Usage: delete code;
+ * -------------------
+ * Frees the compiled lines, the parallel loops and the graph that owns
+ * their statements.
+ */
+
+   ~CompiledProgram();
+
+/*
+ * Method: getEntry
+ * Usage: int pc = code->getEntry(lineNumber);
+ * -------------------------------------------
+ * Returns the index of the compiled line that runs first when execution
+ * starts at lineNumber.  This method raises an error if the program has
+ * no such line.  If the line is a comment or a GOTO, the result is the
+ * line that control actually reaches.
+ */
+
+   int getEntry(int lineNumber);
+
+/*
+ * Method: size
+ * Usage: int n = code->size();
+ * ----------------------------
+ * Returns the number of compiled lines.
+ */
+
+   int size();
+
+/*
+ * Method: getLines
+ * Usage: CompiledLine *lines = code->getLines();
+ * ----------------------------------------------
+ * Returns the compiled lines as an array for the run loop.
+ */
+
+   CompiledLine *getLines();
+
+/*
+ * Method: getGraph
+ * Usage: ControlFlowGraph & graph = code->getGraph();
+ * ---------------------------------------------------
+ * Returns the control-flow graph the program was compiled from.
+ */
+
+   ControlFlowGraph & getGraph();
+
+/*
+ * Method: getKeptChecks
+ * Usage: Vector<string> kept = code->getKeptChecks();
+ * ---------------------------------------------------
+ * Returns the variable reads that still check for an undefined
+ * variable, as strings such as "20: X".
+ */
+
+   Vector<std::string> getKeptChecks();
+
+/*
+ * Method: getCachedExpressions
+ * Usage: Vector<string> cached = code->getCachedExpressions();
+ * ------------------------------------------------------------
+ * Returns the subexpressions that passes 7 and 8 cache, as strings such
+ * as "30: (A * B)".
+ */
+
+   Vector<std::string> getCachedExpressions();
+
+/*
+ * Method: invalidateCaches
+ * Usage: code->invalidateCaches();
+ * --------------------------------
+ * Makes every cached value stale.  Program::run calls this before each
+ * run.
+ */
+
+   void invalidateCaches();
+
+/*
+ * Method: link
+ * Usage: code->link(state);
+ * -------------------------
+ * Resolves the program's variables and arrays to their slots in state.
+ * Program::run calls this before running the code in a state; linking
+ * again to the same state does nothing.
+ */
+
+   void link(EvalState & state);
+
+/*
+ * Method: getIntegerVariables
+ * Usage: Vector<string> integers = code->getIntegerVariables();
+ * -------------------------------------------------------------
+ * Returns the variables that pass 6 found to hold only integers.  The
+ * baseline tier has none.
+ */
+
+   Vector<std::string> getIntegerVariables();
+
+/*
+ * Method: admits
+ * Usage: if (code->admits(state)) . . .
+ * -------------------------------------
+ * Links the code to state and returns true if the code can run in it:
+ * the variables of pass 6 must hold integers, of either size, if they
+ * are defined at all.  A run that starts in a fresh state always can,
+ * but a direct LET, CONT or RESUME can leave a real number where the
+ * program never puts one, and that run must use code that tests the
+ * types.
+ */
+
+   bool admits(EvalState & state);
+
+/*
+ * Method: isOptimized
+ * Usage: if (code->isOptimized()) . . .
+ * -------------------------------------
+ * Returns true if this is the optimized tier.
+ */
+
+   bool isOptimized();
+
+private:
+
+   ControlFlowGraph graph;
+   ExpressionCache cache;
+   CompiledLine *lines;
+   int *tables;
+   int count;
+   HashMap<int,int> entries;
+   Vector<std::string> keptChecks;
+   Vector<std::string> cachedExpressions;
+   Vector<std::string> integerVariables;
+   Vector<int> integerSlots;
+   Vector<FlatExp *> flats;
+   Vector<SlotExp *> slots;
+   Vector<ArrayExp *> elements;
+   HashMap<int,ParallelLoop *> loops;
+   EvalState *linked;
+   bool optimized;
+
+   void buildParallelLoops(bool optimize);
+   void deleteParallelLoops();
+
+};
+
+#endif
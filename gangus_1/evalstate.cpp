@@ -6,30 +6,120 @@
  * methods are simple enough that they need no individual documentation.
  */
 
+#include <algorithm>
+#include <climits>
+#include <new>
 #include <string>
+#include <vector>
+#include "accounting.h"
+#include "budget.h"
+#include "error.h"
 #include "evalstate.h"
-#include "map.h"
+#include "hashmap.h"
+#include "inputsource.h"
+#include "stats.h"
+#include "strlib.h"
+#include "vector.h"
 using namespace std;
 
 /* Implementation of the EvalState class */
 
 EvalState::EvalState() {
    currentLineNumber = 0;
+   input = NULL;
+   meter = NULL;
+   inLoop = false;
+   loopLine = 0;
+   loopNext = 0;
+   loopLast = 0;
+   returns = NULL;
+   returnDepth = 0;
+   returnCapacity = 0;
+   borrowed = false;
 }
 
 EvalState::~EvalState() {
+   delete[] returns;
+   for (int i = 0; i < arrays.size(); i++) {
+      freeArray(i);
+   }
 }
 
-void EvalState::setValue(string var, int value) {
-   symbolTable.put(var, value);
+void EvalState::setValue(string var, Value value) {
+   countStat(STAT_LOOKUPS);
+   setSlotValue(getSlot(var), value);
 }
 
-int EvalState::getValue(string var) {
-   return symbolTable.get(var);
+void EvalState::appendValue(string var, const Value & tail) {
+   countStat(STAT_LOOKUPS);
+   appendSlotValue(getSlot(var), tail);
+}
+
+Value EvalState::getValue(string var) {
+   countStat(STAT_LOOKUPS);
+   if (!slots.containsKey(var)) return Value();
+   return values[slots.get(var)];
 }
 
 bool EvalState::isDefined(string var) {
-   return symbolTable.containsKey(var);
+   countStat(STAT_LOOKUPS);
+   if (slots.containsKey(var) && defined[slots.get(var)]) return true;
+   countStat(STAT_LOOKUP_MISSES);
+   return false;
+}
+
+/*
+* Method: getInputSource
+* Usage: InputSource & source = state.getInputSource();
+* ---------------------------------------
+* Returns the source of this state, or the shared one if it has none
+*/
+
+void EvalState::setInputSource(InputSource *source) {
+    input = source;
+}
+
+InputSource & EvalState::getInputSource() {
+    if (input != NULL) return *input;
+    return ::getInputSource();
+}
+
+/*
+* Method: getSlot
+* Usage: int slot = state.getSlot(var);
+* ---------------------------------------
+* Returns the slot of var, giving it a new undefined one the first time
+*/
+
+int EvalState::getSlot(string var) {
+    if (slots.containsKey(var)) return slots.get(var);
+    MemoryScope scope(MEM_SYMBOLS);
+    int slot = names.size();
+    slots.put(var, slot);
+    names.add(var);
+    values.add(Value());
+    defined.add(false);
+    return slot;
+}
+
+/*
+* Method: getVariables
+* Usage: Vector<string> names = state.getVariables();
+* ---------------------------------------
+* Returns the names of the defined variables, sorted
+*/
+
+Vector<string> EvalState::getVariables() {
+    vector<string> sorted;
+    for (int i = 0; i < names.size(); i++) {
+        if (defined[i]) sorted.push_back(names[i]);
+    }
+    sort(sorted.begin(), sorted.end());
+    Vector<string> result;
+    for (string name : sorted) {
+        result.add(name);
+    }
+    return result;
 }
 
 /*
@@ -58,9 +148,256 @@ void EvalState::setCurrentLineNumber(int newLineNumber) {
 * Method: clear
 * Usage: clear();
 * ---------------------------------------
-* Clears map symbolTable
+* Undefines every variable but keeps the slots, which compiled code
+* may have resolved
 */
 
 void EvalState::clear(){
-    symbolTable.clear();
+    for (int i = 0; i < defined.size(); i++) {
+        defined[i] = false;
+    }
+    returnDepth = 0;
+    inLoop = false;
+    for (int i = 0; i < arrays.size(); i++) {
+        freeArray(i);
+    }
+}
+
+/*
+* Methods: setLoopProgress, takeLoopProgress, isInLoop
+* Usage: state.setLoopProgress(lineNumber, next, last);
+* ---------------------------------------
+* Keep, hand back and tell about the progress of a suspended PARALLEL FOR
+*/
+
+void EvalState::setLoopProgress(int lineNumber, long long next, long long last) {
+    inLoop = true;
+    loopLine = lineNumber;
+    loopNext = next;
+    loopLast = last;
+}
+
+bool EvalState::takeLoopProgress(int lineNumber, long long & next, long long & last) {
+    if (!inLoop || loopLine != lineNumber) return false;
+    inLoop = false;
+    next = loopNext;
+    last = loopLast;
+    return true;
+}
+
+bool EvalState::isInLoop() {
+    return inLoop;
+}
+
+/*
+* Methods: getReturnDepth, getReturn, clearReturns
+* Usage: int depth = state.getReturnDepth();
+* ---------------------------------------
+* Give access to the active calls, the oldest first, or forget them
+*/
+
+int EvalState::getReturnDepth() {
+    return returnDepth;
+}
+
+ReturnAddress & EvalState::getReturn(int index) {
+    if (index < 0 || index >= returnDepth) error("Return stack index out of range");
+    return returns[index];
+}
+
+void EvalState::clearReturns() {
+    returnDepth = 0;
+}
+
+/*
+* Method: reserveReturns
+* Usage: state.reserveReturns(depth);
+* ---------------------------------------
+* Reallocates the return stack if its size is not depth, keeping the
+* active calls
+*/
+
+void EvalState::reserveReturns(int depth) {
+    if (depth == returnCapacity) return;
+    if (depth < returnDepth) error("GOSUB calls nested deeper than the limit");
+    MemoryScope scope(MEM_SYMBOLS);
+    ReturnAddress *resized = new ReturnAddress[depth];
+    for (int i = 0; i < returnDepth; i++) {
+        resized[i] = returns[i];
+    }
+    delete[] returns;
+    returns = resized;
+    returnCapacity = depth;
+}
+
+/*
+* Methods: growReturns, emptyReturns
+* Usage: growReturns();
+* ---------------------------------------
+* The slow paths of pushReturn and popReturn: the first call allocates
+* the whole stack, and a call past the limit or a return with no call is
+* an error
+*/
+
+void EvalState::growReturns() {
+    int limit = getReturnStackLimit();
+    if (returnCapacity >= limit) {
+        error("GOSUB calls nested more than " + integerToString(limit) + " deep");
+    }
+    reserveReturns(limit);
+}
+
+void EvalState::emptyReturns() {
+    error("RETURN without GOSUB");
+}
+
+/*
+* Method: getArraySlot
+* Usage: int slot = state.getArraySlot(name);
+* ---------------------------------------
+* Returns the slot of the array, giving it a new one with no storage the
+* first time
+*/
+
+int EvalState::getArraySlot(string name) {
+    if (arraySlots.containsKey(name)) return arraySlots.get(name);
+    MemoryScope scope(MEM_SYMBOLS);
+    int slot = arrayNames.size();
+    ArrayStorage array;
+    array.data = NULL;
+    array.size = 0;
+    for (int i = 0; i < 3; i++) {
+        array.extent[i] = 0;
+        array.stride[i] = 0;
+    }
+    arraySlots.put(name, slot);
+    arrayNames.add(name);
+    arrays.add(array);
+    return slot;
+}
+
+/*
+* Method: dimArray
+* Usage: state.dimArray(slot, first, second);
+* ---------------------------------------
+* Replaces the storage of the array with zeroed elements; the size is
+* capped so that every offset, and the size in bytes, fits in an int,
+* and checked against the memory limit before anything is freed or
+* allocated, so an array that would not fit leaves the old one in place
+*/
+
+void EvalState::dimArray(int slot, int first, int second) {
+    string name = arrayNames[slot];
+    if (first < 0 || second < -1) error("Illegal dimension for array " + name);
+    long long rows = first + 1LL;
+    long long columns = second + 1LL;
+    long long size = (second == -1) ? rows : rows * columns;
+    if (size > INT_MAX / (long long) sizeof(int)) error("Array " + name + " is too large");
+    //the old storage is given back before the new is taken
+    long long freed = borrowed ? 0 : arrays[slot].size;
+    checkMemoryRequest((size - freed) * (long long) sizeof(int));
+    freeArray(slot);
+    ArrayStorage & array = arrays[slot];
+    {
+        MemoryScope scope(MEM_SYMBOLS);
+        array.data = new (align_val_t(ARRAY_ALIGNMENT)) int[size]();
+    }
+    array.size = size;
+    if (second == -1) {
+        array.extent[SUBSCRIPT_VECTOR] = rows;
+        array.stride[SUBSCRIPT_VECTOR] = 1;
+    } else {
+        array.extent[SUBSCRIPT_ROW] = rows;
+        array.stride[SUBSCRIPT_ROW] = columns;
+        array.extent[SUBSCRIPT_COLUMN] = columns;
+        array.stride[SUBSCRIPT_COLUMN] = 1;
+    }
+}
+
+/*
+* Method: reshapeArray
+* Usage: state.reshapeArray(slot, first, second);
+* ---------------------------------------
+* Gives the array new storage only if its shape is not already the one
+* asked for, which lets a statement that overwrites every element reuse
+* the storage
+*/
+
+void EvalState::reshapeArray(int slot, int first, int second) {
+    ArrayStorage & array = arrays[slot];
+    if (array.data != NULL) {
+        if (second == -1 && array.extent[SUBSCRIPT_VECTOR] == first + 1LL) return;
+        if (second != -1 && array.extent[SUBSCRIPT_ROW] == first + 1LL
+            && array.extent[SUBSCRIPT_COLUMN] == second + 1LL) return;
+    }
+    dimArray(slot, first, second);
+}
+
+/*
+* Method: getArrays
+* Usage: Vector<string> names = state.getArrays();
+* ---------------------------------------
+* Returns the names of the dimensioned arrays, sorted
+*/
+
+Vector<string> EvalState::getArrays() {
+    vector<string> sorted;
+    for (int i = 0; i < arrayNames.size(); i++) {
+        if (arrays[i].data != NULL) sorted.push_back(arrayNames[i]);
+    }
+    sort(sorted.begin(), sorted.end());
+    Vector<string> result;
+    for (string name : sorted) {
+        result.add(name);
+    }
+    return result;
+}
+
+/*
+* Method: borrowFrom
+* Usage: worker.borrowFrom(state);
+* ---------------------------------------
+* Copies the slots and the values, and the array descriptors without
+* the storage they point to
+*/
+
+void EvalState::borrowFrom(EvalState & state) {
+    slots = state.slots;
+    names = state.names;
+    values = state.values;
+    defined = state.defined;
+    currentLineNumber = state.currentLineNumber;
+    input = state.input;
+    meter = state.meter;
+    arraySlots = state.arraySlots;
+    arrayNames = state.arrayNames;
+    arrays = state.arrays;
+    borrowed = true;
+}
+
+/*
+* Methods: subscriptError, freeArray
+* Usage: subscriptError(slot, position, subscript);
+* ---------------------------------------
+* The slow path of getOffset, which works out which of the errors a
+* failed check means, and the release of an array's storage
+*/
+
+void EvalState::subscriptError(int slot, int position, long long subscript) {
+    ArrayStorage & array = arrays[slot];
+    string name = arrayNames[slot];
+    if (array.data == NULL) error("Array " + name + " is not dimensioned");
+    if (array.extent[position] == 0) error("Wrong number of subscripts for " + name);
+    error("Subscript " + to_string(subscript) + " is out of range for " + name);
+}
+
+void EvalState::freeArray(int slot) {
+    ArrayStorage & array = arrays[slot];
+    if (array.data != NULL && !borrowed) operator delete[](array.data, align_val_t(ARRAY_ALIGNMENT));
+    array.data = NULL;
+    array.size = 0;
+    for (int i = 0; i < 3; i++) {
+        array.extent[i] = 0;
+        array.stride[i] = 0;
+    }
 }
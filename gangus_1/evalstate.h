@@ -10,7 +10,53 @@
 #define _evalstate_h
 
 #include <string>
-#include "map.h"
+#include <utility>
+#include "hashmap.h"
+#include "stringvalue.h"
+#include "value.h"
+#include "vector.h"
+
+class InputSource;
+class RunMeter;
+
+/*
+ * Type: ReturnAddress
+ * -------------------
+ * One active GOSUB: the index of the call in the compiled program, whose
+ * next line is where RETURN goes, and the call's line number, which
+ * finds the call again when the program is run by other code.
+ */
+
+struct ReturnAddress {
+    int pc;
+    int callLine;
+};
+
+/*
+ * Type: ArrayStorage
+ * ------------------
+ * One array: its elements, contiguous, in row-major order and aligned to
+ * ARRAY_ALIGNMENT bytes, and for each subscript position the number of
+ * values the subscript may take and the distance between consecutive
+ * ones.  An array with one subscript uses SUBSCRIPT_VECTOR and one with
+ * two uses SUBSCRIPT_ROW and SUBSCRIPT_COLUMN; the other positions have
+ * extent 0, so one check catches both a subscript out of range and the
+ * wrong number of subscripts.  An array that has not been dimensioned
+ * has no data and no extents.
+ */
+
+enum SubscriptPosition {
+    SUBSCRIPT_VECTOR, SUBSCRIPT_ROW, SUBSCRIPT_COLUMN
+};
+
+const int ARRAY_ALIGNMENT = 64;
+
+struct ArrayStorage {
+    int *data;
+    int size;
+    int extent[3];
+    int stride[3];
+};
 
 /*
  * Class: EvalState
@@ -53,16 +99,16 @@ public:
  * Sets the value associated with the specified var.
  */
 
-    void setValue(std::string var, int value);
+    void setValue(std::string var, Value value);
 
     /*
  * Method: getValue
- * Usage: int value = state.getValue(var);
- * ---------------------------------------
+ * Usage: Value value = state.getValue(var);
+ * -----------------------------------------
  * Returns the value associated with the specified variable.
  */
 
-    int getValue(std::string var);
+    Value getValue(std::string var);
 
     /*
  * Method: isDefined
@@ -73,6 +119,15 @@ public:
 
     bool isDefined(std::string var);
 
+    /*
+    * Method: getVariables
+    * Usage: Vector<string> names = state.getVariables();
+    * --------------------------------------
+    * Returns the names of all defined variables in alphabetical order
+    */
+
+    Vector<std::string> getVariables();
+
     /*
     * Method: getCurrentLineNumber()
     * Usage: lineNumber = state.getCurrentLineNumber()
@@ -95,15 +150,234 @@ public:
     * Method: clear()
     * Usage: state.clear()
     * --------------------------------------
-    * Clears the symbolTable
+    * Undefines every variable and frees the storage of every array
     */
 
     void clear();
 
+    /*
+    * Methods: getSlot, getSlotValue, isSlotDefined, setSlotValue
+    * Usage: int slot = state.getSlot(var);
+    *        Value value = state.getSlotValue(slot);
+    * --------------------------------------
+    * Every variable the state has seen has a slot, a small integer that
+    * stays the same until the state is destroyed, even across clear.
+    * Code that has resolved a variable to its slot reads and assigns it
+    * through these methods without looking the name up.  They share the
+    * storage that setValue and getValue use.  getSlotValue returns a
+    * reference, so testing the type of a value does not copy it; the
+    * reference lasts until the next variable is added.
+    */
+
+    /*
+    * Methods: setInputSource, getInputSource
+    * Usage: state.setInputSource(source);
+    * --------------------------------------
+    * Gives this state its own source of INPUT values, so that programs
+    * run by the same thread can each be fed separately.  The state does
+    * not take ownership of source.  Without one, INPUT reads from the
+    * source in inputsource.h.
+    */
+
+    void setInputSource(InputSource *source);
+
+    InputSource & getInputSource();
+
+    /*
+    * Methods: setLoopProgress, takeLoopProgress, isInLoop
+    * Usage: state.setLoopProgress(lineNumber, next, last);
+    * --------------------------------------
+    * Where a PARALLEL FOR that a run was suspended in stands: the loop's
+    * line, the first iteration that has not run and the last one.
+    * takeLoopProgress hands them back once, and only to the loop at that
+    * line; clear forgets them
+    */
+
+    void setLoopProgress(int lineNumber, long long next, long long last);
+    bool takeLoopProgress(int lineNumber, long long & next, long long & last);
+    bool isInLoop();
+
+    /*
+    * Methods: setRunMeter, getRunMeter
+    * Usage: state.setRunMeter(&meter);
+    * --------------------------------------
+    * The meter of the run the state is in, which statements that do a
+    * lot of work in one step charge it to, or NULL outside a run.  The
+    * state does not take ownership of meter.
+    */
+
+    void setRunMeter(RunMeter *meter) {
+        this->meter = meter;
+    }
+
+    RunMeter *getRunMeter() {
+        return meter;
+    }
+
+    /*
+    * Methods: pushReturn, popReturn, getReturnDepth, getReturn, clearReturns
+    * Usage: state.pushReturn(pc, callLine);
+    *        ReturnAddress & address = state.popReturn();
+    * --------------------------------------
+    * The return stack of the GOSUB calls that have not returned.  The
+    * stack is allocated once, at the limit in budget.h, so pushing and
+    * popping never allocate; pushing onto a full stack and popping an
+    * empty one raise errors.  clear empties the stack too.
+    */
+
+    void pushReturn(int pc, int callLine) {
+        if (returnDepth == returnCapacity) growReturns();
+        ReturnAddress & address = returns[returnDepth++];
+        address.pc = pc;
+        address.callLine = callLine;
+    }
+
+    ReturnAddress & popReturn() {
+        if (returnDepth == 0) emptyReturns();
+        return returns[--returnDepth];
+    }
+
+    int getReturnDepth();
+
+    ReturnAddress & getReturn(int index);
+
+    void clearReturns();
+
+    /*
+    * Method: reserveReturns
+    * Usage: state.reserveReturns(getReturnStackLimit());
+    * --------------------------------------
+    * Sizes the return stack for depth calls, which allocates only if the
+    * size changes.  Runs call this so a changed limit takes effect.
+    */
+
+    void reserveReturns(int depth);
+
+    int getSlot(std::string var);
+
+    const Value & getSlotValue(int slot) {
+        return values[slot];
+    }
+
+    bool isSlotDefined(int slot) {
+        return defined[slot];
+    }
+
+    void setSlotValue(int slot, Value value) {
+        values[slot] = std::move(value);
+        defined[slot] = true;
+    }
+
+    /*
+    * Methods: appendValue, appendSlotValue
+    * Usage: state.appendSlotValue(slot, tail);
+    * --------------------------------------
+    * Add the string tail to the end of the string in a variable, in the
+    * variable's own buffer when nothing else shares it (see
+    * appendString in stringvalue.h)
+    */
+
+    void appendValue(std::string var, const Value & tail);
+
+    void appendSlotValue(int slot, const Value & tail) {
+        appendString(values[slot], tail);
+        defined[slot] = true;
+    }
+
+    /*
+    * Methods: getArraySlot, dimArray, reshapeArray, getArray, getArrays
+    * Usage: int slot = state.getArraySlot(name);
+    *        state.dimArray(slot, 10, -1);
+    * --------------------------------------
+    * Arrays have slots of their own, apart from the variables, so a name
+    * can stand for both.  dimArray gives an array new zeroed storage for
+    * subscripts from 0 through first and, unless second is -1, 0 through
+    * second, replacing any storage it had.  reshapeArray does the same
+    * only if the array does not have that shape already; otherwise the
+    * array keeps its storage and its elements.  getArrays returns the names
+    * of the dimensioned arrays in alphabetical order.  clear frees the
+    * storage of every array but keeps the slots.
+    */
+
+    int getArraySlot(std::string name);
+
+    void dimArray(int slot, int first, int second);
+
+    void reshapeArray(int slot, int first, int second);
+
+    ArrayStorage & getArray(int slot) {
+        return arrays[slot];
+    }
+
+    Vector<std::string> getArrays();
+
+    /*
+    * Method: borrowFrom
+    * Usage: worker.borrowFrom(state);
+    * --------------------------------------
+    * Gives a new state copies of the variables of state, in the same
+    * slots, and the same storage for its arrays, which is how each worker
+    * of a PARALLEL FOR gets private scalars and shared arrays.  The
+    * arrays stay owned by state, so this state never frees them, and
+    * state must outlive it without giving them new storage.
+    */
+
+    void borrowFrom(EvalState & state);
+
+    /*
+    * Methods: getOffset, getElement, setElement
+    * Usage: int offset = state.getOffset(slot, SUBSCRIPT_VECTOR, i);
+    *        int value = state.getElement(slot, offset);
+    * --------------------------------------
+    * getOffset checks one subscript of an element and returns it scaled
+    * by its stride.  The offsets of all of an element's subscripts add up
+    * to its index, which getElement and setElement take without checking
+    * it again.  The subscript may be any 64-bit integer, since the check
+    * is what rejects the ones that are too large.
+    */
+
+    int getOffset(int slot, int position, long long subscript) {
+        ArrayStorage & array = arrays[slot];
+        if ((unsigned long long) subscript
+            >= (unsigned long long) array.extent[position]) {
+            subscriptError(slot, position, subscript);
+        }
+        return (int) subscript * array.stride[position];
+    }
+
+    int getElement(int slot, int offset) {
+        return arrays[slot].data[offset];
+    }
+
+    void setElement(int slot, int offset, int value) {
+        arrays[slot].data[offset] = value;
+    }
+
 private:
 
-    Map<std::string,int> symbolTable;
+    HashMap<std::string,int> slots;
+    Vector<std::string> names;
+    Vector<Value> values;
+    Vector<bool> defined;
     int currentLineNumber;
+    InputSource *input;
+    RunMeter *meter;
+    bool inLoop;
+    int loopLine;
+    long long loopNext;
+    long long loopLast;
+    ReturnAddress *returns;
+    int returnDepth;
+    int returnCapacity;
+    HashMap<std::string,int> arraySlots;
+    Vector<std::string> arrayNames;
+    Vector<ArrayStorage> arrays;
+    bool borrowed;
+
+    void growReturns();
+    void emptyReturns();
+    void subscriptError(int slot, int position, long long subscript);
+    void freeArray(int slot);
 
 };
 
@@ -4,13 +4,35 @@
  * This file implements the Expression class and its subclasses.
  */
 
+#include <climits>
 #include <string>
 #include "error.h"
 #include "evalstate.h"
 #include "exp.h"
+#include "flatexp.h"
+#include "stats.h"
+#include "stringvalue.h"
 #include "strlib.h"
 using namespace std;
 
+/* Constants */
+
+static const int MAX_ARGS = 3;
+
+/*
+ * Constant: FUNCTION_NAMES
+ * ------------------------
+ * The names of the built-in functions, in the order of StringFunction.
+ */
+
+static const char *FUNCTION_NAMES[] = { "LEN", "LEFT$", "RIGHT$", "MID$" };
+
+static const int FUNCTION_COUNT = sizeof FUNCTION_NAMES / sizeof FUNCTION_NAMES[0];
+
+/* Private function prototypes */
+
+static string subscriptToString(Expression *offset);
+
 /*
  * Implementation notes: the Expression class
  * ------------------------------------------
@@ -33,40 +55,47 @@ Expression::~Expression() {
  * value of state but needs it to match the general prototype for eval.
  */
 
-ConstantExp::ConstantExp(int value) {
+ConstantExp::ConstantExp(Value value) {
    this->value = value;
 }
 
-int ConstantExp::eval(EvalState & state) {
+Value ConstantExp::eval(EvalState & state) {
+   countStat(STAT_EXPRESSIONS);
    return value;
 }
 
 string ConstantExp::toString() {
-   return integerToString(value);
+   if (value.isString()) return quoteString(value);
+   return value.toString();
 }
 
 ExpressionType ConstantExp::getType() {
    return CONSTANT;
 }
 
-int ConstantExp::getValue() {
+Value ConstantExp::getValue() {
    return value;
 }
 
 /*
  * Implementation notes: the IdentifierExp subclass
  * ------------------------------------------------
- * The IdentifierExp subclass declares a single instance variable that
- * stores the name of the variable.  The implementation of eval must
- * look this variable up in the evaluation state.
+ * The IdentifierExp subclass declares an instance variable that stores
+ * the name of the variable, a flag that says whether eval must check
+ * that the variable is defined and the integer flag, which only the
+ * flattened form uses.  The implementation of eval must look this
+ * variable up in the evaluation state.
  */
 
 IdentifierExp::IdentifierExp(string name) {
    this->name = name;
+   checked = true;
+   integer = false;
 }
 
-int IdentifierExp::eval(EvalState & state) {
-   if (!state.isDefined(name)) error(name + " is undefined");
+Value IdentifierExp::eval(EvalState & state) {
+   countStat(STAT_EXPRESSIONS);
+   if (checked && !state.isDefined(name)) error(name + " is undefined");
    return state.getValue(name);
 }
 
@@ -82,6 +111,32 @@ string IdentifierExp::getName() {
    return name;
 }
 
+bool IdentifierExp::isChecked() {
+   return checked;
+}
+
+void IdentifierExp::assign(EvalState & state, Value value) {
+   state.setValue(name, value);
+}
+
+void IdentifierExp::append(EvalState & state, Expression *tail, bool checked) {
+   countStat(STAT_EXPRESSIONS, 2);
+   if (checked && !state.isDefined(name)) error(name + " is undefined");
+   state.appendValue(name, tail->eval(state));
+}
+
+void IdentifierExp::setChecked(bool flag) {
+   checked = flag;
+}
+
+bool IdentifierExp::isInteger() {
+   return integer;
+}
+
+void IdentifierExp::setInteger(bool flag) {
+   integer = flag;
+}
+
 /*
  * Implementation notes: the CompoundExp subclass
  * ----------------------------------------------
@@ -106,18 +161,28 @@ CompoundExp::~CompoundExp() {
  * --------------------------
  * The eval method for the compound expression case must check for the
  * assignment operator as a special case.  Unlike the arithmetic operators
- * the assignment operator does not evaluate its left operand.
+ * the assignment operator does not evaluate its left operand.  The value
+ * functions keep two integers on their inline path.  A string on the
+ * left is a temporary that only this call holds, unless it is a copy of
+ * a variable, so appending to it in place saves a copy.
  */
 
-int CompoundExp::eval(EvalState & state) {
-   int left = lhs->eval(state);
-   int right = rhs->eval(state);
-   if (op == "+") return left + right;
-   if (op == "-") return left - right;
-   if (op == "*") return left * right;
-   if (op == "/") return left / right;
+Value CompoundExp::eval(EvalState & state) {
+   countStat(STAT_EXPRESSIONS);
+   Value left = lhs->eval(state);
+   Value right = rhs->eval(state);
+   if (op == "+") {
+      if (left.isString()) {
+         appendString(left, right);
+         return left;
+      }
+      return addValues(left, right);
+   }
+   if (op == "-") return subtractValues(left, right);
+   if (op == "*") return multiplyValues(left, right);
+   if (op == "/") return divideValues(left, right);
    error("Illegal operator in expression");
-   return 0;
+   return Value();
 }
 
 string CompoundExp::toString() {
@@ -139,3 +204,367 @@ Expression *CompoundExp::getLHS() {
 Expression *CompoundExp::getRHS() {
    return rhs;
 }
+
+void CompoundExp::setLHS(Expression *lhs) {
+   this->lhs = lhs;
+}
+
+void CompoundExp::setRHS(Expression *rhs) {
+   this->rhs = rhs;
+}
+
+/*
+ * Implementation notes: the IndexExp subclass
+ * -------------------------------------------
+ * The check itself is inline in EvalState; eval only makes sure the
+ * subscript is an integer and finds the slot, which an unlinked tree
+ * does by name, as IdentifierExp does.
+ */
+
+IndexExp::IndexExp(string array, int position, Expression *subscript) {
+   this->array = array;
+   this->position = position;
+   this->subscript = subscript;
+}
+
+IndexExp::~IndexExp() {
+   delete subscript;
+}
+
+Value IndexExp::eval(EvalState & state) {
+   countStat(STAT_EXPRESSIONS);
+   long long value = checkInteger(subscript->eval(state), "Subscript");
+   return state.getOffset(state.getArraySlot(array), position, value);
+}
+
+string IndexExp::toString() {
+   if (position == SUBSCRIPT_ROW) return array + "[" + subscript->toString() + ", *]";
+   if (position == SUBSCRIPT_COLUMN) return array + "[*, " + subscript->toString() + "]";
+   return array + "[" + subscript->toString() + "]";
+}
+
+ExpressionType IndexExp::getType() {
+   return INDEX;
+}
+
+string IndexExp::getArray() {
+   return array;
+}
+
+int IndexExp::getPosition() {
+   return position;
+}
+
+Expression *IndexExp::getSubscript() {
+   return subscript;
+}
+
+void IndexExp::setSubscript(Expression *subscript) {
+   this->subscript = subscript;
+}
+
+/*
+ * Implementation notes: the ArrayExp subclass
+ * -------------------------------------------
+ * The offsets are evaluated first and second, which checks them, and
+ * their sum indexes the elements directly.  An offset is always the
+ * integer that an IndexExp made, so its tag is not tested.  A linked
+ * element has its slot, and an unlinked one, slot -1, looks the array
+ * up by name.
+ */
+
+ArrayExp::ArrayExp(string name, Expression *first, Expression *second) {
+   this->name = name;
+   this->first = first;
+   this->second = second;
+   slot = -1;
+}
+
+ArrayExp::~ArrayExp() {
+   delete first;
+   delete second;
+}
+
+Value ArrayExp::eval(EvalState & state) {
+   countStat(STAT_EXPRESSIONS);
+   int offset = first->eval(state).getInteger();
+   if (second != NULL) offset += second->eval(state).getInteger();
+   return state.getElement((slot >= 0) ? slot : state.getArraySlot(name), offset);
+}
+
+void ArrayExp::assign(EvalState & state, Value value) {
+   int offset = first->eval(state).getInteger();
+   if (second != NULL) offset += second->eval(state).getInteger();
+   int element = checkInt(value, "Array element");
+   state.setElement((slot >= 0) ? slot : state.getArraySlot(name), offset, element);
+}
+
+string ArrayExp::toString() {
+   string str = name + "(" + subscriptToString(first);
+   if (second != NULL) str += ", " + subscriptToString(second);
+   return str + ")";
+}
+
+ExpressionType ArrayExp::getType() {
+   return ARRAY;
+}
+
+string ArrayExp::getName() {
+   return name;
+}
+
+Expression *ArrayExp::getFirst() {
+   return first;
+}
+
+Expression *ArrayExp::getSecond() {
+   return second;
+}
+
+void ArrayExp::setFirst(Expression *first) {
+   this->first = first;
+}
+
+void ArrayExp::setSecond(Expression *second) {
+   this->second = second;
+}
+
+void ArrayExp::link(EvalState & state) {
+   slot = state.getArraySlot(name);
+}
+
+/*
+ * Implementation notes: subscriptToString
+ * ---------------------------------------
+ * An element shows the subscripts the program wrote, so the offsets are
+ * unwrapped down to the subscripts of their IndexExp nodes.
+ */
+
+static string subscriptToString(Expression *offset) {
+   if (offset->getType() == CACHED) {
+      return subscriptToString(((CachedExp *) offset)->getExp());
+   }
+   if (offset->getType() == FLAT) {
+      return subscriptToString(((FlatExp *) offset)->getTree());
+   }
+   if (offset->getType() == INDEX) {
+      return ((IndexExp *) offset)->getSubscript()->toString();
+   }
+   return offset->toString();
+}
+
+/*
+ * Implementation notes: the CallExp subclass
+ * ------------------------------------------
+ * The arguments are evaluated into a small array, in order, and passed
+ * to callFunction, which the flattened form calls the same way.
+ */
+
+CallExp::CallExp(StringFunction function, Vector<Expression *> args) {
+   this->function = function;
+   this->args = args;
+}
+
+CallExp::~CallExp() {
+   for (Expression *arg : args) {
+      delete arg;
+   }
+}
+
+Value CallExp::eval(EvalState & state) {
+   countStat(STAT_EXPRESSIONS);
+   Value values[MAX_ARGS];
+   for (int i = 0; i < args.size(); i++) {
+      values[i] = args[i]->eval(state);
+   }
+   return callFunction(function, values, args.size());
+}
+
+string CallExp::toString() {
+   string str = getFunctionName(function) + "(";
+   for (int i = 0; i < args.size(); i++) {
+      if (i > 0) str += ", ";
+      str += args[i]->toString();
+   }
+   return str + ")";
+}
+
+ExpressionType CallExp::getType() {
+   return CALL;
+}
+
+StringFunction CallExp::getFunction() {
+   return function;
+}
+
+int CallExp::getArgCount() {
+   return args.size();
+}
+
+Expression *CallExp::getArg(int index) {
+   return args[index];
+}
+
+void CallExp::setArg(int index, Expression *arg) {
+   args[index] = arg;
+}
+
+/*
+ * Implementation notes: the CachedExp subclass
+ * --------------------------------------------
+ * A hit costs one comparison against the epoch counter.  A hit still
+ * counts as one expression evaluated.
+ */
+
+CachedExp::CachedExp(Expression *exp, CacheSlot *slot, unsigned *epoch,
+                     bool refresh) {
+   this->exp = exp;
+   this->slot = slot;
+   this->epoch = epoch;
+   this->refresh = refresh;
+}
+
+CachedExp::~CachedExp() {
+   delete exp;
+}
+
+Value CachedExp::eval(EvalState & state) {
+   if (!refresh && slot->stamp == *epoch) {
+      countStat(STAT_EXPRESSIONS);
+      return slot->value;
+   }
+   Value value = exp->eval(state);
+   slot->value = value;
+   slot->stamp = *epoch;
+   return value;
+}
+
+string CachedExp::toString() {
+   return exp->toString();
+}
+
+ExpressionType CachedExp::getType() {
+   return CACHED;
+}
+
+Expression *CachedExp::getExp() {
+   return exp;
+}
+
+void CachedExp::setExp(Expression *exp) {
+   this->exp = exp;
+}
+
+CacheSlot *CachedExp::getSlot() {
+   return slot;
+}
+
+unsigned *CachedExp::getEpoch() {
+   return epoch;
+}
+
+bool CachedExp::isRefresh() {
+   return refresh;
+}
+
+/*
+ * Implementation notes: the SlotExp subclass
+ * ------------------------------------------
+ * An unlinked SlotExp has slot -1; evaluating one is a bug in the
+ * compiler, which the bounds check in EvalState reports.
+ */
+
+SlotExp::SlotExp(string name, bool checked) : IdentifierExp(name) {
+   this->checked = checked;
+   slot = -1;
+}
+
+void SlotExp::link(EvalState & state) {
+   slot = state.getSlot(name);
+}
+
+Value SlotExp::eval(EvalState & state) {
+   countStat(STAT_EXPRESSIONS);
+   if (checked && !state.isSlotDefined(slot)) error(name + " is undefined");
+   return state.getSlotValue(slot);
+}
+
+void SlotExp::assign(EvalState & state, Value value) {
+   state.setSlotValue(slot, value);
+}
+
+void SlotExp::append(EvalState & state, Expression *tail, bool checked) {
+   countStat(STAT_EXPRESSIONS, 2);
+   if (checked && !state.isSlotDefined(slot)) error(name + " is undefined");
+   state.appendSlotValue(slot, tail->eval(state));
+}
+
+/*
+ * Implementation notes: isStringName, isStringExpression
+ * ------------------------------------------------------
+ * The operands of a compound expression have the same type, which the
+ * parser has checked, so the left one decides.
+ */
+
+bool isStringName(const string & name) {
+   return !name.empty() && name[name.length() - 1] == '$';
+}
+
+bool isStringExpression(Expression *exp) {
+   switch (exp->getType()) {
+    case CONSTANT:
+      return ((ConstantExp *) exp)->getValue().isString();
+    case IDENTIFIER:
+      return isStringName(((IdentifierExp *) exp)->getName());
+    case COMPOUND:
+      return isStringExpression(((CompoundExp *) exp)->getLHS());
+    case CALL:
+      return ((CallExp *) exp)->getFunction() != FN_LEN;
+    case CACHED:
+      return isStringExpression(((CachedExp *) exp)->getExp());
+    case FLAT:
+      return isStringExpression(((FlatExp *) exp)->getTree());
+    default:
+      return false;
+   }
+}
+
+/*
+ * Implementation notes: findFunction, getFunctionName, callFunction
+ * -----------------------------------------------------------------
+ * The parser has checked the types of the arguments, but the values of
+ * a restored checkpoint have not been, so the string argument is tested
+ * again.  MID$ without a length runs to the end of the string.
+ */
+
+int findFunction(string name) {
+   name = toUpperCase(name);
+   for (int i = 0; i < FUNCTION_COUNT; i++) {
+      if (name == FUNCTION_NAMES[i]) return i;
+   }
+   return -1;
+}
+
+string getFunctionName(StringFunction function) {
+   return FUNCTION_NAMES[function];
+}
+
+Value callFunction(StringFunction function, const Value *args, int count) {
+   if (!args[0].isString()) error("Type mismatch");
+   switch (function) {
+    case FN_LEN:
+      return Value(args[0].getLength());
+    case FN_LEFT:
+      return leftString(args[0], checkInteger(args[1], "String length"));
+    case FN_RIGHT:
+      return rightString(args[0], checkInteger(args[1], "String length"));
+    case FN_MID: {
+      long long start = checkInteger(args[1], "String position");
+      long long n = LLONG_MAX;
+      if (count == 3) n = checkInteger(args[2], "String length");
+      return midString(args[0], start, n);
+    }
+   }
+   error("Illegal function in expression");
+   return Value();
+}
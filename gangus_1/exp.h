@@ -9,16 +9,31 @@
 #ifndef _exp_h
 #define _exp_h
 
+#include <string>
 #include "evalstate.h"
+#include "value.h"
+#include "vector.h"
 
 /*
  * Type: ExpressionType
  * --------------------
- * This enumerated type is used to differentiate the three different
- * expression types: CONSTANT, IDENTIFIER, and COMPOUND.
+ * This enumerated type is used to differentiate the expression types:
+ * CONSTANT, IDENTIFIER, COMPOUND, INDEX, ARRAY and CALL, which the
+ * parser creates, CACHED, which only the optimizer creates, and FLAT,
+ * the array form that compiled programs evaluate (see flatexp.h).
  */
 
-enum ExpressionType { CONSTANT, IDENTIFIER, COMPOUND };
+enum ExpressionType { CONSTANT, IDENTIFIER, COMPOUND, CACHED, FLAT, INDEX, ARRAY,
+                      CALL };
+
+/*
+ * Type: StringFunction
+ * --------------------
+ * The built-in functions, which work on strings.  LEN returns a number
+ * and the others return strings.
+ */
+
+enum StringFunction { FN_LEN, FN_LEFT, FN_RIGHT, FN_MID };
 
 /*
  * Class: Expression
@@ -29,9 +44,12 @@ enum ExpressionType { CONSTANT, IDENTIFIER, COMPOUND };
  * objects of its own.  Any object must be one of the three
  * concrete subclasses of Expression:
  *
- *  1. ConstantExp   -- an integer constant
+ *  1. ConstantExp   -- an integer or real constant
  *  2. IdentifierExp -- a string representing an identifier
  *  3. CompoundExp   -- two expressions combined by an operator
+ *  4. IndexExp      -- one checked subscript of an array element
+ *  5. ArrayExp      -- an array element
+ *  6. CallExp       -- a call of a built-in function
  *
  * The Expression class defines the interface common to all
  * Expression objects; each subclass provides its own specific
@@ -69,13 +87,13 @@ public:
 
 /*
  * Method: eval
- * Usage: int value = exp->eval(state);
- * ------------------------------------
+ * Usage: Value value = exp->eval(state);
+ * --------------------------------------
  * Evaluates this expression and returns its value in the context of
  * the specified EvalState object.
  */
 
-   virtual int eval(EvalState & state) = 0;
+   virtual Value eval(EvalState & state) = 0;
 
 /*
  * Method: toString
@@ -101,7 +119,8 @@ public:
 /*
  * Class: ConstantExp
  * ------------------
- * This subclass represents a constant integer expression.
+ * This subclass represents a constant, which is an integer, a real
+ * number or a string.
  */
 
 class ConstantExp: public Expression {
@@ -112,11 +131,11 @@ public:
  * Constructor: ConstantExp
  * Usage: Expression *exp = new ConstantExp(value);
  * ------------------------------------------------
- * The constructor initializes a new integer constant expression
- * to the given value.
+ * The constructor initializes a new constant expression to the given
+ * value.
  */
 
-   ConstantExp(int value);
+   ConstantExp(Value value);
 
 /*
  * Prototypes for the virtual methods
@@ -125,23 +144,23 @@ public:
  * base class and don't require additional documentation.
  */
 
-   virtual int eval(EvalState & state);
+   virtual Value eval(EvalState & state);
    virtual std::string toString();
    virtual ExpressionType getType();
 
 /*
  * Method: getValue
- * Usage: int value = ((ConstantExp *) exp)->getValue();
- * -----------------------------------------------------
+ * Usage: Value value = ((ConstantExp *) exp)->getValue();
+ * -------------------------------------------------------
  * Returns the value field without calling eval and can be applied
  * only to an object known to be a ConstantExp.
  */
 
-   int getValue();
+   Value getValue();
 
 private:
 
-   int value;
+   Value value;
 
 };
 
@@ -172,7 +191,7 @@ public:
  * base class and don't require additional documentation.
  */
 
-   virtual int eval(EvalState & state);
+   virtual Value eval(EvalState & state);
    virtual std::string toString();
    virtual ExpressionType getType();
 
@@ -186,9 +205,63 @@ public:
 
    std::string getName();
 
-private:
+/*
+ * Methods: isChecked, setChecked
+ * Usage: if (var->isChecked()) . . .
+ *        var->setChecked(false);
+ * ----------------------------------
+ * These methods read and set the checked flag, which is initially true.
+ * While it is set, eval raises an error if the variable is undefined.
+ * The compiler clears it for reads that every path to them has already
+ * assigned, so that those reads skip the check.
+ */
+
+   bool isChecked();
+   void setChecked(bool flag);
+
+/*
+ * Methods: isInteger, setInteger
+ * Usage: if (var->isInteger()) . . .
+ *        var->setInteger(true);
+ * ----------------------------------
+ * These methods read and set the integer flag, which is initially
+ * false.  The compiler sets it for reads of a variable that the program
+ * only ever assigns integers (see inferIntegerVariables in analysis.h),
+ * which lets flattened expressions read the variable without testing
+ * its type.
+ */
+
+   bool isInteger();
+   void setInteger(bool flag);
+
+/*
+ * Method: assign
+ * Usage: var->assign(state, value);
+ * ---------------------------------
+ * Stores value in the variable, which is how LET and INPUT assign.
+ */
+
+   virtual void assign(EvalState & state, Value value);
+
+/*
+ * Method: append
+ * Usage: var->append(state, tail, checked);
+ * -----------------------------------------
+ * Evaluates tail and adds it to the end of the string in the variable,
+ * which is how LET V$ = V$ + tail assigns.  The variable keeps its
+ * buffer when nothing else holds it, so a loop that builds a string
+ * does not copy it on every pass.  If checked is true, an undefined
+ * variable raises an error before tail is evaluated, as reading it
+ * would.
+ */
+
+   virtual void append(EvalState & state, Expression *tail, bool checked);
+
+protected:
 
    std::string name;
+   bool checked;
+   bool integer;
 
 };
 
@@ -222,7 +295,7 @@ public:
  */
 
    virtual ~CompoundExp();
-   virtual int eval(EvalState & state);
+   virtual Value eval(EvalState & state);
    virtual std::string toString();
    virtual ExpressionType getType();
 
@@ -240,11 +313,382 @@ public:
    Expression *getLHS();
    Expression *getRHS();
 
-private:
+/*
+ * Methods: setLHS, setRHS
+ * Usage: ((CompoundExp *) exp)->setLHS(lhs);
+ * ------------------------------------------
+ * These methods replace a subexpression without freeing the old one,
+ * which is how the optimizer rewrites trees in place.
+ */
+
+   void setLHS(Expression *lhs);
+   void setRHS(Expression *rhs);
+
+protected:
 
    std::string op;
    Expression *lhs, *rhs;
 
 };
 
+/*
+ * Class: IndexExp
+ * ---------------
+ * This subclass checks one subscript of an array element against the
+ * dimensions of the array and scales it to an offset into the elements.
+ * The parser builds an ArrayExp on one IndexExp per subscript.  Having
+ * the check in a node of its own lets the optimizer cache it like any
+ * other subexpression, so that a loop over the columns of a row checks
+ * the row subscript once rather than on every pass.
+ */
+
+class IndexExp: public Expression {
+
+public:
+
+/*
+ * Constructor: IndexExp
+ * Usage: Expression *exp = new IndexExp(array, position, subscript);
+ * ------------------------------------------------------------------
+ * Creates the check of subscript, which the new node owns, as the
+ * subscript at position (see evalstate.h) of the named array.
+ */
+
+   IndexExp(std::string array, int position, Expression *subscript);
+
+/*
+ * Prototypes for the virtual methods
+ * ----------------------------------
+ * These methods have the same prototypes as those in the Expression
+ * base class and don't require additional documentation.  The toString
+ * method uses square brackets, with * for the other subscript of a
+ * two-dimensional array, since the node stands for an offset rather
+ * than an element.
+ */
+
+   virtual ~IndexExp();
+   virtual Value eval(EvalState & state);
+   virtual std::string toString();
+   virtual ExpressionType getType();
+
+/*
+ * Methods: getArray, getPosition, getSubscript, setSubscript
+ * Usage: Expression *subscript = ((IndexExp *) exp)->getSubscript();
+ * ------------------------------------------------------------------
+ * These methods return the parts of the node.  setSubscript replaces
+ * the subscript without freeing the old one.
+ */
+
+   std::string getArray();
+   int getPosition();
+   Expression *getSubscript();
+   void setSubscript(Expression *subscript);
+
+private:
+
+   std::string array;
+   int position;
+   Expression *subscript;
+
+};
+
+/*
+ * Class: ArrayExp
+ * ---------------
+ * This subclass represents an element of an array, which is read in an
+ * expression and assigned on the left of LET.  Its first and second
+ * subexpressions give the offsets of its subscripts, usually as IndexExp
+ * nodes; an element of a one-dimensional array has no second.
+ */
+
+class ArrayExp: public Expression {
+
+public:
+
+/*
+ * Constructor: ArrayExp
+ * Usage: ArrayExp *exp = new ArrayExp(name, first, second);
+ * ---------------------------------------------------------
+ * Creates an element of the named array from the offsets of its
+ * subscripts, which the new node owns.  The second may be NULL.
+ */
+
+   ArrayExp(std::string name, Expression *first, Expression *second);
+
+/*
+ * Prototypes for the virtual methods
+ * ----------------------------------
+ * These methods have the same prototypes as those in the Expression
+ * base class and don't require additional documentation.
+ */
+
+   virtual ~ArrayExp();
+   virtual Value eval(EvalState & state);
+   virtual std::string toString();
+   virtual ExpressionType getType();
+
+/*
+ * Methods: getName, getFirst, getSecond, setFirst, setSecond
+ * Usage: Expression *first = ((ArrayExp *) exp)->getFirst();
+ * ----------------------------------------------------------
+ * These methods return and replace the parts of the element.  The set
+ * methods do not free the old subexpression.
+ */
+
+   std::string getName();
+   Expression *getFirst();
+   Expression *getSecond();
+   void setFirst(Expression *first);
+   void setSecond(Expression *second);
+
+/*
+ * Method: assign
+ * Usage: element->assign(state, value);
+ * -------------------------------------
+ * Stores value in the element, which is how LET assigns to one.  The
+ * elements of arrays are integers, so a real value raises an error.
+ */
+
+   void assign(EvalState & state, Value value);
+
+/*
+ * Method: link
+ * Usage: element->link(state);
+ * ----------------------------
+ * Resolves the array to its slot in state, so that eval and assign no
+ * longer look the name up.  An unlinked element looks it up every time.
+ */
+
+   void link(EvalState & state);
+
+private:
+
+   std::string name;
+   Expression *first;
+   Expression *second;
+   int slot;
+
+};
+
+/*
+ * Class: CallExp
+ * --------------
+ * This subclass represents a call of one of the built-in functions.
+ * The parser checks the number and the types of the arguments.
+ */
+
+class CallExp: public Expression {
+
+public:
+
+/*
+ * Constructor: CallExp
+ * Usage: Expression *exp = new CallExp(function, args);
+ * -----------------------------------------------------
+ * Creates a call of function on args, which the new node owns.
+ */
+
+   CallExp(StringFunction function, Vector<Expression *> args);
+
+/*
+ * Prototypes for the virtual methods
+ * ----------------------------------
+ * These methods have the same prototypes as those in the Expression
+ * base class and don't require additional documentation.
+ */
+
+   virtual ~CallExp();
+   virtual Value eval(EvalState & state);
+   virtual std::string toString();
+   virtual ExpressionType getType();
+
+/*
+ * Methods: getFunction, getArgCount, getArg, setArg
+ * Usage: Expression *arg = ((CallExp *) exp)->getArg(0);
+ * ------------------------------------------------------
+ * These methods return the parts of the call.  setArg replaces an
+ * argument without freeing the old one.
+ */
+
+   StringFunction getFunction();
+   int getArgCount();
+   Expression *getArg(int index);
+   void setArg(int index, Expression *arg);
+
+private:
+
+   StringFunction function;
+   Vector<Expression *> args;
+
+};
+
+/*
+ * Type: CacheSlot
+ * ---------------
+ * The storage for one cached value.  The value is current while stamp
+ * equals the epoch counter that the slot is checked against.
+ */
+
+struct CacheSlot {
+   unsigned stamp;
+   Value value;
+};
+
+/*
+ * Class: CachedExp
+ * ----------------
+ * This subclass wraps a subexpression whose value the optimizer has
+ * shown can be reused.  CachedExp nodes that wrap identical
+ * subexpressions share one slot, so whichever is evaluated first fills
+ * it and the others reuse the value until the epoch counter moves on.
+ * Filling the slot lazily, rather than ahead of time, means that an
+ * expression that raises an error is still evaluated only where the
+ * original program evaluated it.
+ */
+
+class CachedExp: public Expression {
+
+public:
+
+/*
+ * Constructor: CachedExp
+ * Usage: Expression *exp = new CachedExp(exp, slot, epoch, refresh);
+ * ------------------------------------------------------------------
+ * Wraps exp, which the new node owns, so that its value is kept in
+ * slot.  If refresh is true, the node always evaluates exp and stores
+ * the result, which is how the first occurrence in a basic block
+ * starts a new lifetime for the value.
+ */
+
+   CachedExp(Expression *exp, CacheSlot *slot, unsigned *epoch, bool refresh);
+
+/*
+ * Prototypes for the virtual methods
+ * ----------------------------------
+ * These methods have the same prototypes as those in the Expression
+ * base class and don't require additional documentation.  The toString
+ * method shows the wrapped expression unchanged.
+ */
+
+   virtual ~CachedExp();
+   virtual Value eval(EvalState & state);
+   virtual std::string toString();
+   virtual ExpressionType getType();
+
+/*
+ * Method: getExp
+ * Usage: Expression *exp = ((CachedExp *) exp)->getExp();
+ * -------------------------------------------------------
+ * Returns the wrapped subexpression.
+ */
+
+   Expression *getExp();
+
+/*
+ * Method: setExp
+ * Usage: ((CachedExp *) exp)->setExp(exp);
+ * ----------------------------------------
+ * Replaces the wrapped subexpression without freeing the old one.
+ */
+
+   void setExp(Expression *exp);
+
+/*
+ * Methods: getSlot, getEpoch, isRefresh
+ * Usage: CacheSlot *slot = ((CachedExp *) exp)->getSlot();
+ * --------------------------------------------------------
+ * Return the arguments the node was created with.
+ */
+
+   CacheSlot *getSlot();
+   unsigned *getEpoch();
+   bool isRefresh();
+
+private:
+
+   Expression *exp;
+   CacheSlot *slot;
+   unsigned *epoch;
+   bool refresh;
+
+};
+
+/*
+ * Class: SlotExp
+ * --------------
+ * This subclass is the specialized form of IdentifierExp that the
+ * optimized tier uses.  The variable is resolved to a slot in the
+ * EvalState once, when the compiled program is linked to the state, so
+ * reading and assigning it cost an index instead of a name lookup.
+ */
+
+class SlotExp: public IdentifierExp {
+
+public:
+
+/*
+ * Constructor: SlotExp
+ * Usage: SlotExp *var = new SlotExp(name, checked);
+ * -------------------------------------------------
+ * Creates an unlinked slot reference for the named variable.
+ */
+
+   SlotExp(std::string name, bool checked);
+
+/*
+ * Method: link
+ * Usage: var->link(state);
+ * ------------------------
+ * Resolves the variable to its slot in state, which must be done before
+ * the expression is evaluated in that state.
+ */
+
+   void link(EvalState & state);
+
+/*
+ * Prototypes for the virtual methods
+ * ----------------------------------
+ * These methods have the same prototypes as those in IdentifierExp and
+ * don't require additional documentation.
+ */
+
+   virtual Value eval(EvalState & state);
+   virtual void assign(EvalState & state, Value value);
+   virtual void append(EvalState & state, Expression *tail, bool checked);
+
+private:
+
+   int slot;
+
+};
+
+/*
+ * Functions: isStringName, isStringExpression
+ * Usage: if (isStringExpression(exp)) . . .
+ * -----------------------------------------
+ * A variable whose name ends in $ holds a string, and every other
+ * variable a number.  An expression is a string if it is a string
+ * constant, a string variable, a concatenation or a call of a function
+ * that returns a string.  The parser uses these to check types, so an
+ * expression never mixes strings and numbers.
+ */
+
+bool isStringName(const std::string & name);
+bool isStringExpression(Expression *exp);
+
+/*
+ * Functions: findFunction, getFunctionName, callFunction
+ * Usage: int function = findFunction(name);
+ *        Value result = callFunction(FN_LEFT, args, 2);
+ * ---------------------------------------------------
+ * findFunction returns the built-in function with the name, in any
+ * case, or -1 if there is none.  callFunction applies a function to its
+ * evaluated arguments, which is the part CallExp and the flattened form
+ * share.
+ */
+
+int findFunction(std::string name);
+std::string getFunctionName(StringFunction function);
+Value callFunction(StringFunction function, const Value *args, int count);
+
 #endif
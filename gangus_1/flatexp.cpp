@@ -0,0 +1,640 @@
+/*
+ * File: flatexp.cpp
+ * -----------------
+ * This file implements the flatexp.h interface.
+ */
+
+#include <climits>
+#include <string>
+#include <vector>
+#include "error.h"
+#include "evalstate.h"
+#include "exp.h"
+#include "flatexp.h"
+#include "stats.h"
+#include "stringvalue.h"
+#include "vector.h"
+using namespace std;
+
+/*
+ * Constants: SMALL_STACK, SMALL_VALUE_STACK
+ * -----------------------------------------
+ * Expressions that need no more stack than this evaluate on the C++
+ * stack; deeper ones, which only generated programs have, use the heap.
+ * A Value has a constructor and a destructor, so every element of the
+ * value stack costs something on each call whether it is used or not,
+ * and that stack is kept short.
+ */
+
+static const int SMALL_STACK = 32;
+static const int SMALL_VALUE_STACK = 8;
+
+/*
+ * Implementation notes: FlatExp constructor
+ * -----------------------------------------
+ * The nodes are collected in a Vector while the tree is walked and then
+ * copied to plain arrays, which is what eval reads.  The depth is found
+ * by running the stack pointer over the code without evaluating, taking
+ * every cache test as a miss.
+ */
+
+FlatExp::FlatExp(Expression *tree) {
+   view = NULL;
+   integer = emit(tree);
+   length = code.size();
+   nodes = new ExpNode[length];
+   for (int i = 0; i < length; i++) {
+      nodes[i] = code[i];
+   }
+   code.clear();
+   caches = new FlatCache[cacheTable.size() + 1];
+   for (int i = 0; i < cacheTable.size(); i++) {
+      caches[i] = cacheTable[i];
+   }
+   slots = new int[names.size() + 1];
+   for (int i = 0; i < names.size(); i++) {
+      slots[i] = -1;
+   }
+   arrays = new FlatArray[arrayTable.size() + 1];
+   for (int i = 0; i < arrayTable.size(); i++) {
+      arrays[i] = arrayTable[i];
+   }
+   calls = new FlatCall[callTable.size() + 1];
+   for (int i = 0; i < callTable.size(); i++) {
+      calls[i] = callTable[i];
+   }
+   depth = 0;
+   int sp = 0;
+   for (int i = 0; i < length; i++) {
+      switch (nodes[i].opcode) {
+       case FLAT_CONST: case FLAT_VALUE:
+       case FLAT_LOAD: case FLAT_LOAD_CHECKED:
+         sp++;
+         break;
+       case FLAT_CACHE_TEST: case FLAT_CACHE_STORE:
+       case FLAT_INDEX: case FLAT_ELEMENT:
+         break;
+       case FLAT_CALL:
+         sp -= calls[nodes[i].operand].count - 1;
+         break;
+       default:
+         sp--;
+         break;
+      }
+      if (sp > depth) depth = sp;
+   }
+}
+
+FlatExp::~FlatExp() {
+   delete[] nodes;
+   delete[] caches;
+   delete[] slots;
+   delete[] arrays;
+   delete[] calls;
+   delete view;
+}
+
+/*
+ * Implementation notes: emit
+ * --------------------------
+ * emit returns true if the subexpression it emitted can run on
+ * integers: every value in it, down to the subscripts, must be an
+ * integer.  A constant that does not fit in the operand of a node goes
+ * in the table of constants.  The arguments of a call are strings, so a
+ * call stops the expression from running on integers, even LEN.
+ */
+
+bool FlatExp::emit(Expression *exp) {
+   ExpNode node;
+   switch (exp->getType()) {
+    case CONSTANT: {
+      Value value = ((ConstantExp *) exp)->getValue();
+      if (value.isInteger() && value.getInteger() == (int) value.getInteger()) {
+         node.opcode = FLAT_CONST;
+         node.operand = value.getInteger();
+      } else {
+         node.opcode = FLAT_VALUE;
+         node.operand = constants.size();
+         constants.add(value);
+      }
+      code.add(node);
+      return value.isInteger() || value.isBig();
+    }
+    case IDENTIFIER: {
+      IdentifierExp *var = (IdentifierExp *) exp;
+      node.opcode = var->isChecked() ? FLAT_LOAD_CHECKED : FLAT_LOAD;
+      node.operand = -1;
+      for (int i = 0; i < names.size(); i++) {
+         if (names[i] == var->getName()) node.operand = i;
+      }
+      if (node.operand == -1) {
+         node.operand = names.size();
+         names.add(var->getName());
+         integers.add(var->isInteger());
+      }
+      code.add(node);
+      return integers[node.operand];
+    }
+    case COMPOUND: {
+      CompoundExp *compound = (CompoundExp *) exp;
+      bool lhs = emit(compound->getLHS());
+      bool rhs = emit(compound->getRHS());
+      string op = compound->getOp();
+      node.operand = 0;
+      if (op == "+") {
+         node.opcode = FLAT_ADD;
+      } else if (op == "-") {
+         node.opcode = FLAT_SUB;
+      } else if (op == "*") {
+         node.opcode = FLAT_MUL;
+      } else if (op == "/") {
+         node.opcode = FLAT_DIV;
+      } else {
+         node.opcode = FLAT_ILLEGAL;
+         node.operand = ops.size();
+         ops.add(op);
+      }
+      code.add(node);
+      return lhs && rhs && node.opcode != FLAT_ILLEGAL;
+    }
+    case CACHED: {
+      CachedExp *cached = (CachedExp *) exp;
+      FlatCache cache;
+      cache.slot = cached->getSlot();
+      cache.epoch = cached->getEpoch();
+      cache.refresh = cached->isRefresh();
+      int index = cacheTable.size();
+      cacheTable.add(cache);
+      node.opcode = FLAT_CACHE_TEST;
+      node.operand = index;
+      int test = code.size();
+      code.add(node);
+      bool result = emit(cached->getExp());
+      node.opcode = FLAT_CACHE_STORE;
+      code.add(node);
+      cacheTable[index].skip = code.size() - 1 - test;
+      return result;
+    }
+    case INDEX: {
+      IndexExp *index = (IndexExp *) exp;
+      bool subscript = emit(index->getSubscript());
+      node.opcode = FLAT_INDEX;
+      node.operand = addArray(index->getArray(), index->getPosition());
+      code.add(node);
+      return subscript;
+    }
+    case ARRAY: {
+      ArrayExp *element = (ArrayExp *) exp;
+      bool offsets = emit(element->getFirst());
+      node.opcode = FLAT_ELEMENT;
+      if (element->getSecond() != NULL) {
+         if (!emit(element->getSecond())) offsets = false;
+         node.opcode = FLAT_ELEMENT2;
+      }
+      node.operand = addArray(element->getName(), -1);
+      code.add(node);
+      return offsets;
+    }
+    case CALL: {
+      CallExp *call = (CallExp *) exp;
+      for (int i = 0; i < call->getArgCount(); i++) {
+         emit(call->getArg(i));
+      }
+      FlatCall entry;
+      entry.function = call->getFunction();
+      entry.count = call->getArgCount();
+      node.opcode = FLAT_CALL;
+      node.operand = callTable.size();
+      callTable.add(entry);
+      code.add(node);
+      return false;
+    }
+    default:
+      error("Cannot flatten expression " + exp->toString());
+      return false;
+   }
+}
+
+int FlatExp::addArray(string name, int position) {
+   for (int i = 0; i < arrayTable.size(); i++) {
+      if (arrayTable[i].name == name && arrayTable[i].position == position) {
+         return i;
+      }
+   }
+   FlatArray array;
+   array.name = name;
+   array.slot = -1;
+   array.position = position;
+   arrayTable.add(array);
+   return arrayTable.size() - 1;
+}
+
+/*
+ * Implementation notes: eval
+ * --------------------------
+ * The loop keeps the stack pointer and the node count in registers.
+ * Errors are raised at the same point and with the same message as in
+ * the tree evaluator, and every value node counts as one expression in
+ * the statistics, as every tree node does.  A subscript check is made
+ * inline, and only a failed one calls EvalState::getOffset, to raise
+ * the error.
+ *
+ * An integer expression starts in evalIntegers, on 64-bit integers,
+ * and the others run in evalValues, which has the same cases on values.
+ * evalIntegers stops before any node it cannot finish on integers: an
+ * operation that overflows, or a variable, constant or cached value
+ * that is not a 64-bit integer.  It then returns the index of that
+ * node, and evalValues carries on from there with the stack and the
+ * count so far, so nothing is evaluated or counted twice.
+ */
+
+Value FlatExp::eval(EvalState & state) {
+   if (!integer) return evalValues(state, 0, NULL, 0, 0);
+   long long small[SMALL_STACK];
+   vector<long long> large;
+   long long *stack = small;
+   if (depth > SMALL_STACK) {
+      large.resize(depth);
+      stack = large.data();
+   }
+   int sp;
+   int counted;
+   int pc = evalIntegers(state, stack, sp, counted);
+   if (pc == length) return Value(stack[0]);
+   return evalValues(state, pc, stack, sp, counted);
+}
+
+int FlatExp::evalIntegers(EvalState & state, long long *stack,
+                          int & top, int & count) {
+   int sp = 0;
+   int counted = 0;
+   for (int pc = 0; pc < length; pc++) {
+      const ExpNode & node = nodes[pc];
+      switch (node.opcode) {
+       case FLAT_CONST:
+         stack[sp++] = node.operand;
+         counted++;
+         break;
+       case FLAT_VALUE: {
+         const Value & value = constants[node.operand];
+         if (!value.isInteger()) {
+            top = sp;
+            count = counted;
+            return pc;
+         }
+         stack[sp++] = value.getInteger();
+         counted++;
+         break;
+       }
+       case FLAT_LOAD: {
+         const Value & value = state.getSlotValue(slots[node.operand]);
+         if (!value.isInteger()) {
+            top = sp;
+            count = counted;
+            return pc;
+         }
+         stack[sp++] = value.getInteger();
+         counted++;
+         break;
+       }
+       case FLAT_LOAD_CHECKED: {
+         int slot = slots[node.operand];
+         if (!state.isSlotDefined(slot)) {
+            countStat(STAT_EXPRESSIONS, counted + 1);
+            error(names[node.operand] + " is undefined");
+         }
+         const Value & value = state.getSlotValue(slot);
+         if (!value.isInteger()) {
+            top = sp;
+            count = counted;
+            return pc;
+         }
+         stack[sp++] = value.getInteger();
+         counted++;
+         break;
+       }
+       case FLAT_ADD:
+       case FLAT_SUB:
+       case FLAT_MUL: {
+         long long result;
+         bool overflow;
+         if (node.opcode == FLAT_ADD) {
+            overflow = __builtin_add_overflow(stack[sp - 2], stack[sp - 1], &result);
+         } else if (node.opcode == FLAT_SUB) {
+            overflow = __builtin_sub_overflow(stack[sp - 2], stack[sp - 1], &result);
+         } else {
+            overflow = __builtin_mul_overflow(stack[sp - 2], stack[sp - 1], &result);
+         }
+         if (overflow) {
+            top = sp;
+            count = counted;
+            return pc;
+         }
+         sp--;
+         stack[sp - 1] = result;
+         counted++;
+         break;
+       }
+       case FLAT_DIV:
+         if (stack[sp - 1] == 0) {
+            countStat(STAT_EXPRESSIONS, counted + 1);
+            error("Division by zero");
+         }
+         if (stack[sp - 1] == -1 && stack[sp - 2] == LLONG_MIN) {
+            top = sp;
+            count = counted;
+            return pc;
+         }
+         sp--;
+         stack[sp - 1] = stack[sp - 1] / stack[sp];
+         counted++;
+         break;
+       case FLAT_ILLEGAL:
+         countStat(STAT_EXPRESSIONS, counted + 1);
+         error("Illegal operator in expression");
+         break;
+       case FLAT_CACHE_TEST: {
+         FlatCache & cache = caches[node.operand];
+         if (!cache.refresh && cache.slot->stamp == *cache.epoch) {
+            const Value & value = cache.slot->value;
+            if (!value.isInteger()) {
+               top = sp;
+               count = counted;
+               return pc;
+            }
+            stack[sp++] = value.getInteger();
+            pc += cache.skip;
+            counted++;
+         }
+         break;
+       }
+       case FLAT_CACHE_STORE: {
+         FlatCache & cache = caches[node.operand];
+         cache.slot->value = Value(stack[sp - 1]);
+         cache.slot->stamp = *cache.epoch;
+         break;
+       }
+       case FLAT_INDEX: {
+         FlatArray & array = arrays[node.operand];
+         ArrayStorage & storage = state.getArray(array.slot);
+         long long subscript = stack[sp - 1];
+         if ((unsigned long long) subscript
+             >= (unsigned long long) storage.extent[array.position]) {
+            countStat(STAT_EXPRESSIONS, counted + 1);
+            state.getOffset(array.slot, array.position, subscript);
+         }
+         stack[sp - 1] = subscript * storage.stride[array.position];
+         counted++;
+         break;
+       }
+       case FLAT_ELEMENT:
+         stack[sp - 1] = state.getElement(arrays[node.operand].slot,
+                                          (int) stack[sp - 1]);
+         counted++;
+         break;
+       case FLAT_ELEMENT2:
+         sp--;
+         stack[sp - 1] = state.getElement(arrays[node.operand].slot,
+                                          (int) (stack[sp - 1] + stack[sp]));
+         counted++;
+         break;
+      }
+   }
+   countStat(STAT_EXPRESSIONS, counted);
+   return length;
+}
+
+Value FlatExp::evalValues(EvalState & state, int start,
+                          const long long *prefix, int sp, int counted) {
+   Value small[SMALL_VALUE_STACK];
+   vector<Value> large;
+   Value *stack = small;
+   if (depth > SMALL_VALUE_STACK) {
+      large.resize(depth);
+      stack = large.data();
+   }
+   for (int i = 0; i < sp; i++) {
+      stack[i] = Value(prefix[i]);
+   }
+   for (int pc = start; pc < length; pc++) {
+      const ExpNode & node = nodes[pc];
+      switch (node.opcode) {
+       case FLAT_CONST:
+         stack[sp++] = Value(node.operand);
+         counted++;
+         break;
+       case FLAT_VALUE:
+         stack[sp++] = constants[node.operand];
+         counted++;
+         break;
+       case FLAT_LOAD:
+         stack[sp++] = state.getSlotValue(slots[node.operand]);
+         counted++;
+         break;
+       case FLAT_LOAD_CHECKED: {
+         int slot = slots[node.operand];
+         if (!state.isSlotDefined(slot)) {
+            countStat(STAT_EXPRESSIONS, counted + 1);
+            error(names[node.operand] + " is undefined");
+         }
+         stack[sp++] = state.getSlotValue(slot);
+         counted++;
+         break;
+       }
+       case FLAT_ADD:
+         sp--;
+         if (stack[sp - 1].isString()) {
+            appendString(stack[sp - 1], stack[sp]);
+         } else {
+            stack[sp - 1] = addValues(stack[sp - 1], stack[sp]);
+         }
+         counted++;
+         break;
+       case FLAT_SUB:
+         sp--;
+         stack[sp - 1] = subtractValues(stack[sp - 1], stack[sp]);
+         counted++;
+         break;
+       case FLAT_MUL:
+         sp--;
+         stack[sp - 1] = multiplyValues(stack[sp - 1], stack[sp]);
+         counted++;
+         break;
+       case FLAT_DIV:
+         sp--;
+         if (stack[sp].toReal() == 0) {
+            countStat(STAT_EXPRESSIONS, counted + 1);
+            error("Division by zero");
+         }
+         stack[sp - 1] = divideValues(stack[sp - 1], stack[sp]);
+         counted++;
+         break;
+       case FLAT_ILLEGAL:
+         countStat(STAT_EXPRESSIONS, counted + 1);
+         error("Illegal operator in expression");
+         break;
+       case FLAT_CACHE_TEST: {
+         FlatCache & cache = caches[node.operand];
+         if (!cache.refresh && cache.slot->stamp == *cache.epoch) {
+            stack[sp++] = cache.slot->value;
+            pc += cache.skip;
+            counted++;
+         }
+         break;
+       }
+       case FLAT_CACHE_STORE: {
+         FlatCache & cache = caches[node.operand];
+         cache.slot->value = stack[sp - 1];
+         cache.slot->stamp = *cache.epoch;
+         break;
+       }
+       case FLAT_INDEX: {
+         FlatArray & array = arrays[node.operand];
+         ArrayStorage & storage = state.getArray(array.slot);
+         if (!stack[sp - 1].isInteger()) {
+            countStat(STAT_EXPRESSIONS, counted + 1);
+            checkInteger(stack[sp - 1], "Subscript");
+         }
+         long long subscript = stack[sp - 1].getInteger();
+         if ((unsigned long long) subscript
+             >= (unsigned long long) storage.extent[array.position]) {
+            countStat(STAT_EXPRESSIONS, counted + 1);
+            state.getOffset(array.slot, array.position, subscript);
+         }
+         stack[sp - 1] = Value((int) subscript * storage.stride[array.position]);
+         counted++;
+         break;
+       }
+       case FLAT_ELEMENT:
+         stack[sp - 1] = Value(state.getElement(arrays[node.operand].slot,
+                                                (int) stack[sp - 1].getInteger()));
+         counted++;
+         break;
+       case FLAT_ELEMENT2:
+         sp--;
+         stack[sp - 1] = Value(state.getElement(arrays[node.operand].slot,
+                                                (int) (stack[sp - 1].getInteger()
+                                                       + stack[sp].getInteger())));
+         counted++;
+         break;
+       case FLAT_CALL: {
+         const FlatCall & call = calls[node.operand];
+         sp -= call.count - 1;
+         stack[sp - 1] = callFunction(call.function, stack + sp - 1, call.count);
+         counted++;
+         break;
+       }
+      }
+   }
+   countStat(STAT_EXPRESSIONS, counted);
+   return stack[0];
+}
+
+string FlatExp::toString() {
+   return getTree()->toString();
+}
+
+ExpressionType FlatExp::getType() {
+   return FLAT;
+}
+
+void FlatExp::link(EvalState & state) {
+   for (int i = 0; i < names.size(); i++) {
+      slots[i] = state.getSlot(names[i]);
+   }
+   for (int i = 0; i < arrayTable.size(); i++) {
+      arrays[i].slot = state.getArraySlot(arrays[i].name);
+   }
+}
+
+int FlatExp::size() {
+   return length;
+}
+
+bool FlatExp::isInteger() {
+   return integer;
+}
+
+/*
+ * Implementation notes: getTree, build
+ * ------------------------------------
+ * In postorder the root is the last node and an operator's right
+ * operand ends just before it, so build reads the array backward.
+ */
+
+Expression *FlatExp::getTree() {
+   if (view == NULL) {
+      int pos = length - 1;
+      view = build(pos);
+   }
+   return view;
+}
+
+Expression *FlatExp::build(int & pos) {
+   const ExpNode & node = nodes[pos--];
+   switch (node.opcode) {
+    case FLAT_CONST:
+      return new ConstantExp(Value(node.operand));
+    case FLAT_VALUE:
+      return new ConstantExp(constants[node.operand]);
+    case FLAT_LOAD:
+    case FLAT_LOAD_CHECKED: {
+      IdentifierExp *var = new IdentifierExp(names[node.operand]);
+      var->setChecked(node.opcode == FLAT_LOAD_CHECKED);
+      var->setInteger(integers[node.operand]);
+      return var;
+    }
+    case FLAT_CACHE_STORE: {
+      Expression *exp = build(pos);
+      pos--;
+      return exp;
+    }
+    case FLAT_INDEX: {
+      const FlatArray & array = arrays[node.operand];
+      return new IndexExp(array.name, array.position, build(pos));
+    }
+    case FLAT_ELEMENT:
+      return new ArrayExp(arrays[node.operand].name, build(pos), NULL);
+    case FLAT_ELEMENT2: {
+      Expression *second = build(pos);
+      Expression *first = build(pos);
+      return new ArrayExp(arrays[node.operand].name, first, second);
+    }
+    case FLAT_CALL: {
+      const FlatCall & call = calls[node.operand];
+      Vector<Expression *> args(call.count, NULL);
+      for (int i = call.count - 1; i >= 0; i--) {
+         args[i] = build(pos);
+      }
+      return new CallExp(call.function, args);
+    }
+    default: {
+      Expression *rhs = build(pos);
+      Expression *lhs = build(pos);
+      string op;
+      switch (node.opcode) {
+       case FLAT_ADD: op = "+"; break;
+       case FLAT_SUB: op = "-"; break;
+       case FLAT_MUL: op = "*"; break;
+       case FLAT_DIV: op = "/"; break;
+       default: op = ops[node.operand]; break;
+      }
+      return new CompoundExp(op, lhs, rhs);
+    }
+   }
+}
+
+string FlatExp::getOp() {
+   if (getTree()->getType() != COMPOUND) error("Expression has no operator");
+   return ((CompoundExp *) getTree())->getOp();
+}
+
+Expression *FlatExp::getLHS() {
+   if (getTree()->getType() != COMPOUND) error("Expression has no operator");
+   return ((CompoundExp *) getTree())->getLHS();
+}
+
+Expression *FlatExp::getRHS() {
+   if (getTree()->getType() != COMPOUND) error("Expression has no operator");
+   return ((CompoundExp *) getTree())->getRHS();
+}
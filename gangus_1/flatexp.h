@@ -0,0 +1,235 @@
+/*
+ * File: flatexp.h
+ * ---------------
+ * This interface exports FlatExp, the form in which compiled programs
+ * store their expressions.  A parsed expression is a tree of separately
+ * allocated nodes, and evaluating it chases pointers all over the heap.
+ * A FlatExp holds the same expression as one contiguous array of
+ * fixed-size nodes in postorder, which eval runs as a loop over a small
+ * stack of values.  An expression that can only produce integers runs on
+ * a stack of 64-bit integers and only tests the type tags of the values
+ * it loads.
+ */
+
+#ifndef _flatexp_h
+#define _flatexp_h
+
+#include <string>
+#include "evalstate.h"
+#include "exp.h"
+#include "vector.h"
+
+/*
+ * Type: FlatOpcode
+ * ----------------
+ * The operations a flat node performs.  Each operator pops its operands
+ * and pushes its result.  FLAT_CACHE_TEST comes before a cached
+ * subexpression and, if the cached value is current, pushes it and
+ * skips the subexpression; FLAT_CACHE_STORE comes after it and stores
+ * its value.  The array nodes take an operand that indexes the table of
+ * arrays: FLAT_INDEX checks a subscript and turns it into an offset,
+ * and FLAT_ELEMENT and FLAT_ELEMENT2 load the element at the sum of
+ * their one or two offsets.  A constant that does not fit in the
+ * operand, a real number, a larger integer or a string, is pushed by
+ * FLAT_VALUE from the table of constants.  FLAT_CALL pops the arguments
+ * of a built-in function, which its operand finds in the table of calls,
+ * and pushes the result.
+ */
+
+enum FlatOpcode {
+   FLAT_CONST,           /* push the operand                          */
+   FLAT_VALUE,           /* push the constant with index operand      */
+   FLAT_LOAD,            /* push the variable with index operand      */
+   FLAT_LOAD_CHECKED,    /* the same, after checking it is defined    */
+   FLAT_ADD,
+   FLAT_SUB,
+   FLAT_MUL,
+   FLAT_DIV,
+   FLAT_ILLEGAL,         /* an operator the evaluator does not know   */
+   FLAT_CACHE_TEST,      /* operand is the index of the cache         */
+   FLAT_CACHE_STORE,
+   FLAT_INDEX,
+   FLAT_ELEMENT,
+   FLAT_ELEMENT2,
+   FLAT_CALL
+};
+
+/*
+ * Type: ExpNode
+ * -------------
+ * One node of a flat expression: an opcode byte and an operand, which
+ * is an immediate value or an index into one of the FlatExp's tables.
+ */
+
+struct ExpNode {
+   unsigned char opcode;
+   int operand;
+};
+
+/*
+ * Class: FlatExp
+ * --------------
+ * This subclass of Expression is built from a tree, which it does not
+ * take over; the caller usually deletes the tree afterward.  Variables
+ * are reached through slots, so a FlatExp must be linked to the
+ * EvalState it runs in.
+ *
+ * An expression made only of integer constants, variables marked as
+ * integers, array elements and the four operators, with subscripts made
+ * the same way, is an integer expression; a function call never is.  Its eval runs on 64-bit
+ * integers until a result overflows or a value it loads is not a 64-bit
+ * integer, and then finishes the expression on values, so the result is
+ * always right; but a variable marked as an integer that holds a real
+ * number costs that switch on every evaluation.  The other expressions
+ * evaluate on values and test their types as the tree evaluator does.
+ *
+ * Tools can still look at the expression as a tree: getTree builds one
+ * from the array the first time it is called, and getOp, getLHS and
+ * getRHS read the root of that tree.  Cached subexpressions appear in
+ * the tree without their CachedExp wrapper.
+ */
+
+class FlatExp: public Expression {
+
+public:
+
+/*
+ * Constructor: FlatExp
+ * Usage: FlatExp *flat = new FlatExp(tree);
+ * -----------------------------------------
+ * Flattens tree, which may contain CachedExp nodes but no FlatExp.
+ */
+
+   FlatExp(Expression *tree);
+
+/*
+ * Prototypes for the virtual methods
+ * ----------------------------------
+ * These methods have the same prototypes as those in the Expression
+ * base class and don't require additional documentation.
+ */
+
+   virtual ~FlatExp();
+   virtual Value eval(EvalState & state);
+   virtual std::string toString();
+   virtual ExpressionType getType();
+
+/*
+ * Method: link
+ * Usage: flat->link(state);
+ * -------------------------
+ * Resolves the variables and arrays of the expression to their slots in
+ * state.
+ */
+
+   void link(EvalState & state);
+
+/*
+ * Methods: getTree, getOp, getLHS, getRHS
+ * Usage: Expression *tree = flat->getTree();
+ *        Expression *lhs = flat->getLHS();
+ * ------------------------------------------
+ * These methods return views of the expression as a tree, which belong
+ * to the FlatExp.  The getOp, getLHS and getRHS methods can be applied
+ * only if the root of the expression is an operator.
+ */
+
+   Expression *getTree();
+   std::string getOp();
+   Expression *getLHS();
+   Expression *getRHS();
+
+/*
+ * Method: size
+ * Usage: int n = flat->size();
+ * ----------------------------
+ * Returns the number of nodes in the array.
+ */
+
+   int size();
+
+/*
+ * Method: isInteger
+ * Usage: if (flat->isInteger()) . . .
+ * -----------------------------------
+ * Returns true if this is an integer expression, which evaluates on
+ * 64-bit integers as long as they do not overflow.
+ */
+
+   bool isInteger();
+
+private:
+
+/*
+ * Type: FlatCache
+ * ---------------
+ * What a FLAT_CACHE_TEST or FLAT_CACHE_STORE node refers to: the fields
+ * of the CachedExp it replaces plus the number of nodes to skip on a hit.
+ */
+
+   struct FlatCache {
+      CacheSlot *slot;
+      unsigned *epoch;
+      bool refresh;
+      int skip;
+   };
+
+/*
+ * Type: FlatArray
+ * ---------------
+ * What an array node refers to: the array, its slot once linked, and
+ * for FLAT_INDEX the position of the subscript.
+ */
+
+   struct FlatArray {
+      std::string name;
+      int slot;
+      int position;
+   };
+
+/*
+ * Type: FlatCall
+ * --------------
+ * What a FLAT_CALL node refers to: the function and how many arguments
+ * it pops.
+ */
+
+   struct FlatCall {
+      StringFunction function;
+      int count;
+   };
+
+   ExpNode *nodes;
+   int length;
+   int depth;
+   bool integer;
+   int *slots;
+   FlatCache *caches;
+   FlatArray *arrays;
+   FlatCall *calls;
+   Vector<ExpNode> code;
+   Vector<FlatCache> cacheTable;
+   Vector<FlatArray> arrayTable;
+   Vector<FlatCall> callTable;
+   Vector<std::string> names;
+   Vector<bool> integers;
+   Vector<Value> constants;
+   Vector<std::string> ops;
+   Expression *view;
+
+   bool emit(Expression *exp);
+   int evalIntegers(EvalState & state, long long *stack,
+                    int & top, int & count);
+   Value evalValues(EvalState & state, int start,
+                    const long long *prefix, int sp, int counted);
+   int addArray(std::string name, int position);
+   Expression *build(int & pos);
+
+/* Copying a FlatExp would share its arrays, so it is not allowed */
+
+   FlatExp(const FlatExp & src);
+   FlatExp & operator=(const FlatExp & src);
+
+};
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ * File: hashcons.cpp
+ * ------------------
+ * This file implements the hashcons.h interface.
+ */
+
+#include <string>
+#include "error.h"
+#include "exp.h"
+#include "hashcons.h"
+#include "hashmap.h"
+#include "statement.h"
+#include "strlib.h"
+#include "vector.h"
+using namespace std;
+
+/* Private function prototypes */
+
+static int sizeOf(Expression *exp);
+static int sizeOf(Statement *stmt);
+
+HashConsTable::HashConsTable() {
+   nextId = 0;
+   nodeCount = 0;
+   byteCount = 0;
+   unsharedNodeCount = 0;
+   unsharedByteCount = 0;
+}
+
+/*
+ * Implementation notes: ~HashConsTable
+ * ------------------------------------
+ * Statements are freed first, which releases the expressions they use;
+ * whatever expressions remain are then freed on their own.
+ */
+
+HashConsTable::~HashConsTable() {
+   for (Statement *stmt : statementEntries.keys()) {
+      discardStatement(stmt);
+   }
+   Vector<Expression *> remaining = expressionEntries.keys();
+   for (Expression *exp : remaining) {
+      if (exp->getType() == COMPOUND) {
+         ((CompoundExp *) exp)->setLHS(NULL);
+         ((CompoundExp *) exp)->setRHS(NULL);
+      } else if (exp->getType() == INDEX) {
+         ((IndexExp *) exp)->setSubscript(NULL);
+      } else if (exp->getType() == ARRAY) {
+         ((ArrayExp *) exp)->setFirst(NULL);
+         ((ArrayExp *) exp)->setSecond(NULL);
+      } else if (exp->getType() == CALL) {
+         CallExp *call = (CallExp *) exp;
+         for (int i = 0; i < call->getArgCount(); i++) {
+            call->setArg(i, NULL);
+         }
+      }
+      delete exp;
+   }
+}
+
+/*
+ * Implementation notes: intern
+ * ----------------------------
+ * The expressions are interned first, bottom up, so the key of a node
+ * can name its children by their ids rather than spell them out, which
+ * keeps every key short.  A statement's key is built the same way from
+ * the ids of its expressions.
+ */
+
+Statement *HashConsTable::intern(Statement *stmt) {
+   int nodes = 1;
+   int bytes = sizeOf(stmt);
+   string key;
+   switch (stmt->getType()) {
+    case PRINT_STMT: {
+      PrintStmt *print = (PrintStmt *) stmt;
+      print->setExp(internExpression(print->getExp(), nodes, bytes));
+      key = "PRINT " + getId(print->getExp());
+      break;
+    }
+    case LET_STMT: {
+      LetStmt *let = (LetStmt *) stmt;
+      if (let->getElement() != NULL) {
+         let->setElement((ArrayExp *)
+                         internExpression(let->getElement(), nodes, bytes));
+         let->setExp(internExpression(let->getExp(), nodes, bytes));
+         key = "LET " + getId(let->getElement()) + " " + getId(let->getExp());
+         break;
+      }
+      let->setVariable((IdentifierExp *)
+                       internExpression(let->getVariable(), nodes, bytes));
+      let->setExp(internExpression(let->getExp(), nodes, bytes));
+      key = "LET " + getId(let->getVariable()) + " " + getId(let->getExp());
+      if (let->getBase() != NULL) {
+         let->setBase((IdentifierExp *)
+                      internExpression(let->getBase(), nodes, bytes));
+         key += " +" + getId(let->getBase());
+      }
+      break;
+    }
+    case INPUT_STMT: {
+      InputStmt *input = (InputStmt *) stmt;
+      input->setVariable((IdentifierExp *)
+                         internExpression(input->getVariable(), nodes, bytes));
+      key = "INPUT " + getId(input->getVariable());
+      break;
+    }
+    case GOTO_STMT:
+      key = "GOTO " + integerToString(((GotoStmt *) stmt)->getTarget());
+      break;
+    case IF_STMT: {
+      IfStmt *ifStmt = (IfStmt *) stmt;
+      ifStmt->setLHS(internExpression(ifStmt->getLHS(), nodes, bytes));
+      ifStmt->setRHS(internExpression(ifStmt->getRHS(), nodes, bytes));
+      key = "IF " + getId(ifStmt->getLHS()) + " " + ifStmt->getOp() + " "
+          + getId(ifStmt->getRHS()) + " "
+          + integerToString(ifStmt->getTarget());
+      break;
+    }
+    case REM_STMT:
+      key = "REM";
+      break;
+    case END_STMT:
+      key = "END";
+      break;
+    case GOSUB_STMT:
+      key = "GOSUB " + integerToString(((GosubStmt *) stmt)->getTarget());
+      break;
+    case RETURN_STMT:
+      key = "RETURN";
+      break;
+    case ON_GOTO_STMT:
+    case ON_GOSUB_STMT: {
+      OnStmt *on = (OnStmt *) stmt;
+      on->setExp(internExpression(on->getExp(), nodes, bytes));
+      key = statementTypeToString(on->getType()) + " " + getId(on->getExp());
+      for (int target : on->getTargets()) {
+         key += " " + integerToString(target);
+      }
+      break;
+    }
+    default:
+      key = "#" + integerToString(nextId);
+      break;
+   }
+   unsharedNodeCount += nodes;
+   unsharedByteCount += bytes;
+   if (statements.containsKey(key)) {
+      Statement *shared = statements.get(key);
+      statementEntries[shared].refs++;
+      discardStatement(stmt);
+      return shared;
+   }
+   Entry entry;
+   entry.key = key;
+   entry.refs = 1;
+   entry.id = nextId++;
+   entry.treeNodes = nodes;
+   entry.treeBytes = bytes;
+   statements.put(key, stmt);
+   statementEntries.put(stmt, entry);
+   nodeCount++;
+   byteCount += sizeOf(stmt);
+   return stmt;
+}
+
+void HashConsTable::release(Statement *stmt) {
+   if (stmt == NULL) return;
+   Entry & entry = statementEntries[stmt];
+   unsharedNodeCount -= entry.treeNodes;
+   unsharedByteCount -= entry.treeBytes;
+   if (--entry.refs > 0) return;
+   statements.remove(entry.key);
+   statementEntries.remove(stmt);
+   nodeCount--;
+   byteCount -= sizeOf(stmt);
+   discardStatement(stmt);
+}
+
+int HashConsTable::getNodeCount() {
+   return nodeCount;
+}
+
+int HashConsTable::getByteCount() {
+   return byteCount;
+}
+
+int HashConsTable::getUnsharedNodeCount() {
+   return unsharedNodeCount;
+}
+
+int HashConsTable::getUnsharedByteCount() {
+   return unsharedByteCount;
+}
+
+/*
+ * Implementation notes: internExpression
+ * --------------------------------------
+ * Each call takes one reference to the node it returns.  When a new
+ * node turns out to be a duplicate, the references its children took
+ * are given back as it is discarded, since the shared node already
+ * holds its own.
+ */
+
+Expression *HashConsTable::internExpression(Expression *exp, int & nodes,
+                                            int & bytes) {
+   nodes++;
+   bytes += sizeOf(exp);
+   string key;
+   switch (exp->getType()) {
+    case CONSTANT:
+      key = exp->toString();
+      break;
+    case IDENTIFIER:
+      key = "$" + ((IdentifierExp *) exp)->getName();
+      break;
+    case COMPOUND: {
+      CompoundExp *compound = (CompoundExp *) exp;
+      compound->setLHS(internExpression(compound->getLHS(), nodes, bytes));
+      compound->setRHS(internExpression(compound->getRHS(), nodes, bytes));
+      key = "(" + getId(compound->getLHS()) + compound->getOp()
+          + getId(compound->getRHS()) + ")";
+      break;
+    }
+    case INDEX: {
+      IndexExp *index = (IndexExp *) exp;
+      index->setSubscript(internExpression(index->getSubscript(), nodes, bytes));
+      key = "[" + index->getArray() + " " + integerToString(index->getPosition())
+          + " " + getId(index->getSubscript()) + "]";
+      break;
+    }
+    case ARRAY: {
+      ArrayExp *element = (ArrayExp *) exp;
+      element->setFirst(internExpression(element->getFirst(), nodes, bytes));
+      key = element->getName() + "(" + getId(element->getFirst());
+      if (element->getSecond() != NULL) {
+         element->setSecond(internExpression(element->getSecond(), nodes, bytes));
+         key += " " + getId(element->getSecond());
+      }
+      key += ")";
+      break;
+    }
+    case CALL: {
+      CallExp *call = (CallExp *) exp;
+      key = getFunctionName(call->getFunction()) + "(";
+      for (int i = 0; i < call->getArgCount(); i++) {
+         call->setArg(i, internExpression(call->getArg(i), nodes, bytes));
+         key += " " + getId(call->getArg(i));
+      }
+      key += ")";
+      break;
+    }
+    default:
+      error("Cannot share expression " + exp->toString());
+   }
+   if (expressions.containsKey(key)) {
+      Expression *shared = expressions.get(key);
+      expressionEntries[shared].refs++;
+      discardExpression(exp);
+      return shared;
+   }
+   Entry entry;
+   entry.key = key;
+   entry.refs = 1;
+   entry.id = nextId++;
+   entry.treeNodes = 0;
+   entry.treeBytes = 0;
+   expressions.put(key, exp);
+   expressionEntries.put(exp, entry);
+   nodeCount++;
+   byteCount += sizeOf(exp);
+   return exp;
+}
+
+void HashConsTable::releaseExpression(Expression *exp) {
+   if (exp == NULL) return;
+   Entry & entry = expressionEntries[exp];
+   if (--entry.refs > 0) return;
+   expressions.remove(entry.key);
+   expressionEntries.remove(exp);
+   nodeCount--;
+   byteCount -= sizeOf(exp);
+   discardExpression(exp);
+}
+
+/*
+ * Implementation notes: discardExpression, discardStatement
+ * ---------------------------------------------------------
+ * These functions free one node whose parts are shared: the parts are
+ * released and detached, so that the destructor does not free them.
+ */
+
+void HashConsTable::discardExpression(Expression *exp) {
+   if (exp->getType() == COMPOUND) {
+      CompoundExp *compound = (CompoundExp *) exp;
+      releaseExpression(compound->getLHS());
+      releaseExpression(compound->getRHS());
+      compound->setLHS(NULL);
+      compound->setRHS(NULL);
+   } else if (exp->getType() == INDEX) {
+      IndexExp *index = (IndexExp *) exp;
+      releaseExpression(index->getSubscript());
+      index->setSubscript(NULL);
+   } else if (exp->getType() == ARRAY) {
+      ArrayExp *element = (ArrayExp *) exp;
+      releaseExpression(element->getFirst());
+      releaseExpression(element->getSecond());
+      element->setFirst(NULL);
+      element->setSecond(NULL);
+   } else if (exp->getType() == CALL) {
+      CallExp *call = (CallExp *) exp;
+      for (int i = 0; i < call->getArgCount(); i++) {
+         releaseExpression(call->getArg(i));
+         call->setArg(i, NULL);
+      }
+   }
+   delete exp;
+}
+
+void HashConsTable::discardStatement(Statement *stmt) {
+   switch (stmt->getType()) {
+    case PRINT_STMT:
+      releaseExpression(((PrintStmt *) stmt)->getExp());
+      ((PrintStmt *) stmt)->setExp(NULL);
+      break;
+    case LET_STMT:
+      releaseExpression(((LetStmt *) stmt)->getVariable());
+      releaseExpression(((LetStmt *) stmt)->getElement());
+      releaseExpression(((LetStmt *) stmt)->getExp());
+      releaseExpression(((LetStmt *) stmt)->getBase());
+      ((LetStmt *) stmt)->setVariable(NULL);
+      ((LetStmt *) stmt)->setElement(NULL);
+      ((LetStmt *) stmt)->setExp(NULL);
+      ((LetStmt *) stmt)->setBase(NULL);
+      break;
+    case INPUT_STMT:
+      releaseExpression(((InputStmt *) stmt)->getVariable());
+      ((InputStmt *) stmt)->setVariable(NULL);
+      break;
+    case ON_GOTO_STMT:
+    case ON_GOSUB_STMT:
+      releaseExpression(((OnStmt *) stmt)->getExp());
+      ((OnStmt *) stmt)->setExp(NULL);
+      break;
+    case IF_STMT:
+      releaseExpression(((IfStmt *) stmt)->getLHS());
+      releaseExpression(((IfStmt *) stmt)->getRHS());
+      ((IfStmt *) stmt)->setLHS(NULL);
+      ((IfStmt *) stmt)->setRHS(NULL);
+      break;
+    default:
+      break;
+   }
+   delete stmt;
+}
+
+string HashConsTable::getId(Expression *exp) {
+   return integerToString(expressionEntries[exp].id);
+}
+
+/*
+ * Implementation notes: sizeOf
+ * ----------------------------
+ * The sizes are those of the objects themselves.  Variable names are
+ * short enough to live inside their string objects.
+ */
+
+static int sizeOf(Expression *exp) {
+   switch (exp->getType()) {
+    case CONSTANT: return sizeof(ConstantExp);
+    case IDENTIFIER: return sizeof(IdentifierExp);
+    case COMPOUND: return sizeof(CompoundExp);
+    case INDEX: return sizeof(IndexExp);
+    case ARRAY: return sizeof(ArrayExp);
+    case CALL: return sizeof(CallExp);
+    default: return 0;
+   }
+}
+
+static int sizeOf(Statement *stmt) {
+   switch (stmt->getType()) {
+    case PRINT_STMT: return sizeof(PrintStmt);
+    case LET_STMT: return sizeof(LetStmt);
+    case REM_STMT: return sizeof(RemStmt);
+    case INPUT_STMT: return sizeof(InputStmt);
+    case GOTO_STMT: return sizeof(GotoStmt);
+    case IF_STMT: return sizeof(IfStmt);
+    case END_STMT: return sizeof(EndStmt);
+    case GOSUB_STMT: return sizeof(GosubStmt);
+    case RETURN_STMT: return sizeof(ReturnStmt);
+    case ON_GOTO_STMT:
+    case ON_GOSUB_STMT: return sizeof(OnStmt);
+    case DIM_STMT: return sizeof(DimStmt);
+    case MAT_STMT: return sizeof(MatStmt);
+    case PARALLEL_FOR_STMT: return sizeof(ParallelForStmt);
+    case NEXT_STMT: return sizeof(NextStmt);
+    default: return 0;
+   }
+}
@@ -0,0 +1,129 @@
+/*
+ * File: hashcons.h
+ * ----------------
+ * This interface exports HashConsTable, which stores parsed statements
+ * so that structurally identical ones, and identical subexpressions
+ * within them, exist only once.  Generated programs repeat the same
+ * few shapes of line thousands of times, and with the table all of
+ * those lines point at one Statement.
+ */
+
+#ifndef _hashcons_h
+#define _hashcons_h
+
+#include <string>
+#include "exp.h"
+#include "hashmap.h"
+#include "statement.h"
+
+/*
+ * Class: HashConsTable
+ * --------------------
+ * Statements and expressions in the table are shared, so nothing may
+ * change or delete them directly.  Each intern call counts as one
+ * reference to the statement it returns, which release gives back; a
+ * node is freed when its last reference goes.  The table is not
+ * thread-safe.
+ */
+
+class HashConsTable {
+
+public:
+
+   HashConsTable();
+
+/*
+ * Destructor: ~HashConsTable
+ * Usage: usually implicit
+ * -----------------------
+ * Frees every node still in the table.
+ */
+
+   ~HashConsTable();
+
+/*
+ * Method: intern
+ * Usage: stmt = table.intern(stmt);
+ * ---------------------------------
+ * Takes over a freshly parsed statement and returns the shared
+ * statement with the same structure, which may be stmt itself.  The
+ * parts of stmt that are not kept are freed.
+ */
+
+   Statement *intern(Statement *stmt);
+
+/*
+ * Method: release
+ * Usage: table.release(stmt);
+ * ---------------------------
+ * Gives back one reference to a statement returned by intern.  Passing
+ * NULL does nothing.
+ */
+
+   void release(Statement *stmt);
+
+/*
+ * Methods: getNodeCount, getByteCount
+ * Usage: int bytes = table.getByteCount();
+ * ----------------------------------------
+ * Return the number and total size of the statement and expression
+ * nodes the table holds.
+ */
+
+   int getNodeCount();
+   int getByteCount();
+
+/*
+ * Methods: getUnsharedNodeCount, getUnsharedByteCount
+ * Usage: int bytes = table.getUnsharedByteCount();
+ * ------------------------------------------------
+ * Return the number and total size of the nodes that the statements
+ * referenced from the table would need if every reference had a tree
+ * of its own, which is how much they took before sharing.
+ */
+
+   int getUnsharedNodeCount();
+   int getUnsharedByteCount();
+
+private:
+
+/*
+ * Type: Entry
+ * -----------
+ * What the table knows about one shared node.  The id stands for the
+ * node in the keys of its parents, and the tree size is kept for
+ * statements only.
+ */
+
+   struct Entry {
+      std::string key;
+      int refs;
+      int id;
+      int treeNodes;
+      int treeBytes;
+   };
+
+   HashMap<std::string,Expression *> expressions;
+   HashMap<Expression *,Entry> expressionEntries;
+   HashMap<std::string,Statement *> statements;
+   HashMap<Statement *,Entry> statementEntries;
+   int nextId;
+   int nodeCount;
+   int byteCount;
+   int unsharedNodeCount;
+   int unsharedByteCount;
+
+   Expression *internExpression(Expression *exp, int & nodes, int & bytes);
+   void releaseExpression(Expression *exp);
+   void discardExpression(Expression *exp);
+   void discardStatement(Statement *stmt);
+   std::string getId(Expression *exp);
+
+/* Copying a table would share its nodes, so it is not allowed */
+
+   HashConsTable(const HashConsTable & src);
+   HashConsTable & operator=(const HashConsTable & src);
+
+};
+
+#endif
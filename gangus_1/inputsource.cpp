@@ -0,0 +1,408 @@
+/*
+ * File: inputsource.cpp
+ * ---------------------
+ * This file implements the inputsource.h interface.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "error.h"
+#include "inputsource.h"
+#include "output.h"
+#include "simpio.h"
+#include "strlib.h"
+#include "value.h"
+#include "vector.h"
+#ifdef _WIN32
+#include <io.h>
+#define open _open
+#define read _read
+#define close _close
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+/* Constants */
+
+static const int RING_SIZE = 1 << 14;
+static const int CHUNK_SIZE = 1 << 16;
+
+/* Private state */
+
+static InputSource *currentSource = NULL;
+
+/* Private function prototypes */
+
+static Value checkNumber(const Value & value);
+static Value toText(const Value & value);
+
+/* Implementation of the InputSource classes */
+
+InputSource::~InputSource() {
+   /* Empty */
+}
+
+bool InputSource::isReady() {
+   return true;
+}
+
+void InputSource::waitUntilReady() {
+   /* Empty */
+}
+
+Value InputSource::readString() {
+   return toText(readValue());
+}
+
+/*
+ * Implementation notes: ConsoleInputSource
+ * ----------------------------------------
+ * The line is read with getLine and parsed with scanValue, the parser
+ * the other sources use, so that the console accepts the same numbers;
+ * the message on a bad line is the one getInteger gives.  A string is
+ * the line exactly as typed.
+ */
+
+Value ConsoleInputSource::readValue() {
+   printText(" ? ");
+   flushBeforeInput();
+   while (true) {
+      string line = trim(getLine());
+      Value value;
+      if (scanValue(line.data(), line.data() + line.length(), value)) {
+         return value;
+      }
+      printLine("Illegal numeric format. Try again.");
+   }
+}
+
+Value ConsoleInputSource::readString() {
+   printText(" ? ");
+   flushBeforeInput();
+   string line = getLine();
+   return Value(line.data(), line.length());
+}
+
+VectorInputSource::VectorInputSource(const Vector<Value> & values) {
+   this->values = values;
+   index = 0;
+}
+
+Value VectorInputSource::readValue() {
+   return checkNumber(next());
+}
+
+Value VectorInputSource::readString() {
+   return toText(next());
+}
+
+Value VectorInputSource::next() {
+   if (index >= values.size()) error("No more input values");
+   return values[index++];
+}
+
+/*
+ * Implementation notes: QueueInputSource
+ * --------------------------------------
+ * Values that have been read are dropped whenever the queue runs dry,
+ * so a long-running program does not accumulate its whole input.
+ */
+
+QueueInputSource::QueueInputSource() {
+   index = 0;
+   finished = false;
+}
+
+Value QueueInputSource::readValue() {
+   return checkNumber(next());
+}
+
+Value QueueInputSource::readString() {
+   return toText(next());
+}
+
+Value QueueInputSource::next() {
+   if (index >= values.size()) {
+      if (finished) error("No more input values");
+      error("No input value is ready");
+   }
+   Value value = values[index++];
+   if (index == values.size()) {
+      values.clear();
+      index = 0;
+   }
+   return value;
+}
+
+bool QueueInputSource::isReady() {
+   return index < values.size() || finished;
+}
+
+void QueueInputSource::supply(Value value) {
+   values.add(value);
+}
+
+void QueueInputSource::finish() {
+   finished = true;
+}
+
+/*
+ * Implementation notes: StreamInputSource
+ * ---------------------------------------
+ * The Reader structure is shared by the interpreter thread, which pops
+ * values, and the reader thread, which pushes them.  The ring counters
+ * only grow, so the ring holds exactly RING_SIZE values.  Neither side
+ * takes the lock while the ring has both values and room: the reader
+ * signals filled once per chunk, and the interpreter signals drained
+ * only when a full ring has emptied to half, which the full flag tells
+ * it.  That flag and head are sequentially consistent so that the
+ * reader cannot go to sleep on a ring the interpreter has just drained.
+ * Deleting the source sets stopping, wakes the reader from its wait or
+ * from poll through the wake pipe, and joins the thread.
+ */
+
+struct StreamInputSource::Reader {
+   int fd;
+   int wake[2];
+   Value values[RING_SIZE];
+   atomic<unsigned> head;
+   atomic<unsigned> tail;
+   atomic<bool> done;
+   atomic<bool> stopping;
+   atomic<bool> full;
+   string message;
+   mutex lock;
+   condition_variable filled;
+   condition_variable drained;
+   thread worker;
+
+   void run();
+   bool push(Value value);
+   bool waitForData();
+};
+
+StreamInputSource::StreamInputSource(string filename) {
+   int fd = (filename == "-") ? 0 : open(filename.c_str(), O_RDONLY);
+   if (fd < 0) error("Cannot open input file " + filename);
+   reader = new Reader;
+   reader->fd = fd;
+   reader->wake[0] = reader->wake[1] = -1;
+#ifndef _WIN32
+   if (pipe(reader->wake) < 0) {
+      if (fd != 0) close(fd);
+      delete reader;
+      error("Cannot start the input reader");
+   }
+#endif
+   reader->head = 0;
+   reader->tail = 0;
+   reader->done = false;
+   reader->stopping = false;
+   reader->full = false;
+   reader->worker = thread(&Reader::run, reader);
+}
+
+StreamInputSource::~StreamInputSource() {
+   reader->stopping = true;
+#ifndef _WIN32
+   char byte = 0;
+   while (write(reader->wake[1], &byte, 1) < 0 && errno == EINTR) {
+      /* Retry */
+   }
+#endif
+   {
+      lock_guard<mutex> guard(reader->lock);
+      reader->drained.notify_one();
+   }
+   reader->worker.join();
+#ifndef _WIN32
+   close(reader->wake[0]);
+   close(reader->wake[1]);
+#endif
+   delete reader;
+}
+
+Value StreamInputSource::readValue() {
+   return checkNumber(next());
+}
+
+Value StreamInputSource::readString() {
+   return toText(next());
+}
+
+Value StreamInputSource::next() {
+   while (true) {
+      unsigned h = reader->head.load(memory_order_relaxed);
+      unsigned t = reader->tail.load(memory_order_acquire);
+      if (h != t) {
+         Value value = reader->values[h % RING_SIZE];
+         reader->head.store(h + 1);
+         if (reader->full && t - (h + 1) <= RING_SIZE / 2) {
+            lock_guard<mutex> guard(reader->lock);
+            reader->full = false;
+            reader->drained.notify_one();
+         }
+         return value;
+      }
+      if (!reader->waitForData()) {
+         if (reader->message != "") error(reader->message);
+         error("No more input values");
+      }
+   }
+}
+
+bool StreamInputSource::isReady() {
+   unsigned h = reader->head.load(memory_order_relaxed);
+   return h != reader->tail.load(memory_order_acquire)
+       || reader->done.load(memory_order_acquire);
+}
+
+void StreamInputSource::waitUntilReady() {
+   reader->waitForData();
+}
+
+/*
+ * Implementation notes: Reader::run
+ * ---------------------------------
+ * The reader parses the data in large chunks.  A number that straddles
+ * two chunks is carried over by moving its prefix to the front of the
+ * buffer before the next read.  A word that is not a number is pushed as
+ * a string, and the error, if any, waits for the INPUT that reads it.
+ * Outside Windows the reader blocks in poll rather than read, so that a
+ * byte on the wake pipe can end a read that would never return.
+ */
+
+void StreamInputSource::Reader::run() {
+   char *buffer = new char[CHUNK_SIZE];
+   int length = 0;
+   bool atEnd = false;
+   while (!atEnd && !stopping) {
+#ifndef _WIN32
+      pollfd fds[2];
+      fds[0].fd = fd;
+      fds[0].events = POLLIN;
+      fds[1].fd = wake[0];
+      fds[1].events = POLLIN;
+      if (poll(fds, 2, -1) < 0) {
+         if (errno == EINTR) continue;
+         break;
+      }
+      if (fds[1].revents != 0) break;
+#endif
+      int n = read(fd, buffer + length, CHUNK_SIZE - length);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) atEnd = true;
+      if (n > 0) length += n;
+      char *cp = buffer;
+      char *end = buffer + length;
+      while (true) {
+         while (cp < end && isspace((unsigned char) *cp)) cp++;
+         char *start = cp;
+         while (cp < end && !isspace((unsigned char) *cp)) cp++;
+         if (start == cp || (cp == end && !atEnd)) {
+            cp = start;
+            break;
+         }
+         Value value;
+         if (!scanValue(start, cp, value)) value = Value(start, cp - start);
+         if (!push(value)) {
+            atEnd = true;
+            break;
+         }
+      }
+      length = end - cp;
+      if (length == CHUNK_SIZE) {
+         message = "Input token is too long";
+         atEnd = true;
+      }
+      memmove(buffer, cp, length);
+      lock_guard<mutex> guard(lock);
+      filled.notify_one();
+   }
+   delete[] buffer;
+   if (fd != 0) close(fd);
+   lock_guard<mutex> guard(lock);
+   done.store(true, memory_order_release);
+   filled.notify_one();
+}
+
+bool StreamInputSource::Reader::push(Value value) {
+   unsigned t = tail.load(memory_order_relaxed);
+   if (t - head.load(memory_order_acquire) == RING_SIZE) {
+      unique_lock<mutex> guard(lock);
+      filled.notify_one();
+      while (true) {
+         full = true;
+         if (t - head.load() != RING_SIZE) break;
+         if (stopping) return false;
+         drained.wait(guard);
+      }
+      full = false;
+   }
+   values[t % RING_SIZE] = value;
+   tail.store(t + 1, memory_order_release);
+   return true;
+}
+
+/*
+ * Implementation notes: Reader::waitForData
+ * -----------------------------------------
+ * The interpreter sleeps on filled while the ring is empty.  The return
+ * value is false once the reader has finished and left nothing behind.
+ */
+
+bool StreamInputSource::Reader::waitForData() {
+   unique_lock<mutex> guard(lock);
+   while (true) {
+      if (head.load(memory_order_relaxed) != tail.load(memory_order_acquire)) {
+         return true;
+      }
+      if (done.load(memory_order_acquire)) {
+         return head.load(memory_order_relaxed)
+             != tail.load(memory_order_acquire);
+      }
+      filled.wait(guard);
+   }
+}
+
+/*
+ * Implementation notes: setInputSource, getInputSource
+ * ----------------------------------------------------
+ * The console source is created on first use.
+ */
+
+void setInputSource(InputSource *source) {
+   if (currentSource != source) delete currentSource;
+   currentSource = source;
+}
+
+InputSource & getInputSource() {
+   if (currentSource == NULL) currentSource = new ConsoleInputSource();
+   return *currentSource;
+}
+
+/*
+ * Implementation notes: checkNumber, toText
+ * -----------------------------------------
+ * A string that a numeric INPUT meets gets the message the reader used
+ * to give when it found the word.
+ */
+
+static Value checkNumber(const Value & value) {
+   if (value.isString()) error("Illegal number in input: " + value.toString());
+   return value;
+}
+
+static Value toText(const Value & value) {
+   if (value.isString()) return value;
+   string text = value.toString();
+   return Value(text.data(), text.length());
+}
@@ -0,0 +1,218 @@
+/*
+ * File: inputsource.h
+ * -------------------
+ * This interface exports the InputSource class hierarchy, which supplies
+ * the values read by INPUT statements.  By default values come from the
+ * console, but a program can also be fed from a file, a pipe or a vector
+ * of values held in memory.
+ */
+
+#ifndef _inputsource_h
+#define _inputsource_h
+
+#include <string>
+#include "value.h"
+#include "vector.h"
+
+/*
+ * Class: InputSource
+ * ------------------
+ * This abstract class defines the interface for a source of input
+ * values, which INPUT reads as numbers or, for a string variable, as
+ * strings.  Each subclass decides where the values come from.
+ */
+
+class InputSource {
+
+public:
+
+/*
+ * Destructor: ~InputSource
+ * Usage: delete source;
+ * ---------------------
+ * The destructor must be virtual so that subclasses can free their
+ * own resources.
+ */
+
+   virtual ~InputSource();
+
+/*
+ * Method: readValue
+ * Usage: Value value = source->readValue();
+ * -----------------------------------------
+ * Returns the next input value, an integer or a real number written as
+ * a BASIC program writes one.  This method raises an error if the source
+ * is exhausted or contains something other than a number.
+ */
+
+   virtual Value readValue() = 0;
+
+/*
+ * Method: readString
+ * Usage: Value str = source->readString();
+ * ----------------------------------------
+ * Returns the next input value as a string.  A number is given in the
+ * form PRINT would show it, which is all the default implementation
+ * does; the console returns the whole line that the user types.
+ */
+
+   virtual Value readString();
+
+/*
+ * Method: isReady
+ * Usage: if (source->isReady()) . . .
+ * -----------------------------------
+ * Returns true if readValue would return at once, either with a
+ * value or with its error, instead of waiting for data to arrive.  A
+ * run that must not block tests this before each INPUT statement.  The
+ * default implementation returns true.
+ */
+
+   virtual bool isReady();
+
+/*
+ * Method: waitUntilReady
+ * Usage: source->waitUntilReady();
+ * --------------------------------
+ * Blocks until isReady would return true, which lets a host with nothing
+ * else to run resume a suspended program without spinning.  The default
+ * implementation returns at once.
+ */
+
+   virtual void waitUntilReady();
+
+};
+
+/*
+ * Class: ConsoleInputSource
+ * -------------------------
+ * This subclass prompts with " ? " and reads values typed by the user,
+ * asking again until the line is a number.  Since the prompt is part of
+ * the read, the console is always ready.
+ */
+
+class ConsoleInputSource : public InputSource {
+public:
+   virtual Value readValue();
+   virtual Value readString();
+};
+
+/*
+ * Class: VectorInputSource
+ * ------------------------
+ * This subclass returns the values of a vector in order, which lets a
+ * host program feed a BASIC program without any I/O.  The vector may
+ * hold strings for the string variables to read.
+ */
+
+class VectorInputSource : public InputSource {
+public:
+   VectorInputSource(const Vector<Value> & values);
+   virtual Value readValue();
+   virtual Value readString();
+private:
+   Value next();
+   Vector<Value> values;
+   int index;
+};
+
+/*
+ * Class: QueueInputSource
+ * -----------------------
+ * This subclass returns values that the host supplies while the program
+ * runs.  It is ready whenever a value is queued or the host has called
+ * finish, so a host that suspends runs on input can feed each program
+ * as its data arrives and continue it.  The host must supply values on
+ * the thread that runs the program.
+ */
+
+class QueueInputSource : public InputSource {
+public:
+   QueueInputSource();
+   virtual Value readValue();
+   virtual Value readString();
+   virtual bool isReady();
+
+/*
+ * Methods: supply, finish
+ * Usage: source->supply(value);
+ *        source->finish();
+ * ----------------------------
+ * Adds a value to the end of the queue, or marks the end of the input,
+ * after which reading from an empty queue raises an error.
+ */
+
+   void supply(Value value);
+   void finish();
+
+private:
+   Value next();
+   Vector<Value> values;
+   int index;
+   bool finished;
+};
+
+/*
+ * Class: StreamInputSource
+ * ------------------------
+ * This subclass reads whitespace-separated numbers from a file or a
+ * pipe.  A background thread reads and parses the data ahead of the
+ * program into a ring, so readValue is normally just a pop with no
+ * system call, no locking and no allocation; it sleeps only when the
+ * ring is empty.  A word that is not
+ * a number is kept as a string, which a string variable may read; a
+ * numeric INPUT that meets one raises the error.
+ */
+
+class StreamInputSource : public InputSource {
+public:
+
+/*
+ * Constructor: StreamInputSource
+ * Usage: InputSource *source = new StreamInputSource(filename);
+ * -------------------------------------------------------------
+ * Opens the named file, or standard input if the name is "-", and
+ * starts the reader thread.
+ */
+
+   StreamInputSource(std::string filename);
+
+/*
+ * Destructor: ~StreamInputSource
+ * ------------------------------
+ * Stops the reader thread, even one blocked on a pipe with no data, and
+ * waits for it to exit.
+ */
+
+   virtual ~StreamInputSource();
+   virtual Value readValue();
+   virtual Value readString();
+   virtual bool isReady();
+   virtual void waitUntilReady();
+
+private:
+   struct Reader;
+   Reader *reader;
+   Value next();
+};
+
+/*
+ * Function: setInputSource
+ * Usage: setInputSource(new StreamInputSource(filename));
+ * -------------------------------------------------------
+ * Makes source the supplier of INPUT values.  The input module takes
+ * ownership of source and deletes the source it replaces.
+ */
+
+void setInputSource(InputSource *source);
+
+/*
+ * Function: getInputSource
+ * Usage: Value value = getInputSource().readValue();
+ * --------------------------------------------------
+ * Returns the current input source, which is initially the console.
+ */
+
+InputSource & getInputSource();
+
+#endif
@@ -0,0 +1,393 @@
+/*
+ * File: matrix.cpp
+ * ----------------
+ * This file implements the matrix.h interface.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "error.h"
+#include "matrix.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+using namespace std;
+
+/*
+ * Constants: TILE, BLOCK_INNER, BLOCK_COLUMNS
+ * -------------------------------------------
+ * The transpose works through TILE x TILE tiles, so that the rows it
+ * reads and the rows it writes both stay in the L1 cache.  The multiply
+ * works through blocks of BLOCK_INNER rows of b, BLOCK_COLUMNS elements
+ * wide, which is 128K and stays in the L2 cache while every row of a
+ * is multiplied by it.  The part of a result row that each step adds
+ * to is 1K and stays in the L1 cache.
+ */
+
+static const int TILE = 32;
+static const int BLOCK_INNER = 128;
+static const int BLOCK_COLUMNS = 256;
+
+/*
+ * Type: KernelSet
+ * ---------------
+ * One version of the kernels.  The transpose and the multiply are split
+ * into the blocking, which is shared, and the work on a single tile or
+ * block, which is not.
+ */
+
+struct KernelSet {
+   const char *name;
+   bool (*isSupported)();
+   void (*add)(int *result, const int *a, const int *b, int size);
+   void (*subtract)(int *result, const int *a, const int *b, int size);
+   void (*scale)(int *result, const int *a, int factor, int size);
+   void (*fill)(int *result, int value, int size);
+   void (*transposeTile)(int *result, const int *a, int rows, int columns,
+                         int row, int rowEnd, int column, int columnEnd);
+   void (*multiplyBlock)(int *result, const int *a, const int *b,
+                         int rows, int inner, int columns,
+                         int k, int kEnd, int column, int columnEnd);
+};
+
+/*
+ * Implementation notes: scalar kernels
+ * ------------------------------------
+ * These run anywhere and finish the elements left over by the vector
+ * loops.  The arithmetic is done on unsigned values so that it wraps
+ * around instead of overflowing.
+ */
+
+static bool alwaysSupported() {
+   return true;
+}
+
+static void addScalar(int *result, const int *a, const int *b, int size) {
+   for (int i = 0; i < size; i++) {
+      result[i] = (int) ((unsigned) a[i] + (unsigned) b[i]);
+   }
+}
+
+static void subtractScalar(int *result, const int *a, const int *b, int size) {
+   for (int i = 0; i < size; i++) {
+      result[i] = (int) ((unsigned) a[i] - (unsigned) b[i]);
+   }
+}
+
+static void scaleScalar(int *result, const int *a, int factor, int size) {
+   for (int i = 0; i < size; i++) {
+      result[i] = (int) ((unsigned) a[i] * (unsigned) factor);
+   }
+}
+
+static void fillScalar(int *result, int value, int size) {
+   for (int i = 0; i < size; i++) {
+      result[i] = value;
+   }
+}
+
+static void transposeTileScalar(int *result, const int *a, int rows, int columns,
+                                int row, int rowEnd, int column, int columnEnd) {
+   for (int i = row; i < rowEnd; i++) {
+      for (int j = column; j < columnEnd; j++) {
+         result[(size_t) j * rows + i] = a[(size_t) i * columns + j];
+      }
+   }
+}
+
+static void multiplyBlockScalar(int *result, const int *a, const int *b,
+                                int rows, int inner, int columns,
+                                int k, int kEnd, int column, int columnEnd) {
+   for (int i = 0; i < rows; i++) {
+      int *c = result + (size_t) i * columns;
+      for (int kk = k; kk < kEnd; kk++) {
+         unsigned factor = a[(size_t) i * inner + kk];
+         const int *row = b + (size_t) kk * columns;
+         for (int j = column; j < columnEnd; j++) {
+            c[j] = (int) ((unsigned) c[j] + factor * (unsigned) row[j]);
+         }
+      }
+   }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Implementation notes: SSE2 kernels
+ * ----------------------------------
+ * SSE2 is part of every x86-64 processor.  It has no 32-bit multiply
+ * that keeps the low halves, so mulLow builds one from two 32 x 32 to
+ * 64-bit multiplies of the even and odd lanes.  The transpose moves
+ * 4 x 4 blocks with unpack instructions.
+ */
+
+static inline __m128i mulLow(__m128i x, __m128i y) {
+   __m128i even = _mm_mul_epu32(x, y);
+   __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), _mm_srli_epi64(y, 32));
+   return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                             _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static void addSse2(int *result, const int *a, const int *b, int size) {
+   int i = 0;
+   for (; i + 4 <= size; i += 4) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+      __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+      _mm_storeu_si128((__m128i *) (result + i), _mm_add_epi32(x, y));
+   }
+   addScalar(result + i, a + i, b + i, size - i);
+}
+
+static void subtractSse2(int *result, const int *a, const int *b, int size) {
+   int i = 0;
+   for (; i + 4 <= size; i += 4) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+      __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+      _mm_storeu_si128((__m128i *) (result + i), _mm_sub_epi32(x, y));
+   }
+   subtractScalar(result + i, a + i, b + i, size - i);
+}
+
+static void scaleSse2(int *result, const int *a, int factor, int size) {
+   __m128i y = _mm_set1_epi32(factor);
+   int i = 0;
+   for (; i + 4 <= size; i += 4) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+      _mm_storeu_si128((__m128i *) (result + i), mulLow(x, y));
+   }
+   scaleScalar(result + i, a + i, factor, size - i);
+}
+
+static void fillSse2(int *result, int value, int size) {
+   __m128i x = _mm_set1_epi32(value);
+   int i = 0;
+   for (; i + 4 <= size; i += 4) {
+      _mm_storeu_si128((__m128i *) (result + i), x);
+   }
+   fillScalar(result + i, value, size - i);
+}
+
+static void transposeTileSse2(int *result, const int *a, int rows, int columns,
+                              int row, int rowEnd, int column, int columnEnd) {
+   int rowFull = row + (rowEnd - row) / 4 * 4;
+   int columnFull = column + (columnEnd - column) / 4 * 4;
+   for (int i = row; i < rowFull; i += 4) {
+      for (int j = column; j < columnFull; j += 4) {
+         const int *in = a + (size_t) i * columns + j;
+         __m128i r0 = _mm_loadu_si128((const __m128i *) in);
+         __m128i r1 = _mm_loadu_si128((const __m128i *) (in + columns));
+         __m128i r2 = _mm_loadu_si128((const __m128i *) (in + 2 * (size_t) columns));
+         __m128i r3 = _mm_loadu_si128((const __m128i *) (in + 3 * (size_t) columns));
+         __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+         __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+         __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+         __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+         int *out = result + (size_t) j * rows + i;
+         _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi64(t0, t1));
+         _mm_storeu_si128((__m128i *) (out + rows), _mm_unpackhi_epi64(t0, t1));
+         _mm_storeu_si128((__m128i *) (out + 2 * (size_t) rows), _mm_unpacklo_epi64(t2, t3));
+         _mm_storeu_si128((__m128i *) (out + 3 * (size_t) rows), _mm_unpackhi_epi64(t2, t3));
+      }
+      transposeTileScalar(result, a, rows, columns, i, i + 4, columnFull, columnEnd);
+   }
+   transposeTileScalar(result, a, rows, columns, rowFull, rowEnd, column, columnEnd);
+}
+
+static void multiplyBlockSse2(int *result, const int *a, const int *b,
+                              int rows, int inner, int columns,
+                              int k, int kEnd, int column, int columnEnd) {
+   for (int i = 0; i < rows; i++) {
+      int *c = result + (size_t) i * columns;
+      for (int kk = k; kk < kEnd; kk++) {
+         int factor = a[(size_t) i * inner + kk];
+         const int *row = b + (size_t) kk * columns;
+         __m128i y = _mm_set1_epi32(factor);
+         int j = column;
+         for (; j + 4 <= columnEnd; j += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i *) (row + j));
+            __m128i sum = _mm_loadu_si128((const __m128i *) (c + j));
+            _mm_storeu_si128((__m128i *) (c + j), _mm_add_epi32(sum, mulLow(x, y)));
+         }
+         for (; j < columnEnd; j++) {
+            c[j] = (int) ((unsigned) c[j] + (unsigned) factor * (unsigned) row[j]);
+         }
+      }
+   }
+}
+
+/*
+ * Implementation notes: AVX2 kernels
+ * ----------------------------------
+ * These are compiled for AVX2 whatever the build flags say, and are
+ * only called once __builtin_cpu_supports has found it.  The transpose
+ * is bound by memory rather than by instructions, so the AVX2 set uses
+ * the SSE2 tiles.
+ */
+
+static bool isAvx2Supported() {
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void addAvx2(int *result, const int *a, const int *b, int size) {
+   int i = 0;
+   for (; i + 8 <= size; i += 8) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+      __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+      _mm256_storeu_si256((__m256i *) (result + i), _mm256_add_epi32(x, y));
+   }
+   addScalar(result + i, a + i, b + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void subtractAvx2(int *result, const int *a, const int *b, int size) {
+   int i = 0;
+   for (; i + 8 <= size; i += 8) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+      __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+      _mm256_storeu_si256((__m256i *) (result + i), _mm256_sub_epi32(x, y));
+   }
+   subtractScalar(result + i, a + i, b + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void scaleAvx2(int *result, const int *a, int factor, int size) {
+   __m256i y = _mm256_set1_epi32(factor);
+   int i = 0;
+   for (; i + 8 <= size; i += 8) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+      _mm256_storeu_si256((__m256i *) (result + i), _mm256_mullo_epi32(x, y));
+   }
+   scaleScalar(result + i, a + i, factor, size - i);
+}
+
+__attribute__((target("avx2")))
+static void fillAvx2(int *result, int value, int size) {
+   __m256i x = _mm256_set1_epi32(value);
+   int i = 0;
+   for (; i + 8 <= size; i += 8) {
+      _mm256_storeu_si256((__m256i *) (result + i), x);
+   }
+   fillScalar(result + i, value, size - i);
+}
+
+__attribute__((target("avx2")))
+static void multiplyBlockAvx2(int *result, const int *a, const int *b,
+                              int rows, int inner, int columns,
+                              int k, int kEnd, int column, int columnEnd) {
+   for (int i = 0; i < rows; i++) {
+      int *c = result + (size_t) i * columns;
+      for (int kk = k; kk < kEnd; kk++) {
+         int factor = a[(size_t) i * inner + kk];
+         const int *row = b + (size_t) kk * columns;
+         __m256i y = _mm256_set1_epi32(factor);
+         int j = column;
+         for (; j + 8 <= columnEnd; j += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i *) (row + j));
+            __m256i sum = _mm256_loadu_si256((const __m256i *) (c + j));
+            _mm256_storeu_si256((__m256i *) (c + j),
+                                _mm256_add_epi32(sum, _mm256_mullo_epi32(x, y)));
+         }
+         for (; j < columnEnd; j++) {
+            c[j] = (int) ((unsigned) c[j] + (unsigned) factor * (unsigned) row[j]);
+         }
+      }
+   }
+}
+
+#endif
+
+/*
+ * Constant: KERNEL_SETS
+ * ---------------------
+ * The kernel sets, fastest first.
+ */
+
+static const KernelSet KERNEL_SETS[] = {
+#if defined(__x86_64__)
+   { "avx2", isAvx2Supported, addAvx2, subtractAvx2, scaleAvx2, fillAvx2,
+     transposeTileSse2, multiplyBlockAvx2 },
+   { "sse2", alwaysSupported, addSse2, subtractSse2, scaleSse2, fillSse2,
+     transposeTileSse2, multiplyBlockSse2 },
+#endif
+   { "scalar", alwaysSupported, addScalar, subtractScalar, scaleScalar,
+     fillScalar, transposeTileScalar, multiplyBlockScalar }
+};
+
+static const int KERNEL_SET_COUNT = sizeof KERNEL_SETS / sizeof KERNEL_SETS[0];
+
+/* Private state */
+
+static const KernelSet *chooseKernels();
+
+static const KernelSet *kernels = chooseKernels();
+
+static const KernelSet *chooseKernels() {
+   for (int i = 0; i < KERNEL_SET_COUNT; i++) {
+      if (KERNEL_SETS[i].isSupported()) return &KERNEL_SETS[i];
+   }
+   return &KERNEL_SETS[KERNEL_SET_COUNT - 1];
+}
+
+void matrixAdd(int *result, const int *a, const int *b, int size) {
+   kernels->add(result, a, b, size);
+}
+
+void matrixSubtract(int *result, const int *a, const int *b, int size) {
+   kernels->subtract(result, a, b, size);
+}
+
+void matrixScale(int *result, const int *a, int factor, int size) {
+   kernels->scale(result, a, factor, size);
+}
+
+void matrixFill(int *result, int value, int size) {
+   kernels->fill(result, value, size);
+}
+
+void matrixTranspose(int *result, const int *a, int rows, int columns) {
+   for (int i = 0; i < rows; i += TILE) {
+      for (int j = 0; j < columns; j += TILE) {
+         kernels->transposeTile(result, a, rows, columns,
+                                i, min(i + TILE, rows), j, min(j + TILE, columns));
+      }
+   }
+}
+
+/*
+ * Implementation notes: matrixMultiply
+ * ------------------------------------
+ * The loops run in i-k-j order, so the innermost loop adds a multiple
+ * of a row of b to a row of the result, which vectorizes without
+ * gathering a column of b.
+ */
+
+void matrixMultiply(int *result, const int *a, const int *b,
+                    int rows, int inner, int columns) {
+   memset(result, 0, (size_t) rows * columns * sizeof(int));
+   for (int k = 0; k < inner; k += BLOCK_INNER) {
+      for (int j = 0; j < columns; j += BLOCK_COLUMNS) {
+         kernels->multiplyBlock(result, a, b, rows, inner, columns,
+                                k, min(k + BLOCK_INNER, inner),
+                                j, min(j + BLOCK_COLUMNS, columns));
+      }
+   }
+}
+
+void setMatrixKernels(string name) {
+   for (int i = 0; i < KERNEL_SET_COUNT; i++) {
+      if (name != KERNEL_SETS[i].name) continue;
+      if (!KERNEL_SETS[i].isSupported()) {
+         error("This processor cannot run the " + name + " kernels");
+      }
+      kernels = &KERNEL_SETS[i];
+      return;
+   }
+   error("Unknown kernel set " + name);
+}
+
+string getMatrixKernels() {
+   return kernels->name;
+}
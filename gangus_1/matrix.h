@@ -0,0 +1,83 @@
+/*
+ * File: matrix.h
+ * --------------
+ * This interface exports the kernels behind the MAT statements.  Each
+ * kernel works on whole arrays of ints stored in row-major order, the
+ * way EvalState stores them, and comes in AVX2, SSE2 and plain C++
+ * versions.  The fastest set the processor supports is chosen when the
+ * interpreter starts.  Array elements are ints, and the arithmetic
+ * wraps around on overflow within them; only scalar integers grow into
+ * big integers.
+ */
+
+#ifndef _matrix_h
+#define _matrix_h
+
+#include <string>
+
+/*
+ * Functions: matrixAdd, matrixSubtract
+ * Usage: matrixAdd(result, a, b, size);
+ * -------------------------------------
+ * Stores the sum or the difference of the first size elements of a and
+ * b in result.  The result may be either operand.
+ */
+
+void matrixAdd(int *result, const int *a, const int *b, int size);
+void matrixSubtract(int *result, const int *a, const int *b, int size);
+
+/*
+ * Function: matrixScale
+ * Usage: matrixScale(result, a, factor, size);
+ * --------------------------------------------
+ * Stores the first size elements of a times factor in result, which may
+ * be a.
+ */
+
+void matrixScale(int *result, const int *a, int factor, int size);
+
+/*
+ * Function: matrixFill
+ * Usage: matrixFill(result, value, size);
+ * ---------------------------------------
+ * Stores value in the first size elements of result.
+ */
+
+void matrixFill(int *result, int value, int size);
+
+/*
+ * Function: matrixTranspose
+ * Usage: matrixTranspose(result, a, rows, columns);
+ * -------------------------------------------------
+ * Stores the transpose of the rows x columns matrix a in result, which
+ * has columns rows of rows elements each.  The result must not overlap
+ * a.
+ */
+
+void matrixTranspose(int *result, const int *a, int rows, int columns);
+
+/*
+ * Function: matrixMultiply
+ * Usage: matrixMultiply(result, a, b, rows, inner, columns);
+ * ----------------------------------------------------------
+ * Stores the product of the rows x inner matrix a and the inner x
+ * columns matrix b in the rows x columns matrix result, which must not
+ * overlap either operand.
+ */
+
+void matrixMultiply(int *result, const int *a, const int *b,
+                    int rows, int inner, int columns);
+
+/*
+ * Functions: setMatrixKernels, getMatrixKernels
+ * Usage: setMatrixKernels("sse2");
+ * --------------------------------
+ * Choose and return the kernel set in use: "avx2", "sse2" or "scalar".
+ * Choosing a set the processor cannot run is an error.  Forcing a
+ * slower set is mainly useful for comparing them.
+ */
+
+void setMatrixKernels(std::string name);
+std::string getMatrixKernels();
+
+#endif
@@ -0,0 +1,760 @@
+/*
+ * File: optimizer.cpp
+ * -------------------
+ * This file implements the optimizer.h interface.
+ */
+
+#include <cmath>
+#include <string>
+#include "analysis.h"
+#include "cfg.h"
+#include "exp.h"
+#include "flatexp.h"
+#include "hashmap.h"
+#include "optimizer.h"
+#include "statement.h"
+#include "stringvalue.h"
+#include "strlib.h"
+#include "value.h"
+#include "vector.h"
+using namespace std;
+
+/*
+ * Type: ExpRef
+ * ------------
+ * A place in a statement that holds an expression, which is either one
+ * of the statement's own expressions or a part of another expression.
+ * The rhs flag picks the second of two places, and arg picks an argument
+ * of a function call.  The optimizer needs the place, not just the
+ * expression, to wrap it.
+ */
+
+struct ExpRef {
+   Expression *exp;
+   Statement *stmt;
+   Expression *parent;
+   bool rhs;
+   int arg;
+};
+
+/*
+ * Type: Candidate
+ * ---------------
+ * A subexpression that shareCommonSubexpressions may cache: the first
+ * occurrence, the later occurrences that can reuse its value, and the
+ * variables it reads, which decide when it stops being available.
+ */
+
+struct Candidate {
+   ExpRef def;
+   Vector<ExpRef> uses;
+   Vector<string> vars;
+   int lineNumber;
+};
+
+/* Private function prototypes */
+
+static void getRoots(Statement *stmt, StatementType type, Vector<ExpRef> & refs);
+static void getChildren(ExpRef & ref, Vector<ExpRef> & refs);
+static void replace(ExpRef & ref, Expression *exp);
+static void collectVariables(Expression *exp, Vector<string> & vars);
+static void getWrites(CfgNode & node, Vector<string> & writes);
+static bool isCacheable(Expression *exp);
+static bool fold(ExpRef & ref);
+static Vector<int> computeDominators(ControlFlowGraph & graph, int entry,
+                                     Vector<int> & order);
+static bool dominates(Vector<int> & idom, int entry, int dominator, int index);
+static void hoist(ExpRef & ref, HashMap<string,bool> & assigned,
+                  HashMap<string,CacheSlot *> & shared, unsigned *epoch,
+                  ExpressionCache & cache, int lineNumber,
+                  Vector<string> & report);
+static void share(ExpRef & ref, HashMap<string,int> & available,
+                  Vector<Candidate> & candidates, int lineNumber);
+
+/*
+ * Implementation notes: ExpressionCache
+ * -------------------------------------
+ * Epochs start at 1 and slots at stamp 0, so a new slot is never
+ * current.  The counters and slots are allocated one at a time because
+ * CachedExp nodes keep pointers to them.
+ */
+
+ExpressionCache::ExpressionCache() {
+   newEpoch();
+}
+
+ExpressionCache::~ExpressionCache() {
+   for (unsigned *epoch : epochs) {
+      delete epoch;
+   }
+   for (CacheSlot *slot : slots) {
+      delete slot;
+   }
+}
+
+unsigned *ExpressionCache::newEpoch() {
+   unsigned *epoch = new unsigned(1);
+   epochs.add(epoch);
+   return epoch;
+}
+
+CacheSlot *ExpressionCache::newSlot() {
+   CacheSlot *slot = new CacheSlot;
+   slot->stamp = 0;
+   slot->value = 0;
+   slots.add(slot);
+   return slot;
+}
+
+unsigned *ExpressionCache::getRunEpoch() {
+   return epochs[0];
+}
+
+void ExpressionCache::invalidate() {
+   for (unsigned *epoch : epochs) {
+      (*epoch)++;
+   }
+}
+
+int ExpressionCache::getSlotCount() {
+   return slots.size();
+}
+
+/*
+ * Implementation notes: setOptimizing, isOptimizing
+ * -------------------------------------------------
+ * The flag is only read when a program is compiled.
+ */
+
+static bool optimizing = true;
+
+void setOptimizing(bool flag) {
+   optimizing = flag;
+}
+
+bool isOptimizing() {
+   return optimizing;
+}
+
+/*
+ * Implementation notes: hoistLoopInvariants
+ * -----------------------------------------
+ * The loop body of a back edge from n to header h is h together with
+ * every node that reaches n without passing through h.  Back edges that
+ * share a header form a single loop.  Loops are processed from the
+ * largest body down, so an outer loop claims an invariant before any
+ * loop nested in it; the nested loop then sees a CachedExp and leaves
+ * it alone.  An edge from a RETURN is stored in the next field of its
+ * GOSUB, which can be in the body when the RETURN is not, so a GOSUB
+ * that returns to the header always goes through the preheader; an
+ * extra pass through the preheader costs time but never correctness.
+ */
+
+int hoistLoopInvariants(ControlFlowGraph & graph, int entry,
+                        ExpressionCache & cache, Vector<string> & report) {
+   if (entry < 0) return entry;
+   int n = graph.size();
+   Vector<int> order = reversePostorder(graph, entry);
+   Vector<int> idom = computeDominators(graph, entry, order);
+   Vector<Vector<int> > preds = graph.getPredecessors();
+   Vector<int> headers;
+   Vector<Vector<bool> > bodies;
+   for (int index : order) {
+      for (int header : graph.getSuccessors(index)) {
+         if (!dominates(idom, entry, header, index)) continue;
+         int loop = 0;
+         while (loop < headers.size() && headers[loop] != header) loop++;
+         if (loop == headers.size()) {
+            loop = headers.size();
+            headers.add(header);
+            bodies.add(Vector<bool>(n, false));
+            bodies[loop][header] = true;
+         }
+         Vector<bool> & body = bodies[loop];
+         Vector<int> stack;
+         stack.add(index);
+         while (!stack.isEmpty()) {
+            int node = stack[stack.size() - 1];
+            stack.remove(stack.size() - 1);
+            if (body[node]) continue;
+            body[node] = true;
+            for (int pred : preds[node]) {
+               if (idom[pred] != -1 && !body[pred]) stack.add(pred);
+            }
+         }
+      }
+   }
+   Vector<int> sizes;
+   for (int loop = 0; loop < headers.size(); loop++) {
+      int size = 0;
+      for (int i = 0; i < n; i++) {
+         if (bodies[loop][i]) size++;
+      }
+      sizes.add(size);
+   }
+   Vector<int> loops;
+   for (int loop = 0; loop < headers.size(); loop++) {
+      int pos = 0;
+      while (pos < loops.size() && sizes[loops[pos]] >= sizes[loop]) pos++;
+      loops.insert(pos, loop);
+   }
+   for (int loop : loops) {
+      Vector<bool> & body = bodies[loop];
+      HashMap<string,bool> assigned;
+      for (int i = 0; i < n; i++) {
+         if (!body[i]) continue;
+         Vector<string> writes;
+         getWrites(graph.getNode(i), writes);
+         for (string name : writes) {
+            assigned.put(name, true);
+         }
+      }
+      HashMap<string,CacheSlot *> shared;
+      unsigned *epoch = cache.newEpoch();
+      for (int i = 0; i < n; i++) {
+         if (!body[i]) continue;
+         CfgNode & node = graph.getNode(i);
+         Vector<ExpRef> roots;
+         getRoots(node.stmt, node.type, roots);
+         for (ExpRef & root : roots) {
+            hoist(root, assigned, shared, epoch, cache, node.lineNumber,
+                  report);
+         }
+      }
+      if (shared.isEmpty()) continue;
+      int header = headers[loop];
+      CfgNode preheader;
+      preheader.lineNumber = graph.getNode(header).lineNumber;
+      preheader.stmt = new LoopEntryStmt(epoch);
+      preheader.type = LOOP_ENTRY_STMT;
+      preheader.next = header;
+      preheader.target = EXIT_NODE;
+      preheader.reachable = true;
+      int added = graph.addNode(preheader);
+      for (int i = 0; i < n; i++) {
+         CfgNode & node = graph.getNode(i);
+         if (!node.reachable) continue;
+         bool call = node.type == GOSUB_STMT || node.type == ON_GOSUB_STMT;
+         if (call && node.next == header) node.next = added;
+         if (body[i]) continue;
+         if (node.next == header) node.next = added;
+         if (node.target == header) node.target = added;
+         for (int & target : node.table) {
+            if (target == header) target = added;
+         }
+      }
+      if (entry == header) entry = added;
+   }
+   return entry;
+}
+
+/*
+ * Implementation notes: shareCommonSubexpressions
+ * -----------------------------------------------
+ * A node continues the block of its predecessor when that predecessor
+ * is its only one and falls through to it, so whenever the node runs,
+ * the rest of its block has just run in order.  A GOSUB or ON GOSUB
+ * ends its block, since its next line may run only after a subroutine.  Subexpressions are
+ * visited in the order eval starts them, which puts every first
+ * occurrence ahead of the later ones.  A candidate is only wrapped if
+ * some later occurrence reuses it.
+ */
+
+void shareCommonSubexpressions(ControlFlowGraph & graph, int entry,
+                               ExpressionCache & cache,
+                               Vector<string> & report) {
+   if (entry < 0) return;
+   Vector<Vector<int> > preds = graph.getPredecessors();
+   Vector<int> order = reversePostorder(graph, entry);
+   for (int leader : order) {
+      if (leader != entry && preds[leader].size() == 1
+          && graph.getNode(preds[leader][0]).next == leader
+          && preds[leader][0] != leader) {
+         continue;
+      }
+      Vector<Candidate> candidates;
+      HashMap<string,int> available;
+      int index = leader;
+      while (true) {
+         CfgNode & node = graph.getNode(index);
+         Vector<ExpRef> roots;
+         getRoots(node.stmt, node.type, roots);
+         for (ExpRef & root : roots) {
+            share(root, available, candidates, node.lineNumber);
+         }
+         Vector<string> writes;
+         getWrites(node, writes);
+         for (string write : writes) {
+            for (string key : available.keys()) {
+               for (string name : candidates[available.get(key)].vars) {
+                  if (name == write) {
+                     available.remove(key);
+                     break;
+                  }
+               }
+            }
+         }
+         int next = node.next;
+         if (node.type == GOSUB_STMT || node.type == ON_GOSUB_STMT) break;
+         if (next < 0 || next == entry || next == leader
+             || preds[next].size() != 1) {
+            break;
+         }
+         index = next;
+      }
+      for (Candidate & c : candidates) {
+         if (c.uses.isEmpty()) continue;
+         CacheSlot *slot = cache.newSlot();
+         unsigned *epoch = cache.getRunEpoch();
+         report.add(integerToString(c.lineNumber) + ": " + c.def.exp->toString());
+         replace(c.def, new CachedExp(c.def.exp, slot, epoch, true));
+         for (ExpRef & use : c.uses) {
+            replace(use, new CachedExp(use.exp, slot, epoch, false));
+         }
+      }
+   }
+}
+
+/*
+ * Implementation notes: foldConstants
+ * -----------------------------------
+ * Folding works bottom up, so (2 * 3) + 4 folds completely.  Arithmetic
+ * is done by the functions in value.h, so a folded constant has the
+ * value and type the interpreter would compute.  A division by zero is
+ * left alone so that it still raises its error when, and only if, the
+ * line runs, and so is a real result that overflows, which has no
+ * constant to stand for it.  A string joined from two literals is
+ * interned like the literals themselves.  Calls are not folded, since a
+ * call with a bad count must raise its error when the line runs.
+ */
+
+int foldConstants(ControlFlowGraph & graph) {
+   int folded = 0;
+   for (int i = 0; i < graph.size(); i++) {
+      CfgNode & node = graph.getNode(i);
+      if (!node.reachable) continue;
+      Vector<ExpRef> roots;
+      getRoots(node.stmt, node.type, roots);
+      for (ExpRef & root : roots) {
+         if (fold(root)) folded++;
+      }
+   }
+   return folded;
+}
+
+static bool fold(ExpRef & ref) {
+   bool folded = false;
+   Vector<ExpRef> children;
+   getChildren(ref, children);
+   for (ExpRef & child : children) {
+      if (fold(child)) folded = true;
+   }
+   if (ref.exp->getType() != COMPOUND) return folded;
+   CompoundExp *exp = (CompoundExp *) ref.exp;
+   if (exp->getLHS()->getType() != CONSTANT) return folded;
+   if (exp->getRHS()->getType() != CONSTANT) return folded;
+   Value lhs = ((ConstantExp *) exp->getLHS())->getValue();
+   Value rhs = ((ConstantExp *) exp->getRHS())->getValue();
+   string op = exp->getOp();
+   Value value;
+   if (op == "+") {
+      value = addValues(lhs, rhs);
+   } else if (op == "-") {
+      value = subtractValues(lhs, rhs);
+   } else if (op == "*") {
+      value = multiplyValues(lhs, rhs);
+   } else if (op == "/" && rhs.toReal() != 0) {
+      value = divideValues(lhs, rhs);
+   } else {
+      return folded;
+   }
+   if (value.isReal() && !isfinite(value.getReal())) return folded;
+   if (value.isString()) value = internString(value.toString());
+   replace(ref, new ConstantExp(value));
+   delete exp;
+   return true;
+}
+
+/*
+ * Implementation notes: flattenExpressions
+ * ----------------------------------------
+ * Each root expression is flattened whole, CachedExp nodes included,
+ * and the tree is then deleted.  The variables assigned by LET and
+ * INPUT become slots, and the elements assigned by LET are linked too.
+ * The loop variable of a PARALLEL FOR stays a name; the loop looks its
+ * slot up when it runs.
+ */
+
+void flattenExpressions(ControlFlowGraph & graph, Vector<FlatExp *> & flats,
+                        Vector<SlotExp *> & slots,
+                        Vector<ArrayExp *> & elements) {
+   Vector<int> nodes;
+   for (int i = 0; i < graph.size(); i++) {
+      if (graph.getNode(i).reachable) nodes.add(i);
+   }
+   flattenExpressions(graph, nodes, flats, slots, elements);
+}
+
+void flattenExpressions(ControlFlowGraph & graph, Vector<int> & nodes,
+                        Vector<FlatExp *> & flats, Vector<SlotExp *> & slots,
+                        Vector<ArrayExp *> & elements) {
+   for (int i : nodes) {
+      CfgNode & node = graph.getNode(i);
+      Vector<ExpRef> roots;
+      getRoots(node.stmt, node.type, roots);
+      for (ExpRef & root : roots) {
+         Expression *tree = root.exp;
+         FlatExp *flat = new FlatExp(tree);
+         flats.add(flat);
+         replace(root, flat);
+         delete tree;
+      }
+      if (node.type == LET_STMT && ((LetStmt *) node.stmt)->getElement() != NULL) {
+         elements.add(((LetStmt *) node.stmt)->getElement());
+      }
+      IdentifierExp *var = getDefinition(node);
+      if (var == NULL || node.type == PARALLEL_FOR_STMT) continue;
+      SlotExp *slot = new SlotExp(var->getName(), false);
+      slots.add(slot);
+      if (node.type == LET_STMT) {
+         ((LetStmt *) node.stmt)->setVariable(slot);
+      } else {
+         ((InputStmt *) node.stmt)->setVariable(slot);
+      }
+      delete var;
+   }
+}
+
+/*
+ * Implementation notes: hoist, share
+ * ----------------------------------
+ * Both functions look at the largest subexpressions first.  A
+ * subexpression that can be cached is not searched any further, since
+ * its parts are evaluated only when the whole is.
+ */
+
+static void hoist(ExpRef & ref, HashMap<string,bool> & assigned,
+                  HashMap<string,CacheSlot *> & shared, unsigned *epoch,
+                  ExpressionCache & cache, int lineNumber,
+                  Vector<string> & report) {
+   if (!isCacheable(ref.exp)) return;
+   Vector<string> vars;
+   collectVariables(ref.exp, vars);
+   bool invariant = true;
+   for (string var : vars) {
+      if (assigned.containsKey(var)) invariant = false;
+   }
+   if (invariant) {
+      string key = ref.exp->toString();
+      if (!shared.containsKey(key)) shared.put(key, cache.newSlot());
+      report.add(integerToString(lineNumber) + ": " + key);
+      replace(ref, new CachedExp(ref.exp, shared.get(key), epoch, false));
+      return;
+   }
+   Vector<ExpRef> children;
+   getChildren(ref, children);
+   for (ExpRef & child : children) {
+      hoist(child, assigned, shared, epoch, cache, lineNumber, report);
+   }
+}
+
+static void share(ExpRef & ref, HashMap<string,int> & available,
+                  Vector<Candidate> & candidates, int lineNumber) {
+   if (!isCacheable(ref.exp)) return;
+   string key = ref.exp->toString();
+   if (available.containsKey(key)) {
+      candidates[available.get(key)].uses.add(ref);
+      return;
+   }
+   Candidate c;
+   c.def = ref;
+   c.lineNumber = lineNumber;
+   collectVariables(ref.exp, c.vars);
+   available.put(key, candidates.size());
+   candidates.add(c);
+   Vector<ExpRef> children;
+   getChildren(ref, children);
+   for (ExpRef & child : children) {
+      share(child, available, candidates, lineNumber);
+   }
+}
+
+/*
+ * Implementation notes: getRoots, getChildren, replace
+ * ----------------------------------------------------
+ * These functions know where statements and expressions keep their
+ * subexpressions.  The IF condition's left side comes first because
+ * IfStmt::test evaluates it first, and the subscripts of an element on
+ * the left of LET come after the value, since they are evaluated after
+ * it.  A MAT has either a scale or bounds, never both, so its first root
+ * is whichever it has.
+ */
+
+static void getRoots(Statement *stmt, StatementType type, Vector<ExpRef> & refs) {
+   ExpRef ref;
+   ref.stmt = stmt;
+   ref.parent = NULL;
+   ref.rhs = false;
+   ref.arg = 0;
+   switch (type) {
+    case PRINT_STMT:
+      ref.exp = ((PrintStmt *) stmt)->getExp();
+      refs.add(ref);
+      break;
+    case LET_STMT: {
+      ref.exp = ((LetStmt *) stmt)->getExp();
+      refs.add(ref);
+      ArrayExp *element = ((LetStmt *) stmt)->getElement();
+      if (element == NULL) break;
+      ref.parent = element;
+      ref.exp = element->getFirst();
+      refs.add(ref);
+      if (element->getSecond() == NULL) break;
+      ref.exp = element->getSecond();
+      ref.rhs = true;
+      refs.add(ref);
+      break;
+    }
+    case DIM_STMT:
+      ref.exp = ((DimStmt *) stmt)->getFirst();
+      refs.add(ref);
+      if (((DimStmt *) stmt)->getSecond() == NULL) break;
+      ref.exp = ((DimStmt *) stmt)->getSecond();
+      ref.rhs = true;
+      refs.add(ref);
+      break;
+    case MAT_STMT: {
+      MatStmt *mat = (MatStmt *) stmt;
+      ref.exp = (mat->getScale() != NULL) ? mat->getScale() : mat->getFirst();
+      if (ref.exp == NULL) break;
+      refs.add(ref);
+      if (mat->getSecond() == NULL) break;
+      ref.exp = mat->getSecond();
+      ref.rhs = true;
+      refs.add(ref);
+      break;
+    }
+    case PARALLEL_FOR_STMT:
+      ref.exp = ((ParallelForStmt *) stmt)->getFirst();
+      refs.add(ref);
+      ref.exp = ((ParallelForStmt *) stmt)->getLast();
+      ref.rhs = true;
+      refs.add(ref);
+      break;
+    case ON_GOTO_STMT:
+    case ON_GOSUB_STMT:
+      ref.exp = ((OnStmt *) stmt)->getExp();
+      refs.add(ref);
+      break;
+    case IF_STMT:
+      ref.exp = ((IfStmt *) stmt)->getLHS();
+      refs.add(ref);
+      ref.exp = ((IfStmt *) stmt)->getRHS();
+      ref.rhs = true;
+      refs.add(ref);
+      break;
+    default:
+      break;
+   }
+}
+
+static void getChildren(ExpRef & ref, Vector<ExpRef> & refs) {
+   ExpRef child;
+   child.stmt = ref.stmt;
+   child.parent = ref.exp;
+   child.rhs = false;
+   child.arg = 0;
+   if (ref.exp->getType() == CACHED) {
+      child.exp = ((CachedExp *) ref.exp)->getExp();
+      refs.add(child);
+   } else if (ref.exp->getType() == INDEX) {
+      child.exp = ((IndexExp *) ref.exp)->getSubscript();
+      refs.add(child);
+   } else if (ref.exp->getType() == ARRAY) {
+      ArrayExp *exp = (ArrayExp *) ref.exp;
+      child.exp = exp->getFirst();
+      refs.add(child);
+      if (exp->getSecond() == NULL) return;
+      child.exp = exp->getSecond();
+      child.rhs = true;
+      refs.add(child);
+   } else if (ref.exp->getType() == COMPOUND) {
+      CompoundExp *exp = (CompoundExp *) ref.exp;
+      child.exp = exp->getLHS();
+      refs.add(child);
+      child.exp = exp->getRHS();
+      child.rhs = true;
+      refs.add(child);
+   } else if (ref.exp->getType() == CALL) {
+      CallExp *exp = (CallExp *) ref.exp;
+      for (int i = 0; i < exp->getArgCount(); i++) {
+         child.exp = exp->getArg(i);
+         child.arg = i;
+         refs.add(child);
+      }
+   }
+}
+
+static void replace(ExpRef & ref, Expression *exp) {
+   if (ref.parent != NULL && ref.parent->getType() == CACHED) {
+      ((CachedExp *) ref.parent)->setExp(exp);
+   } else if (ref.parent != NULL && ref.parent->getType() == INDEX) {
+      ((IndexExp *) ref.parent)->setSubscript(exp);
+   } else if (ref.parent != NULL && ref.parent->getType() == ARRAY) {
+      if (ref.rhs) {
+         ((ArrayExp *) ref.parent)->setSecond(exp);
+      } else {
+         ((ArrayExp *) ref.parent)->setFirst(exp);
+      }
+   } else if (ref.parent != NULL && ref.parent->getType() == CALL) {
+      ((CallExp *) ref.parent)->setArg(ref.arg, exp);
+   } else if (ref.parent != NULL) {
+      if (ref.rhs) {
+         ((CompoundExp *) ref.parent)->setRHS(exp);
+      } else {
+         ((CompoundExp *) ref.parent)->setLHS(exp);
+      }
+   } else if (ref.stmt->getType() == PRINT_STMT) {
+      ((PrintStmt *) ref.stmt)->setExp(exp);
+   } else if (ref.stmt->getType() == LET_STMT) {
+      ((LetStmt *) ref.stmt)->setExp(exp);
+   } else if (ref.stmt->getType() == ON_GOTO_STMT
+              || ref.stmt->getType() == ON_GOSUB_STMT) {
+      ((OnStmt *) ref.stmt)->setExp(exp);
+   } else if (ref.stmt->getType() == DIM_STMT) {
+      if (ref.rhs) {
+         ((DimStmt *) ref.stmt)->setSecond(exp);
+      } else {
+         ((DimStmt *) ref.stmt)->setFirst(exp);
+      }
+   } else if (ref.stmt->getType() == MAT_STMT) {
+      MatStmt *mat = (MatStmt *) ref.stmt;
+      if (ref.rhs) {
+         mat->setSecond(exp);
+      } else if (mat->getScale() != NULL) {
+         mat->setScale(exp);
+      } else {
+         mat->setFirst(exp);
+      }
+   } else if (ref.stmt->getType() == PARALLEL_FOR_STMT) {
+      if (ref.rhs) {
+         ((ParallelForStmt *) ref.stmt)->setLast(exp);
+      } else {
+         ((ParallelForStmt *) ref.stmt)->setFirst(exp);
+      }
+   } else if (ref.rhs) {
+      ((IfStmt *) ref.stmt)->setRHS(exp);
+   } else {
+      ((IfStmt *) ref.stmt)->setLHS(exp);
+   }
+   ref.exp = exp;
+}
+
+static void collectVariables(Expression *exp, Vector<string> & vars) {
+   if (exp->getType() == IDENTIFIER) {
+      vars.add(((IdentifierExp *) exp)->getName());
+   } else if (exp->getType() == INDEX) {
+      vars.add(getShapeKey(((IndexExp *) exp)->getArray()));
+      collectVariables(((IndexExp *) exp)->getSubscript(), vars);
+   } else if (exp->getType() == ARRAY) {
+      vars.add(getElementsKey(((ArrayExp *) exp)->getName()));
+      collectVariables(((ArrayExp *) exp)->getFirst(), vars);
+      if (((ArrayExp *) exp)->getSecond() != NULL) {
+         collectVariables(((ArrayExp *) exp)->getSecond(), vars);
+      }
+   } else if (exp->getType() == COMPOUND) {
+      collectVariables(((CompoundExp *) exp)->getLHS(), vars);
+      collectVariables(((CompoundExp *) exp)->getRHS(), vars);
+   } else if (exp->getType() == CALL) {
+      CallExp *call = (CallExp *) exp;
+      for (int i = 0; i < call->getArgCount(); i++) {
+         collectVariables(call->getArg(i), vars);
+      }
+   } else if (exp->getType() == CACHED) {
+      collectVariables(((CachedExp *) exp)->getExp(), vars);
+   } else if (exp->getType() == FLAT) {
+      collectVariables(((FlatExp *) exp)->getTree(), vars);
+   }
+}
+
+/*
+ * Implementation notes: getWrites, isCacheable
+ * --------------------------------------------
+ * A node's writes are named as collectVariables names its reads, so an
+ * array element goes stale when its array is assigned and a subscript
+ * check only when the array is dimensioned again.  Compound expressions,
+ * function calls, subscript checks and array elements are worth caching;
+ * constants and variables cost no more to evaluate than a cached value.
+ * A cached string shares its buffer with the slot, so nothing appends to
+ * it in place.
+ */
+
+static void getWrites(CfgNode & node, Vector<string> & writes) {
+   IdentifierExp *var = getDefinition(node);
+   if (var != NULL) writes.add(var->getName());
+   getArrayWrites(node, writes);
+   if (node.type == PARALLEL_FOR_STMT) {
+      for (string key : ((ParallelForStmt *) node.stmt)->getWrites()) {
+         writes.add(key);
+      }
+   }
+}
+
+static bool isCacheable(Expression *exp) {
+   ExpressionType type = exp->getType();
+   return type == COMPOUND || type == CALL || type == INDEX || type == ARRAY;
+}
+
+/*
+ * Implementation notes: computeDominators, dominates
+ * --------------------------------------------------
+ * This is the iterative algorithm of Cooper, Harvey and Kennedy, which
+ * walks the immediate-dominator tree using reverse postorder numbers.
+ * Unreachable nodes have no immediate dominator and are marked with -1.
+ */
+
+static Vector<int> computeDominators(ControlFlowGraph & graph, int entry,
+                                     Vector<int> & order) {
+   Vector<int> number(graph.size(), -1);
+   for (int i = 0; i < order.size(); i++) {
+      number[order[i]] = i;
+   }
+   Vector<Vector<int> > preds = graph.getPredecessors();
+   Vector<int> idom(graph.size(), -1);
+   idom[entry] = entry;
+   bool changed = true;
+   while (changed) {
+      changed = false;
+      for (int index : order) {
+         if (index == entry) continue;
+         int newIdom = -1;
+         for (int pred : preds[index]) {
+            if (idom[pred] == -1) continue;
+            if (newIdom == -1) {
+               newIdom = pred;
+               continue;
+            }
+            int a = pred;
+            int b = newIdom;
+            while (a != b) {
+               while (number[a] > number[b]) a = idom[a];
+               while (number[b] > number[a]) b = idom[b];
+            }
+            newIdom = a;
+         }
+         if (idom[index] != newIdom) {
+            idom[index] = newIdom;
+            changed = true;
+         }
+      }
+   }
+   return idom;
+}
+
+static bool dominates(Vector<int> & idom, int entry, int dominator, int index) {
+   while (true) {
+      if (index == dominator) return true;
+      if (index == entry || idom[index] == -1) return false;
+      index = idom[index];
+   }
+}
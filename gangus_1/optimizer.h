@@ -0,0 +1,168 @@
+/*
+ * File: optimizer.h
+ * -----------------
+ * This interface exports the optimizations that the compiler applies to
+ * the expressions of a program: hoisting loop-invariant subexpressions
+ * and sharing common subexpressions within a basic block.  Both work by
+ * wrapping subexpressions in CachedExp nodes whose values live in an
+ * ExpressionCache, so the program's behavior, including which errors it
+ * raises and where, is exactly that of the unoptimized program.
+ */
+
+#ifndef _optimizer_h
+#define _optimizer_h
+
+#include "cfg.h"
+#include "exp.h"
+#include "flatexp.h"
+#include "vector.h"
+
+/*
+ * Class: ExpressionCache
+ * ----------------------
+ * Owns the cache slots and epoch counters used by the CachedExp nodes
+ * of one compiled program.  The first epoch counter is the run epoch,
+ * which only moves when a run starts; the others belong to loops.
+ */
+
+class ExpressionCache {
+
+public:
+
+   ExpressionCache();
+   ~ExpressionCache();
+
+/*
+ * Methods: newEpoch, newSlot
+ * Usage: unsigned *epoch = cache.newEpoch();
+ *        CacheSlot *slot = cache.newSlot();
+ * -----------------------------------------
+ * Allocate an epoch counter or a slot that stays valid as long as the
+ * cache does.  A new slot is stale under every epoch.
+ */
+
+   unsigned *newEpoch();
+   CacheSlot *newSlot();
+
+/*
+ * Method: getRunEpoch
+ * Usage: unsigned *epoch = cache.getRunEpoch();
+ * ---------------------------------------------
+ * Returns the epoch counter that moves only when a run starts.
+ */
+
+   unsigned *getRunEpoch();
+
+/*
+ * Method: invalidate
+ * Usage: cache.invalidate();
+ * --------------------------
+ * Advances every epoch counter, which makes every slot stale.  The run
+ * loop calls this before each run, since RESUME can enter a loop or a
+ * basic block in the middle.
+ */
+
+   void invalidate();
+
+/*
+ * Method: getSlotCount
+ * Usage: int n = cache.getSlotCount();
+ * ------------------------------------
+ * Returns the number of slots allocated.
+ */
+
+   int getSlotCount();
+
+private:
+
+   Vector<unsigned *> epochs;
+   Vector<CacheSlot *> slots;
+
+/* Copying a cache would share its counters, so it is not allowed */
+
+   ExpressionCache(const ExpressionCache & src);
+   ExpressionCache & operator=(const ExpressionCache & src);
+
+};
+
+/*
+ * Functions: setOptimizing, isOptimizing
+ * Usage: setOptimizing(false);
+ * ----------------------------
+ * Turn the optimizations in this interface on or off for programs
+ * compiled from now on.  They are on by default; turning them off gives
+ * the reference behavior to compare against.
+ */
+
+void setOptimizing(bool flag);
+bool isOptimizing();
+
+/*
+ * Function: hoistLoopInvariants
+ * Usage: entry = hoistLoopInvariants(graph, entry, cache, report);
+ * ----------------------------------------------------------------
+ * Finds the natural loops of the graph, whose back edges are GOTO and
+ * IF edges to a line that dominates their source.  Each subexpression
+ * of a loop that reads no variable assigned in the loop is cached for
+ * as long as control stays in the loop, using the outermost loop for
+ * which that holds.  A LOOP_ENTRY node is added in front of each loop
+ * header to start a new epoch whenever the loop is entered from
+ * outside.  The value is computed the first time the subexpression is
+ * evaluated in an epoch rather than at loop entry, so a subexpression
+ * that would fail is only evaluated where the program evaluates it.
+ *
+ * The function returns the new entry node, which changes if the entry
+ * is a loop header.  Each hoisted subexpression is added to report as
+ * a string such as "30: (A * B)".
+ */
+
+int hoistLoopInvariants(ControlFlowGraph & graph, int entry,
+                        ExpressionCache & cache, Vector<std::string> & report);
+
+/*
+ * Function: shareCommonSubexpressions
+ * Usage: shareCommonSubexpressions(graph, entry, cache, report);
+ * --------------------------------------------------------------
+ * Within each basic block, the first evaluation of a subexpression
+ * stores its value and later identical subexpressions reuse it, until
+ * a LET or INPUT assigns one of the variables it reads.  Each shared
+ * subexpression is added to report as a string such as "40: (I * 2)".
+ */
+
+void shareCommonSubexpressions(ControlFlowGraph & graph, int entry,
+                               ExpressionCache & cache,
+                               Vector<std::string> & report);
+
+/*
+ * Function: foldConstants
+ * Usage: int folded = foldConstants(graph);
+ * -----------------------------------------
+ * Replaces every arithmetic subexpression of constants with its value,
+ * except divisions by zero, and returns the number of expressions that
+ * changed.
+ */
+
+int foldConstants(ControlFlowGraph & graph);
+
+/*
+ * Function: flattenExpressions
+ * Usage: flattenExpressions(graph, flats, slots, elements);
+ *        flattenExpressions(graph, nodes, flats, slots, elements);
+ * ---------------------------------------------------------
+ * Replaces every expression in the graph with a FlatExp and the
+ * variables that LET and INPUT assign with SlotExp nodes.  The new nodes
+ * are added to flats and slots, and the array elements that LET assigns
+ * to elements; they must all be linked to an EvalState
+ * before the program runs.  This must be the last pass, since the
+ * others work on trees.  The first form flattens the reachable nodes and
+ * the second the listed ones, such as the body of a PARALLEL FOR.
+ */
+
+void flattenExpressions(ControlFlowGraph & graph, Vector<FlatExp *> & flats,
+                        Vector<SlotExp *> & slots,
+                        Vector<ArrayExp *> & elements);
+void flattenExpressions(ControlFlowGraph & graph, Vector<int> & nodes,
+                        Vector<FlatExp *> & flats, Vector<SlotExp *> & slots,
+                        Vector<ArrayExp *> & elements);
+
+#endif
@@ -0,0 +1,462 @@
+/*
+ * File: output.cpp
+ * ----------------
+ * This file implements the output.h interface.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "accounting.h"
+#include "error.h"
+#include "output.h"
+#include "strlib.h"
+#include "value.h"
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define write _write
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+/* Constants */
+
+static const int BUFFER_SIZE = 1 << 16;
+static const int RING_SIZE = 8;
+static const int MAX_LINE = 24;
+
+/*
+ * Type: Block
+ * -----------
+ * A block is one output buffer.  The interpreter fills one block at a
+ * time; the others are either waiting for the writer or free.
+ */
+
+struct Block {
+   char data[BUFFER_SIZE];
+   int length;
+};
+
+/*
+ * Class: BlockRing
+ * ----------------
+ * A lock-free single-producer, single-consumer ring of block pointers.
+ * The head and tail counters only grow, so the ring holds exactly
+ * RING_SIZE entries and full and empty are easy to tell apart.
+ */
+
+class BlockRing {
+public:
+   BlockRing() : head(0), tail(0) { }
+
+   bool push(Block *block) {
+      unsigned t = tail.load(memory_order_relaxed);
+      if (t - head.load(memory_order_acquire) == RING_SIZE) return false;
+      slots[t % RING_SIZE] = block;
+      tail.store(t + 1, memory_order_release);
+      return true;
+   }
+
+   Block *pop() {
+      unsigned h = head.load(memory_order_relaxed);
+      if (h == tail.load(memory_order_acquire)) return NULL;
+      Block *block = slots[h % RING_SIZE];
+      head.store(h + 1, memory_order_release);
+      return block;
+   }
+
+   bool isEmpty() {
+      return head.load(memory_order_relaxed) == tail.load(memory_order_acquire);
+   }
+
+private:
+   Block *slots[RING_SIZE];
+   atomic<unsigned> head;
+   atomic<unsigned> tail;
+};
+
+/* Private state */
+
+static FlushPolicy policy = FLUSH_ON_INPUT;
+static long limit = 0;
+static int interactive = -1;
+static bool started = false;
+static Block *current = NULL;
+static atomic<long long> pendingSince(0);
+static BlockRing fullBlocks;
+static BlockRing freeBlocks;
+static atomic<long> submitted(0);
+static atomic<long> written(0);
+static atomic<bool> stopping(false);
+static thread writer;
+static mutex bufferLock;
+static mutex waitLock;
+static condition_variable work;
+static condition_variable done;
+
+/* Private function prototypes */
+
+static bool isInteractive();
+static void startWriter();
+static void stopWriter();
+static void writerLoop();
+static bool takePending();
+static void writeBlock(Block *block);
+static void recycle(Block *block);
+static unique_lock<mutex> lockBuffer();
+static void submit();
+static void reserve(int n);
+static void append(const char *chars, int length);
+static void afterWrite();
+static void wakeWriter();
+static long long currentTimeMillis();
+
+/*
+ * Implementation notes: setFlushPolicy
+ * ------------------------------------
+ * The string form splits the spec at the colon and checks that a limit
+ * is present for the size and time policies.
+ */
+
+void setFlushPolicy(FlushPolicy newPolicy, long newLimit) {
+   if ((newPolicy == FLUSH_BY_SIZE || newPolicy == FLUSH_BY_TIME)
+       && newLimit <= 0) {
+      error("Flush limit must be positive");
+   }
+   policy = newPolicy;
+   limit = newLimit;
+}
+
+void setFlushPolicy(string spec) {
+   string name = toLowerCase(spec);
+   string arg;
+   size_t colon = name.find(':');
+   if (colon != string::npos) {
+      arg = name.substr(colon + 1);
+      name = name.substr(0, colon);
+   }
+   if (name == "exit" && arg == "") {
+      setFlushPolicy(FLUSH_ON_EXIT);
+   } else if (name == "input" && arg == "") {
+      setFlushPolicy(FLUSH_ON_INPUT);
+   } else if (name == "size" && arg != "") {
+      setFlushPolicy(FLUSH_BY_SIZE, stringToInteger(arg));
+   } else if (name == "time" && arg != "") {
+      setFlushPolicy(FLUSH_BY_TIME, stringToInteger(arg));
+   } else {
+      error("Unknown flush policy " + spec);
+   }
+}
+
+/*
+ * Implementation notes: printInteger, printLine, printChars, printText
+ * --------------------------------------------------------------------
+ * On a terminal these functions behave exactly like cout with endl.
+ * Otherwise integers are formatted with to_chars straight into the
+ * current block, which avoids both the stream machinery and the flush.
+ * Under FLUSH_BY_TIME the writer may take the current block, so the
+ * block is only touched with bufferLock held.
+ */
+
+void printInteger(long long value) {
+   if (isInteractive()) {
+      cout << value << endl;
+      return;
+   }
+   unique_lock<mutex> guard = lockBuffer();
+   reserve(MAX_LINE);
+   char *end = current->data + current->length;
+   end = to_chars(end, end + MAX_LINE - 1, value).ptr;
+   *end++ = '\n';
+   current->length = end - current->data;
+   afterWrite();
+}
+
+void printValue(const Value & value) {
+   if (value.isInteger()) {
+      printInteger(value.getInteger());
+   } else if (value.isString()) {
+      printChars(value.getChars(), value.getLength());
+   } else {
+      printLine(value.toString());
+   }
+}
+
+void printLine(const string & line) {
+   if (isInteractive()) {
+      cout << line << endl;
+      return;
+   }
+   printText(line);
+   printText("\n");
+}
+
+void printChars(const char *chars, int length) {
+   if (isInteractive()) {
+      cout.write(chars, length) << endl;
+      return;
+   }
+   unique_lock<mutex> guard = lockBuffer();
+   append(chars, length);
+   append("\n", 1);
+   afterWrite();
+}
+
+void printText(const string & text) {
+   if (isInteractive()) {
+      cout << text;
+      return;
+   }
+   unique_lock<mutex> guard = lockBuffer();
+   append(text.data(), text.length());
+   afterWrite();
+}
+
+void flushBeforeInput() {
+   if (isInteractive()) {
+      cout.flush();
+   } else if (policy != FLUSH_ON_EXIT) {
+      flushOutput();
+   }
+}
+
+/*
+ * Implementation notes: isOutputReady
+ * -----------------------------------
+ * Only the interpreter takes blocks from freeBlocks, so once a free
+ * block is seen it is still there when the next line is printed.  The
+ * current block is handed off only when it is full, and fullBlocks has
+ * room for every block, so that hand-off never waits.
+ */
+
+bool isOutputReady() {
+   if (isInteractive() || !started) return true;
+   unique_lock<mutex> guard = lockBuffer();
+   if (current != NULL && current->length + MAX_LINE <= BUFFER_SIZE) return true;
+   return !freeBlocks.isEmpty();
+}
+
+/*
+ * Implementation notes: waitForOutput
+ * -----------------------------------
+ * When isOutputReady fails, the current block is full and the only way
+ * forward is a block the writer recycles, which it announces on done.
+ */
+
+void waitForOutput() {
+   if (isOutputReady()) return;
+   unique_lock<mutex> guard(waitLock);
+   while (freeBlocks.isEmpty()) done.wait(guard);
+}
+
+/*
+ * Implementation notes: flushOutput
+ * ---------------------------------
+ * Every block handed to the writer bumps submitted, and the writer bumps
+ * written once the block is on its way to the operating system, so the
+ * output is complete when the two counters agree.
+ */
+
+void flushOutput() {
+   if (!started) {
+      cout.flush();
+      return;
+   }
+   {
+      unique_lock<mutex> guard = lockBuffer();
+      if (current != NULL && current->length > 0) submit();
+   }
+   unique_lock<mutex> guard(waitLock);
+   while (written.load(memory_order_acquire) != submitted.load()) {
+      done.wait(guard);
+   }
+}
+
+/*
+ * Implementation notes: writer management
+ * ---------------------------------------
+ * The writer thread is started on first use and stopped by an atexit
+ * handler, which also writes any output that is still pending.  Blocks
+ * circulate between the two rings and are never freed while the
+ * interpreter runs.
+ *
+ * The writer sleeps on the work condition until a block is full, the
+ * interpreter exits or, under FLUSH_BY_TIME, the oldest pending byte
+ * reaches its deadline.  It then takes the current block itself, so
+ * the output appears on time even when the program prints nothing more.
+ * It only tries for bufferLock: the interpreter may hold it while it
+ * waits for the writer to free a block, and if the lock is busy the
+ * interpreter is printing and its own afterWrite meets the deadline.
+ * Waiting threads check their conditions with waitLock held, and the
+ * threads that change them take waitLock before they notify, so no
+ * wakeup is lost.
+ */
+
+static bool isInteractive() {
+   if (interactive == -1) interactive = isatty(1) ? 1 : 0;
+   return interactive == 1;
+}
+
+static void startWriter() {
+   MemoryScope scope(MEM_OUTPUT);
+   for (int i = 0; i < RING_SIZE; i++) {
+      Block *block = new Block;
+      block->length = 0;
+      freeBlocks.push(block);
+   }
+   cout.flush();
+   started = true;
+   writer = thread(writerLoop);
+   atexit(stopWriter);
+}
+
+static void stopWriter() {
+   flushOutput();
+   stopping = true;
+   wakeWriter();
+   writer.join();
+}
+
+static void writerLoop() {
+   while (true) {
+      Block *block = fullBlocks.pop();
+      if (block != NULL) {
+         writeBlock(block);
+         recycle(block);
+         continue;
+      }
+      unique_lock<mutex> guard(waitLock);
+      if (!fullBlocks.isEmpty()) continue;
+      if (stopping) return;
+      long long since = pendingSince.load();
+      if (policy != FLUSH_BY_TIME || since == 0) {
+         work.wait(guard);
+      } else if (currentTimeMillis() - since < limit) {
+         chrono::milliseconds deadline(since + limit);
+         work.wait_until(guard, chrono::steady_clock::time_point(deadline));
+      } else {
+         guard.unlock();
+         if (takePending()) continue;
+         guard.lock();
+         work.wait_for(guard, chrono::milliseconds(1));
+      }
+   }
+}
+
+static bool takePending() {
+   unique_lock<mutex> guard(bufferLock, try_to_lock);
+   if (!guard.owns_lock()) return false;
+   Block *block = current;
+   long long since = pendingSince.load();
+   if (since != 0 && currentTimeMillis() - since < limit) return true;
+   pendingSince = 0;
+   if (block == NULL || block->length == 0) return true;
+   current = NULL;
+   submitted.fetch_add(1);
+   guard.unlock();
+   writeBlock(block);
+   recycle(block);
+   return true;
+}
+
+static void writeBlock(Block *block) {
+   const char *cp = block->data;
+   int remaining = block->length;
+   while (remaining > 0) {
+      int n = write(1, cp, remaining);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         return;
+      }
+      cp += n;
+      remaining -= n;
+   }
+}
+
+static void recycle(Block *block) {
+   block->length = 0;
+   freeBlocks.push(block);
+   written.fetch_add(1, memory_order_release);
+   {
+      lock_guard<mutex> guard(waitLock);
+   }
+   done.notify_all();
+}
+
+/*
+ * Implementation notes: submit, reserve, append, afterWrite
+ * ---------------------------------------------------------
+ * These functions run only on the interpreter thread, which is the sole
+ * producer for fullBlocks and the sole consumer of freeBlocks.  If the
+ * writer falls behind, the interpreter waits for a free block, which
+ * bounds the memory used by the pipeline.  Every block is in one ring
+ * or current, so the push in submit always finds room.
+ */
+
+static unique_lock<mutex> lockBuffer() {
+   if (policy != FLUSH_BY_TIME) return unique_lock<mutex>();
+   return unique_lock<mutex>(bufferLock);
+}
+
+static void submit() {
+   submitted.fetch_add(1);
+   fullBlocks.push(current);
+   current = NULL;
+   pendingSince = 0;
+   wakeWriter();
+}
+
+static void reserve(int n) {
+   if (!started) startWriter();
+   if (current != NULL && current->length + n > BUFFER_SIZE) submit();
+   if (current == NULL) {
+      unique_lock<mutex> guard(waitLock);
+      while ((current = freeBlocks.pop()) == NULL) done.wait(guard);
+   }
+   if (current->length == 0 && policy == FLUSH_BY_TIME) {
+      pendingSince = currentTimeMillis();
+      wakeWriter();
+   }
+}
+
+static void append(const char *chars, int length) {
+   while (length > 0) {
+      reserve(1);
+      int n = BUFFER_SIZE - current->length;
+      if (n > length) n = length;
+      memcpy(current->data + current->length, chars, n);
+      current->length += n;
+      chars += n;
+      length -= n;
+   }
+}
+
+static void afterWrite() {
+   if (policy == FLUSH_BY_SIZE) {
+      if (current->length >= limit) submit();
+   } else if (policy == FLUSH_BY_TIME) {
+      if (currentTimeMillis() - pendingSince >= limit) submit();
+   }
+}
+
+static void wakeWriter() {
+   {
+      lock_guard<mutex> guard(waitLock);
+   }
+   work.notify_one();
+}
+
+static long long currentTimeMillis() {
+   return chrono::duration_cast<chrono::milliseconds>(
+             chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,132 @@
+/*
+ * File: output.h
+ * --------------
+ * This interface exports the output subsystem used by PRINT, LIST and
+ * the command loop.  When standard output is a terminal, every line is
+ * written and flushed immediately, exactly as with cout and endl.  When
+ * it is a file or a pipe, output is formatted into large buffers that a
+ * writer thread hands to the operating system, so an output-heavy
+ * program no longer pays for a system call on every line.
+ */
+
+#ifndef _output_h
+#define _output_h
+
+#include <string>
+#include "value.h"
+
+/*
+ * Type: FlushPolicy
+ * -----------------
+ * This enumerated type selects when a partly filled buffer is handed
+ * to the writer thread.  Full buffers are always handed off at once.
+ *
+ *  FLUSH_ON_EXIT  -- only when the interpreter exits
+ *  FLUSH_ON_INPUT -- also before the interpreter reads any input
+ *  FLUSH_BY_SIZE  -- also whenever limit bytes are pending
+ *  FLUSH_BY_TIME  -- also when the oldest pending byte is limit ms old
+ */
+
+enum FlushPolicy { FLUSH_ON_EXIT, FLUSH_ON_INPUT, FLUSH_BY_SIZE, FLUSH_BY_TIME };
+
+/*
+ * Function: setFlushPolicy
+ * Usage: setFlushPolicy(FLUSH_BY_SIZE, 4096);
+ *        setFlushPolicy("time:100");
+ * -----------------------------------------
+ * Sets the flush policy for buffered output.  The second form accepts
+ * the spelling used by the --flush option: exit, input, size:bytes or
+ * time:millis.  The default policy is FLUSH_ON_INPUT.
+ */
+
+void setFlushPolicy(FlushPolicy policy, long limit = 0);
+void setFlushPolicy(std::string spec);
+
+/*
+ * Function: printInteger
+ * Usage: printInteger(value);
+ * ---------------------------
+ * Writes value followed by a newline.
+ */
+
+void printInteger(long long value);
+
+/*
+ * Function: printValue
+ * Usage: printValue(value);
+ * -------------------------
+ * Writes value as PRINT shows it, followed by a newline.  A string is
+ * copied straight from the value, so printing one makes no temporary.
+ */
+
+void printValue(const Value & value);
+
+/*
+ * Function: printLine
+ * Usage: printLine(line);
+ * -----------------------
+ * Writes line followed by a newline.
+ */
+
+void printLine(const std::string & line);
+
+/*
+ * Function: printChars
+ * Usage: printChars(chars, length);
+ * ---------------------------------
+ * Writes the length characters at chars followed by a newline.
+ */
+
+void printChars(const char *chars, int length);
+
+/*
+ * Function: printText
+ * Usage: printText(text);
+ * -----------------------
+ * Writes text with no newline, as for a prompt.
+ */
+
+void printText(const std::string & text);
+
+/*
+ * Function: flushBeforeInput
+ * Usage: flushBeforeInput();
+ * --------------------------
+ * Applies the flush policy before the interpreter blocks on input, so
+ * that prompts are visible under FLUSH_ON_INPUT.
+ */
+
+void flushBeforeInput();
+
+/*
+ * Function: isOutputReady
+ * Usage: if (isOutputReady()) . . .
+ * ---------------------------------
+ * Returns true if a line of PRINT output can be written without waiting
+ * for the writer thread to free a buffer.  It is always true on a
+ * terminal.
+ */
+
+bool isOutputReady();
+
+/*
+ * Function: waitForOutput
+ * Usage: waitForOutput();
+ * -----------------------
+ * Blocks until isOutputReady would return true.
+ */
+
+void waitForOutput();
+
+/*
+ * Function: flushOutput
+ * Usage: flushOutput();
+ * ---------------------
+ * Hands any pending output to the writer and waits until it has been
+ * written.  This is called before error messages so that they appear
+ * after the output that preceded them.
+ */
+
+void flushOutput();
+
+#endif
@@ -0,0 +1,608 @@
+/*
+ * File: parallel.cpp
+ * ------------------
+ * This file implements the parallel.h interface.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <string>
+#include "analysis.h"
+#include "budget.h"
+#include "cfg.h"
+#include "compiler.h"
+#include "error.h"
+#include "evalstate.h"
+#include "exp.h"
+#include "hashmap.h"
+#include "parallel.h"
+#include "stats.h"
+#include "statement.h"
+#include "strlib.h"
+#include "threadpool.h"
+#include "vector.h"
+using namespace std;
+
+/* Constants */
+
+static const long long CHARGE_INTERVAL = 1024;
+static const long long FIRST_SLICE = 64;
+static const int SLICE_MILLIS = 10;
+
+/* Private function prototypes */
+
+static string describe(ControlFlowGraph & graph, int header);
+static void checkBody(ControlFlowGraph & graph, int header, int end);
+static Vector<int> getBodySuccessors(CfgNode & node);
+static bool matchReduction(CfgNode & node, Reduction & reduction);
+
+/*
+ * Implementation notes: checkParallelLoops
+ * ----------------------------------------
+ * The jumps are checked on the edges as the graph builds them, before
+ * skipComments and collapseJumps can route a jump through a body line
+ * to somewhere else.  Every line of a body is checked, reachable or not,
+ * and owner records which loop each line belongs to, NEXT included.
+ */
+
+void checkParallelLoops(ControlFlowGraph & graph) {
+   Vector<int> owner(graph.size(), -1);
+   for (int i = 0; i < graph.size() && graph.isSourceNode(i); i++) {
+      if (graph.getNode(i).type != PARALLEL_FOR_STMT) continue;
+      int end = graph.getLoopEnd(i);
+      if (end == MISSING_NODE) {
+         error("PARALLEL FOR without NEXT at line "
+               + integerToString(graph.getNode(i).lineNumber));
+      }
+      checkBody(graph, i, end);
+      for (int j = i + 1; j <= end; j++) {
+         owner[j] = i;
+      }
+   }
+   for (int i = 0; i < graph.size() && graph.isSourceNode(i); i++) {
+      if (owner[i] != -1) continue;
+      for (int succ : graph.getSuccessors(i)) {
+         if (owner[succ] != -1) {
+            error("Cannot jump into the " + describe(graph, owner[succ]));
+         }
+      }
+   }
+}
+
+static string describe(ControlFlowGraph & graph, int header) {
+   return "PARALLEL FOR at line " + integerToString(graph.getNode(header).lineNumber);
+}
+
+static void checkBody(ControlFlowGraph & graph, int header, int end) {
+   string loop = describe(graph, header);
+   string variable = ((ParallelForStmt *) graph.getNode(header).stmt)
+                        ->getVariable()->getName();
+   for (int j = header + 1; j < end; j++) {
+      CfgNode & node = graph.getNode(j);
+      switch (node.type) {
+       case LET_STMT: case GOTO_STMT: case REM_STMT:
+         break;
+       case IF_STMT: {
+         string op = ((IfStmt *) node.stmt)->getOp();
+         if (op != "=" && op != "<" && op != ">") {
+            error(loop + " cannot end the program");
+         }
+         break;
+       }
+       default:
+         error(loop + " cannot contain " + statementTypeToString(node.type));
+      }
+      IdentifierExp *var = getDefinition(node);
+      if (var != NULL && var->getName() == variable) {
+         error(loop + " assigns its loop variable " + variable);
+      }
+      for (int succ : getBodySuccessors(node)) {
+         if (succ <= header || succ > end) error(loop + " cannot leave its body");
+      }
+   }
+}
+
+/*
+ * Implementation notes: getBodySuccessors
+ * ---------------------------------------
+ * Only the fields a body statement uses are successors; a GOTO's next
+ * field and the target of a LET are EXIT_NODE without meaning that the
+ * line leaves the body.
+ */
+
+static Vector<int> getBodySuccessors(CfgNode & node) {
+   Vector<int> result;
+   if (node.type != GOTO_STMT) result.add(node.next);
+   if (node.type == GOTO_STMT || node.type == IF_STMT) result.add(node.target);
+   return result;
+}
+
+/*
+ * Implementation notes: ParallelLoop constructor
+ * ----------------------------------------------
+ * The body lines are the nodes reachable from the line after the
+ * header, kept in line order.  The assigned variables are then sorted
+ * into reductions and privates.  A private must be in the set of
+ * variables assigned on every path to each of its reads, which is the
+ * definite-assignment analysis of analysis.cpp on the body alone,
+ * starting from nothing at the top of each iteration.
+ */
+
+ParallelLoop::ParallelLoop(ControlFlowGraph & graph, int header, bool record) {
+   stmt = (ParallelForStmt *) graph.getNode(header).stmt;
+   lineNumber = graph.getNode(header).lineNumber;
+   string loop = describe(graph, header);
+   int end = graph.getLoopEnd(header);
+   Vector<bool> visited(end - header, false);
+   int first = graph.resolve(header + 1);
+   Vector<int> stack;
+   if (first != end) {
+      visited[first - header] = true;
+      stack.add(first);
+   }
+   while (!stack.isEmpty()) {
+      int index = stack[stack.size() - 1];
+      stack.remove(stack.size() - 1);
+      for (int succ : getBodySuccessors(graph.getNode(index))) {
+         if (succ != end && !visited[succ - header]) {
+            visited[succ - header] = true;
+            stack.add(succ);
+         }
+      }
+   }
+   HashMap<int,int> local;
+   for (int i = header + 1; i < end; i++) {
+      if (!visited[i - header]) continue;
+      local.put(i, nodes.size());
+      nodes.add(i);
+   }
+   count = nodes.size();
+   entry = (first == end) ? EXIT_NODE : local.get(first);
+   lines = new CompiledLine[count > 0 ? count : 1];
+   for (int k = 0; k < count; k++) {
+      CfgNode & node = graph.getNode(nodes[k]);
+      CompiledLine & line = lines[k];
+      line.stmt = node.stmt;
+      line.type = node.type;
+      line.lineNumber = node.lineNumber;
+      line.next = EXIT_NODE;
+      line.target = EXIT_NODE;
+      if (node.type != GOTO_STMT && node.next != end) line.next = local.get(node.next);
+      if (node.type == GOTO_STMT || node.type == IF_STMT) {
+         if (node.target != end) line.target = local.get(node.target);
+      }
+      line.heat = 0;
+      line.table = NULL;
+      line.tableSize = 0;
+      line.loop = NULL;
+   }
+   HashMap<string,int> writes;
+   HashMap<string,int> reads;
+   Vector<string> arrays;
+   for (int index : nodes) {
+      CfgNode & node = graph.getNode(index);
+      IdentifierExp *var = getDefinition(node);
+      if (var != NULL) writes.put(var->getName(), writes.get(var->getName()) + 1);
+      Vector<IdentifierExp *> used;
+      getReads(node, used);
+      for (IdentifierExp *exp : used) {
+         reads.put(exp->getName(), reads.get(exp->getName()) + 1);
+      }
+      getArrayWrites(node, arrays);
+   }
+   HashMap<string,bool> reduced;
+   for (int index : nodes) {
+      Reduction reduction;
+      if (!matchReduction(graph.getNode(index), reduction)) continue;
+      if (writes.get(reduction.name) != 1 || reads.get(reduction.name) != 1) continue;
+      reductions.add(reduction);
+      reduced.put(reduction.name, true);
+   }
+   HashMap<string,int> numbers;
+   for (int index : nodes) {
+      IdentifierExp *var = getDefinition(graph.getNode(index));
+      if (var == NULL || reduced.containsKey(var->getName())) continue;
+      if (numbers.containsKey(var->getName())) continue;
+      numbers.put(var->getName(), privates.size());
+      privates.add(var->getName());
+   }
+   Vector<Vector<bool> > out(count, Vector<bool>(privates.size(), true));
+   Vector<Vector<bool> > in(count, Vector<bool>(privates.size(), false));
+   Vector<Vector<int> > preds(count);
+   for (int k = 0; k < count; k++) {
+      if (lines[k].next >= 0) preds[lines[k].next].add(k);
+      if (lines[k].target >= 0 && lines[k].target != lines[k].next) {
+         preds[lines[k].target].add(k);
+      }
+   }
+   bool changed = true;
+   while (changed) {
+      changed = false;
+      for (int k = 0; k < count; k++) {
+         Vector<bool> set(privates.size(), k != entry);
+         for (int pred : preds[k]) {
+            for (int v = 0; v < privates.size(); v++) {
+               set[v] = set[v] && out[pred][v];
+            }
+         }
+         in[k] = set;
+         IdentifierExp *var = getDefinition(graph.getNode(nodes[k]));
+         if (var != NULL && numbers.containsKey(var->getName())) {
+            set[numbers.get(var->getName())] = true;
+         }
+         for (int v = 0; v < privates.size(); v++) {
+            if (set[v] != out[k][v]) {
+               out[k] = set;
+               changed = true;
+               break;
+            }
+         }
+      }
+   }
+   for (int k = 0; k < count; k++) {
+      Vector<IdentifierExp *> used;
+      getReads(graph.getNode(nodes[k]), used);
+      for (IdentifierExp *exp : used) {
+         string name = exp->getName();
+         if (numbers.containsKey(name) && !in[k][numbers.get(name)]) {
+            delete[] lines;
+            error(loop + " writes the shared variable " + name);
+         }
+      }
+   }
+   if (record) {
+      for (string name : privates) {
+         stmt->addWrite(name);
+      }
+      for (Reduction & reduction : reductions) {
+         stmt->addWrite(reduction.name);
+      }
+      for (string key : arrays) {
+         stmt->addWrite(key);
+      }
+   }
+}
+
+/*
+ * Implementation notes: matchReduction
+ * ------------------------------------
+ * Only the shape of the LET is checked here; the caller makes sure that
+ * the variable is read and assigned nowhere else, which also rules out
+ * a variable that appears in e.  X - e is the sum of X and -e.  Joining
+ * strings depends on their order, so a string is never reduced.
+ */
+
+static bool matchReduction(CfgNode & node, Reduction & reduction) {
+   if (node.type != LET_STMT) return false;
+   LetStmt *let = (LetStmt *) node.stmt;
+   if (let->getVariable() == NULL || let->getExp()->getType() != COMPOUND) {
+      return false;
+   }
+   string name = let->getVariable()->getName();
+   if (isStringName(name)) return false;
+   CompoundExp *exp = (CompoundExp *) let->getExp();
+   string op = exp->getOp();
+   if (op != "+" && op != "-" && op != "*") return false;
+   Expression *lhs = exp->getLHS();
+   Expression *rhs = exp->getRHS();
+   bool onLeft = lhs->getType() == IDENTIFIER
+                 && ((IdentifierExp *) lhs)->getName() == name;
+   bool onRight = rhs->getType() == IDENTIFIER
+                  && ((IdentifierExp *) rhs)->getName() == name;
+   if (!onLeft && !(onRight && op != "-")) return false;
+   reduction.name = name;
+   reduction.op = (op == "*") ? '*' : '+';
+   return true;
+}
+
+ParallelLoop::~ParallelLoop() {
+   delete[] lines;
+}
+
+CompiledLine *ParallelLoop::getLines() {
+   return lines;
+}
+
+int ParallelLoop::size() {
+   return count;
+}
+
+int ParallelLoop::getEntry() {
+   return entry;
+}
+
+Vector<int> & ParallelLoop::getNodes() {
+   return nodes;
+}
+
+Vector<string> & ParallelLoop::getPrivates() {
+   return privates;
+}
+
+Vector<Reduction> & ParallelLoop::getReductions() {
+   return reductions;
+}
+
+/*
+ * Type: WorkerRun
+ * ---------------
+ * What one worker of a loop has: its state, made on its first range,
+ * the first iteration it saw fail, if any, and the statements it has
+ * run but not yet charged to the meter.  Each worker has a cache line
+ * to itself.
+ */
+
+struct alignas(64) WorkerRun {
+   EvalState *state;
+   long long failed;
+   long long pending;
+   string message;
+};
+
+/*
+ * Class: LoopRun
+ * --------------
+ * One run of a ParallelLoop, as the task the pool runs.  The slots are
+ * looked up in the program's state before any worker copies it, so
+ * they are the same in every worker's state.
+ */
+
+class LoopRun : public ParallelTask {
+
+public:
+
+   LoopRun(ParallelLoop & loop, EvalState & state, long long first,
+           long long last);
+   virtual ~LoopRun();
+   virtual void runRange(int worker, long long first, long long end);
+   void finish();
+
+private:
+
+   ParallelLoop & loop;
+   EvalState & state;
+   long long last;
+   int variable;
+   Vector<int> reductions;
+   Vector<int> privates;
+   Vector<Value> lastValues;
+   Vector<bool> lastDefined;
+   WorkerRun *workers;
+   int count;
+   atomic<long long> stopAt;
+   RunMeter *meter;
+
+};
+
+LoopRun::LoopRun(ParallelLoop & loop, EvalState & state, long long first,
+                 long long last) : loop(loop), state(state) {
+   this->last = last;
+   variable = state.getSlot(loop.stmt->getVariable()->getName());
+   for (Reduction & reduction : loop.reductions) {
+      reductions.add(state.getSlot(reduction.name));
+   }
+   for (string name : loop.privates) {
+      privates.add(state.getSlot(name));
+   }
+   count = getWorkerCount(last - first + 1);
+   workers = new WorkerRun[count];
+   for (int w = 0; w < count; w++) {
+      workers[w].state = NULL;
+      workers[w].failed = LLONG_MAX;
+      workers[w].pending = 0;
+   }
+   lastValues = Vector<Value>(privates.size(), Value());
+   lastDefined = Vector<bool>(privates.size(), false);
+   stopAt = LLONG_MAX;
+   //without limits to check, the workers leave the meter alone
+   meter = state.getRunMeter();
+   if (meter != NULL && !meter->isWatching()) meter = NULL;
+}
+
+LoopRun::~LoopRun() {
+   for (int w = 0; w < count; w++) {
+      delete workers[w].state;
+   }
+   delete[] workers;
+}
+
+/*
+ * Implementation notes: runRange
+ * ------------------------------
+ * A failed iteration stops every worker before any later iteration,
+ * but the earlier ones still run, so the error that finish raises is
+ * the one a sequential loop would have stopped at.
+ * The private variables are saved as the last iteration leaves them,
+ * since its worker may go on to run earlier iterations it has stolen.
+ * A worker charges its statements to the meter every CHARGE_INTERVAL
+ * statements and checks the limits then, and a limit that stops it
+ * fails the iteration like any other error.
+ */
+
+void LoopRun::runRange(int worker, long long first, long long end) {
+   WorkerRun & self = workers[worker];
+   if (self.state == NULL) {
+      self.state = new EvalState;
+      self.state->borrowFrom(state);
+      for (int r = 0; r < reductions.size(); r++) {
+         int identity = (loop.reductions[r].op == '*') ? 1 : 0;
+         self.state->setSlotValue(reductions[r], Value(identity));
+      }
+   }
+   for (long long i = first; i < end; i++) {
+      if (i > stopAt.load(memory_order_relaxed)) return;
+      self.state->setSlotValue(variable, Value(i));
+      try {
+         self.pending += loop.runBody(*self.state, meter);
+         if (meter != NULL && self.pending >= CHARGE_INTERVAL) {
+            meter->charge(self.pending);
+            self.pending = 0;
+            meter->enforce(0, chrono::steady_clock::now(), loop.lineNumber);
+         }
+      } catch (ErrorException & ex) {
+         self.failed = i;
+         self.message = ex.getMessage();
+         long long lowest = stopAt.load(memory_order_relaxed);
+         while (i < lowest && !stopAt.compare_exchange_weak(lowest, i)) {
+            /* compare_exchange_weak has loaded the new lowest */
+         }
+         return;
+      }
+      if (i == last) {
+         for (int p = 0; p < privates.size(); p++) {
+            lastValues[p] = self.state->getSlotValue(privates[p]);
+            lastDefined[p] = self.state->isSlotDefined(privates[p]);
+         }
+      }
+   }
+}
+
+/*
+ * Implementation notes: finish
+ * ----------------------------
+ * The partial results are combined with the value functions, whose
+ * integer arithmetic is exact, so the order the iterations ran in does
+ * not change an integer result.
+ */
+
+void LoopRun::finish() {
+   long long failed = LLONG_MAX;
+   string message;
+   for (int w = 0; w < count; w++) {
+      if (meter != NULL) meter->charge(workers[w].pending);
+      if (workers[w].failed < failed) {
+         failed = workers[w].failed;
+         message = workers[w].message;
+      }
+   }
+   if (failed != LLONG_MAX) error(message);
+   for (int r = 0; r < reductions.size(); r++) {
+      int slot = reductions[r];
+      Value result = state.getSlotValue(slot);
+      for (int w = 0; w < count; w++) {
+         if (workers[w].state == NULL) continue;
+         Value partial = workers[w].state->getSlotValue(slot);
+         if (loop.reductions[r].op == '*') {
+            result = multiplyValues(result, partial);
+         } else {
+            result = addValues(result, partial);
+         }
+      }
+      state.setSlotValue(slot, result);
+   }
+   for (int p = 0; p < privates.size(); p++) {
+      if (lastDefined[p]) state.setSlotValue(privates[p], lastValues[p]);
+   }
+}
+
+/*
+ * Implementation notes: run
+ * -------------------------
+ * The bounds are evaluated once, in the program's state, and the loop
+ * variable is set afterwards by the loop itself, since the workers only
+ * set their own copies.  Without a budget or a deadline the iterations
+ * go to the workers in one slice.  With one, the first slice is small
+ * and each next one doubles while a slice takes less than SLICE_MILLIS,
+ * but never holds more iterations than the budget has statements left
+ * for at the rate of the slice before.  Each slice leaves its reductions
+ * and private variables in state, so the loop can stop between slices
+ * as if it had only ever had the iterations before.
+ */
+
+bool ParallelLoop::run(EvalState & state) {
+   long long next;
+   long long last;
+   int slot = state.getSlot(stmt->getVariable()->getName());
+   if (!state.takeLoopProgress(lineNumber, next, last)) {
+      next = checkInt(stmt->getFirst()->eval(state), "Loop bound");
+      last = checkInt(stmt->getLast()->eval(state), "Loop bound");
+      if (next > last) {
+         state.setSlotValue(slot, Value(next));
+         return true;
+      }
+      for (Reduction & reduction : reductions) {
+         if (!state.isDefined(reduction.name)) error(reduction.name + " is undefined");
+      }
+   }
+   RunMeter *meter = state.getRunMeter();
+   bool sliced = meter != NULL && isBudgeted();
+   long long slice = sliced ? FIRST_SLICE : last - next + 1;
+   while (next <= last) {
+      long long end = min(last + 1, next + slice);
+      long long count = end - next;
+      long long before = sliced ? meter->getExecuted() : 0;
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      LoopRun task(*this, state, next, end - 1);
+      runParallel(task, next, end);
+      task.finish();
+      next = end;
+      if (next > last) break;
+      string reason;
+      if (meter->isOverBudget()) {
+         reason = "Statement budget exhausted";
+      } else if (meter->isPastDeadline()) {
+         reason = "Deadline exceeded";
+      }
+      if (reason != "") {
+         if (getBudgetAction() == BUDGET_ERROR) {
+            error(reason + " at line " + integerToString(lineNumber));
+         }
+         state.setSlotValue(slot, Value(next));
+         state.setLoopProgress(lineNumber, next, last);
+         return false;
+      }
+      if (chrono::steady_clock::now() - start < chrono::milliseconds(SLICE_MILLIS)) {
+         slice *= 2;
+      }
+      long long rate = max(1LL, (meter->getExecuted() - before) / count);
+      slice = max(1LL, min(slice, meter->getStatementsLeft() / rate));
+   }
+   state.setSlotValue(slot, Value(last + 1));
+   return true;
+}
+
+/*
+ * Implementation notes: runBody
+ * -----------------------------
+ * This is the run loop of Program::run for the few statements a body
+ * may contain, counted the same way.  A loop inside the body is the only
+ * way an iteration can go on for long, so every 256th jump back charges
+ * the statements so far and checks the limits, with the iteration as the
+ * step whose time starts at the first check.  The statements not yet
+ * charged are returned.
+ */
+
+long long ParallelLoop::runBody(EvalState & state, RunMeter *meter) {
+   int pc = entry;
+   long long executed = 0;
+   long long charged = 0;
+   unsigned backJumps = 0;
+   chrono::steady_clock::time_point start;
+   while (pc >= 0) {
+      int current = pc;
+      CompiledLine & line = lines[pc];
+      countStat(StatCounter(STAT_STATEMENTS + line.type));
+      executed++;
+      switch (line.type) {
+       case GOTO_STMT:
+         pc = line.target;
+         break;
+       case IF_STMT:
+         pc = ((IfStmt *) line.stmt)->test(state) ? line.target : line.next;
+         break;
+       default:
+         line.stmt->execute(state);
+         pc = line.next;
+         break;
+      }
+      if (meter != NULL && pc >= 0 && pc <= current && (++backJumps & 255) == 0) {
+         if (backJumps == 256) start = chrono::steady_clock::now();
+         meter->charge(executed - charged);
+         charged = executed;
+         meter->enforce(executed, start, line.lineNumber);
+      }
+   }
+   return executed - charged;
+}
@@ -0,0 +1,167 @@
+/*
+ * File: parallel.h
+ * ----------------
+ * This interface exports the ParallelLoop class, which runs the body of
+ * a PARALLEL FOR I = a TO b ... NEXT I loop on the threads of the pool
+ * in threadpool.h.  The iterations may run in any order and at the same
+ * time, so the compiler only accepts a body whose iterations cannot
+ * interfere through variables:
+ *
+ *  - the body may contain only LET, IF, GOTO and REM, and its jumps
+ *    must stay inside it, so it cannot do input or output or end the
+ *    program;
+ *  - the body may not assign the loop variable;
+ *  - every other variable the body assigns is either private, which
+ *    means every iteration assigns it before reading it, or a
+ *    reduction, which means it is assigned once, by LET X = X + e,
+ *    X - e, X * e, e + X or e * X, and used nowhere else in the body.
+ *
+ * Each worker runs its iterations in a state of its own that shares the
+ * arrays of the program, so the iterations must also not depend on the
+ * elements that other iterations assign.  A reduction starts each worker
+ * at 0, or 1 for *, and the partial results are combined when all
+ * iterations are done, which gives the result of the sequential loop
+ * because integer arithmetic is exact.  A reduction over real
+ * numbers adds or multiplies them in a different order than the
+ * sequential loop, so its result may differ in the last digits.  The
+ * private variables end with
+ * the values the last iteration left them with, and the loop variable
+ * ends at b + 1, or a if the loop does not run at all.
+ *
+ * Every statement the iterations execute counts toward the statement
+ * budget of budget.h, and the workers check the limits of the run and
+ * the memory limits while they go.  Under a budget or a deadline the
+ * iterations are handed to the workers in slices, and the run's limits
+ * are checked between slices.  There the loop can be suspended under
+ * BUDGET_YIELD, with the iterations before the slice done and the rest
+ * to come when the run is continued.
+ */
+
+#ifndef _parallel_h
+#define _parallel_h
+
+#include <string>
+#include "budget.h"
+#include "cfg.h"
+#include "evalstate.h"
+#include "statement.h"
+#include "vector.h"
+
+struct CompiledLine;
+
+/*
+ * Function: checkParallelLoops
+ * Usage: checkParallelLoops(graph);
+ * ---------------------------------
+ * Checks the statements and the jumps of the body of every PARALLEL FOR
+ * in the graph, which must not have been through any passes yet, and
+ * raises an error for the first one that breaks the rules above.  A
+ * jump from outside into a body is an error too.
+ */
+
+void checkParallelLoops(ControlFlowGraph & graph);
+
+/*
+ * Type: Reduction
+ * ---------------
+ * A variable the body reduces, with the operator that combines the
+ * partial results, '+' or '*'.
+ */
+
+struct Reduction {
+   std::string name;
+   char op;
+};
+
+/*
+ * Class: ParallelLoop
+ * -------------------
+ * The compiled form of one PARALLEL FOR.  The body lines are numbered
+ * from 0, and EXIT_NODE in their next and target fields means that the
+ * iteration is done.
+ */
+
+class ParallelLoop {
+
+public:
+
+/*
+ * Constructor: ParallelLoop
+ * Usage: ParallelLoop *loop = new ParallelLoop(graph, header, record);
+ * --------------------------------------------------------------------
+ * Builds the loop for the PARALLEL FOR node at header in a graph that
+ * checkParallelLoops has accepted, after skipComments and
+ * collapseJumps.  The constructor raises an error if the body assigns
+ * a variable that is neither private nor a reduction.  If record is
+ * true, the variables and arrays the body assigns are added to the
+ * writes of the PARALLEL FOR statement for the optimizer.
+ */
+
+   ParallelLoop(ControlFlowGraph & graph, int header, bool record);
+
+/*
+ * Destructor: ~ParallelLoop
+ * Usage: delete loop;
+ * -------------------
+ * Frees the body lines; their statements belong to the graph.
+ */
+
+   ~ParallelLoop();
+
+/*
+ * Method: run
+ * Usage: if (!loop->run(state)) . . .
+ * -----------------------------------
+ * Evaluates the bounds, runs every iteration and leaves the results in
+ * state.  If iterations fail, the error of the lowest failed iteration
+ * is raised once all workers have stopped; the iterations after it may
+ * or may not have run.  The limits of the run raise their errors the
+ * same way under BUDGET_ERROR.  Under BUDGET_YIELD, run returns false
+ * when the run must be suspended, leaving its progress in the state so
+ * that the next call for this loop goes on from there instead of
+ * evaluating the bounds again; it returns true once the loop is done.
+ */
+
+   bool run(EvalState & state);
+
+/*
+ * Methods: getLines, size, getEntry, getNodes
+ * Usage: CompiledLine *lines = loop->getLines();
+ * ----------------------------------------------
+ * Give access to the body lines, the first of them to run, which is
+ * EXIT_NODE for an empty body, and the graph nodes they came from.
+ */
+
+   CompiledLine *getLines();
+   int size();
+   int getEntry();
+   Vector<int> & getNodes();
+
+/*
+ * Methods: getPrivates, getReductions
+ * Usage: Vector<Reduction> & reductions = loop->getReductions();
+ * --------------------------------------------------------------
+ * Return the variables that the body assigns, by kind.
+ */
+
+   Vector<std::string> & getPrivates();
+   Vector<Reduction> & getReductions();
+
+private:
+
+   ParallelForStmt *stmt;
+   int lineNumber;
+   CompiledLine *lines;
+   int count;
+   int entry;
+   Vector<int> nodes;
+   Vector<std::string> privates;
+   Vector<Reduction> reductions;
+
+   long long runBody(EvalState & state, RunMeter *meter);
+
+   friend class LoopRun;
+
+};
+
+#endif
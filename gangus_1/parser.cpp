@@ -8,11 +8,19 @@
 #include <string>
 #include "error.h"
 #include "exp.h"
+#include "hashcons.h"
 #include "parser.h"
+#include "stringvalue.h"
 #include "strlib.h"
 #include "tokenscanner.h"
+#include "vector.h"
 using namespace std;
 
+/* Private function prototypes */
+
+static CallExp *readCall(TokenScanner & scanner, StringFunction function);
+static void checkOperands(string op, Expression *lhs, Expression *rhs);
+
 /*
  * Implementation notes: parseExp
  * ------------------------------
@@ -27,6 +35,19 @@ Expression *parseExp(TokenScanner & scanner) {
    return exp;
 }
 
+/*
+ * Implementation notes: configureScanner
+ * --------------------------------------
+ * The $ that ends the name of a string variable is part of the word.
+ */
+
+void configureScanner(TokenScanner & scanner) {
+   scanner.ignoreWhitespace();
+   scanner.scanNumbers();
+   scanner.scanStrings();
+   scanner.addWordCharacters("$");
+}
+
 /*
  * Implementation notes: readE
  * Usage: exp = readE(scanner, prec);
@@ -36,6 +57,8 @@ Expression *parseExp(TokenScanner & scanner) {
  * subexpressions until it finds an operator whose precedence is greater
  * than the prevailing one.  When a higher-precedence operator is found,
  * readE calls itself recursively to read in that subexpression as a unit.
+ * The operands of each operator are checked against each other here, so
+ * that a type mismatch is reported when the line is entered.
  */
 
 Expression *readE(TokenScanner & scanner, int prec) {
@@ -46,6 +69,7 @@ Expression *readE(TokenScanner & scanner, int prec) {
       int newPrec = precedence(token);
       if (newPrec <= prec) break;
       Expression *rhs = readE(scanner, newPrec);
+      checkOperands(token, exp, rhs);
       exp = new CompoundExp(token, exp, rhs);
    }
    scanner.saveToken(token);
@@ -55,15 +79,34 @@ Expression *readE(TokenScanner & scanner, int prec) {
 /*
  * Implementation notes: readT
  * ---------------------------
- * This function scans a term, which is either an integer, an identifier,
- * or a parenthesized subexpression.
+ * This function scans a term, which is either a number, a string, an
+ * identifier, an array element, a function call or a parenthesized
+ * subexpression.  A name followed by a parenthesis is a call if it
+ * names a built-in function and an array element otherwise.  A string
+ * literal is interned, so the same text shares one buffer.
  */
 
 Expression *readT(TokenScanner & scanner) {
    string token = scanner.nextToken();
    TokenType type = scanner.getTokenType(token);
-   if (type == WORD) return new IdentifierExp(token);
-   if (type == NUMBER) return new ConstantExp(stringToInteger(token));
+   if (type == WORD) {
+      string next = scanner.nextToken();
+      if (next == "(") {
+         int function = findFunction(token);
+         if (function >= 0) return readCall(scanner, StringFunction(function));
+         return readElement(scanner, token);
+      }
+      scanner.saveToken(next);
+      checkName(token);
+      return new IdentifierExp(token);
+   }
+   if (type == NUMBER) return new ConstantExp(stringToValue(token));
+   if (type == STRING) {
+      if (token.length() < 2 || token[token.length() - 1] != token[0]) {
+         error("Unterminated string");
+      }
+      return new ConstantExp(internString(scanner.getStringValue(token)));
+   }
    if (token != "(") error("Illegal term in expression");
    Expression *exp = readE(scanner);
    if (scanner.nextToken() != ")") {
@@ -72,6 +115,99 @@ Expression *readT(TokenScanner & scanner) {
    return exp;
 }
 
+/*
+ * Implementation notes: readElement
+ * ---------------------------------
+ * Each subscript is wrapped in the IndexExp that checks it against its
+ * position, which is decided here by the number of subscripts.  Arrays
+ * hold numbers, so a string name cannot be an array.
+ */
+
+ArrayExp *readElement(TokenScanner & scanner, string name) {
+   checkName(name);
+   if (isStringName(name)) error("Arrays of strings are not supported");
+   Expression *first = readE(scanner);
+   Expression *second = NULL;
+   string token = scanner.nextToken();
+   if (token == ",") {
+      second = readE(scanner);
+      token = scanner.nextToken();
+   }
+   if (token != ")") {
+      delete first;
+      delete second;
+      error("Unbalanced parentheses in subscript");
+   }
+   if (second == NULL) {
+      return new ArrayExp(name, new IndexExp(name, SUBSCRIPT_VECTOR, first), NULL);
+   }
+   return new ArrayExp(name, new IndexExp(name, SUBSCRIPT_ROW, first),
+                       new IndexExp(name, SUBSCRIPT_COLUMN, second));
+}
+
+/*
+ * Implementation notes: readCall
+ * ------------------------------
+ * The first argument of every function is a string and the others are
+ * numbers.  MID$ takes an optional third argument.
+ */
+
+static CallExp *readCall(TokenScanner & scanner, StringFunction function) {
+   Vector<Expression *> args;
+   string token;
+   do {
+      args.add(readE(scanner));
+      token = scanner.nextToken();
+   } while (token == "," && args.size() < 3);
+   int min = (function == FN_LEN) ? 1 : 2;
+   int max = (function == FN_MID) ? 3 : min;
+   bool typed = true;
+   for (int i = 0; i < args.size(); i++) {
+      if (isStringExpression(args[i]) != (i == 0)) typed = false;
+   }
+   if (token != ")" || args.size() < min || args.size() > max || !typed) {
+      for (Expression *arg : args) {
+         delete arg;
+      }
+      if (!typed) error("Type mismatch");
+      error("Wrong arguments to " + getFunctionName(function));
+   }
+   return new CallExp(function, args);
+}
+
+/*
+ * Implementation notes: checkOperands
+ * -----------------------------------
+ * Two strings may only be joined with +, and a string never meets a
+ * number.  The operands are freed before the error is raised.
+ */
+
+static void checkOperands(string op, Expression *lhs, Expression *rhs) {
+   bool left = isStringExpression(lhs);
+   if (left == isStringExpression(rhs) && (!left || op == "+")) return;
+   delete lhs;
+   delete rhs;
+   error("Type mismatch");
+}
+
+/*
+ * Implementation notes: checkName, checkTypes
+ * -------------------------------------------
+ * The scanner counts $ as a letter, so a name that has one anywhere but
+ * at the end is caught here.
+ */
+
+void checkName(string name) {
+   size_t dollar = name.find('$');
+   if (dollar != string::npos && dollar != name.length() - 1) {
+      error("Illegal variable name " + name);
+   }
+}
+
+void checkTypes(bool target, Expression *exp) {
+   if (target != isStringExpression(exp)) error("Type mismatch");
+}
+
 /*
  * Implementation notes: precedence
  * --------------------------------
@@ -101,5 +237,16 @@ Statement *parseStatement(TokenScanner & scanner) {
     if (nextToken == "GOTO") return new GotoStmt(scanner);
     if (nextToken == "IF") return new IfStmt(scanner);
     if (nextToken == "END") return new EndStmt();
+    if (nextToken == "GOSUB") return new GosubStmt(scanner);
+    if (nextToken == "RETURN") return new ReturnStmt();
+    if (nextToken == "ON") return new OnStmt(scanner);
+    if (nextToken == "DIM") return new DimStmt(scanner);
+    if (nextToken == "MAT") return new MatStmt(scanner);
+    if (nextToken == "PARALLEL") return new ParallelForStmt(scanner);
+    if (nextToken == "NEXT") return new NextStmt(scanner);
     return new EndStmt();
 }
+
+Statement *parseStatement(TokenScanner & scanner, HashConsTable & table) {
+   return table.intern(parseStatement(scanner));
+}
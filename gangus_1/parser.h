@@ -9,6 +9,7 @@
 
 #include <string>
 #include "exp.h"
+#include "hashcons.h"
 #include "tokenscanner.h"
 #include "statement.h"
 
@@ -17,12 +18,23 @@
  * Usage: Expression *exp = parseExp(scanner);
  * -------------------------------------------
  * Parses an expression by reading tokens from the scanner, which must
- * be provided by the client.  The scanner should be set to ignore
- * whitespace and to scan numbers.
+ * be provided by the client.  The scanner should be set up by
+ * configureScanner.
  */
 
 Expression *parseExp(TokenScanner & scanner);
 
+/*
+ * Function: configureScanner
+ * Usage: configureScanner(scanner);
+ * ---------------------------------
+ * Sets a scanner to ignore whitespace, to scan numbers and strings and
+ * to take $ as part of a word, which is how every reader of program
+ * lines must see them.
+ */
+
+void configureScanner(TokenScanner & scanner);
+
 /*
  * Function: readE
  * Usage: Expression *exp = readE(scanner, prec);
@@ -38,12 +50,40 @@ Expression *readE(TokenScanner & scanner, int prec = 0);
  * Function: readT
  * Usage: Expression *exp = readT(scanner);
  * ----------------------------------------
- * Returns the next individual term, which is either a constant, an
- * identifier, or a parenthesized subexpression.
+ * Returns the next individual term, which is either a number, a string
+ * literal, an identifier, an array element, a call to LEN, LEFT$,
+ * RIGHT$ or MID$, or a parenthesized subexpression.  A literal's value
+ * comes from internString, and a call's arguments are checked for
+ * their number and types.
  */
 
 Expression *readT(TokenScanner & scanner);
 
+/*
+ * Function: readElement
+ * Usage: ArrayExp *element = readElement(scanner, name);
+ * ------------------------------------------------------
+ * Reads the one or two subscripts of an element of the named array and
+ * the closing parenthesis.  The caller has already read the name and
+ * the opening parenthesis.
+ */
+
+ArrayExp *readElement(TokenScanner & scanner, std::string name);
+
+/*
+ * Functions: checkName, checkTypes
+ * Usage: checkName(name);
+ *        checkTypes(isStringName(name), exp);
+ * -------------------------------------------
+ * checkName raises an error unless name is a legal variable name, which
+ * may end in $ but has no $ before that.  checkTypes raises "Type
+ * mismatch" unless exp is a string exactly when target is true, which is
+ * how statements check the expressions they assign and compare.
+ */
+
+void checkName(std::string name);
+void checkTypes(bool target, Expression *exp);
+
 /*
  * Function: precedence
  * Usage: int prec = precedence(token);
@@ -63,4 +103,15 @@ int precedence(std::string token);
 
 Statement *parseStatement(TokenScanner & scanner);
 
+/*
+ * Function: parseStatement
+ * Usage: Statement *stmt = parseStatement(scanner, table);
+ * --------------------------------------------------------
+ * Parses the statement and interns it in table, so that it may be
+ * shared with earlier statements of the same structure.  The result
+ * must be given back with table.release.
+ */
+
+Statement *parseStatement(TokenScanner & scanner, HashConsTable & table);
+
 #endif
@@ -0,0 +1,169 @@
+/*
+ * File: perfcounters.cpp
+ * ----------------------
+ * This file implements the perfcounters.h interface.  On platforms other
+ * than Linux every event is reported as not available.
+ */
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include "perfcounters.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+/*
+ * Type: EventInfo
+ * ---------------
+ * The name and perf_event_open encoding of each event, in the order of
+ * the PerfEvent constants.
+ */
+
+struct EventInfo {
+   const char *name;
+   unsigned type;
+   unsigned long long config;
+};
+
+#ifdef __linux__
+static const EventInfo EVENTS[NUM_PERF_EVENTS] = {
+   { "task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+   { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+   { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+   { "branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+   { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+   { "L1d-misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                                     | PERF_COUNT_HW_CACHE_OP_READ << 8
+                                     | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+   { "LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+};
+#else
+static const EventInfo EVENTS[NUM_PERF_EVENTS] = {
+   { "task-clock", 0, 0 }, { "instructions", 0, 0 }, { "cycles", 0, 0 },
+   { "branches", 0, 0 }, { "branch-misses", 0, 0 }, { "L1d-misses", 0, 0 },
+   { "LLC-misses", 0, 0 }
+};
+#endif
+
+PerfCounters::PerfCounters() {
+   for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+      fds[i] = -1;
+      values[i] = -1;
+   }
+   opened = false;
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+   for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+      if (fds[i] != -1) close(fds[i]);
+   }
+#endif
+}
+
+/*
+ * Implementation notes: open
+ * --------------------------
+ * Each event is opened on its own rather than as a group, so that one
+ * missing event does not take the others with it.  User-space counting
+ * only is requested, which is what unprivileged users may measure.
+ */
+
+void PerfCounters::open() {
+   opened = true;
+#ifdef __linux__
+   for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof attr);
+      attr.type = EVENTS[i].type;
+      attr.size = sizeof attr;
+      attr.config = EVENTS[i].config;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+   }
+#endif
+}
+
+void PerfCounters::start() {
+   if (!opened) open();
+#ifdef __linux__
+   for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+      if (fds[i] == -1) continue;
+      ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+   }
+#endif
+}
+
+/*
+ * Implementation notes: stop
+ * --------------------------
+ * If the kernel had more events than hardware counters, each counter
+ * ran for only part of the time, so its count is scaled by the ratio of
+ * enabled to running time.
+ */
+
+void PerfCounters::stop() {
+   for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+      values[i] = -1;
+#ifdef __linux__
+      if (fds[i] == -1) continue;
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      unsigned long long data[3];
+      if (read(fds[i], data, sizeof data) != sizeof data) continue;
+      if (data[2] == 0) continue;
+      values[i] = data[0] * ((double) data[1] / data[2]);
+#endif
+   }
+}
+
+double PerfCounters::getValue(PerfEvent event) {
+   return values[event];
+}
+
+string PerfCounters::toString(unsigned long long statements) {
+   ostringstream out;
+   out << fixed;
+   out << "Performance counters (" << statements << " statements):" << endl;
+   for (int i = 0; i < NUM_PERF_EVENTS; i++) {
+      out << "  " << left << setw(16) << EVENTS[i].name << right;
+      if (values[i] < 0) {
+         out << setw(16) << "not available" << endl;
+         continue;
+      }
+      if (i == PERF_TASK_CLOCK) {
+         out << setw(13) << setprecision(3) << values[i] / 1e6 << " ms";
+      } else {
+         out << setw(16) << setprecision(0) << values[i];
+      }
+      if (statements > 0) {
+         out << setw(14) << setprecision(2) << values[i] / statements
+             << (i == PERF_TASK_CLOCK ? " ns" : "") << " per statement";
+      }
+      out << endl;
+   }
+   double instructions = values[PERF_INSTRUCTIONS];
+   double cycles = values[PERF_CYCLES];
+   double branches = values[PERF_BRANCHES];
+   double misses = values[PERF_BRANCH_MISSES];
+   if (instructions >= 0 && cycles > 0) {
+      out << "  " << left << setw(16) << "IPC" << right
+          << setw(16) << setprecision(2) << instructions / cycles << endl;
+   }
+   if (misses >= 0 && branches > 0) {
+      out << "  " << left << setw(16) << "branch-miss-rate" << right
+          << setw(15) << setprecision(2) << 100 * misses / branches
+          << "%" << endl;
+   }
+   return out.str();
+}
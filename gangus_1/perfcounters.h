@@ -0,0 +1,99 @@
+/*
+ * File: perfcounters.h
+ * --------------------
+ * This interface exports the PerfCounters class, which measures a
+ * program run with the hardware performance counters that Linux makes
+ * available through perf_event_open.  The counts are reported per BASIC
+ * statement as well as in total, so that changes to the interpreter can
+ * be judged by what each statement costs.
+ */
+
+#ifndef _perfcounters_h
+#define _perfcounters_h
+
+#include <string>
+
+/*
+ * Type: PerfEvent
+ * ---------------
+ * This enumerated type names the events that are measured.
+ */
+
+enum PerfEvent {
+   PERF_TASK_CLOCK, PERF_INSTRUCTIONS, PERF_CYCLES, PERF_BRANCHES,
+   PERF_BRANCH_MISSES, PERF_L1D_MISSES, PERF_LLC_MISSES, NUM_PERF_EVENTS
+};
+
+/*
+ * Class: PerfCounters
+ * -------------------
+ * A PerfCounters object opens one counter per event for the calling
+ * thread.  Events that the kernel, the hardware or a virtual machine
+ * does not provide are reported as not available; they never cause an
+ * error.
+ */
+
+class PerfCounters {
+
+public:
+
+/*
+ * Constructor: PerfCounters
+ * Usage: PerfCounters counters;
+ * -----------------------------
+ * Creates a set of counters.  The counters are opened on first use.
+ */
+
+   PerfCounters();
+
+/*
+ * Destructor: ~PerfCounters
+ * Usage: usually implicit
+ * -----------------------
+ * Closes the counters.
+ */
+
+   ~PerfCounters();
+
+/*
+ * Methods: start, stop
+ * Usage: counters.start();
+ *        counters.stop();
+ * -----------------------
+ * Reset and enable the counters, and disable and read them.
+ */
+
+   void start();
+   void stop();
+
+/*
+ * Method: getValue
+ * Usage: double count = counters.getValue(PERF_CYCLES);
+ * -----------------------------------------------------
+ * Returns the count for the last measurement, scaled up if the kernel
+ * had to multiplex the counter, or -1 if the event is not available.
+ */
+
+   double getValue(PerfEvent event);
+
+/*
+ * Method: toString
+ * Usage: string report = counters.toString(statements);
+ * -----------------------------------------------------
+ * Returns a report of the last measurement, including IPC, the branch
+ * miss rate and the cost per statement for the given statement count.
+ */
+
+   std::string toString(unsigned long long statements);
+
+private:
+
+   int fds[NUM_PERF_EVENTS];
+   double values[NUM_PERF_EVENTS];
+   bool opened;
+
+   void open();
+
+};
+
+#endif
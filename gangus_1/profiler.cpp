@@ -0,0 +1,246 @@
+/*
+ * File: profiler.cpp
+ * ------------------
+ * This file implements the profiler.h interface.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "error.h"
+#include "profiler.h"
+#include "strlib.h"
+#ifndef _WIN32
+#include <sys/time.h>
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+/* Constants */
+
+static const int TABLE_SIZE = 4096;
+
+/*
+ * Type: Sample
+ * ------------
+ * One entry in the sample table: a distinct stack and its count.  The
+ * frames are the call lines from the outermost in, followed by the
+ * executing line.
+ */
+
+struct Sample {
+   int length;
+   int frames[MAX_PROFILE_DEPTH + 1];
+   unsigned long count;
+};
+
+/* Published interpreter state */
+
+atomic<unsigned long long> profileState(0);
+volatile sig_atomic_t profileStack[MAX_PROFILE_DEPTH];
+
+/* Private state */
+
+static Sample table[TABLE_SIZE];
+static unsigned long dropped = 0;
+static bool running = false;
+static string outputFile;
+#ifdef __linux__
+static timer_t timer;
+static int perfFd = -1;
+#endif
+
+/* Private function prototypes */
+
+static void sampleHandler(int sig);
+static string frameName(int lineNumber);
+#ifdef __linux__
+static bool startPerfClock(long interval);
+#endif
+
+/*
+ * Implementation notes: startProfiler
+ * -----------------------------------
+ * On Linux the clock measures the CPU time of the interpreter thread
+ * alone and delivers its signal to that thread, so time spent in the
+ * output and input threads is not charged to BASIC lines.  The clock
+ * is a perf_event_open task clock where the kernel allows it, because
+ * POSIX CPU timers only fire on scheduler ticks and so cannot sample
+ * faster than the kernel's tick rate; a thread CPU-time timer is the
+ * fallback.  Elsewhere the process-wide ITIMER_PROF timer is used.
+ */
+
+void startProfiler(string filename, int hz) {
+#ifdef _WIN32
+   error("Profiling is not supported on this platform");
+#else
+   if (hz <= 0 || hz > 100000) error("Illegal profiling rate");
+   if (running) stopProfiler();
+   memset(table, 0, sizeof table);
+   dropped = 0;
+   outputFile = filename;
+   struct sigaction action;
+   memset(&action, 0, sizeof action);
+   action.sa_handler = sampleHandler;
+   action.sa_flags = SA_RESTART;
+   sigemptyset(&action.sa_mask);
+   sigaction(SIGPROF, &action, NULL);
+   long interval = 1000000000L / hz;
+#ifdef __linux__
+   if (startPerfClock(interval)) {
+      running = true;
+      return;
+   }
+   struct sigevent event;
+   memset(&event, 0, sizeof event);
+   event.sigev_notify = SIGEV_THREAD_ID;
+   event.sigev_signo = SIGPROF;
+   event._sigev_un._tid = gettid();
+   if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0) {
+      error("Cannot create profiling timer");
+   }
+   struct itimerspec spec;
+   spec.it_interval.tv_sec = interval / 1000000000L;
+   spec.it_interval.tv_nsec = interval % 1000000000L;
+   spec.it_value = spec.it_interval;
+   timer_settime(timer, 0, &spec, NULL);
+#else
+   struct itimerval spec;
+   spec.it_interval.tv_sec = interval / 1000000000L;
+   spec.it_interval.tv_usec = interval % 1000000000L / 1000;
+   spec.it_value = spec.it_interval;
+   setitimer(ITIMER_PROF, &spec, NULL);
+#endif
+   running = true;
+#endif
+}
+
+/*
+ * Implementation notes: stopProfiler
+ * ----------------------------------
+ * The timer is disarmed before the table is read, so the handler can no
+ * longer run and the table needs no locking.
+ */
+
+void stopProfiler() {
+   if (!running) return;
+   running = false;
+#ifdef __linux__
+   if (perfFd != -1) {
+      close(perfFd);
+      perfFd = -1;
+   } else {
+      timer_delete(timer);
+   }
+#elif !defined(_WIN32)
+   struct itimerval spec;
+   memset(&spec, 0, sizeof spec);
+   setitimer(ITIMER_PROF, &spec, NULL);
+#endif
+   ofstream out(outputFile.c_str());
+   if (out.fail()) error("Cannot write profile " + outputFile);
+   for (int i = 0; i < TABLE_SIZE; i++) {
+      Sample & sample = table[i];
+      if (sample.count == 0) continue;
+      out << "BASIC";
+      for (int j = 0; j < sample.length; j++) {
+         out << ";" << frameName(sample.frames[j]);
+      }
+      out << " " << sample.count << endl;
+   }
+   if (dropped > 0) out << "BASIC;[dropped] " << dropped << endl;
+}
+
+/*
+ * Implementation notes: sampleHandler
+ * -----------------------------------
+ * The handler runs in signal context, so it touches only the static
+ * table: it hashes the current stack and increments the matching entry,
+ * probing linearly from the hash.  When the table is full the sample is
+ * counted as dropped.  The ioctl can set errno, which belongs to the
+ * code the signal interrupted, so the handler puts it back.
+ */
+
+static void sampleHandler(int) {
+   int savedErrno = errno;
+#ifdef __linux__
+   if (perfFd != -1) ioctl(perfFd, PERF_EVENT_IOC_REFRESH, 1);
+#endif
+   unsigned long long state = profileState.load(memory_order_relaxed);
+   atomic_signal_fence(memory_order_acquire);
+   int frames[MAX_PROFILE_DEPTH + 1];
+   unsigned long long depth = state >> 32;
+   if (depth > MAX_PROFILE_DEPTH) depth = MAX_PROFILE_DEPTH;
+   int length = 0;
+   for (unsigned long long i = 0; i < depth; i++) {
+      frames[length++] = profileStack[i];
+   }
+   frames[length++] = (int) (state & 0xffffffffULL);
+   unsigned hash = 2166136261u;
+   for (int i = 0; i < length; i++) {
+      hash = (hash ^ (unsigned) frames[i]) * 16777619u;
+   }
+   for (int probe = 0; probe < TABLE_SIZE; probe++) {
+      Sample & sample = table[(hash + probe) % TABLE_SIZE];
+      if (sample.count == 0) {
+         sample.length = length;
+         memcpy(sample.frames, frames, length * sizeof(int));
+      } else if (sample.length != length
+                 || memcmp(sample.frames, frames, length * sizeof(int)) != 0) {
+         continue;
+      }
+      sample.count++;
+      errno = savedErrno;
+      return;
+   }
+   dropped++;
+   errno = savedErrno;
+}
+
+/*
+ * Implementation notes: startPerfClock
+ * ------------------------------------
+ * The task clock counts nanoseconds of CPU time for the calling thread
+ * and raises SIGPROF each time interval nanoseconds have elapsed.  The
+ * event disables itself after each overflow until the handler rearms
+ * it with PERF_EVENT_IOC_REFRESH.
+ */
+
+#ifdef __linux__
+static bool startPerfClock(long interval) {
+   struct perf_event_attr attr;
+   memset(&attr, 0, sizeof attr);
+   attr.type = PERF_TYPE_SOFTWARE;
+   attr.size = sizeof attr;
+   attr.config = PERF_COUNT_SW_TASK_CLOCK;
+   attr.sample_period = interval;
+   attr.wakeup_events = 1;
+   attr.disabled = 1;
+   int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+   if (fd < 0) return false;
+   struct f_owner_ex owner;
+   owner.type = F_OWNER_TID;
+   owner.pid = gettid();
+   if (fcntl(fd, F_SETFL, O_ASYNC) != 0 || fcntl(fd, F_SETSIG, SIGPROF) != 0
+       || fcntl(fd, F_SETOWN_EX, &owner) != 0) {
+      close(fd);
+      return false;
+   }
+   perfFd = fd;
+   ioctl(perfFd, PERF_EVENT_IOC_REFRESH, 1);
+   return true;
+}
+#endif
+
+static string frameName(int lineNumber) {
+   if (lineNumber <= 0) return "[interpreter]";
+   return "line " + integerToString(lineNumber);
+}
@@ -0,0 +1,108 @@
+/*
+ * File: profiler.h
+ * ----------------
+ * This interface exports a statistical profiler for BASIC programs.
+ * A CPU-time timer interrupts the interpreter at a fixed rate, and the
+ * signal handler records the BASIC line that is executing along with
+ * the lines of any active subroutine calls.  The samples are written in
+ * the folded-stack format read by standard flame-graph tools.
+ */
+
+#ifndef _profiler_h
+#define _profiler_h
+
+#include <atomic>
+#include <csignal>
+#include <string>
+
+/* Constants */
+
+const int MAX_PROFILE_DEPTH = 16;
+
+/*
+ * Variables: profileState, profileStack
+ * -------------------------------------
+ * The interpreter publishes the number of active subroutine calls in
+ * the high half of profileState and the line it is executing in the low
+ * half, and the line numbers of the calls in profileStack.  The signal
+ * handler only reads these variables, and a call or a return changes
+ * the depth and the line in one store, so a sample never sees a frame
+ * pushed or popped without the line that goes with it.  Publishing
+ * costs nothing more when the profiler is off.
+ */
+
+extern std::atomic<unsigned long long> profileState;
+extern volatile sig_atomic_t profileStack[MAX_PROFILE_DEPTH];
+
+/*
+ * Function: publishLine
+ * Usage: publishLine(lineNumber);
+ * -------------------------------
+ * Records the line that is about to execute; 0 means no program line.
+ */
+
+inline void publishLine(int lineNumber) {
+   unsigned long long depth = profileState.load(std::memory_order_relaxed) >> 32;
+   profileState.store(depth << 32 | (unsigned) lineNumber,
+                      std::memory_order_relaxed);
+}
+
+/*
+ * Functions: publishCall, publishReturn
+ * Usage: publishCall(callLine, lineNumber);
+ *        publishReturn(lineNumber);
+ * ----------------------------------------
+ * Record entry to a subroutine called from callLine and exit from the
+ * innermost one, together with lineNumber, the line that runs next.
+ * Calls nested deeper than MAX_PROFILE_DEPTH are counted but not
+ * recorded, so deep recursion folds into its outermost frames.
+ */
+
+inline void publishCall(int callLine, int lineNumber) {
+   unsigned long long depth = profileState.load(std::memory_order_relaxed) >> 32;
+   if (depth < MAX_PROFILE_DEPTH) profileStack[depth] = callLine;
+   std::atomic_signal_fence(std::memory_order_release);
+   profileState.store((depth + 1) << 32 | (unsigned) lineNumber,
+                      std::memory_order_relaxed);
+}
+
+inline void publishReturn(int lineNumber) {
+   unsigned long long depth = profileState.load(std::memory_order_relaxed) >> 32;
+   if (depth > 0) depth--;
+   profileState.store(depth << 32 | (unsigned) lineNumber,
+                      std::memory_order_relaxed);
+}
+
+/*
+ * Function: resetCallStack
+ * Usage: resetCallStack();
+ * ------------------------
+ * Discards the published call stack and line, as when a program stops.
+ */
+
+inline void resetCallStack() {
+   profileState.store(0, std::memory_order_relaxed);
+}
+
+/*
+ * Function: startProfiler
+ * Usage: startProfiler(filename, hz);
+ * -----------------------------------
+ * Starts sampling the calling thread hz times per second of CPU time.
+ * The samples are written to filename by stopProfiler.
+ */
+
+void startProfiler(std::string filename, int hz = 1000);
+
+/*
+ * Function: stopProfiler
+ * Usage: stopProfiler();
+ * ----------------------
+ * Stops sampling and writes the folded stacks, one line per distinct
+ * stack, such as "BASIC;line 20;line 110 37".  Calling stopProfiler
+ * when the profiler is not running has no effect.
+ */
+
+void stopProfiler();
+
+#endif
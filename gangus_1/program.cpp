@@ -8,16 +8,32 @@
  * the performance guarantees specified in the assignment.
  */
 
+#include <chrono>
+#include <cstring>
 #include <string>
+#include "accounting.h"
+#include "budget.h"
+#include "compiler.h"
+#include "inputsource.h"
+#include "optimizer.h"
+#include "output.h"
+#include "parallel.h"
+#include "profiler.h"
 #include "program.h"
+#include "stats.h"
 #include "statement.h"
+#include "strlib.h"
 #include "evalstate.h"
 using namespace std;
 
 Program::Program() {
-    head = NULL;
-    count = 0;
-
+    suspension = SUSPEND_NONE;
+    suspendedLine = 0;
+    compiled = NULL;
+    baseline = NULL;
+    tierRequested = false;
+    fingerprint = 0;
+    fingerprinted = false;
 }
 
 Program::~Program() {
@@ -25,46 +41,331 @@ Program::~Program() {
 }
 
 void Program::clear() {
-    count = 0;
-    map.clear();
+    //frees every line and gives back its shared statement
+    for (lineCommand *command : commands) {
+        sharedTrees.release(command->stmt);
+        deleteCommand(command);
+    }
+    commands = Vector<lineCommand *>();
+    //no line is left to use the names, so the table's storage goes too
+    tokenizer.clear();
+    invalidate();
 }
 
 bool Program::isEmpty() {
-    return count == 0;
+    return commands.isEmpty();
+}
+
+/*
+ * Type: TierTimer
+ * -------------------------------------------------
+ * adds the time a run spends in each tier to the stats, even when the
+ * run ends with an error
+ */
+
+struct TierTimer {
+    chrono::steady_clock::time_point start;
+    bool optimized;
+
+    TierTimer(bool optimized) {
+        this->optimized = optimized;
+        start = chrono::steady_clock::now();
+    }
+
+    ~TierTimer() {
+        record();
+    }
+
+    //charges the time so far to the current tier and starts over
+    void record() {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        unsigned long long nanos =
+            chrono::duration_cast<chrono::nanoseconds>(now - start).count();
+        countStat(optimized ? STAT_OPTIMIZED_NANOS : STAT_BASELINE_NANOS, nanos);
+        start = now;
+    }
+};
+
+/*
+ * Type: ReturnStackReset
+ * -------------------------------------------------
+ * forgets the calls that are still active when a run ends, even with
+ * an error, unless the run is suspended and will go on with them
+ */
+
+struct ReturnStackReset {
+    EvalState & state;
+    bool keep;
+
+    ReturnStackReset(EvalState & state) : state(state) {
+        keep = false;
+    }
+
+    ~ReturnStackReset() {
+        if (!keep) state.clearReturns();
+    }
+};
+
+/*
+ * Type: RunMeterScope
+ * -------------------------------------------------
+ * lends the meter of a run to the state for as long as the run lasts,
+ * even when it ends with an error
+ */
+
+struct RunMeterScope {
+    EvalState & state;
+
+    RunMeterScope(EvalState & state, RunMeter & meter) : state(state) {
+        state.setRunMeter(&meter);
+    }
+
+    ~RunMeterScope() {
+        state.setRunMeter(NULL);
+    }
+};
+
+/*
+ * Function: relinkReturns
+ * Usage: relinkReturns(code, state);
+ * -------------------------------------------------
+ * finds the active calls in code by their line numbers, since a
+ * suspended run or a checkpoint may continue in other code; a call
+ * that starts the program may be found through its loop entry
+ */
+
+static void relinkReturns(CompiledProgram *code, EvalState & state) {
+    CompiledLine *lines = code->getLines();
+    for (int i = 0; i < state.getReturnDepth(); i++) {
+        ReturnAddress & address = state.getReturn(i);
+        int pc = code->getEntry(address.callLine);
+        if (pc >= 0 && lines[pc].type == LOOP_ENTRY_STMT) pc = lines[pc].next;
+        address.pc = pc;
+    }
+}
+
+/*
+ * Function: lineNumberAt
+ * Usage: int lineNumber = lineNumberAt(lines, pc);
+ * -------------------------------------------------
+ * gives the line number at pc, or 0 once the run is leaving the code
+ */
+
+static int lineNumberAt(CompiledLine *lines, int pc) {
+    return (pc >= 0) ? lines[pc].lineNumber : 0;
+}
+
+/*
+ * Function: checkWait
+ * Usage: SuspendReason reason = checkWait(line, state);
+ * -------------------------------------------------
+ * tells whether running the line now would wait for input or for the
+ * output writer
+ */
+
+static SuspendReason checkWait(CompiledLine & line, EvalState & state) {
+    if (line.type == INPUT_STMT && !state.getInputSource().isReady()) {
+        return SUSPEND_INPUT;
+    }
+    if (line.type == PRINT_STMT && !isOutputReady()) return SUSPEND_OUTPUT;
+    return SUSPEND_NONE;
 }
 
 /*
  * Method: run
  * Usage: program.run(lineNumber, state);
  * -------------------------------------------------
- * runs the program and syncs the line numbers in state and program
+ * runs the compiled program from the line number given; GOTO, IF and
+ * END are handled here because their targets are already resolved.
+ * In the baseline tier every jump back counts toward its line's heat;
+ * the first hot line sends the program to the background compiler, and
+ * the optimized code takes over at a jump back once it is ready, or at
+ * once when a PARALLEL FOR is about to run, as long as it admits the
+ * values the variables hold
  */
 
 void Program::run(int lineNumber, EvalState & state) {
-    //sets the state line number to the line number passed in
-    state.setCurrentLineNumber(lineNumber);
-    //executes the statement
-    getParsedStatement(lineNumber)->execute(state);
-    while (lineNumber != -1) {
-        //checks if the numbers are in sync
-        if (lineNumber == state.getCurrentLineNumber()) {
-            //moves to next line number
-            lineNumber = getNextLineNumber(lineNumber);
-            //changes state to the new line number
-            state.setCurrentLineNumber(lineNumber);
+    suspension = SUSPEND_NONE;
+    CompiledProgram *code = selectTier(state);
+    checkMemoryLimits();
+    code->link(state);
+    code->invalidateCaches();
+    CompiledLine *lines = code->getLines();
+    bool baselineTier = !code->isOptimized() && isOptimizing();
+    int threshold = getTierUpThreshold();
+    TierTimer timer(code->isOptimized());
+    //the calls a continued run is inside of return into this code
+    state.reserveReturns(getReturnStackLimit());
+    relinkReturns(code, state);
+    for (int i = 0; i < state.getReturnDepth(); i++) {
+        publishCall(state.getReturn(i).callLine, lineNumber);
+    }
+    ReturnStackReset returns(state);
+    int pc = code->getEntry(lineNumber);
+    //the limits of this run, which are checked at jumps back and after
+    //the statements that charge their own work to the meter
+    RunMeter meter;
+    RunMeterScope metered(state, meter);
+    bool budgeted = isBudgeted();
+    bool suspendOnWait = isSuspendingOnWait();
+    long long budget = getStatementBudget();
+    long long executed = 0;
+    unsigned backJumps = 0;
+    while (pc >= 0) {
+        //a PARALLEL FOR is hot as soon as it starts, and its body has no
+        //jump back here to change tiers at, so the loop is optimized first
+        if (baselineTier && lines[pc].type == PARALLEL_FOR_STMT) {
+            baselineTier = false;
+            if (compile().admits(state)) {
+                int nextLine = lines[pc].lineNumber;
+                code = &compile();
+                code->invalidateCaches();
+                relinkReturns(code, state);
+                lines = code->getLines();
+                pc = code->getEntry(nextLine);
+                countStat(STAT_TIER_UPS);
+                timer.record();
+                timer.optimized = true;
+            }
+        }
+        int current = pc;
+        executed++;
+        CompiledLine & line = lines[pc];
+        //a statement that would have to wait suspends the run before it starts
+        if (suspendOnWait) {
+            SuspendReason reason = checkWait(line, state);
+            if (reason != SUSPEND_NONE) {
+                suspend(reason, line.lineNumber);
+                returns.keep = true;
+                return;
+            }
         }
-        else {
-            //syncs the numbers
-            lineNumber = state.getCurrentLineNumber();
+        //keeps the state in sync with the line being executed
+        state.setCurrentLineNumber(line.lineNumber);
+        //takes a snapshot at the statement boundary if one is due
+        //a PARALLEL FOR stopped between slices is not at a boundary yet
+        if (!state.isInLoop() && checkpoint.tick()) checkpoint.write(state, getFingerprint());
+        countStat(StatCounter(STAT_STATEMENTS + line.type));
+        publishLine(line.lineNumber);
+        //a MAT charges the meter for each element it works on, and a
+        //PARALLEL FOR for each statement its iterations run
+        bool charged = line.type == MAT_STMT || line.type == PARALLEL_FOR_STMT;
+        if (charged) meter.setExecuted(executed);
+        switch (line.type) {
+        case GOTO_STMT:
+            pc = line.target;
+            break;
+        case IF_STMT:
+            if (((IfStmt *) line.stmt)->test(state)) {
+                pc = line.target;
+            } else if (state.getCurrentLineNumber() == -1) {
+                //an unknown operator ends the program
+                pc = EXIT_NODE;
+            } else {
+                pc = line.next;
+            }
+            break;
+        case END_STMT:
+            pc = EXIT_NODE;
+            break;
+        case PARALLEL_FOR_STMT:
+            //the whole loop runs here, and its body is not in lines; a
+            //loop that reaches a limit under yield goes on from this line
+            if (!line.loop->run(state)) {
+                suspend(SUSPEND_LIMIT, line.lineNumber);
+                returns.keep = true;
+                return;
+            }
+            pc = line.next;
+            break;
+        case GOSUB_STMT:
+            //the call's own index is kept, and its next line is the return
+            state.pushReturn(pc, line.lineNumber);
+            pc = line.target;
+            //the profiler sees the new frame and its first line at once
+            publishCall(line.lineNumber, lineNumberAt(lines, pc));
+            break;
+        case RETURN_STMT:
+            pc = lines[state.popReturn().pc].next;
+            publishReturn(lineNumberAt(lines, pc));
+            break;
+        case ON_GOTO_STMT: {
+            //the table is numbered from 1, and the unsigned compare also
+            //sends values below 1 on to the next line
+            unsigned long long index = ((OnStmt *) line.stmt)->getCase(state) - 1ULL;
+            pc = (index < (unsigned long long) line.tableSize) ? line.table[index] : line.next;
+            break;
         }
-        //double checks in case numbers are updated
-        if (lineNumber != -1) {
-            //executes statement
-            getParsedStatement(lineNumber)->execute(state);
+        case ON_GOSUB_STMT: {
+            unsigned long long index = ((OnStmt *) line.stmt)->getCase(state) - 1ULL;
+            if (index < (unsigned long long) line.tableSize) {
+                state.pushReturn(pc, line.lineNumber);
+                pc = line.table[index];
+                publishCall(line.lineNumber, lineNumberAt(lines, pc));
+            } else {
+                pc = line.next;
+            }
+            break;
+        }
+        default:
+            line.stmt->execute(state);
+            pc = line.next;
+            break;
+        }
+        if (charged) executed = meter.getExecuted();
+        //a jump back is a loop, and the statement boundary is a safe
+        //place to check the memory limits and to change tiers; a
+        //statement that charged its work is checked as if it were a loop
+        if (pc >= 0 && (pc <= current || charged)) {
+            checkMemoryLimits();
+            if (budgeted) {
+                string reason;
+                if (budget > 0 && executed >= budget) {
+                    reason = "Statement budget exhausted";
+                } else if (getRunDeadline() > 0
+                           && (charged || (++backJumps & 255) == 0)
+                           && meter.isPastDeadline()) {
+                    reason = "Deadline exceeded";
+                }
+                if (reason != "") {
+                    int nextLine = lines[pc].lineNumber;
+                    if (getBudgetAction() == BUDGET_ERROR) {
+                        error(reason + " at line " + integerToString(nextLine));
+                    }
+                    suspend(SUSPEND_LIMIT, nextLine);
+                    returns.keep = true;
+                    return;
+                }
+            }
+        }
+        if (baselineTier && pc >= 0 && pc <= current) {
+            if (++lines[pc].heat == threshold && !tierRequested) {
+                tierRequested = true;
+                tierCompiler.submit(getSource());
+            }
+            if (tierCompiler.isReady()) {
+                CompiledProgram *optimized = tierCompiler.take();
+                if (optimized != NULL) compiled = optimized;
+                if (optimized != NULL && optimized->admits(state)) {
+                    int nextLine = lines[pc].lineNumber;
+                    code = optimized;
+                    code->invalidateCaches();
+                    relinkReturns(code, state);
+                    lines = code->getLines();
+                    pc = code->getEntry(nextLine);
+                    baselineTier = false;
+                    countStat(STAT_TIER_UPS);
+                    timer.record();
+                    timer.optimized = true;
+                }
+            }
         }
     }
-    //clears variables
-    state.clear();
+    //tells the profiler that no line is executing
+    resetCallStack();
+    if (pc == MISSING_NODE) error("Cannot access key");
+    //the variables are kept so the results can be looked at afterwards;
+    //RUN clears them before the next run
 }
 
 /*
@@ -75,12 +376,8 @@ void Program::run(int lineNumber, EvalState & state) {
  */
 
 void Program::list() {
-    lineCommand *current = head;
-    while (current != NULL) {
-        if(map.containsKey(current->lineNumber)) {
-            cout << current->line << endl;
-        }
-        current = current->link;
+    for (lineCommand *command : commands) {
+        printLine(getText(command));
     }
 }
 
@@ -88,61 +385,34 @@ void Program::list() {
  * Method: addSourceLine
  * Usage: addSourceLine(lineNumber,line(;
  * -------------------------------------------------
- * adds command lines to the linked list
+ * adds command lines in order of their numbers
  */
 
 void Program::addSourceLine(int lineNumber, string line) {
-    //creates a new element that doesn't point to anything
-    lineCommand *newCommand = new lineCommand;
-    newCommand->lineNumber = lineNumber;
-    //creates a new element that will be doing iterating
-    lineCommand *current;
     //checks if the line is a command
     if (!isCommand(line)) {
         error("Not a command");
     }
-    newCommand->line = line;
-    newCommand->link = NULL;
-    //removes code with the same line number
-    if (map.containsKey(lineNumber)) {
-        removeSourceLine(lineNumber);
-    }
-    //adds the command line to the map
-    map.put(lineNumber,newCommand);
-    //if its the first element, make it the head
-    if (isEmpty()) {
-        head = newCommand;
-        current = head;
-    }
-    else {
-        //creates a pointer that points at the front
-        current = head;
-        //if the new element's priority is more urgent than the head's, make it the head
-        if (lineNumber < current->lineNumber) {
-            newCommand->link = current;
-            head = newCommand;
-        }
-        //else look for the spot where it belongs
-        else {
-            //while it isn't pointing at the end
-            while (current->link != NULL) {
-                //if the element's priority is more urgent than the current and less than the next
-                if (lineNumber >= current->lineNumber && lineNumber < current->link->lineNumber) {
-                    //set the new element's link to the current's link
-                    newCommand->link = current->link;
-                    //change the current link to the element
-                    current->link = newCommand;
-                    count++;
-                    return;
-                }
-                //updates the iteration
-                current = current->link;
-            }
-            //if it doesn't return, add it to the end
-            current->link = newCommand;
-        }
+    //the line store is charged for everything kept about the line
+    MemoryScope scope(MEM_LINES);
+    string tokens = tokenizer.tokenize(line);
+    //the record and the tokens share one block
+    void *block = operator new(sizeof(lineCommand) + tokens.length());
+    lineCommand *newCommand = new (block) lineCommand;
+    newCommand->lineNumber = lineNumber;
+    newCommand->length = tokens.length();
+    newCommand->stmt = NULL;
+    memcpy(newCommand + 1, tokens.data(), tokens.length());
+    //replaces a line with the same number, or makes room in order
+    int index = findLine(lineNumber);
+    if (index < commands.size() && commands[index]->lineNumber == lineNumber) {
+        sharedTrees.release(commands[index]->stmt);
+        deleteCommand(commands[index]);
+        commands[index] = newCommand;
+    } else {
+        commands.insert(index, newCommand);
     }
-    count++;
+    invalidate();
 }
 
 /*
@@ -153,42 +423,17 @@ void Program::addSourceLine(int lineNumber, string line) {
  */
 
 void Program::removeSourceLine(int lineNumber) {
-    //creates an element at the beginning
-    lineCommand *current = head;
-    //checks if the map is empty or doesn't have the line number
-    if (!map.containsKey(lineNumber) || count == 0) error("Cannot remove line");;
-    //removes one from the total count
-    count--;
-    //condition if it's the first one
-    if (current->lineNumber == lineNumber && current == head) {
-        //moves head to the next
-        head = current->link;
-        map.remove(lineNumber);
-        delete current;
-        return;
-    }
-    while (current->link != NULL) {
-        //condition if it's the last one
-        if (current->link->lineNumber == lineNumber && current->link->link == NULL) {
-            map.remove(lineNumber);
-            //deletes the next one
-            current->link = NULL;
-            delete current->link;
-            return;
-        }
-        //condition if it's the middle one
-        else if (current->link->lineNumber == lineNumber) {
-            lineCommand *remove = current->link;
-            lineCommand *new_next = remove->link;
-            //links the current to the one after the next
-            current->link = new_next;
-            remove->link = NULL;
-            map.remove(lineNumber);
-            return;
-        }
-        //updates the iteration
-        current = current->link;
+    int index = findLine(lineNumber);
+    //checks if the program has the line number
+    if (index == commands.size() || commands[index]->lineNumber != lineNumber) {
+        error("Cannot remove line");
     }
+    lineCommand *command = commands[index];
+    //gives back the line's statement, which other lines may still share
+    sharedTrees.release(command->stmt);
+    commands.remove(index);
+    deleteCommand(command);
+    invalidate();
 }
 
 /*
@@ -199,7 +444,9 @@ void Program::removeSourceLine(int lineNumber) {
  */
 
 string Program::getSourceLine(int lineNumber) {
-    return map.get(lineNumber)->line;
+    lineCommand *command = getCommand(lineNumber);
+    if (command == NULL) return "";
+    return getText(command);
 }
 
 /*
@@ -210,9 +457,14 @@ string Program::getSourceLine(int lineNumber) {
  */
 
 void Program::setParsedStatement(int lineNumber, Statement *stmt) {
-    //checks if the number exists in the map
-    if (map.containsKey(lineNumber)) {
-        map.get(lineNumber)->stmt = stmt;
+    lineCommand *command = getCommand(lineNumber);
+    //checks if the number exists in the program
+    if (command != NULL) {
+        MemoryScope scope(MEM_AST);
+        //lines with the same statement share one copy of it
+        sharedTrees.release(command->stmt);
+        command->stmt = sharedTrees.intern(stmt);
+        invalidate();
     }
     else {
         error("Cannot access key");
@@ -223,14 +475,15 @@ void Program::setParsedStatement(int lineNumber, Statement *stmt) {
  * Method: getParsedStatement
  * Usage: getParsedStatement(int lineNumber);
  * -------------------------------------------------
- * gets the statement from the map
+ * gets the statement of the line
  */
 
 Statement *Program::getParsedStatement(int lineNumber) {
     Statement *parsedStatement;
-    //checks if the number exists in the map
-    if (map.containsKey(lineNumber)) {
-        parsedStatement = map.get(lineNumber)->stmt;
+    lineCommand *command = getCommand(lineNumber);
+    //checks if the number exists in the program
+    if (command != NULL) {
+        parsedStatement = command->stmt;
     }
     else {
         error("Cannot access key");
@@ -246,7 +499,7 @@ Statement *Program::getParsedStatement(int lineNumber) {
  */
 
 int Program::getFirstLineNumber() {
-    return head->lineNumber;
+    return commands[0]->lineNumber;
 }
 
 /*
@@ -257,20 +510,192 @@ int Program::getFirstLineNumber() {
  */
 
 int Program::getNextLineNumber(int lineNumber) {
-    int nextLineNumber;
-    //checks if the number exists in the map
-    if (map.containsKey(lineNumber)) {
+    int index = findLine(lineNumber);
+    //checks if the number exists in the program
+    if (index < commands.size() && commands[index]->lineNumber == lineNumber) {
         //if it's the last one, make it -1
-        if (map.get(lineNumber)->link == NULL) {
+        if (index + 1 == commands.size()) {
             return -1;
         }
-        //assigns the next number to the link
-        nextLineNumber = map.get(lineNumber)->link->lineNumber;
-        return nextLineNumber;
+        return commands[index + 1]->lineNumber;
     }
     return -1;
 }
 
+/*
+ * Method: compile
+ * Usage: compile();
+ * -------------------------------------------------
+ * compiles the program again if it changed since the last compile
+ */
+
+CompiledProgram & Program::compile() {
+    if (compiled == NULL) compiled = tierCompiler.take();
+    if (compiled == NULL) {
+        MemoryScope scope(MEM_CODE);
+        compiled = new CompiledProgram(getSource(), true);
+        //the background result would be the same program
+        tierCompiler.cancel();
+        tierRequested = true;
+    }
+    return *compiled;
+}
+
+/*
+ * Method: getSource
+ * Usage: getSource();
+ * -------------------------------------------------
+ * copies the source lines in order
+ */
+
+Vector<SourceLine> Program::getSource() {
+    Vector<SourceLine> source;
+    for (lineCommand *command : commands) {
+        SourceLine line;
+        line.lineNumber = command->lineNumber;
+        line.text = getText(command);
+        source.add(line);
+    }
+    return source;
+}
+
+/*
+ * Method: selectTier
+ * Usage: selectTier();
+ * -------------------------------------------------
+ * picks the code a run starts with: the optimized tier if it exists or
+ * the background compiler has finished it, the baseline tier otherwise,
+ * which is also the only tier when the optimizer is off; the baseline
+ * tier also runs when the optimized code types a variable as an integer
+ * and the state holds a real number in it
+ */
+
+CompiledProgram *Program::selectTier(EvalState & state) {
+    if (compiled == NULL) {
+        compiled = tierCompiler.take();
+        if (compiled != NULL) countStat(STAT_TIER_UPS);
+    }
+    //without tiering everything is optimized up front
+    if (compiled == NULL && isOptimizing() && getTierUpThreshold() <= 0) compile();
+    if (compiled != NULL && compiled->admits(state)) return compiled;
+    if (baseline == NULL) {
+        MemoryScope scope(MEM_CODE);
+        baseline = new CompiledProgram(getSource(), false, &sharedTrees);
+    }
+    return baseline;
+}
+
+/*
+ * Method: getFingerprint
+ * Usage: getFingerprint();
+ * -------------------------------------------------
+ * hashes the source lines in order with 64-bit FNV-1a; the hash is kept
+ * until the program changes, so a snapshot does not rehash the program
+ */
+
+unsigned long long Program::getFingerprint() {
+    if (fingerprinted) return fingerprint;
+    unsigned long long hash = 14695981039346656037ULL;
+    for (lineCommand *command : commands) {
+        string text = getText(command);
+        for (size_t i = 0; i < text.length(); i++) {
+            hash = (hash ^ (unsigned char) text[i]) * 1099511628211ULL;
+        }
+        //separates the lines so that splitting text differently changes the hash
+        hash = (hash ^ '\n') * 1099511628211ULL;
+    }
+    fingerprint = hash;
+    fingerprinted = true;
+    return hash;
+}
+
+/*
+ * Method: isSuspended
+ * Usage: isSuspended();
+ * -------------------------------------------------
+ * checks if the last run ran out of budget and can be continued
+ */
+
+bool Program::isSuspended() {
+    return suspension != SUSPEND_NONE;
+}
+
+/*
+ * Method: getSuspendedLine
+ * Usage: getSuspendedLine();
+ * -------------------------------------------------
+ * gets the line a suspended run continues from
+ */
+
+int Program::getSuspendedLine() {
+    if (suspension == SUSPEND_NONE) error("Cannot continue");
+    return suspendedLine;
+}
+
+/*
+ * Method: getSuspendReason
+ * Usage: getSuspendReason();
+ * -------------------------------------------------
+ * tells why the last run was suspended
+ */
+
+SuspendReason Program::getSuspendReason() {
+    return suspension;
+}
+
+/*
+ * Method: suspend
+ * Usage: suspend(reason, lineNumber);
+ * -------------------------------------------------
+ * ends a run early, keeping the variables and the line to continue from
+ */
+
+void Program::suspend(SuspendReason reason, int lineNumber) {
+    suspension = reason;
+    suspendedLine = lineNumber;
+    resetCallStack();
+}
+
+/*
+ * Method: getSharedTrees
+ * Usage: getSharedTrees();
+ * -------------------------------------------------
+ * returns the table that shares the parsed statements
+ */
+
+HashConsTable & Program::getSharedTrees() {
+    return sharedTrees;
+}
+
+/*
+ * Method: getCheckpoint
+ * Usage: getCheckpoint();
+ * -------------------------------------------------
+ * returns the checkpoint policy
+ */
+
+Checkpoint & Program::getCheckpoint() {
+    return checkpoint;
+}
+
+/*
+ * Method: invalidate
+ * Usage: invalidate();
+ * -------------------------------------------------
+ * discards the compiled form so the next run compiles the new text
+ */
+
+void Program::invalidate() {
+    suspension = SUSPEND_NONE;
+    fingerprinted = false;
+    delete compiled;
+    compiled = NULL;
+    delete baseline;
+    baseline = NULL;
+    tierCompiler.cancel();
+    tierRequested = false;
+}
+
 /*
  * Method: isCommand
  * Usage: isCommand(line);
@@ -291,5 +716,75 @@ bool Program::isCommand(string line) {
     if (command == "GOTO") return true;
     if (command == "IF") return true;
     if (command == "END") return true;
+    if (command == "GOSUB") return true;
+    if (command == "RETURN") return true;
+    if (command == "ON") return true;
+    if (command == "DIM") return true;
+    if (command == "MAT") return true;
+    if (command == "PARALLEL") return true;
+    if (command == "NEXT") return true;
     return false;
 }
+
+/*
+ * Method: findLine
+ * Usage: int index = findLine(lineNumber);
+ * -------------------------------------------------
+ * finds by binary search the index of the first line whose number is
+ * not below lineNumber, which is where a new line with that number goes
+ */
+
+int Program::findLine(int lineNumber) {
+    countStat(STAT_LINE_PROBES);
+    int low = 0;
+    int high = commands.size();
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (commands[middle]->lineNumber < lineNumber) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/*
+ * Method: getCommand
+ * Usage: lineCommand *command = getCommand(lineNumber);
+ * -------------------------------------------------
+ * gets the record of the line, or NULL if there is no such line
+ */
+
+Program::lineCommand *Program::getCommand(int lineNumber) {
+    int index = findLine(lineNumber);
+    if (index == commands.size() || commands[index]->lineNumber != lineNumber) {
+        return NULL;
+    }
+    return commands[index];
+}
+
+/*
+ * Method: getText
+ * Usage: string text = getText(command);
+ * -------------------------------------------------
+ * converts the tokens after the record back to the line as typed
+ */
+
+string Program::getText(lineCommand *command) {
+    return tokenizer.detokenize((const char *) (command + 1), command->length);
+}
+
+/*
+ * Method: deleteCommand
+ * Usage: deleteCommand(command);
+ * -------------------------------------------------
+ * gives back the names of the line and frees its block; the caller has
+ * already taken the record out of the program and released its statement
+ */
+
+void Program::deleteCommand(lineCommand *command) {
+    tokenizer.release((const char *) (command + 1), command->length);
+    command->~lineCommand();
+    operator delete(command);
+}
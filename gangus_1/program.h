@@ -9,8 +9,14 @@
 #define _program_h
 
 #include <string>
+#include "budget.h"
+#include "cfg.h"
+#include "checkpoint.h"
+#include "hashcons.h"
 #include "statement.h"
-#include "hashmap.h"
+#include "tiering.h"
+#include "tokenizer.h"
+#include "vector.h"
 using namespace std;
 
 /*
@@ -20,10 +26,17 @@ using namespace std;
  * components:
  *
  * 1. The source line, which is the complete line (including the
- *    line number) that was entered by the user.
+ *    line number) that was entered by the user.  It is stored in
+ *    tokenized form (see tokenizer.h), in the same block as the
+ *    rest of the line's record, and converted back to text when
+ *    it is listed or compiled.
  *
  * 2. The parsed representation of that statement, which is a
  *    pointer to a Statement.
+ *
+ * The program is executed from a separate compiled form (see
+ * compiler.h), which is rebuilt from the source lines on the first
+ * run after any change.
  */
 
 class Program {
@@ -70,11 +83,31 @@ public:
  * Method: run
  * Usage: program.run();
  * -----------------------
- * Executes the program
+ * Executes the program.  The variables are left as the program left
+ * them, so they can be printed or saved once it ends; RUN clears them
+ * before it starts the program again.
  */
 
     void run(int lineNumber, EvalState & state);
 
+    /*
+ * Methods: isSuspended, getSuspendedLine, getSuspendReason
+ * Usage: if (program.isSuspended()) {
+ *            program.run(program.getSuspendedLine(), state);
+ *        }
+ * ---------------------------------------------------------
+ * A run that reaches a limit in budget.h with the BUDGET_YIELD action
+ * returns early instead of raising an error, and so does a run that
+ * would wait for input or output when setSuspendOnWait is on.  The
+ * program is then suspended: the variables are kept, and running it
+ * again from the suspended line continues where it stopped with a
+ * fresh budget.  Any change to the program ends the suspension.
+ */
+
+    bool isSuspended();
+    int getSuspendedLine();
+    SuspendReason getSuspendReason();
+
     /*
  * Method: list
  * Usage: program.list();
@@ -126,7 +159,9 @@ public:
  * Adds the parsed representation of the statement to the statement
  * at the specified line number.  If no such line exists, this
  * method raises an error.  If a previous parsed representation
- * exists, the memory for that statement is reclaimed.
+ * exists, the memory for that statement is reclaimed.  The program
+ * takes over stmt and interns it, so lines with structurally
+ * identical statements share one copy, which must not be changed.
  */
 
     void setParsedStatement(int lineNumber, Statement *stmt);
@@ -163,23 +198,94 @@ public:
 
     int getNextLineNumber(int lineNumber);
 
+    /*
+ * Method: compile
+ * Usage: CompiledProgram & code = program.compile();
+ * --------------------------------------------------
+ * Returns the optimized form of the program, compiling it on the calling
+ * thread first if the program has changed since it was last compiled.
+ * This is what tools such as CHECKS use; run only compiles the baseline
+ * tier up front and leaves the optimized tier to the background.
+ */
+
+    CompiledProgram & compile();
+
+    /*
+ * Method: getSource
+ * Usage: Vector<SourceLine> source = program.getSource();
+ * -------------------------------------------------------
+ * Returns a copy of the source lines in line-number order.
+ */
+
+    Vector<SourceLine> getSource();
+
+    /*
+ * Method: getFingerprint
+ * Usage: unsigned long long hash = program.getFingerprint();
+ * ----------------------------------------------------------
+ * Returns a 64-bit hash of the source lines in program order, which
+ * identifies the program a checkpoint was taken from.  The hash is
+ * computed once after each change to the program.
+ */
+
+    unsigned long long getFingerprint();
+
+    /*
+ * Method: getSharedTrees
+ * Usage: HashConsTable & table = program.getSharedTrees();
+ * --------------------------------------------------------
+ * Returns the table that holds the parsed statements, which is where
+ * their memory use before and after sharing can be found.
+ */
+
+    HashConsTable & getSharedTrees();
+
+    /*
+ * Method: getCheckpoint
+ * Usage: program.getCheckpoint().enable(filename, statements, millis);
+ * --------------------------------------------------------------------
+ * Returns the checkpoint policy that run applies at every statement
+ * boundary.
+ */
+
+    Checkpoint & getCheckpoint();
+
 private:
 
+    //the line as typed follows the record in the same block, in the
+    //compact form of tokenizer.h
     struct lineCommand {
         Statement *stmt;
-        lineCommand *link;
         int lineNumber;
-        string line;
+        int length;
     };
 
 
     /* static variables */
 
-    lineCommand *head;
-    int count;
-    HashMap<int,lineCommand*> map;
+    //the lines in order of their numbers
+    Vector<lineCommand *> commands;
+    HashConsTable sharedTrees;
+    LineTokenizer tokenizer;
+    Checkpoint checkpoint;
+
+    CompiledProgram *compiled;
+    CompiledProgram *baseline;
+    TierCompiler tierCompiler;
+    bool tierRequested;
+    unsigned long long fingerprint;
+    bool fingerprinted;
+    SuspendReason suspension;
+    int suspendedLine;
 
     bool isCommand(string line);
+    int findLine(int lineNumber);
+    lineCommand *getCommand(int lineNumber);
+    string getText(lineCommand *command);
+    void deleteCommand(lineCommand *command);
+    void invalidate();
+    void suspend(SuspendReason reason, int lineNumber);
+    CompiledProgram *selectTier(EvalState & state);
 
 };
 
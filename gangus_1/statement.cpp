@@ -7,13 +7,22 @@
  * BASIC statements.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
 #include <string>
+#include <vector>
+#include "accounting.h"
+#include "budget.h"
 #include "statement.h"
 #include "parser.h"
 #include "tokenscanner.h"
 #include "exp.h"
 #include "evalstate.h"
-#include "simpio.h"
+#include "inputsource.h"
+#include "matrix.h"
+#include "output.h"
 #include "program.h"
 using namespace std;
 
@@ -27,6 +36,29 @@ Statement::~Statement() {
    /* Empty */
 }
 
+string statementTypeToString(StatementType type) {
+   switch (type) {
+    case PRINT_STMT: return "PRINT";
+    case LET_STMT: return "LET";
+    case REM_STMT: return "REM";
+    case INPUT_STMT: return "INPUT";
+    case GOTO_STMT: return "GOTO";
+    case IF_STMT: return "IF";
+    case END_STMT: return "END";
+    case GOSUB_STMT: return "GOSUB";
+    case RETURN_STMT: return "RETURN";
+    case ON_GOTO_STMT: return "ON-GOTO";
+    case ON_GOSUB_STMT: return "ON-GOSUB";
+    case DIM_STMT: return "DIM";
+    case MAT_STMT: return "MAT";
+    case PARALLEL_FOR_STMT: return "PARALLEL-FOR";
+    case NEXT_STMT: return "NEXT";
+    case LOOP_ENTRY_STMT: return "LOOP-ENTRY";
+    case NUM_STATEMENT_TYPES: break;
+   }
+   return "?";
+}
+
 /*
  * Constructor: PrintStmt
  * -------------------------------------------------
@@ -58,13 +90,26 @@ PrintStmt::~PrintStmt() {
  */
 
 void PrintStmt::execute(EvalState & state) {
-    cout << exp->eval(state) << endl;
+    printValue(exp->eval(state));
 };
 
+StatementType PrintStmt::getType() {
+    return PRINT_STMT;
+}
+
+Expression *PrintStmt::getExp() {
+    return exp;
+}
+
+//replaces the expression without freeing it, for the optimizer
+void PrintStmt::setExp(Expression *exp) {
+    this->exp = exp;
+}
+
 /*
  * Constructor: LetStmt
  * -------------------------------------------------
- * Assigns a variable to an expression
+ * Assigns a variable or an array element to an expression
  */
 
 LetStmt::LetStmt(TokenScanner & scanner) {
@@ -74,42 +119,139 @@ LetStmt::LetStmt(TokenScanner & scanner) {
     if (!isalpha(firstChar)) {
         error ("Not valid input");
     }
-    IdentifierExp *identifier = new IdentifierExp(firstWord);
-    //puls the assignment operator
+    IdentifierExp *identifier = NULL;
+    ArrayExp *arrayElement = NULL;
+    //puls the assignment operator, after the subscripts of an element
     string assignment = scanner.nextToken();
+    if (assignment == "(") {
+        arrayElement = readElement(scanner, firstWord);
+        assignment = scanner.nextToken();
+    } else {
+        checkName(firstWord);
+        identifier = new IdentifierExp(firstWord);
+    }
     if (assignment != "=") {
         error ("Not an assignment operator");
     }
-    //creates an expression
+    //creates an expression, which must have the type of the target
     exp = readE(scanner, 0);
     if (scanner.hasMoreTokens()) {
         error("Extraneous token " + scanner.nextToken());
     }
-    //sets the instance variable to the identifier
+    checkTypes(isStringName(firstWord) && identifier != NULL, exp);
+    //sets the instance variables to the identifier or the element
     variable = identifier;
+    element = arrayElement;
+    base = NULL;
+    if (variable != NULL && isStringName(firstWord)) findAppend();
+}
+
+/*
+ * Method: findAppend()
+ * -------------------------------------------------
+ * turns LET V$ = V$ + tail into an append of tail to V$, so a loop that
+ * builds a string grows it in place; the joins below the first are
+ * rebuilt as the tail, which joins the same strings in the same order
+ */
+
+void LetStmt::findAppend() {
+    //walks down the left operands of the joins to the first string
+    Vector<CompoundExp *> joins;
+    Expression *first = exp;
+    while (first->getType() == COMPOUND) {
+        joins.add((CompoundExp *) first);
+        first = ((CompoundExp *) first)->getLHS();
+    }
+    if (joins.isEmpty() || first->getType() != IDENTIFIER) return;
+    if (((IdentifierExp *) first)->getName() != variable->getName()) return;
+    //the innermost join goes away, and its right operand starts the tail
+    CompoundExp *innermost = joins[joins.size() - 1];
+    Expression *tail = innermost->getRHS();
+    innermost->setLHS(NULL);
+    innermost->setRHS(NULL);
+    delete innermost;
+    for (int i = joins.size() - 2; i >= 0; i--) {
+        joins[i]->setLHS(tail);
+        tail = joins[i];
+    }
+    base = (IdentifierExp *) first;
+    exp = tail;
 }
 
 /*
  * Destructor: LetStmt
  * -------------------------------------------------
- * Deletes exp and variable
+ * Deletes exp and variable or element
  */
 
 LetStmt::~LetStmt() {
     delete exp;
     delete variable;
+    delete element;
+    delete base;
 }
 
 /*
  * Method: execute(state)
  * -------------------------------------------------
- * creates a value in the map
+ * creates a value in the map, or stores it in the element after
+ * evaluating it
  */
 
 void LetStmt::execute(EvalState & state) {
-    state.setValue(variable->getName(),exp->eval(state));
+    if (element != NULL) {
+        element->assign(state,exp->eval(state));
+        return;
+    }
+    //an append checks the variable the way reading it would
+    if (base != NULL) {
+        variable->append(state, exp, base->isChecked());
+        return;
+    }
+    variable->assign(state,exp->eval(state));
 };
 
+StatementType LetStmt::getType() {
+    return LET_STMT;
+}
+
+IdentifierExp *LetStmt::getVariable() {
+    return variable;
+}
+
+ArrayExp *LetStmt::getElement() {
+    return element;
+}
+
+Expression *LetStmt::getExp() {
+    return exp;
+}
+
+//replaces the expression without freeing it, for the optimizer
+void LetStmt::setExp(Expression *exp) {
+    this->exp = exp;
+}
+
+//replaces the variable without freeing it, for the optimizer
+void LetStmt::setVariable(IdentifierExp *variable) {
+    this->variable = variable;
+}
+
+//the read of the variable in an append, or NULL for a plain LET
+IdentifierExp *LetStmt::getBase() {
+    return base;
+}
+
+//replaces the base without freeing it, for the optimizer
+void LetStmt::setBase(IdentifierExp *base) {
+    this->base = base;
+}
+
+//replaces the element without freeing it, for the optimizer
+void LetStmt::setElement(ArrayExp *element) {
+    this->element = element;
+}
+
 /*
  * Constructor: RemStmt
  * -------------------------------------------------
@@ -119,6 +261,7 @@ void LetStmt::execute(EvalState & state) {
 RemStmt::RemStmt(TokenScanner & scanner) {}
 RemStmt::~RemStmt() {}
 void RemStmt::execute(EvalState & state) {};
+StatementType RemStmt::getType() { return REM_STMT; }
 
 /*
  * Constructor: InputStmt
@@ -133,6 +276,7 @@ InputStmt::InputStmt(TokenScanner & scanner) {
     if (!isalpha(firstChar)) {
         error ("Not valid input");
     }
+    checkName(inputString);
     IdentifierExp * inputVariable = new IdentifierExp(inputString);
     if (scanner.hasMoreTokens()) {
         error("Extraneous token " + scanner.nextToken());
@@ -143,29 +287,41 @@ InputStmt::InputStmt(TokenScanner & scanner) {
 /*
  * Destructor: InputStmt
  * -------------------------------------------------
- * Deletes pointers constant and variable
+ * Deletes pointer variable
  */
 
 InputStmt::~InputStmt() {
-    delete constant;
     delete variable;
 }
 
 /*
  * Method: execute(state)
  * -------------------------------------------------
- * creates a value in the map with user input
+ * creates a value in the map with the next value from the input source
  */
 
 void InputStmt::execute(EvalState & state) {
-    //takes user input
-    int firstInt = getInteger(" ? ");
-    ConstantExp * inputValue = new ConstantExp(firstInt);
-    constant = inputValue;
-    //puts the value in the map
-    state.setValue(variable->getName(),constant->getValue());
+    //a string variable takes the whole line as it was typed
+    if (isStringName(variable->getName())) {
+        variable->assign(state,state.getInputSource().readString());
+        return;
+    }
+    variable->assign(state,state.getInputSource().readValue());
 };
 
+StatementType InputStmt::getType() {
+    return INPUT_STMT;
+}
+
+IdentifierExp *InputStmt::getVariable() {
+    return variable;
+}
+
+//replaces the variable without freeing it, for the optimizer
+void InputStmt::setVariable(IdentifierExp *variable) {
+    this->variable = variable;
+}
+
 /*
  * Constructor: EndStmt
  * -------------------------------------------------
@@ -186,6 +342,10 @@ void EndStmt::execute(EvalState &state) {
     state.setCurrentLineNumber(-1);
 };
 
+StatementType EndStmt::getType() {
+    return END_STMT;
+}
+
 /*
  * Constructor: GotoStmt
  * -------------------------------------------------
@@ -209,6 +369,20 @@ void GotoStmt::execute(EvalState & state) {
     state.setCurrentLineNumber(newLineNumber);
 };
 
+/*
+ * Method: getTarget()
+ * -------------------------------------------------
+ * returns the line number to jump to
+ */
+
+int GotoStmt::getTarget() {
+    return newLineNumber;
+}
+
+StatementType GotoStmt::getType() {
+    return GOTO_STMT;
+}
+
 /*
  * Constructor: IfStmt
  * -------------------------------------------------
@@ -216,20 +390,26 @@ void GotoStmt::execute(EvalState & state) {
  */
 
 IfStmt::IfStmt(TokenScanner & scanner) {
-    //gets the left side expression
-    exp1 = readE(scanner, 0);
+    //gets the left side expression, stopping at = since it compares here
+    exp1 = readE(scanner, 1);
     //gets the operator
     op = scanner.nextToken();
-    //gets the right side expression
-    exp2 = readE(scanner, 0);
+    //gets the right side expression, which must have the same type
+    exp2 = readE(scanner, 1);
+    if (isStringExpression(exp1) != isStringExpression(exp2)) {
+        delete exp1;
+        delete exp2;
+        error("Type mismatch");
+    }
     //checks if there is a THEN after the expression
-    if (toUpperCase(scanner.nextToken()) == "THEN") {
-        newLineNumber = stringToInteger(scanner.nextToken());
+    if (toUpperCase(scanner.nextToken()) != "THEN") {
+        error("THEN expected");
     }
+    newLineNumber = stringToInteger(scanner.nextToken());
 }
 
 /*
- * Destructor: InputStmt
+ * Destructor: IfStmt
  * -------------------------------------------------
  * Deletes pointers exp1 and exp2
  */
@@ -246,26 +426,799 @@ IfStmt::~IfStmt() {
  */
 
 void IfStmt::execute(EvalState & state) {
+    if (test(state)) {
+        state.setCurrentLineNumber(newLineNumber);
+    }
+};
+
+/*
+ * Method: test(state)
+ * -------------------------------------------------
+ * evaluates the condition without jumping; an unknown operator
+ * moves the program to the end and counts as false
+ */
+
+bool IfStmt::test(EvalState & state) {
     //evaluates the left side
-    int first = exp1->eval(state);
+    Value first = exp1->eval(state);
     //evaluates the right side
-    int second = exp2->eval(state);
-    if (op == "=") {
-        if (first == second) {
-            state.setCurrentLineNumber(newLineNumber);
+    Value second = exp2->eval(state);
+    //compares them as numbers, so 2 = 2.0, or as strings
+    if (op == "=") return valuesEqual(first, second);
+    if (op == ">") return valueLess(second, first);
+    if (op == "<") return valueLess(first, second);
+    //moves it to the end
+    state.setCurrentLineNumber(-1);
+    return false;
+}
+
+/*
+ * Method: getTarget()
+ * -------------------------------------------------
+ * returns the line number to jump to
+ */
+
+int IfStmt::getTarget() {
+    return newLineNumber;
+}
+
+/*
+ * Methods: getLHS(), getRHS(), getOp()
+ * -------------------------------------------------
+ * return the parts of the condition
+ */
+
+Expression *IfStmt::getLHS() {
+    return exp1;
+}
+
+Expression *IfStmt::getRHS() {
+    return exp2;
+}
+
+string IfStmt::getOp() {
+    return op;
+}
+
+/*
+ * Methods: setLHS(), setRHS()
+ * -------------------------------------------------
+ * replace a side of the condition without freeing it, for the optimizer
+ */
+
+void IfStmt::setLHS(Expression *lhs) {
+    exp1 = lhs;
+}
+
+void IfStmt::setRHS(Expression *rhs) {
+    exp2 = rhs;
+}
+
+StatementType IfStmt::getType() {
+    return IF_STMT;
+}
+
+/*
+ * Constructor: GosubStmt
+ * -------------------------------------------------
+ * Calls the subroutine at a line
+ */
+
+GosubStmt::GosubStmt(TokenScanner & scanner) {
+    string potentialNumber = scanner.nextToken();
+    newLineNumber = stringToInteger(potentialNumber);
+    if (scanner.hasMoreTokens()) {
+        error("Extraneous token " + scanner.nextToken());
+    }
+}
+
+GosubStmt::~GosubStmt() {}
+
+/*
+ * Method: execute(state)
+ * -------------------------------------------------
+ * sets the line number to the subroutine's, like GOTO; the call itself
+ * is made by the run loop, which owns the return addresses
+ */
+
+void GosubStmt::execute(EvalState & state) {
+    state.setCurrentLineNumber(newLineNumber);
+};
+
+/*
+ * Method: getTarget()
+ * -------------------------------------------------
+ * returns the line number of the subroutine
+ */
+
+int GosubStmt::getTarget() {
+    return newLineNumber;
+}
+
+StatementType GosubStmt::getType() {
+    return GOSUB_STMT;
+}
+
+/*
+ * Constructor: ReturnStmt
+ * -------------------------------------------------
+ * Ends a subroutine
+ */
+
+ReturnStmt::ReturnStmt() {}
+
+ReturnStmt::~ReturnStmt() {}
+
+/*
+ * Method: execute(state)
+ * -------------------------------------------------
+ * outside a running program there is no call to return from
+ */
+
+void ReturnStmt::execute(EvalState & state) {
+    error("RETURN without GOSUB");
+};
+
+StatementType ReturnStmt::getType() {
+    return RETURN_STMT;
+}
+
+/*
+ * Constructor: OnStmt
+ * -------------------------------------------------
+ * Reads the expression, GOTO or GOSUB and the comma-separated lines
+ */
+
+OnStmt::OnStmt(TokenScanner & scanner) {
+    exp = readE(scanner, 0);
+    string keyword = toUpperCase(scanner.nextToken());
+    if (keyword != "GOTO" && keyword != "GOSUB") {
+        delete exp;
+        error("ON needs GOTO or GOSUB");
+    }
+    gosub = keyword == "GOSUB";
+    //reads the lines, which must be separated by commas
+    do {
+        string potentialNumber = scanner.nextToken();
+        if (scanner.getTokenType(potentialNumber) != NUMBER) {
+            delete exp;
+            error("Line number expected in ON");
         }
+        targets.add(stringToInteger(potentialNumber));
+    } while (scanner.hasMoreTokens() && scanner.nextToken() == ",");
+    if (scanner.hasMoreTokens()) {
+        delete exp;
+        error("Extraneous token " + scanner.nextToken());
+    }
+}
+
+OnStmt::~OnStmt() {
+    delete exp;
+}
+
+/*
+ * Method: execute(state)
+ * -------------------------------------------------
+ * sets the line number to the chosen line, like GOTO; the jump or the
+ * call is made by the run loop
+ */
+
+void OnStmt::execute(EvalState & state) {
+    long long value = getCase(state);
+    if (value >= 1 && value <= targets.size()) {
+        state.setCurrentLineNumber(targets[value - 1]);
     }
-    else if (op == ">") {
-        if (first > second) {
-            state.setCurrentLineNumber(newLineNumber);
+};
+
+/*
+ * Method: getCase(state)
+ * -------------------------------------------------
+ * evaluates the expression, which numbers the lines from 1; a big
+ * integer is past the end of any table, so it is returned as 0
+ */
+
+long long OnStmt::getCase(EvalState & state) {
+    Value value = exp->eval(state);
+    if (value.isBig()) return 0;
+    return checkInteger(value, "ON value");
+}
+
+/*
+ * Method: getTargets()
+ * -------------------------------------------------
+ * returns the line numbers in order
+ */
+
+const Vector<int> & OnStmt::getTargets() {
+    return targets;
+}
+
+/*
+ * Methods: getExp(), setExp()
+ * -------------------------------------------------
+ * give the optimizer the expression
+ */
+
+Expression *OnStmt::getExp() {
+    return exp;
+}
+
+void OnStmt::setExp(Expression *exp) {
+    this->exp = exp;
+}
+
+StatementType OnStmt::getType() {
+    return gosub ? ON_GOSUB_STMT : ON_GOTO_STMT;
+}
+
+/*
+ * Constructor: DimStmt
+ * -------------------------------------------------
+ * Reads the array name and its one or two bounds in parentheses
+ */
+
+DimStmt::DimStmt(TokenScanner & scanner) {
+    name = scanner.nextToken();
+    //checks that the array has a name and parentheses after it
+    if (scanner.getTokenType(name) != WORD) {
+        error("Array name expected in DIM");
+    }
+    if (isStringName(name)) {
+        error("Arrays of strings are not supported");
+    }
+    if (scanner.nextToken() != "(") {
+        error("DIM needs the bounds of the array");
+    }
+    first = readE(scanner, 0);
+    second = NULL;
+    string token = scanner.nextToken();
+    if (token == ",") {
+        second = readE(scanner, 0);
+        token = scanner.nextToken();
+    }
+    if (token != ")") {
+        delete first;
+        delete second;
+        error("Unbalanced parentheses in DIM");
+    }
+    if (scanner.hasMoreTokens()) {
+        delete first;
+        delete second;
+        error("Extraneous token " + scanner.nextToken());
+    }
+}
+
+DimStmt::~DimStmt() {
+    delete first;
+    delete second;
+}
+
+/*
+ * Method: execute(state)
+ * -------------------------------------------------
+ * evaluates the bounds and gives the array new storage, even if it had
+ * some, so a DIM that runs again starts the array over
+ */
+
+void DimStmt::execute(EvalState & state) {
+    int firstBound = checkInt(first->eval(state), "Array dimension");
+    int secondBound = -1;
+    if (second != NULL) {
+        secondBound = checkInt(second->eval(state), "Array dimension");
+        if (secondBound < 0) error("Illegal dimension for array " + name);
+    }
+    state.dimArray(state.getArraySlot(name), firstBound, secondBound);
+};
+
+StatementType DimStmt::getType() {
+    return DIM_STMT;
+}
+
+/*
+ * Methods: getName(), getFirst(), getSecond(), setFirst(), setSecond()
+ * -------------------------------------------------
+ * give the optimizer the array and its bounds
+ */
+
+string DimStmt::getName() {
+    return name;
+}
+
+Expression *DimStmt::getFirst() {
+    return first;
+}
+
+Expression *DimStmt::getSecond() {
+    return second;
+}
+
+void DimStmt::setFirst(Expression *first) {
+    this->first = first;
+}
+
+void DimStmt::setSecond(Expression *second) {
+    this->second = second;
+}
+
+/*
+ * Constructor: MatStmt
+ * -------------------------------------------------
+ * Reads the target array, the = and one of the forms of MAT
+ */
+
+MatStmt::MatStmt(TokenScanner & scanner) {
+    scale = NULL;
+    first = NULL;
+    second = NULL;
+    //the destructor does not run if the constructor throws
+    try {
+        parse(scanner);
+    } catch (ErrorException & ex) {
+        delete scale;
+        delete first;
+        delete second;
+        throw;
+    }
+}
+
+MatStmt::~MatStmt() {
+    delete scale;
+    delete first;
+    delete second;
+}
+
+/*
+ * Method: parse(scanner)
+ * -------------------------------------------------
+ * ZER, CON and TRN are only special right after the =, so they can
+ * still be used as names everywhere else
+ */
+
+static string readArrayName(TokenScanner & scanner) {
+    string token = scanner.nextToken();
+    if (scanner.getTokenType(token) != WORD) {
+        error("Array name expected in MAT");
+    }
+    if (isStringName(token)) {
+        error("Arrays of strings are not supported");
+    }
+    return token;
+}
+
+void MatStmt::parse(TokenScanner & scanner) {
+    name = readArrayName(scanner);
+    if (scanner.nextToken() != "=") {
+        error("MAT needs = after the array name");
+    }
+    string token = scanner.nextToken();
+    string word = toUpperCase(token);
+    if (word == "ZER" || word == "CON") {
+        operation = (word == "ZER") ? MAT_ZERO : MAT_ONE;
+        if (scanner.hasMoreTokens()) {
+            if (scanner.nextToken() != "(") error("Unbalanced parentheses in MAT");
+            first = readE(scanner, 0);
+            token = scanner.nextToken();
+            if (token == ",") {
+                second = readE(scanner, 0);
+                token = scanner.nextToken();
+            }
+            if (token != ")") error("Unbalanced parentheses in MAT");
+        }
+    } else if (word == "TRN") {
+        operation = MAT_TRANSPOSE;
+        if (scanner.nextToken() != "(") error("Unbalanced parentheses in MAT");
+        left = readArrayName(scanner);
+        if (scanner.nextToken() != ")") error("Unbalanced parentheses in MAT");
+    } else if (token == "(") {
+        //a scalar in parentheses, as in classic BASIC, multiplies an array
+        operation = MAT_SCALE;
+        scale = readE(scanner, 0);
+        if (scanner.nextToken() != ")") error("Unbalanced parentheses in MAT");
+        if (scanner.nextToken() != "*") error("MAT needs * after the scalar");
+        left = readArrayName(scanner);
+    } else {
+        scanner.saveToken(token);
+        left = readArrayName(scanner);
+        operation = MAT_COPY;
+        if (scanner.hasMoreTokens()) {
+            string op = scanner.nextToken();
+            if (op == "+") {
+                operation = MAT_ADD;
+            } else if (op == "-") {
+                operation = MAT_SUBTRACT;
+            } else if (op == "*") {
+                operation = MAT_MULTIPLY;
+            } else {
+                error("Illegal operator in MAT");
+            }
+            right = readArrayName(scanner);
+        }
+    }
+    if (scanner.hasMoreTokens()) {
+        error("Extraneous token " + scanner.nextToken());
+    }
+}
+
+/*
+ * Method: execute(state)
+ * -------------------------------------------------
+ * works out the shape of the result, gives the target that shape and
+ * runs one kernel over the whole array; a multiply or transpose whose
+ * target is also an operand goes through a temporary first.  The work
+ * is charged to the run one statement per element, or per multiplication
+ * for a product.  Under BUDGET_ERROR a product is done a band of rows at
+ * a time so that it stops when the run goes over its limits; under
+ * BUDGET_YIELD it always finishes, and the run yields after it
+ */
+
+//about how many multiplications a band of a product does
+static const long long BAND_WORK = 1 << 24;
+
+static void chargeWork(EvalState & state, long long work) {
+    RunMeter *meter = state.getRunMeter();
+    if (meter != NULL) meter->charge(work);
+}
+
+static void multiplyInBands(EvalState & state, int *result, const int *a,
+                            const int *b, long long rows, int inner, int columns) {
+    RunMeter *meter = state.getRunMeter();
+    long long work = (long long) inner * columns;
+    if (meter == NULL || !meter->isWatching() || getBudgetAction() != BUDGET_ERROR
+        || rows * work <= BAND_WORK) {
+        matrixMultiply(result, a, b, rows, inner, columns);
+        chargeWork(state, rows * work);
+        return;
+    }
+    long long band = max(1LL, BAND_WORK / work);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (long long row = 0; row < rows; row += band) {
+        int count = (int) min(band, rows - row);
+        matrixMultiply(result + row * columns, a + row * inner, b, count, inner, columns);
+        meter->charge(count * work);
+        if (row + count < rows) {
+            meter->enforce((row + count) * work, start, state.getCurrentLineNumber());
         }
     }
-    else if (op == "<") {
-        if (first < second) {
-            state.setCurrentLineNumber(newLineNumber);
+}
+
+static int getSource(EvalState & state, string name) {
+    int slot = state.getArraySlot(name);
+    if (state.getArray(slot).data == NULL) {
+        error("Array " + name + " is not dimensioned");
+    }
+    return slot;
+}
+
+static bool isMatrix(ArrayStorage & array) {
+    return array.extent[SUBSCRIPT_ROW] != 0;
+}
+
+static int getRows(ArrayStorage & array) {
+    return isMatrix(array) ? array.extent[SUBSCRIPT_ROW] : array.extent[SUBSCRIPT_VECTOR];
+}
+
+static int getColumns(ArrayStorage & array) {
+    return isMatrix(array) ? array.extent[SUBSCRIPT_COLUMN] : 1;
+}
+
+void MatStmt::execute(EvalState & state) {
+    int factor = 0;
+    if (scale != NULL) factor = checkInt(scale->eval(state), "Scale factor");
+    int target = state.getArraySlot(name);
+    if (operation == MAT_ZERO || operation == MAT_ONE) {
+        if (first != NULL) {
+            int firstBound = checkInt(first->eval(state), "Array dimension");
+            int secondBound = -1;
+            if (second != NULL) {
+                secondBound = checkInt(second->eval(state), "Array dimension");
+                if (secondBound < 0) error("Illegal dimension for array " + name);
+            }
+            state.reshapeArray(target, firstBound, secondBound);
         }
+        ArrayStorage & array = state.getArray(target);
+        if (array.data == NULL) error("Array " + name + " is not dimensioned");
+        matrixFill(array.data, (operation == MAT_ONE) ? 1 : 0, array.size);
+        chargeWork(state, array.size);
+        return;
     }
-    //moves it to the end
-    else state.setCurrentLineNumber(-1);
-};
+    //every slot is looked up before any reference into the arrays is taken
+    int a = getSource(state, left);
+    int b = (right == "") ? -1 : getSource(state, right);
+    ArrayStorage & x = state.getArray(a);
+    if (operation == MAT_MULTIPLY || operation == MAT_TRANSPOSE) {
+        if (!isMatrix(x)) error("Array " + left + " is not two-dimensional");
+        //a transpose has the shape of x turned on its side
+        long long rows = getColumns(x);
+        int inner = getColumns(x);
+        int columns = getRows(x);
+        bool matrix = true;
+        if (operation == MAT_MULTIPLY) {
+            ArrayStorage & y = state.getArray(b);
+            if (getRows(y) != getColumns(x)) {
+                error("Arrays " + left + " and " + right + " cannot be multiplied");
+            }
+            rows = getRows(x);
+            columns = getColumns(y);
+            matrix = isMatrix(y);
+        }
+        if (rows * columns > INT_MAX / (long long) sizeof(int)) {
+            error("Array " + name + " is too large");
+        }
+        if (target == a || target == b) {
+            checkMemoryRequest(rows * columns * (long long) sizeof(int));
+            vector<int> temp(rows * columns);
+            if (operation == MAT_MULTIPLY) {
+                multiplyInBands(state, temp.data(), x.data, state.getArray(b).data,
+                                rows, inner, columns);
+            } else {
+                matrixTranspose(temp.data(), x.data, getRows(x), getColumns(x));
+                chargeWork(state, temp.size());
+            }
+            reshape(state, target, rows, columns, matrix);
+            memcpy(state.getArray(target).data, temp.data(), temp.size() * sizeof(int));
+            return;
+        }
+        reshape(state, target, rows, columns, matrix);
+        ArrayStorage & result = state.getArray(target);
+        if (operation == MAT_MULTIPLY) {
+            multiplyInBands(state, result.data, x.data, state.getArray(b).data,
+                            rows, inner, columns);
+        } else {
+            matrixTranspose(result.data, x.data, getRows(x), getColumns(x));
+            chargeWork(state, result.size);
+        }
+        return;
+    }
+    if (b != -1) {
+        ArrayStorage & y = state.getArray(b);
+        if (isMatrix(x) != isMatrix(y) || getRows(x) != getRows(y)
+            || getColumns(x) != getColumns(y)) {
+            error("Arrays " + left + " and " + right + " have different shapes");
+        }
+    }
+    //the target has the shape of its operands already if it is one of them
+    reshape(state, target, getRows(x), getColumns(x), isMatrix(x));
+    ArrayStorage & result = state.getArray(target);
+    switch (operation) {
+    case MAT_COPY:
+        if (target != a) memcpy(result.data, x.data, x.size * sizeof(int));
+        break;
+    case MAT_ADD:
+        matrixAdd(result.data, x.data, state.getArray(b).data, x.size);
+        break;
+    case MAT_SUBTRACT:
+        matrixSubtract(result.data, x.data, state.getArray(b).data, x.size);
+        break;
+    case MAT_SCALE:
+        matrixScale(result.data, x.data, factor, x.size);
+        break;
+    default:
+        break;
+    }
+    chargeWork(state, x.size);
+}
+
+/*
+ * Method: reshape(state, slot, rows, columns, matrix)
+ * -------------------------------------------------
+ * gives the target the shape of a result with rows x columns elements,
+ * or rows elements if it is not a matrix
+ */
+
+void MatStmt::reshape(EvalState & state, int slot, long long rows, int columns,
+                      bool matrix) {
+    state.reshapeArray(slot, rows - 1, matrix ? columns - 1 : -1);
+}
+
+StatementType MatStmt::getType() {
+    return MAT_STMT;
+}
+
+/*
+ * Methods: getOperation(), getName(), getLeft(), getRight(), getScale(),
+ *          getFirst(), getSecond(), setScale(), setFirst(), setSecond()
+ * -------------------------------------------------
+ * give the optimizer and the transpiler the form of the statement and
+ * its expressions
+ */
+
+MatOperation MatStmt::getOperation() {
+    return operation;
+}
+
+string MatStmt::getName() {
+    return name;
+}
+
+string MatStmt::getLeft() {
+    return left;
+}
+
+string MatStmt::getRight() {
+    return right;
+}
+
+Expression *MatStmt::getScale() {
+    return scale;
+}
+
+Expression *MatStmt::getFirst() {
+    return first;
+}
+
+Expression *MatStmt::getSecond() {
+    return second;
+}
+
+void MatStmt::setScale(Expression *scale) {
+    this->scale = scale;
+}
+
+void MatStmt::setFirst(Expression *first) {
+    this->first = first;
+}
+
+void MatStmt::setSecond(Expression *second) {
+    this->second = second;
+}
+
+/*
+ * Constructor: ParallelForStmt
+ * -------------------------------------------------
+ * Reads the loop variable and the bounds; the bounds stop at TO and at
+ * the end of the line, so neither can be a comparison
+ */
+
+ParallelForStmt::ParallelForStmt(TokenScanner & scanner) {
+    if (toUpperCase(scanner.nextToken()) != "FOR") {
+        error("PARALLEL needs FOR");
+    }
+    string name = scanner.nextToken();
+    if (scanner.getTokenType(name) != WORD || isStringName(name)) {
+        error("Loop variable expected in PARALLEL FOR");
+    }
+    if (scanner.nextToken() != "=") {
+        error("PARALLEL FOR needs = after the loop variable");
+    }
+    first = readE(scanner, 1);
+    if (toUpperCase(scanner.nextToken()) != "TO") {
+        delete first;
+        error("PARALLEL FOR needs TO");
+    }
+    last = readE(scanner, 1);
+    if (scanner.hasMoreTokens()) {
+        delete first;
+        delete last;
+        error("Extraneous token " + scanner.nextToken());
+    }
+    variable = new IdentifierExp(name);
+}
+
+ParallelForStmt::~ParallelForStmt() {
+    delete variable;
+    delete first;
+    delete last;
+}
+
+/*
+ * Method: execute(state)
+ * -------------------------------------------------
+ * the body is only known to the compiled program, which runs the loop
+ * itself, so this only runs for a PARALLEL FOR typed as a command
+ */
+
+void ParallelForStmt::execute(EvalState & state) {
+    error("PARALLEL FOR is only allowed in a program");
+}
+
+StatementType ParallelForStmt::getType() {
+    return PARALLEL_FOR_STMT;
+}
+
+/*
+ * Methods: getVariable(), getFirst(), getLast(), setFirst(), setLast()
+ * -------------------------------------------------
+ * give the compiler and the optimizer the loop variable and the bounds
+ */
+
+IdentifierExp *ParallelForStmt::getVariable() {
+    return variable;
+}
+
+Expression *ParallelForStmt::getFirst() {
+    return first;
+}
+
+Expression *ParallelForStmt::getLast() {
+    return last;
+}
+
+void ParallelForStmt::setFirst(Expression *first) {
+    this->first = first;
+}
+
+void ParallelForStmt::setLast(Expression *last) {
+    this->last = last;
+}
+
+/*
+ * Methods: getWrites(), addWrite()
+ * -------------------------------------------------
+ * the variables and the array elements the body may change, as keys in
+ * the form analysis.h uses
+ */
 
+Vector<string> & ParallelForStmt::getWrites() {
+    return writes;
+}
+
+void ParallelForStmt::addWrite(string key) {
+    writes.add(key);
+}
+
+/*
+ * Constructor: NextStmt
+ * -------------------------------------------------
+ * Reads the variable of the loop it ends
+ */
+
+NextStmt::NextStmt(TokenScanner & scanner) {
+    name = scanner.nextToken();
+    if (scanner.getTokenType(name) != WORD) {
+        error("NEXT needs the loop variable");
+    }
+    if (scanner.hasMoreTokens()) {
+        error("Extraneous token " + scanner.nextToken());
+    }
+}
+
+NextStmt::~NextStmt() {
+    /* Empty */
+}
+
+/*
+ * Method: execute(state)
+ * -------------------------------------------------
+ * a NEXT is only reached on its own when no PARALLEL FOR is running it
+ */
+
+void NextStmt::execute(EvalState & state) {
+    error("NEXT without PARALLEL FOR");
+}
+
+StatementType NextStmt::getType() {
+    return NEXT_STMT;
+}
+
+string NextStmt::getName() {
+    return name;
+}
+
+/*
+ * Constructor: LoopEntryStmt
+ * -------------------------------------------------
+ * Remembers the epoch counter of the loop it guards
+ */
+
+LoopEntryStmt::LoopEntryStmt(unsigned *epoch) {
+    this->epoch = epoch;
+}
+
+LoopEntryStmt::~LoopEntryStmt() {
+    //the epoch counter belongs to the compiled program
+}
+
+/*
+ * Method: execute
+ * -------------------------------------------------
+ * moves the loop on to a new epoch, which makes every value cached
+ * inside the loop stale
+ */
+
+void LoopEntryStmt::execute(EvalState & state) {
+    (*epoch)++;
+}
+
+StatementType LoopEntryStmt::getType() {
+    return LOOP_ENTRY_STMT;
+}
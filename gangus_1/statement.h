@@ -15,9 +15,32 @@
 #include "evalstate.h"
 #include "exp.h"
 #include "tokenscanner.h"
+#include "vector.h"
 
 using namespace std;
 
+/*
+ * Type: StatementType
+ * -------------------
+ * This enumerated type is used to differentiate the statement types.
+ * NUM_STATEMENT_TYPES is not a type; it counts the ones before it.
+ */
+
+enum StatementType {
+   PRINT_STMT, LET_STMT, REM_STMT, INPUT_STMT, GOTO_STMT, IF_STMT, END_STMT,
+   GOSUB_STMT, RETURN_STMT, ON_GOTO_STMT, ON_GOSUB_STMT, DIM_STMT, MAT_STMT,
+   PARALLEL_FOR_STMT, NEXT_STMT, LOOP_ENTRY_STMT, NUM_STATEMENT_TYPES
+};
+
+/*
+ * Function: statementTypeToString
+ * Usage: string name = statementTypeToString(type);
+ * -------------------------------------------------
+ * Returns the BASIC keyword for the statement type.
+ */
+
+std::string statementTypeToString(StatementType type);
+
 /*
  * Class: Statement
  * ----------------
@@ -65,6 +88,15 @@ public:
 
    virtual void execute(EvalState & state) = 0;
 
+/*
+ * Method: getType
+ * Usage: StatementType type = stmt->getType();
+ * --------------------------------------------
+ * Returns the type of the statement.
+ */
+
+   virtual StatementType getType() = 0;
+
 };
 
 /*
@@ -91,6 +123,9 @@ public:
     PrintStmt(TokenScanner & scanner);
     virtual ~PrintStmt();
     virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    Expression *getExp();
+    void setExp(Expression *exp);
 private:
     Expression *exp;
 };
@@ -98,7 +133,9 @@ private:
 /*
  * Class: LetStmt
  * ----------------
- * Assigns an expression to a variable
+ * Assigns an expression to a variable or to an array element; the one
+ * that is not assigned is NULL.  LET V$ = V$ + tail keeps the read of
+ * V$ as the base and appends exp, the tail, to V$ in place
  */
 
 class LetStmt: public Statement {
@@ -106,9 +143,21 @@ public:
     LetStmt(TokenScanner & scanner);
     virtual ~LetStmt();
     virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    IdentifierExp *getVariable();
+    ArrayExp *getElement();
+    Expression *getExp();
+    void setExp(Expression *exp);
+    void setVariable(IdentifierExp *variable);
+    void setElement(ArrayExp *element);
+    IdentifierExp *getBase();
+    void setBase(IdentifierExp *base);
 private:
+    void findAppend();
     Expression *exp;
     IdentifierExp *variable;
+    ArrayExp *element;
+    IdentifierExp *base;
 };
 
 /*
@@ -122,6 +171,7 @@ public:
     RemStmt(TokenScanner & scanner);
     virtual ~RemStmt();
     virtual void execute(EvalState & state);
+    virtual StatementType getType();
 private:
 };
 
@@ -136,8 +186,10 @@ public:
     InputStmt(TokenScanner & scanner);
     virtual ~InputStmt();
     virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    IdentifierExp *getVariable();
+    void setVariable(IdentifierExp *variable);
 private:
-    ConstantExp *constant;
     IdentifierExp *variable;
 };
 
@@ -152,6 +204,8 @@ public:
     GotoStmt(TokenScanner & scanner);
     virtual ~GotoStmt();
     virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    int getTarget();
 private:
     int newLineNumber;
 };
@@ -167,6 +221,14 @@ public:
     IfStmt(TokenScanner & scanner);
     virtual ~IfStmt();
     virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    int getTarget();
+    bool test(EvalState & state);
+    Expression *getLHS();
+    Expression *getRHS();
+    string getOp();
+    void setLHS(Expression *lhs);
+    void setRHS(Expression *rhs);
 private:
     Expression *exp1;
     Expression *exp2;
@@ -185,7 +247,201 @@ public:
     EndStmt();
     virtual ~EndStmt();
     virtual void execute(EvalState & state);
+    virtual StatementType getType();
+private:
+};
+
+/*
+ * Class: GosubStmt
+ * ----------------
+ * Calls the subroutine at a line; the run loop keeps the return address
+ */
+
+class GosubStmt: public Statement {
+public:
+    GosubStmt(TokenScanner & scanner);
+    virtual ~GosubStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    int getTarget();
+private:
+    int newLineNumber;
+};
+
+/*
+ * Class: ReturnStmt
+ * ----------------
+ * Goes back to the line after the latest GOSUB
+ */
+
+class ReturnStmt: public Statement {
+public:
+    ReturnStmt();
+    virtual ~ReturnStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
+private:
+};
+
+/*
+ * Class: OnStmt
+ * ----------------
+ * Jumps to, or calls, the line an expression picks from a list; a value
+ * outside the list goes on to the next line
+ */
+
+class OnStmt: public Statement {
+public:
+    OnStmt(TokenScanner & scanner);
+    virtual ~OnStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    long long getCase(EvalState & state);
+    const Vector<int> & getTargets();
+    Expression *getExp();
+    void setExp(Expression *exp);
+private:
+    Expression *exp;
+    Vector<int> targets;
+    bool gosub;
+};
+
+/*
+ * Class: DimStmt
+ * ----------------
+ * Gives an array storage for subscripts from 0 through the values of one
+ * or two expressions; the second is NULL for one subscript
+ */
+
+class DimStmt: public Statement {
+public:
+    DimStmt(TokenScanner & scanner);
+    virtual ~DimStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    string getName();
+    Expression *getFirst();
+    Expression *getSecond();
+    void setFirst(Expression *first);
+    void setSecond(Expression *second);
+private:
+    string name;
+    Expression *first;
+    Expression *second;
+};
+
+/*
+ * Type: MatOperation
+ * ----------------
+ * The forms of MAT: MAT C = A, A + B, A - B, A * B, (k) * A, TRN(A),
+ * ZER and CON
+ */
+
+enum MatOperation {
+    MAT_COPY, MAT_ADD, MAT_SUBTRACT, MAT_MULTIPLY, MAT_SCALE, MAT_TRANSPOSE,
+    MAT_ZERO, MAT_ONE
+};
+
+/*
+ * Class: MatStmt
+ * ----------------
+ * Works on whole arrays in one statement, using the kernels in matrix.h.
+ * The target array takes the shape of the result; ZER and CON keep the
+ * shape of the target unless they are given bounds, as DIM is.  The
+ * scale is NULL except for (k) * A, and the bounds are NULL except for
+ * ZER and CON with bounds.
+ */
+
+class MatStmt: public Statement {
+public:
+    MatStmt(TokenScanner & scanner);
+    virtual ~MatStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    MatOperation getOperation();
+    string getName();
+    string getLeft();
+    string getRight();
+    Expression *getScale();
+    Expression *getFirst();
+    Expression *getSecond();
+    void setScale(Expression *scale);
+    void setFirst(Expression *first);
+    void setSecond(Expression *second);
+private:
+    void parse(TokenScanner & scanner);
+    void reshape(EvalState & state, int slot, long long rows, int columns,
+                 bool matrix);
+    MatOperation operation;
+    string name;
+    string left;
+    string right;
+    Expression *scale;
+    Expression *first;
+    Expression *second;
+};
+
+/*
+ * Class: ParallelForStmt
+ * ----------------
+ * Heads a PARALLEL FOR I = a TO b ... NEXT I loop.  Only a compiled
+ * program can run one, through the ParallelLoop in parallel.h; the writes
+ * are the keys the body may change, which the compiler records for the
+ * optimizer
+ */
+
+class ParallelForStmt: public Statement {
+public:
+    ParallelForStmt(TokenScanner & scanner);
+    virtual ~ParallelForStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    IdentifierExp *getVariable();
+    Expression *getFirst();
+    Expression *getLast();
+    void setFirst(Expression *first);
+    void setLast(Expression *last);
+    Vector<string> & getWrites();
+    void addWrite(string key);
+private:
+    IdentifierExp *variable;
+    Expression *first;
+    Expression *last;
+    Vector<string> writes;
+};
+
+/*
+ * Class: NextStmt
+ * ----------------
+ * Ends the body of the PARALLEL FOR with the same variable
+ */
+
+class NextStmt: public Statement {
+public:
+    NextStmt(TokenScanner & scanner);
+    virtual ~NextStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
+    string getName();
+private:
+    string name;
+};
+
+/*
+ * Class: LoopEntryStmt
+ * ----------------
+ * Never parsed; the optimizer puts one in front of each loop so that
+ * entering the loop starts a new epoch for the values cached in it
+ */
+
+class LoopEntryStmt: public Statement {
+public:
+    LoopEntryStmt(unsigned *epoch);
+    virtual ~LoopEntryStmt();
+    virtual void execute(EvalState & state);
+    virtual StatementType getType();
 private:
+    unsigned *epoch;
 };
 
 #endif
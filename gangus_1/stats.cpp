@@ -0,0 +1,136 @@
+/*
+ * File: stats.cpp
+ * ---------------
+ * This file implements the stats.h interface.  The allocation counters
+ * are updated by the replacement operator new in accounting.cpp.
+ */
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include "statement.h"
+#include "stats.h"
+using namespace std;
+
+/* Constants */
+
+static const int MAX_BLOCKS = 64;
+
+static_assert(STAT_EXPRESSIONS - STAT_STATEMENTS == NUM_STATEMENT_TYPES,
+              "StatCounter needs one statement counter per StatementType");
+
+/*
+ * Implementation notes: counter blocks
+ * ------------------------------------
+ * Blocks live in a static array so that claiming one never allocates,
+ * which matters because operator new itself counts.  A thread keeps
+ * its block after it exits, so its counts stay in the totals.  If more
+ * than MAX_BLOCKS threads ever exist, the extra threads share the last
+ * block and update it with atomic additions.
+ */
+
+static StatBlock blocks[MAX_BLOCKS];
+static atomic<int> blockCount(0);
+static unsigned long long baseline[NUM_STAT_COUNTERS];
+static bool overflowShared = (blocks[MAX_BLOCKS - 1].shared = true);
+
+thread_local StatBlock *threadStats = NULL;
+
+/* Private function prototypes */
+
+static unsigned long long total(int counter);
+static string counterName(int counter);
+
+StatBlock *getStatBlock() {
+   int index = blockCount.fetch_add(1);
+   if (index >= MAX_BLOCKS) index = MAX_BLOCKS - 1;
+   threadStats = &blocks[index];
+   return threadStats;
+}
+
+unsigned long long getStat(StatCounter counter) {
+   return total(counter) - baseline[counter];
+}
+
+unsigned long long getStatementCount() {
+   unsigned long long sum = 0;
+   for (int i = STAT_STATEMENTS; i < STAT_EXPRESSIONS; i++) {
+      sum += getStat(StatCounter(i));
+   }
+   return sum;
+}
+
+void resetStats() {
+   for (int i = 0; i < NUM_STAT_COUNTERS; i++) {
+      baseline[i] = total(i);
+   }
+}
+
+/*
+ * Implementation notes: statsToString
+ * -----------------------------------
+ * Statement counters are reported only for statement types that have
+ * executed; the other counters are always reported.
+ */
+
+string statsToString(bool json) {
+   ostringstream out;
+   if (json) {
+      out << "{\"statements\":{";
+      bool first = true;
+      for (int i = STAT_STATEMENTS; i < STAT_EXPRESSIONS; i++) {
+         unsigned long long n = getStat(StatCounter(i));
+         if (n == 0) continue;
+         if (!first) out << ",";
+         out << "\"" << counterName(i) << "\":" << n;
+         first = false;
+      }
+      out << "}";
+      for (int i = STAT_EXPRESSIONS; i < NUM_STAT_COUNTERS; i++) {
+         out << ",\"" << counterName(i) << "\":" << getStat(StatCounter(i));
+      }
+      out << "}";
+   } else {
+      out << "Statements executed:" << endl;
+      for (int i = STAT_STATEMENTS; i < STAT_EXPRESSIONS; i++) {
+         unsigned long long n = getStat(StatCounter(i));
+         if (n == 0) continue;
+         out << "  " << left << setw(20) << counterName(i)
+             << right << setw(14) << n << endl;
+      }
+      for (int i = STAT_EXPRESSIONS; i < NUM_STAT_COUNTERS; i++) {
+         out << left << setw(22) << counterName(i)
+             << right << setw(14) << getStat(StatCounter(i)) << endl;
+      }
+   }
+   return out.str();
+}
+
+static unsigned long long total(int counter) {
+   int n = blockCount.load();
+   if (n > MAX_BLOCKS) n = MAX_BLOCKS;
+   unsigned long long sum = 0;
+   for (int i = 0; i < n; i++) {
+      sum += blocks[i].values[counter].load(memory_order_relaxed);
+   }
+   return sum;
+}
+
+static string counterName(int counter) {
+   if (counter < STAT_EXPRESSIONS) {
+      return statementTypeToString(StatementType(counter - STAT_STATEMENTS));
+   }
+   switch (counter) {
+    case STAT_EXPRESSIONS: return "expressions";
+    case STAT_LOOKUPS: return "lookups";
+    case STAT_LOOKUP_MISSES: return "lookupMisses";
+    case STAT_LINE_PROBES: return "lineProbes";
+    case STAT_ALLOCATIONS: return "allocations";
+    case STAT_ALLOCATED_BYTES: return "allocatedBytes";
+    case STAT_TIER_UPS: return "tierUps";
+    case STAT_BASELINE_NANOS: return "baselineNanos";
+    case STAT_OPTIMIZED_NANOS: return "optimizedNanos";
+    case STAT_TIER_COMPILE_NANOS: return "tierCompileNanos";
+   }
+   return "?";
+}
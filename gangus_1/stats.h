@@ -0,0 +1,126 @@
+/*
+ * File: stats.h
+ * -------------
+ * This interface exports the interpreter's instrumentation counters.
+ * The counters are always on and cheap enough for the hot paths: each
+ * thread updates its own block of counters without locking, and the
+ * blocks are only summed when a report is requested.
+ */
+
+#ifndef _stats_h
+#define _stats_h
+
+#include <atomic>
+#include <string>
+
+/*
+ * Type: StatCounter
+ * -----------------
+ * This enumerated type names the counters.  The statement counters come
+ * first and are in the same order as the StatementType constants, so
+ * that the counter for a statement is STAT_STATEMENTS plus its type.
+ * The 16 must equal NUM_STATEMENT_TYPES, which stats.cpp checks; this
+ * header does not include statement.h because the allocator hooks in
+ * accounting.cpp include it.
+ */
+
+enum StatCounter {
+   STAT_STATEMENTS,
+   STAT_EXPRESSIONS = STAT_STATEMENTS + 16,
+   STAT_LOOKUPS,
+   STAT_LOOKUP_MISSES,
+   STAT_LINE_PROBES,
+   STAT_ALLOCATIONS,
+   STAT_ALLOCATED_BYTES,
+   STAT_TIER_UPS,
+   STAT_BASELINE_NANOS,
+   STAT_OPTIMIZED_NANOS,
+   STAT_TIER_COMPILE_NANOS,
+   NUM_STAT_COUNTERS
+};
+
+/*
+ * Type: StatBlock
+ * ---------------
+ * One thread's counters.  Only the owning thread writes a block, so an
+ * increment is a plain load and store; the atomics only make it safe
+ * for the reporting thread to read the block at the same time.  Blocks
+ * are aligned to cache lines so that neighbouring threads in the block
+ * array do not write to the same line.
+ */
+
+struct alignas(64) StatBlock {
+   std::atomic<unsigned long long> values[NUM_STAT_COUNTERS];
+   bool shared;
+};
+
+/*
+ * Function: getStatBlock
+ * Usage: StatBlock *block = getStatBlock();
+ * -----------------------------------------
+ * Returns the counter block of the calling thread, claiming one on the
+ * thread's first call.  Clients normally use countStat instead.
+ */
+
+StatBlock *getStatBlock();
+
+/*
+ * Function: countStat
+ * Usage: countStat(STAT_LOOKUPS);
+ *        countStat(STAT_ALLOCATED_BYTES, size);
+ * ---------------------------------------------
+ * Adds amount (default 1) to the counter in the calling thread's block.
+ */
+
+extern thread_local StatBlock *threadStats;
+
+inline void countStat(StatCounter counter, unsigned long long amount = 1) {
+   StatBlock *block = threadStats;
+   if (block == NULL) block = getStatBlock();
+   std::atomic<unsigned long long> & value = block->values[counter];
+   if (block->shared) {
+      value.fetch_add(amount, std::memory_order_relaxed);
+   } else {
+      value.store(value.load(std::memory_order_relaxed) + amount,
+                  std::memory_order_relaxed);
+   }
+}
+
+/*
+ * Function: getStat
+ * Usage: unsigned long long n = getStat(STAT_EXPRESSIONS);
+ * --------------------------------------------------------
+ * Returns the total of a counter over all threads since the last reset.
+ */
+
+unsigned long long getStat(StatCounter counter);
+
+/*
+ * Function: getStatementCount
+ * Usage: unsigned long long n = getStatementCount();
+ * --------------------------------------------------
+ * Returns the total of the statement counters over all statement types.
+ */
+
+unsigned long long getStatementCount();
+
+/*
+ * Function: resetStats
+ * Usage: resetStats();
+ * --------------------
+ * Starts all counters again from zero.
+ */
+
+void resetStats();
+
+/*
+ * Function: statsToString
+ * Usage: string report = statsToString(json);
+ * -------------------------------------------
+ * Returns a report of all nonzero counters, either as a readable table
+ * or, if json is true, as a single-line JSON object.
+ */
+
+std::string statsToString(bool json);
+
+#endif
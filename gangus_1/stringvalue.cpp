@@ -0,0 +1,243 @@
+/*
+ * File: stringvalue.cpp
+ * ---------------------
+ * This file implements the stringvalue.h interface.
+ */
+
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include "accounting.h"
+#include "blockarena.h"
+#include "error.h"
+#include "hashmap.h"
+#include "stringvalue.h"
+#include "value.h"
+using namespace std;
+
+/*
+ * Type: StringBuffer
+ * ------------------
+ * The header of a long string.  Its characters follow it in the same
+ * block, and capacity records how many fit, which also tells the arena
+ * the size of the block when it comes back.  An interned buffer is never
+ * freed, so its reference count is not kept.
+ */
+
+struct StringBuffer {
+   atomic<int> refs;
+   int length;
+   int capacity;
+   bool interned;
+};
+
+/* Private state */
+
+static BlockArena arena(MEM_STRINGS);
+static mutex internLock;
+static HashMap<string,StringBuffer *> *interned = NULL;
+
+/* Private function prototypes */
+
+static char *charsOf(StringBuffer *buffer);
+static void freeStringBuffer(StringBuffer *buffer);
+static void checkCount(long long n);
+
+/*
+ * Implementation notes: internString
+ * ----------------------------------
+ * The table is made on first use, since literals are parsed while other
+ * files may still be running their static initialization, and is never
+ * freed.  The background compiler parses too, hence the lock.
+ */
+
+Value internString(const string & text) {
+   if ((int) text.length() <= Value::SHORT_STRING) {
+      return Value(text.data(), text.length());
+   }
+   lock_guard<mutex> guard(internLock);
+   MemoryScope scope(MEM_STRINGS);
+   if (interned == NULL) interned = new HashMap<string,StringBuffer *>();
+   StringBuffer *buffer;
+   if (interned->containsKey(text)) {
+      buffer = interned->get(text);
+   } else {
+      buffer = newStringBuffer(text.data(), text.length(), text.length());
+      buffer->interned = true;
+      interned->put(text, buffer);
+   }
+   return Value(buffer);
+}
+
+/*
+ * Implementation notes: newStringBuffer, freeStringBuffer
+ * -------------------------------------------------------
+ * The arena may hand out a larger block than was asked for, and the
+ * capacity takes in all of it.
+ */
+
+StringBuffer *newStringBuffer(const char *chars, int length, int capacity) {
+   size_t bytes = sizeof(StringBuffer) + capacity;
+   void *block = arena.allocate(bytes);
+   StringBuffer *buffer = new (block) StringBuffer;
+   buffer->refs.store(1, memory_order_relaxed);
+   buffer->length = length;
+   buffer->capacity = bytes - sizeof(StringBuffer);
+   buffer->interned = false;
+   memcpy(charsOf(buffer), chars, length);
+   return buffer;
+}
+
+static void freeStringBuffer(StringBuffer *buffer) {
+   size_t bytes = sizeof(StringBuffer) + buffer->capacity;
+   buffer->~StringBuffer();
+   arena.release(buffer, bytes);
+}
+
+/*
+ * Implementation notes: retainString, releaseString
+ * -------------------------------------------------
+ * These follow retainBig and releaseBig, except that an interned buffer
+ * is left alone, so the literals that every PARALLEL worker reads do not
+ * bounce one counter between them.
+ */
+
+void retainString(StringBuffer *buffer) {
+   if (buffer->interned) return;
+   buffer->refs.fetch_add(1, memory_order_relaxed);
+}
+
+void releaseString(StringBuffer *buffer) {
+   if (buffer->interned) return;
+   if (buffer->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+      freeStringBuffer(buffer);
+   }
+}
+
+const char *getBufferChars(const StringBuffer *buffer) {
+   return (const char *) (buffer + 1);
+}
+
+int getBufferLength(const StringBuffer *buffer) {
+   return buffer->length;
+}
+
+/*
+ * Implementation notes: appendString, concatStrings
+ * -------------------------------------------------
+ * A count of one means that no other Value can see the buffer, so its
+ * characters may change.  The count is read with acquire ordering to
+ * pair with the release of the last other holder.  The tail is copied
+ * from before the target changes, and a tail that shares the buffer
+ * holds a reference of its own, so the buffer is never written in place
+ * while the tail reads from it.
+ */
+
+void appendString(Value & target, const Value & tail) {
+   if (!target.isString() || !tail.isString()) error("Type mismatch");
+   int n = tail.getLength();
+   if (n == 0) return;
+   int length = target.getLength();
+   long long total = (long long) length + n;
+   if (total > INT_MAX / 2) error("String is too long");
+   StringBuffer *buffer = target.getBuffer();
+   if (buffer != NULL && !buffer->interned && total <= buffer->capacity
+       && buffer->refs.load(memory_order_acquire) == 1) {
+      memcpy(charsOf(buffer) + length, tail.getChars(), n);
+      buffer->length = total;
+      return;
+   }
+   if (total <= Value::SHORT_STRING) {
+      char chars[Value::SHORT_STRING];
+      memcpy(chars, target.getChars(), length);
+      memcpy(chars + length, tail.getChars(), n);
+      target = Value(chars, total);
+      return;
+   }
+   StringBuffer *grown = newStringBuffer(target.getChars(), length, 2 * total);
+   memcpy(charsOf(grown) + length, tail.getChars(), n);
+   grown->length = total;
+   target = Value(grown);
+}
+
+Value concatStrings(Value x, const Value & y) {
+   appendString(x, y);
+   return x;
+}
+
+/*
+ * Implementation notes: compareStrings
+ * ------------------------------------
+ * Two Values that share a buffer, as copies of an interned literal do,
+ * are equal without looking at the characters.
+ */
+
+int compareStrings(const Value & x, const Value & y) {
+   StringBuffer *buffer = x.getBuffer();
+   if (buffer != NULL && buffer == y.getBuffer()) return 0;
+   int nx = x.getLength();
+   int ny = y.getLength();
+   int sign = memcmp(x.getChars(), y.getChars(), (nx < ny) ? nx : ny);
+   if (sign != 0) return sign;
+   return (nx < ny) ? -1 : (nx > ny) ? 1 : 0;
+}
+
+/*
+ * Implementation notes: leftString, rightString, midString
+ * --------------------------------------------------------
+ * A part that is the whole string is the string itself, which shares
+ * its buffer rather than copying it.
+ */
+
+Value leftString(const Value & str, long long n) {
+   checkCount(n);
+   if (n >= str.getLength()) return str;
+   return Value(str.getChars(), n);
+}
+
+Value rightString(const Value & str, long long n) {
+   checkCount(n);
+   int length = str.getLength();
+   if (n >= length) return str;
+   return Value(str.getChars() + length - n, n);
+}
+
+Value midString(const Value & str, long long start, long long n) {
+   if (start < 1) integerOutOfRange("String position");
+   checkCount(n);
+   int length = str.getLength();
+   if (start > length) return Value("", 0);
+   if (n > length - start + 1) n = length - start + 1;
+   if (start == 1 && n == length) return str;
+   return Value(str.getChars() + start - 1, n);
+}
+
+string quoteString(const Value & str) {
+   string text = "\"";
+   const char *chars = str.getChars();
+   for (int i = 0; i < str.getLength(); i++) {
+      char ch = chars[i];
+      if (ch == '\n') {
+         text += "\\n";
+      } else if (ch == '\t') {
+         text += "\\t";
+      } else if (ch == '\r') {
+         text += "\\r";
+      } else {
+         if (ch == '"' || ch == '\\') text += '\\';
+         text += ch;
+      }
+   }
+   return text + "\"";
+}
+
+static char *charsOf(StringBuffer *buffer) {
+   return (char *) (buffer + 1);
+}
+
+static void checkCount(long long n) {
+   if (n < 0) integerOutOfRange("String length");
+}
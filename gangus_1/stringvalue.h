@@ -0,0 +1,108 @@
+/*
+ * File: stringvalue.h
+ * -------------------
+ * This interface exports the operations on string values.  A string of
+ * up to Value::SHORT_STRING characters is kept inside its Value and
+ * costs nothing to make or copy.  A longer one lives in a StringBuffer,
+ * a reference-counted block from an arena charged to MEM_STRINGS, which
+ * its copies share.
+ *
+ * Two things keep string-building loops from allocating on every pass.
+ * A buffer has room to grow, and when the Value being appended to is
+ * the only one that holds its buffer, the characters are added in place;
+ * a buffer that has to be replaced is replaced by one twice the size,
+ * so a string built one piece at a time is copied a bounded number of
+ * times.  And the literals of a program are interned: every occurrence
+ * of the same long literal shares one permanent buffer, which is never
+ * freed and whose copies do not touch its reference count.
+ */
+
+#ifndef _stringvalue_h
+#define _stringvalue_h
+
+#include <string>
+#include "value.h"
+
+/*
+ * Function: internString
+ * Usage: Value value = internString(text);
+ * ----------------------------------------
+ * Returns the string value of a literal.  A long literal is looked up in
+ * the table of interned strings, so the same text always gives the same
+ * buffer.
+ */
+
+Value internString(const std::string & text);
+
+/*
+ * Function: newStringBuffer
+ * Usage: StringBuffer *buffer = newStringBuffer(chars, length, capacity);
+ * -----------------------------------------------------------------------
+ * Returns a new buffer holding one reference that contains the length
+ * characters at chars and has room for at least capacity.
+ */
+
+StringBuffer *newStringBuffer(const char *chars, int length, int capacity);
+
+/*
+ * Function: appendString
+ * Usage: appendString(target, tail);
+ * ----------------------------------
+ * Adds the characters of the string tail to the end of the string in
+ * target.  The characters go into the buffer of target if target is its
+ * only holder and it has room; otherwise target gets a new buffer with
+ * room for as many characters again.
+ */
+
+void appendString(Value & target, const Value & tail);
+
+/*
+ * Function: concatStrings
+ * Usage: Value str = concatStrings(x, y);
+ * ---------------------------------------
+ * Returns the concatenation of two strings.  The left operand is taken
+ * by value so that a temporary one is appended to in place.
+ */
+
+Value concatStrings(Value x, const Value & y);
+
+/*
+ * Function: compareStrings
+ * Usage: int sign = compareStrings(x, y);
+ * ---------------------------------------
+ * Returns a negative number, zero or a positive number as the string x
+ * comes before, is the same as or comes after the string y, comparing
+ * the characters as unsigned bytes.  value.h also declares this
+ * function, since its comparisons call it.
+ */
+
+int compareStrings(const Value & x, const Value & y);
+
+/*
+ * Functions: leftString, rightString, midString
+ * Usage: Value head = leftString(str, n);
+ *        Value tail = rightString(str, n);
+ *        Value part = midString(str, start, n);
+ * ---------------------------------------------
+ * Return the first n characters of str, the last n, or the n starting
+ * at position start, counting from 1.  A count beyond the end of str is
+ * cut short, and a start beyond the end gives the empty string; a
+ * negative count or a start below 1 raises an error.
+ */
+
+Value leftString(const Value & str, long long n);
+Value rightString(const Value & str, long long n);
+Value midString(const Value & str, long long start, long long n);
+
+/*
+ * Function: quoteString
+ * Usage: string text = quoteString(value);
+ * ----------------------------------------
+ * Returns a string as a literal in a program would write it, in double
+ * quotes with a backslash before any quote or backslash inside and
+ * with newlines, tabs and returns written as \n, \t and \r.
+ */
+
+std::string quoteString(const Value & str);
+
+#endif
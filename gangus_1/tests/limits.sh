@@ -0,0 +1,111 @@
+#!/bin/sh
+#
+# File: limits.sh
+# ---------------
+# Checks that --max-statements and --deadline stop statements that do a
+# lot of work in one step: MAT and PARALLEL FOR.  Usage: tests/limits.sh path/to/basic
+#
+
+BASIC=${1:-./basic}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+failures=0
+
+# expect name expected-output options...
+expect() {
+   name=$1
+   expected=$2
+   shift 2
+   actual=$(timeout 20 "$BASIC" "$@" 2>&1)
+   if [ "$actual" = "$expected" ]; then
+      echo "ok   $name"
+   else
+      echo "FAIL $name: expected \"$expected\", got \"$actual\""
+      failures=$((failures + 1))
+   fi
+}
+
+# A product of two 2001 x 2001 matrices, about 8e9 multiplications.
+cat > "$DIR/product.bas" <<'BAS'
+10 DIM A(2000,2000)
+20 MAT A = CON
+30 MAT B = A * A
+40 PRINT B(5,5)
+BAS
+
+# Twenty small products that fit one at a time into the budget.
+cat > "$DIR/products.bas" <<'BAS'
+10 DIM A(300,300)
+20 MAT A = CON
+30 LET I = 0
+40 MAT B = A * A
+50 LET I = I + 1
+60 IF I < 20 THEN 40
+70 PRINT B(5,5) + I
+BAS
+
+# A loop of two billion iterations.
+cat > "$DIR/forever.bas" <<'BAS'
+10 LET S = 0
+20 PARALLEL FOR I = 0 TO 2000000000
+30 LET S = S + I
+40 NEXT I
+50 PRINT S
+BAS
+
+# Iterations that never end.
+cat > "$DIR/spin.bas" <<'BAS'
+10 PARALLEL FOR I = 0 TO 10
+20 LET X = 0
+30 LET X = X + 0
+40 IF X = 0 THEN 30
+50 NEXT I
+BAS
+
+# A loop that has to stop between slices to stay in the budget.
+cat > "$DIR/sum.bas" <<'BAS'
+10 LET S = 0
+20 PARALLEL FOR I = 1 TO 100000
+30 LET S = S + I
+40 NEXT I
+50 PRINT S + I
+BAS
+
+expect "MAT counts its elements" \
+   "Error: Statement budget exhausted at line 30" \
+   --max-statements=1000 "$DIR/product.bas"
+expect "MAT product stops at the budget" \
+   "Error: Statement budget exhausted at line 30" \
+   --max-statements=100000000 "$DIR/product.bas"
+expect "MAT product stops at the deadline" \
+   "Error: Deadline exceeded at line 30" \
+   --deadline=100 "$DIR/product.bas"
+expect "MAT products yield between statements" \
+   "321" \
+   --max-statements=30000000 --on-limit=yield "$DIR/products.bas"
+expect "MAT products larger than the budget finish before yielding" \
+   "321" \
+   --max-statements=1000 --on-limit=yield "$DIR/products.bas"
+expect "PARALLEL FOR counts its iterations" \
+   "Error: Statement budget exhausted at line 20" \
+   --max-statements=1000 "$DIR/forever.bas"
+expect "PARALLEL FOR stops at the deadline" \
+   "Error: Deadline exceeded at line 20" \
+   --deadline=100 "$DIR/forever.bas"
+expect "PARALLEL FOR iteration stops at the budget" \
+   "Error: Statement budget exhausted at line 40" \
+   --max-statements=100000 "$DIR/spin.bas"
+expect "PARALLEL FOR iteration stops at the deadline" \
+   "Error: Deadline exceeded at line 40" \
+   --deadline=100 "$DIR/spin.bas"
+expect "PARALLEL FOR iteration stops at the deadline when yielding" \
+   "Error: Deadline exceeded at line 40" \
+   --deadline=100 --on-limit=yield "$DIR/spin.bas"
+expect "PARALLEL FOR yields between slices" \
+   "5000150001" \
+   --max-statements=1000 --on-limit=yield "$DIR/sum.bas"
+
+if [ $failures -ne 0 ]; then
+   echo "$failures failed"
+   exit 1
+fi
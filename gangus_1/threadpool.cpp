@@ -0,0 +1,210 @@
+/*
+ * File: threadpool.cpp
+ * --------------------
+ * This file implements the threadpool.h interface.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "error.h"
+#include "threadpool.h"
+using namespace std;
+
+/*
+ * Type: WorkRange
+ * ---------------
+ * The iterations a worker has yet to start.  The owner takes grains from
+ * the front and thieves take halves from the back, both under the lock.
+ * Each range has a cache line to itself so that workers taking grains
+ * do not slow each other down.
+ */
+
+struct alignas(64) WorkRange {
+   mutex lock;
+   long long next;
+   long long end;
+};
+
+/*
+ * Constants: GRAINS_PER_WORKER, MAX_GRAIN
+ * ---------------------------------------
+ * A worker takes about 1/GRAINS_PER_WORKER of its share at a time, but
+ * never more than MAX_GRAIN iterations, so there is always something
+ * left to steal near the end of a loop.
+ */
+
+static const int GRAINS_PER_WORKER = 16;
+static const long long MAX_GRAIN = 1024;
+
+/*
+ * Type: PoolSignals
+ * -----------------
+ * The lock and the condition variables of the pool.  They are made once
+ * and never destroyed, since the pool threads are still waiting on them
+ * when the program exits.
+ */
+
+struct PoolSignals {
+   mutex lock;
+   condition_variable wakeup;
+   condition_variable finished;
+};
+
+static int threadCount = 0;
+static int started = 1;
+static WorkRange ranges[MAX_THREADS];
+static PoolSignals *signals = new PoolSignals;
+static unsigned long long generation = 0;
+static ParallelTask *job = NULL;
+static int jobWorkers = 0;
+static int active = 0;
+static long long grain = 1;
+
+/* Private function prototypes */
+
+static void startThreads(int threads);
+static void poolLoop(int worker, unsigned long long seen);
+static void work(ParallelTask *task, int worker);
+static bool takeWork(int worker, long long & first, long long & end);
+
+ParallelTask::~ParallelTask() {
+   /* Empty */
+}
+
+void setThreadCount(int threads) {
+   if (threads < 1 || threads > MAX_THREADS) error("Illegal thread count");
+   threadCount = threads;
+}
+
+int getThreadCount() {
+   if (threadCount == 0) {
+      int processors = thread::hardware_concurrency();
+      threadCount = max(1, min(processors, MAX_THREADS));
+   }
+   return threadCount;
+}
+
+int getWorkerCount(long long iterations) {
+   if (iterations < 1) return 1;
+   return (int) min((long long) getThreadCount(), iterations);
+}
+
+/*
+ * Implementation notes: runParallel
+ * ---------------------------------
+ * A loop with one worker runs on the calling thread alone.  Otherwise
+ * the ranges are filled in before the generation changes, under the
+ * pool lock, so every thread that wakes sees them.  Each pool thread
+ * counts itself out of active when it has no more work, and the caller
+ * waits for the count to reach zero before the task can go away.
+ */
+
+void runParallel(ParallelTask & task, long long first, long long end) {
+   long long total = end - first;
+   if (total <= 0) return;
+   int workers = getWorkerCount(total);
+   if (workers == 1) {
+      task.runRange(0, first, end);
+      return;
+   }
+   startThreads(workers);
+   {
+      lock_guard<mutex> guard(signals->lock);
+      grain = max(1LL, min(MAX_GRAIN, total / (workers * GRAINS_PER_WORKER)));
+      for (int w = 0; w < workers; w++) {
+         ranges[w].next = first + total * w / workers;
+         ranges[w].end = first + total * (w + 1) / workers;
+      }
+      job = &task;
+      jobWorkers = workers;
+      active = workers - 1;
+      generation++;
+   }
+   signals->wakeup.notify_all();
+   work(&task, 0);
+   unique_lock<mutex> guard(signals->lock);
+   while (active > 0) signals->finished.wait(guard);
+   job = NULL;
+}
+
+/*
+ * Implementation notes: startThreads, poolLoop
+ * --------------------------------------------
+ * Threads are only ever added, and they are detached and never stopped,
+ * so a loop that follows a larger one still finds its threads asleep.
+ * A thread sits out a loop that has fewer workers than its number.  A
+ * new thread is told the generation before the loop that needs it, in
+ * case it only gets to run after that loop has been posted.
+ */
+
+static void startThreads(int threads) {
+   while (started < threads) {
+      thread(poolLoop, started, generation).detach();
+      started++;
+   }
+}
+
+static void poolLoop(int worker, unsigned long long seen) {
+   unique_lock<mutex> guard(signals->lock);
+   while (true) {
+      while (generation == seen) signals->wakeup.wait(guard);
+      seen = generation;
+      if (worker >= jobWorkers) continue;
+      ParallelTask *task = job;
+      guard.unlock();
+      work(task, worker);
+      guard.lock();
+      if (--active == 0) signals->finished.notify_one();
+   }
+}
+
+static void work(ParallelTask *task, int worker) {
+   long long first, end;
+   while (takeWork(worker, first, end)) {
+      task->runRange(worker, first, end);
+   }
+}
+
+/*
+ * Implementation notes: takeWork
+ * ------------------------------
+ * Stolen iterations go into the thief's own range before it runs any of
+ * them, so they can be stolen again.  A worker gives up after one pass
+ * over the others finds nothing; iterations still in another thief's
+ * hands are that thief's to run.
+ */
+
+static bool takeWork(int worker, long long & first, long long & end) {
+   WorkRange & own = ranges[worker];
+   while (true) {
+      {
+         lock_guard<mutex> guard(own.lock);
+         if (own.next < own.end) {
+            first = own.next;
+            end = min(own.end, first + grain);
+            own.next = end;
+            return true;
+         }
+      }
+      bool stole = false;
+      for (int k = 1; k < jobWorkers && !stole; k++) {
+         WorkRange & victim = ranges[(worker + k) % jobWorkers];
+         long long from, to;
+         {
+            lock_guard<mutex> guard(victim.lock);
+            long long left = victim.end - victim.next;
+            if (left <= 0) continue;
+            to = victim.end;
+            from = victim.end - (left + 1) / 2;
+            victim.end = from;
+         }
+         lock_guard<mutex> guard(own.lock);
+         own.next = from;
+         own.end = to;
+         stole = true;
+      }
+      if (!stole) return false;
+   }
+}
@@ -0,0 +1,75 @@
+/*
+ * File: threadpool.h
+ * ------------------
+ * This interface exports the pool of threads that runs PARALLEL FOR
+ * loops.  The threads are started on first use and then sleep between
+ * loops.  A loop's iterations are first divided evenly among the
+ * workers; a worker that runs out steals the back half of what another
+ * worker has left, so uneven iterations still keep every thread busy.
+ */
+
+#ifndef _threadpool_h
+#define _threadpool_h
+
+/*
+ * Constant: MAX_THREADS
+ * ---------------------
+ * The largest number of threads a loop may use.
+ */
+
+const int MAX_THREADS = 256;
+
+/*
+ * Class: ParallelTask
+ * -------------------
+ * The work of one parallel loop.  runRange runs the iterations from
+ * first up to but not including end on behalf of worker, a number from
+ * 0 to one less than the number of workers.  The calls for one worker
+ * all come from the same thread, one at a time, but calls for different
+ * workers run at once.  runRange must not throw, since nothing on the
+ * pool's threads could catch the error.
+ */
+
+class ParallelTask {
+
+public:
+
+   virtual ~ParallelTask();
+
+   virtual void runRange(int worker, long long first, long long end) = 0;
+
+};
+
+/*
+ * Functions: setThreadCount, getThreadCount
+ * Usage: setThreadCount(8);
+ * -------------------------
+ * Set and return the number of threads a loop uses, counting the thread
+ * that starts it.  The default is the number of processors.
+ */
+
+void setThreadCount(int threads);
+int getThreadCount();
+
+/*
+ * Function: getWorkerCount
+ * Usage: int workers = getWorkerCount(iterations);
+ * ------------------------------------------------
+ * Returns the number of workers runParallel uses for a loop of that many
+ * iterations, which is never more than the iterations themselves.
+ */
+
+int getWorkerCount(long long iterations);
+
+/*
+ * Function: runParallel
+ * Usage: runParallel(task, first, end);
+ * -------------------------------------
+ * Runs the iterations from first up to but not including end and
+ * returns when all of them are done.  The calling thread is worker 0.
+ * Only one thread at a time may call runParallel.
+ */
+
+void runParallel(ParallelTask & task, long long first, long long end);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * File: tiering.cpp
+ * -----------------
+ * This file implements the tiering.h interface.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "accounting.h"
+#include "compiler.h"
+#include "error.h"
+#include "stats.h"
+#include "tiering.h"
+#include "vector.h"
+using namespace std;
+
+static int tierUpThreshold = DEFAULT_TIER_UP_THRESHOLD;
+
+void setTierUpThreshold(int threshold) {
+   tierUpThreshold = threshold;
+}
+
+int getTierUpThreshold() {
+   return tierUpThreshold;
+}
+
+/*
+ * Implementation notes: TierCompiler
+ * ----------------------------------
+ * The generation counter is what lets cancel return at once: the worker
+ * notes the generation of the request it takes, and when it finishes it
+ * publishes the result only if no cancel has happened in between.
+ */
+
+TierCompiler::TierCompiler() {
+   ready = false;
+   request = NULL;
+   result = NULL;
+   generation = 0;
+   stopping = false;
+}
+
+TierCompiler::~TierCompiler() {
+   {
+      lock_guard<mutex> guard(lock);
+      stopping = true;
+   }
+   wakeup.notify_one();
+   if (worker.joinable()) worker.join();
+   delete request;
+   delete result;
+}
+
+void TierCompiler::submit(const Vector<SourceLine> & source) {
+   {
+      lock_guard<mutex> guard(lock);
+      delete request;
+      request = new Vector<SourceLine>(source);
+      if (!worker.joinable()) worker = thread(&TierCompiler::work, this);
+   }
+   wakeup.notify_one();
+}
+
+CompiledProgram *TierCompiler::take() {
+   lock_guard<mutex> guard(lock);
+   CompiledProgram *code = result;
+   result = NULL;
+   ready.store(false, memory_order_relaxed);
+   return code;
+}
+
+void TierCompiler::cancel() {
+   lock_guard<mutex> guard(lock);
+   generation++;
+   delete request;
+   request = NULL;
+   delete result;
+   result = NULL;
+   ready.store(false, memory_order_relaxed);
+}
+
+/*
+ * Implementation notes: work
+ * --------------------------
+ * The program was parsed successfully when its lines were entered, so
+ * compiling it cannot normally fail; if it does, the program simply
+ * stays in the baseline tier.
+ */
+
+void TierCompiler::work() {
+   unique_lock<mutex> guard(lock);
+   while (true) {
+      while (request == NULL && !stopping) wakeup.wait(guard);
+      if (stopping) return;
+      Vector<SourceLine> *source = request;
+      unsigned started = generation;
+      request = NULL;
+      guard.unlock();
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      CompiledProgram *code = NULL;
+      MemoryScope scope(MEM_CODE);
+      try {
+         code = new CompiledProgram(*source, true);
+      } catch (ErrorException & ex) {
+         code = NULL;
+      }
+      delete source;
+      countStat(STAT_TIER_COMPILE_NANOS,
+                chrono::duration_cast<chrono::nanoseconds>(
+                   chrono::steady_clock::now() - start).count());
+      guard.lock();
+      if (code != NULL && generation == started && !stopping) {
+         delete result;
+         result = code;
+         ready.store(true, memory_order_release);
+      } else {
+         delete code;
+      }
+   }
+}
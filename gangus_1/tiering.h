@@ -0,0 +1,128 @@
+/*
+ * File: tiering.h
+ * ---------------
+ * This interface exports the TierCompiler class, which builds the
+ * optimized tier of a program on a background thread.  Program::run
+ * starts every program in the baseline tier, asks for the optimized
+ * tier once a loop turns out to be hot, and switches to it at the next
+ * backward jump after it is ready, so neither cold programs nor the
+ * command loop ever wait for the optimizer.
+ */
+
+#ifndef _tiering_h
+#define _tiering_h
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "cfg.h"
+#include "compiler.h"
+#include "vector.h"
+
+/*
+ * Constant: DEFAULT_TIER_UP_THRESHOLD
+ * -----------------------------------
+ * The number of jumps back to one line after which its loop is hot.
+ */
+
+const int DEFAULT_TIER_UP_THRESHOLD = 1000;
+
+/*
+ * Functions: setTierUpThreshold, getTierUpThreshold
+ * Usage: setTierUpThreshold(n);
+ * -----------------------------
+ * Set and return the hot-loop threshold.  A threshold of 0 or less
+ * turns tiering off: programs are optimized before they start, on the
+ * calling thread.
+ */
+
+void setTierUpThreshold(int threshold);
+int getTierUpThreshold();
+
+/*
+ * Class: TierCompiler
+ * -------------------
+ * One compiler thread serving one Program.  The thread starts with the
+ * first request and sleeps while there is nothing to compile.
+ */
+
+class TierCompiler {
+
+public:
+
+   TierCompiler();
+
+/*
+ * Destructor: ~TierCompiler
+ * Usage: usually implicit
+ * -----------------------
+ * Stops the thread, waiting for a compilation in progress to finish,
+ * and frees any result that was never taken.
+ */
+
+   ~TierCompiler();
+
+/*
+ * Method: submit
+ * Usage: compiler.submit(program.getSource());
+ * --------------------------------------------
+ * Asks for the optimized tier of the snapshot.  A request replaces any
+ * request the thread has not started on.
+ */
+
+   void submit(const Vector<SourceLine> & source);
+
+/*
+ * Method: isReady
+ * Usage: if (compiler.isReady()) . . .
+ * ------------------------------------
+ * Returns true if a result is waiting.  This is a single atomic load,
+ * cheap enough for the run loop.
+ */
+
+   bool isReady() {
+      return ready.load(std::memory_order_acquire);
+   }
+
+/*
+ * Method: take
+ * Usage: CompiledProgram *code = compiler.take();
+ * -----------------------------------------------
+ * Returns the waiting result, which the caller then owns, or NULL.
+ */
+
+   CompiledProgram *take();
+
+/*
+ * Method: cancel
+ * Usage: compiler.cancel();
+ * -------------------------
+ * Drops the pending request and the waiting result.  A compilation in
+ * progress finishes, but its result is thrown away.  Program calls this
+ * whenever the program is edited.
+ */
+
+   void cancel();
+
+private:
+
+   std::thread worker;
+   std::mutex lock;
+   std::condition_variable wakeup;
+   std::atomic<bool> ready;
+   Vector<SourceLine> *request;
+   CompiledProgram *result;
+   unsigned generation;
+   bool stopping;
+
+   void work();
+
+/* Copying a compiler would copy its thread, so it is not allowed */
+
+   TierCompiler(const TierCompiler & src);
+   TierCompiler & operator=(const TierCompiler & src);
+
+};
+
+#endif
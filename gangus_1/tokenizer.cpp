@@ -0,0 +1,229 @@
+/*
+ * File: tokenizer.cpp
+ * -------------------
+ * This file implements the tokenizer.h interface.
+ */
+
+#include <cctype>
+#include <string>
+#include "error.h"
+#include "hashmap.h"
+#include "strlib.h"
+#include "tokenizer.h"
+#include "vector.h"
+using namespace std;
+
+/*
+ * Constants: token bytes
+ * ----------------------
+ * Bytes below 0x80 stand for themselves.  Keyword k is the byte
+ * KEYWORD_BASE + k, and the other tokens start with one of the marker
+ * bytes, followed by an unsigned number in 7-bit groups, low group
+ * first, with the top bit set on every byte but the last.
+ */
+
+static const unsigned char KEYWORD_BASE = 0x80;
+static const unsigned char TOKEN_NUMBER = 0xF0;
+static const unsigned char TOKEN_NAME = 0xF1;
+static const unsigned char TOKEN_BYTE = 0xF2;
+
+/*
+ * Constant: KEYWORDS
+ * ------------------
+ * The words stored as single bytes.  Only the exact uppercase spelling
+ * is a keyword; any other spelling is stored as an identifier, which
+ * keeps the case the user typed.
+ */
+
+static const string KEYWORDS[] = {
+   "PRINT", "LET", "REM", "INPUT", "GOTO", "IF", "THEN", "END",
+   "GOSUB", "RETURN", "ON", "DIM", "MAT", "PARALLEL", "FOR", "TO", "NEXT"
+};
+
+static const int KEYWORD_COUNT = sizeof KEYWORDS / sizeof KEYWORDS[0];
+
+/* Private function prototypes */
+
+static void addBytes(const string & line, size_t start, size_t end,
+                     string & tokens);
+static void addVarint(unsigned value, string & tokens);
+static unsigned readVarint(const char *tokens, int & pos);
+
+/*
+ * Implementation notes: tokenize
+ * ------------------------------
+ * A word starts with a letter and runs on through letters and digits.
+ * A run of digits is stored in binary only if converting it back gives
+ * the same digits, so numbers with leading zeros or too many digits
+ * are kept as text.  The text of a REM and the characters of a quoted
+ * string are kept as they are, since the words in them are not names
+ * and would only fill the name table.  A quote ends a string unless a
+ * backslash comes before it, as in the scanner, and a string that is
+ * not closed runs to the end of the line.
+ */
+
+string LineTokenizer::tokenize(const string & line) {
+   string tokens;
+   size_t i = 0;
+   while (i < line.length()) {
+      unsigned char ch = line[i];
+      if (isalpha(ch)) {
+         size_t start = i;
+         while (i < line.length() && isalnum((unsigned char) line[i])) i++;
+         string word = line.substr(start, i - start);
+         addWord(word, tokens);
+         if (toUpperCase(word) == "REM") {
+            addBytes(line, i, line.length(), tokens);
+            break;
+         }
+      } else if (ch == '"' || ch == '\'') {
+         size_t start = i++;
+         while (i < line.length() && line[i] != (char) ch) {
+            if (line[i] == '\\') i++;
+            i++;
+         }
+         if (i < line.length()) i++;
+         if (i > line.length()) i = line.length();
+         addBytes(line, start, i, tokens);
+      } else if (isdigit(ch)) {
+         size_t start = i;
+         while (i < line.length() && isdigit((unsigned char) line[i])) i++;
+         addNumber(line.substr(start, i - start), tokens);
+      } else {
+         addBytes(line, i, i + 1, tokens);
+         i++;
+      }
+   }
+   return tokens;
+}
+
+string LineTokenizer::detokenize(const char *tokens, int length) {
+   string line;
+   int pos = 0;
+   while (pos < length) {
+      unsigned char ch = tokens[pos++];
+      if (ch < KEYWORD_BASE) {
+         line += (char) ch;
+      } else if (ch < KEYWORD_BASE + KEYWORD_COUNT) {
+         line += KEYWORDS[ch - KEYWORD_BASE];
+      } else if (ch == TOKEN_NUMBER) {
+         line += to_string(readVarint(tokens, pos));
+      } else if (ch == TOKEN_NAME) {
+         line += names[readVarint(tokens, pos)];
+      } else if (ch == TOKEN_BYTE) {
+         line += tokens[pos++];
+      } else {
+         error("Illegal token in stored line");
+      }
+   }
+   return line;
+}
+
+/*
+ * Implementation notes: release
+ * -----------------------------
+ * A name that is no longer used leaves the index, and its slot goes on
+ * the list that addWord takes new slots from first.
+ */
+
+void LineTokenizer::release(const char *tokens, int length) {
+   int pos = 0;
+   while (pos < length) {
+      unsigned char ch = tokens[pos++];
+      if (ch == TOKEN_NUMBER) {
+         readVarint(tokens, pos);
+      } else if (ch == TOKEN_NAME) {
+         int slot = readVarint(tokens, pos);
+         if (--uses[slot] == 0) {
+            index.remove(names[slot]);
+            names[slot] = "";
+            unused.add(slot);
+         }
+      } else if (ch == TOKEN_BYTE) {
+         pos++;
+      }
+   }
+}
+
+int LineTokenizer::getNameCount() {
+   return names.size() - unused.size();
+}
+
+/*
+ * Implementation notes: clear
+ * ---------------------------
+ * The collections are replaced rather than cleared, so that their
+ * storage is freed along with their contents.
+ */
+
+void LineTokenizer::clear() {
+   names = Vector<string>();
+   uses = Vector<int>();
+   unused = Vector<int>();
+   index = HashMap<string,int>();
+}
+
+void LineTokenizer::addWord(const string & word, string & tokens) {
+   for (int k = 0; k < KEYWORD_COUNT; k++) {
+      if (word == KEYWORDS[k]) {
+         tokens += (char) (KEYWORD_BASE + k);
+         return;
+      }
+   }
+   int slot;
+   if (index.containsKey(word)) {
+      slot = index.get(word);
+      uses[slot]++;
+   } else if (!unused.isEmpty()) {
+      slot = unused[unused.size() - 1];
+      unused.remove(unused.size() - 1);
+      names[slot] = word;
+      uses[slot] = 1;
+      index.put(word, slot);
+   } else {
+      slot = names.size();
+      names.add(word);
+      uses.add(1);
+      index.put(word, slot);
+   }
+   tokens += (char) TOKEN_NAME;
+   addVarint(slot, tokens);
+}
+
+void LineTokenizer::addNumber(const string & digits, string & tokens) {
+   bool canonical = digits.length() <= 10 && (digits[0] != '0' || digits == "0");
+   if (canonical) canonical = stoull(digits) <= 0xFFFFFFFFULL;
+   if (!canonical) {
+      tokens += digits;
+      return;
+   }
+   tokens += (char) TOKEN_NUMBER;
+   addVarint((unsigned) stoull(digits), tokens);
+}
+
+static void addBytes(const string & line, size_t start, size_t end,
+                     string & tokens) {
+   for (size_t i = start; i < end; i++) {
+      if ((unsigned char) line[i] >= KEYWORD_BASE) tokens += (char) TOKEN_BYTE;
+      tokens += line[i];
+   }
+}
+
+static void addVarint(unsigned value, string & tokens) {
+   while (value >= 0x80) {
+      tokens += (char) (0x80 | (value & 0x7F));
+      value >>= 7;
+   }
+   tokens += (char) value;
+}
+
+static unsigned readVarint(const char *tokens, int & pos) {
+   unsigned value = 0;
+   int shift = 0;
+   while (true) {
+      unsigned char ch = tokens[pos++];
+      value |= (unsigned) (ch & 0x7F) << shift;
+      if (ch < 0x80) return value;
+      shift += 7;
+   }
+}
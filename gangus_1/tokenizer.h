@@ -0,0 +1,93 @@
+/*
+ * File: tokenizer.h
+ * -----------------
+ * This interface exports LineTokenizer, which converts program lines
+ * to and from the compact form in which Program stores them.  As in
+ * the classic BASIC interpreters, keywords take one byte, numbers are
+ * stored in binary and identifiers are indices into a table of names.
+ * Everything else, spaces, REM text and quoted strings included, is
+ * kept as it was typed, so a line converts back to exactly the text
+ * that was entered.
+ */
+
+#ifndef _tokenizer_h
+#define _tokenizer_h
+
+#include <string>
+#include "hashmap.h"
+#include "vector.h"
+
+/*
+ * Class: LineTokenizer
+ * --------------------
+ * The name table counts the lines that use each name.  A line's tokens
+ * stay valid until they are released, and a name that no line uses any
+ * more gives its slot to the next new name, so editing a program does
+ * not make the table grow.
+ */
+
+class LineTokenizer {
+
+public:
+
+/*
+ * Method: tokenize
+ * Usage: string tokens = tokenizer.tokenize(line);
+ * ------------------------------------------------
+ * Returns the compact form of line.  The names in it count as used
+ * until the tokens are released.
+ */
+
+   std::string tokenize(const std::string & line);
+
+/*
+ * Method: detokenize
+ * Usage: string line = tokenizer.detokenize(tokens, length);
+ * ----------------------------------------------------------
+ * Returns the text of a line from the length bytes of its compact form.
+ */
+
+   std::string detokenize(const char *tokens, int length);
+
+/*
+ * Method: release
+ * Usage: tokenizer.release(tokens, length);
+ * -----------------------------------------
+ * Gives back the names used by the compact form of a line that is no
+ * longer kept.
+ */
+
+   void release(const char *tokens, int length);
+
+/*
+ * Method: getNameCount
+ * Usage: int n = tokenizer.getNameCount();
+ * ----------------------------------------
+ * Returns the number of distinct identifiers in use.
+ */
+
+   int getNameCount();
+
+/*
+ * Method: clear
+ * Usage: tokenizer.clear();
+ * -------------------------
+ * Empties the name table and frees its memory.  Lines tokenized before
+ * the call can no longer be converted back.
+ */
+
+   void clear();
+
+private:
+
+   Vector<std::string> names;
+   Vector<int> uses;
+   Vector<int> unused;
+   HashMap<std::string,int> index;
+
+   void addWord(const std::string & word, std::string & tokens);
+   void addNumber(const std::string & digits, std::string & tokens);
+
+};
+
+#endif
@@ -0,0 +1,1040 @@
+/*
+ * File: transpiler.cpp
+ * --------------------
+ * This file implements the transpiler.h interface.
+ */
+
+#include <climits>
+#include <iostream>
+#include <string>
+#include "analysis.h"
+#include "budget.h"
+#include "compiler.h"
+#include "error.h"
+#include "exp.h"
+#include "flatexp.h"
+#include "hashmap.h"
+#include "parallel.h"
+#include "program.h"
+#include "statement.h"
+#include "stringvalue.h"
+#include "strlib.h"
+#include "transpiler.h"
+#include "vector.h"
+using namespace std;
+
+/*
+ * Constant: RUNTIME
+ * -----------------
+ * The support code at the top of every generated file.  The output is
+ * fully buffered and flushed before each prompt and on every exit, which
+ * is what the interpreter's output module does when stdout is not a
+ * terminal.  Integers are 64-bit, and the arithmetic stops the program
+ * with "Integer overflow" where the interpreter would move on to a big
+ * integer.  A variable that may hold a real number is a Value, a tag and
+ * both payloads, with the arithmetic, comparisons and printing of
+ * value.h.  A string is a std::string, whose comparisons order bytes as
+ * unsigned, as compareStrings does, and whose += grows its buffer
+ * geometrically, as appendString does.  Arrays are laid out and checked as the interpreter lays
+ * them out and checks them (see evalstate.h), and their elements are
+ * ints whose arithmetic wraps around, as in matrix.h.  The MAT
+ * functions are plain loops, which the C++ compiler vectorizes for the
+ * machine it targets; the product and the transpose always go through a
+ * temporary, so the target may be one of the operands.
+ */
+
+static const string RUNTIME =
+   "#include <charconv>\n"
+   "#include <climits>\n"
+   "#include <cmath>\n"
+   "#include <cstdio>\n"
+   "#include <cstdlib>\n"
+   "#include <cstring>\n"
+   "#include <iostream>\n"
+   "#include <string>\n"
+   "#include <vector>\n"
+   "\n"
+   "static void fail(const char *msg) {\n"
+   "   std::fflush(stdout);\n"
+   "   std::fprintf(stderr, \"Error: %s\\n\", msg);\n"
+   "   std::exit(1);\n"
+   "}\n"
+   "\n"
+   "static void undefined(const char *name) {\n"
+   "   std::string msg = std::string(name) + \" is undefined\";\n"
+   "   fail(msg.c_str());\n"
+   "}\n"
+   "\n"
+   "static void print(long long value) {\n"
+   "   std::printf(\"%lld\\n\", value);\n"
+   "}\n"
+   "\n"
+   "static void print(const std::string & str) {\n"
+   "   std::fwrite(str.data(), 1, str.size(), stdout);\n"
+   "   std::putchar('\\n');\n"
+   "}\n"
+   "\n"
+   "struct Value {\n"
+   "   bool real;\n"
+   "   long long integer;\n"
+   "   double number;\n"
+   "   Value() : real(false), integer(0), number(0) { }\n"
+   "   Value(int integer) : real(false), integer(integer), number(0) { }\n"
+   "   Value(long long integer) : real(false), integer(integer), number(0) { }\n"
+   "   Value(double number) : real(true), integer(0), number(number) { }\n"
+   "};\n"
+   "\n"
+   "static void print(const Value & value) {\n"
+   "   if (!value.real) {\n"
+   "      print(value.integer);\n"
+   "      return;\n"
+   "   }\n"
+   "   char buffer[32];\n"
+   "   char *end = std::to_chars(buffer, buffer + sizeof buffer, value.number).ptr;\n"
+   "   std::string str(buffer, end);\n"
+   "   if (str.find_first_of(\".ein\") == std::string::npos) str += \".0\";\n"
+   "   std::printf(\"%s\\n\", str.c_str());\n"
+   "}\n"
+   "\n"
+   "static bool scanValue(const std::string & text, Value & value) {\n"
+   "   size_t start = text.find_first_not_of(\" \\t\\r\");\n"
+   "   if (start == std::string::npos) return false;\n"
+   "   size_t end = text.find_last_not_of(\" \\t\\r\") + 1;\n"
+   "   const char *first = text.data() + start;\n"
+   "   const char *last = text.data() + end;\n"
+   "   bool digits = first + (*first == '-') < last;\n"
+   "   for (const char *cp = first + (*first == '-'); cp < last; cp++) {\n"
+   "      if (*cp < '0' || *cp > '9') digits = false;\n"
+   "   }\n"
+   "   if (digits) {\n"
+   "      long long integer;\n"
+   "      std::from_chars_result result = std::from_chars(first, last, integer);\n"
+   "      if (result.ec == std::errc::result_out_of_range) fail(\"Integer overflow\");\n"
+   "      if (result.ptr != last || result.ec != std::errc()) return false;\n"
+   "      value = Value(integer);\n"
+   "      return true;\n"
+   "   }\n"
+   "   double number;\n"
+   "   std::from_chars_result result = std::from_chars(first, last, number);\n"
+   "   if (result.ptr != last || result.ec != std::errc() || !std::isfinite(number)) {\n"
+   "      return false;\n"
+   "   }\n"
+   "   value = Value(number);\n"
+   "   return true;\n"
+   "}\n"
+   "\n"
+   "static Value readValue() {\n"
+   "   std::fputs(\" ? \", stdout);\n"
+   "   std::fflush(stdout);\n"
+   "   std::string line;\n"
+   "   while (std::getline(std::cin, line)) {\n"
+   "      Value value;\n"
+   "      if (scanValue(line, value)) return value;\n"
+   "      std::fputs(\"Illegal numeric format. Try again.\\n\", stdout);\n"
+   "      std::fflush(stdout);\n"
+   "   }\n"
+   "   fail(\"No more input values\");\n"
+   "   return Value();\n"
+   "}\n"
+   "\n"
+   "static std::string readLine() {\n"
+   "   std::fputs(\" ? \", stdout);\n"
+   "   std::fflush(stdout);\n"
+   "   std::string line;\n"
+   "   if (!std::getline(std::cin, line)) fail(\"No more input values\");\n"
+   "   return line;\n"
+   "}\n"
+   "\n"
+   "static long long opAdd(long long x, long long y) {\n"
+   "   long long result;\n"
+   "   if (__builtin_add_overflow(x, y, &result)) fail(\"Integer overflow\");\n"
+   "   return result;\n"
+   "}\n"
+   "\n"
+   "static long long opSub(long long x, long long y) {\n"
+   "   long long result;\n"
+   "   if (__builtin_sub_overflow(x, y, &result)) fail(\"Integer overflow\");\n"
+   "   return result;\n"
+   "}\n"
+   "\n"
+   "static long long opMul(long long x, long long y) {\n"
+   "   long long result;\n"
+   "   if (__builtin_mul_overflow(x, y, &result)) fail(\"Integer overflow\");\n"
+   "   return result;\n"
+   "}\n"
+   "\n"
+   "static long long opDiv(long long x, long long y) {\n"
+   "   if (y == 0) fail(\"Division by zero\");\n"
+   "   if (y == -1 && x == LLONG_MIN) fail(\"Integer overflow\");\n"
+   "   return x / y;\n"
+   "}\n"
+   "\n"
+   "static int wrapAdd(int x, int y) { return (int) ((unsigned) x + (unsigned) y); }\n"
+   "static int wrapSub(int x, int y) { return (int) ((unsigned) x - (unsigned) y); }\n"
+   "static int wrapMul(int x, int y) { return (int) ((unsigned) x * (unsigned) y); }\n"
+   "\n"
+   "static double toReal(const Value & x) { return x.real ? x.number : (double) x.integer; }\n"
+   "\n"
+   "static Value valAdd(const Value & x, const Value & y) {\n"
+   "   if (!x.real && !y.real) return opAdd(x.integer, y.integer);\n"
+   "   return toReal(x) + toReal(y);\n"
+   "}\n"
+   "\n"
+   "static Value valSub(const Value & x, const Value & y) {\n"
+   "   if (!x.real && !y.real) return opSub(x.integer, y.integer);\n"
+   "   return toReal(x) - toReal(y);\n"
+   "}\n"
+   "\n"
+   "static Value valMul(const Value & x, const Value & y) {\n"
+   "   if (!x.real && !y.real) return opMul(x.integer, y.integer);\n"
+   "   return toReal(x) * toReal(y);\n"
+   "}\n"
+   "\n"
+   "static Value valDiv(const Value & x, const Value & y) {\n"
+   "   if (!x.real && !y.real) return opDiv(x.integer, y.integer);\n"
+   "   if (toReal(y) == 0) fail(\"Division by zero\");\n"
+   "   return toReal(x) / toReal(y);\n"
+   "}\n"
+   "\n"
+   "static bool valEqual(const Value & x, const Value & y) {\n"
+   "   if (!x.real && !y.real) return x.integer == y.integer;\n"
+   "   return toReal(x) == toReal(y);\n"
+   "}\n"
+   "\n"
+   "static bool valLess(const Value & x, const Value & y) {\n"
+   "   if (!x.real && !y.real) return x.integer < y.integer;\n"
+   "   return toReal(x) < toReal(y);\n"
+   "}\n"
+   "\n"
+   "static long long integerOf(const Value & value, const char *what) {\n"
+   "   if (value.real) {\n"
+   "      std::string msg = std::string(what) + \" must be an integer\";\n"
+   "      fail(msg.c_str());\n"
+   "   }\n"
+   "   return value.integer;\n"
+   "}\n"
+   "\n"
+   "static std::string strLeft(const std::string & str, long long n) {\n"
+   "   if (n < 0) fail(\"String length is out of range\");\n"
+   "   return str.substr(0, n);\n"
+   "}\n"
+   "\n"
+   "static std::string strRight(const std::string & str, long long n) {\n"
+   "   if (n < 0) fail(\"String length is out of range\");\n"
+   "   return (n >= (long long) str.size()) ? str : str.substr(str.size() - n);\n"
+   "}\n"
+   "\n"
+   "static std::string strMid(const std::string & str, long long start, long long n) {\n"
+   "   if (start < 1) fail(\"String position is out of range\");\n"
+   "   if (n < 0) fail(\"String length is out of range\");\n"
+   "   if (start > (long long) str.size()) return std::string();\n"
+   "   return str.substr(start - 1, n);\n"
+   "}\n"
+   "\n"
+   "static int intOf(long long value, const char *what) {\n"
+   "   if (value != (int) value) {\n"
+   "      std::string msg = std::string(what) + \" is out of range\";\n"
+   "      fail(msg.c_str());\n"
+   "   }\n"
+   "   return (int) value;\n"
+   "}\n"
+   "\n"
+   "struct Array {\n"
+   "   int *data;\n"
+   "   int extent[3];\n"
+   "   int stride[3];\n"
+   "};\n"
+   "\n"
+   "static void failArray(std::string before, const char *name, const char *after) {\n"
+   "   std::string msg = before + name + after;\n"
+   "   fail(msg.c_str());\n"
+   "}\n"
+   "\n"
+   "static void dim(Array & array, const char *name, int first, int second) {\n"
+   "   if (first < 0 || second < -1) failArray(\"Illegal dimension for array \", name, \"\");\n"
+   "   long long rows = first + 1LL;\n"
+   "   long long columns = second + 1LL;\n"
+   "   long long size = (second == -1) ? rows : rows * columns;\n"
+   "   if (size > INT_MAX / (long long) sizeof(int)) failArray(\"Array \", name, \" is too large\");\n"
+   "   std::free(array.data);\n"
+   "   size_t bytes = (size * sizeof(int) + 63) / 64 * 64;\n"
+   "   array.data = (int *) std::aligned_alloc(64, bytes);\n"
+   "   if (array.data == NULL) fail(\"Out of memory\");\n"
+   "   std::memset(array.data, 0, bytes);\n"
+   "   std::memset(array.extent, 0, sizeof array.extent);\n"
+   "   std::memset(array.stride, 0, sizeof array.stride);\n"
+   "   if (second == -1) {\n"
+   "      array.extent[0] = rows;\n"
+   "      array.stride[0] = 1;\n"
+   "   } else {\n"
+   "      array.extent[1] = rows;\n"
+   "      array.stride[1] = columns;\n"
+   "      array.extent[2] = columns;\n"
+   "      array.stride[2] = 1;\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "static int offset(Array & array, const char *name, int position, long long subscript) {\n"
+   "   if ((unsigned long long) subscript < (unsigned long long) array.extent[position]) {\n"
+   "      return (int) subscript * array.stride[position];\n"
+   "   }\n"
+   "   if (array.data == NULL) failArray(\"Array \", name, \" is not dimensioned\");\n"
+   "   if (array.extent[position] == 0) failArray(\"Wrong number of subscripts for \", name, \"\");\n"
+   "   failArray(\"Subscript \" + std::to_string(subscript) + \" is out of range for \", name, \"\");\n"
+   "   return 0;\n"
+   "}\n"
+   "\n"
+   "static int rowsOf(Array & array) {\n"
+   "   return (array.extent[1] != 0) ? array.extent[1] : array.extent[0];\n"
+   "}\n"
+   "\n"
+   "static int columnsOf(Array & array) {\n"
+   "   return (array.extent[1] != 0) ? array.extent[2] : 1;\n"
+   "}\n"
+   "\n"
+   "static void need(Array & array, const char *name) {\n"
+   "   if (array.data == NULL) failArray(\"Array \", name, \" is not dimensioned\");\n"
+   "}\n"
+   "\n"
+   "static void reshape(Array & array, const char *name, int first, int second) {\n"
+   "   if (array.data != NULL) {\n"
+   "      if (second == -1 && array.extent[0] == first + 1LL) return;\n"
+   "      if (second != -1 && array.extent[1] == first + 1LL && array.extent[2] == second + 1LL) return;\n"
+   "   }\n"
+   "   dim(array, name, first, second);\n"
+   "}\n"
+   "\n"
+   "static void reshapeLike(Array & array, const char *name, Array & like) {\n"
+   "   reshape(array, name, rowsOf(like) - 1, (like.extent[1] != 0) ? columnsOf(like) - 1 : -1);\n"
+   "}\n"
+   "\n"
+   "static void matFill(Array & c, const char *cn, int value) {\n"
+   "   need(c, cn);\n"
+   "   int size = rowsOf(c) * columnsOf(c);\n"
+   "   for (int i = 0; i < size; i++) c.data[i] = value;\n"
+   "}\n"
+   "\n"
+   "static void matCopy(Array & c, const char *cn, Array & a, const char *an) {\n"
+   "   need(a, an);\n"
+   "   reshapeLike(c, cn, a);\n"
+   "   if (&c != &a) std::memcpy(c.data, a.data, (size_t) rowsOf(a) * columnsOf(a) * sizeof(int));\n"
+   "}\n"
+   "\n"
+   "static void matAdd(Array & c, const char *cn, Array & a, const char *an,\n"
+   "                   Array & b, const char *bn, bool subtract) {\n"
+   "   need(a, an);\n"
+   "   need(b, bn);\n"
+   "   if ((a.extent[1] != 0) != (b.extent[1] != 0) || rowsOf(a) != rowsOf(b)\n"
+   "       || columnsOf(a) != columnsOf(b)) {\n"
+   "      failArray(std::string(\"Arrays \") + an + \" and \", bn, \" have different shapes\");\n"
+   "   }\n"
+   "   reshapeLike(c, cn, a);\n"
+   "   int size = rowsOf(a) * columnsOf(a);\n"
+   "   for (int i = 0; i < size; i++) {\n"
+   "      c.data[i] = subtract ? wrapSub(a.data[i], b.data[i]) : wrapAdd(a.data[i], b.data[i]);\n"
+   "   }\n"
+   "}\n"
+   "\n"
+   "static void matScale(Array & c, const char *cn, int factor, Array & a, const char *an) {\n"
+   "   need(a, an);\n"
+   "   reshapeLike(c, cn, a);\n"
+   "   int size = rowsOf(a) * columnsOf(a);\n"
+   "   for (int i = 0; i < size; i++) c.data[i] = wrapMul(a.data[i], factor);\n"
+   "}\n"
+   "\n"
+   "static void matMultiply(Array & c, const char *cn, Array & a, const char *an,\n"
+   "                        Array & b, const char *bn) {\n"
+   "   need(a, an);\n"
+   "   need(b, bn);\n"
+   "   if (a.extent[1] == 0) failArray(\"Array \", an, \" is not two-dimensional\");\n"
+   "   if (rowsOf(b) != columnsOf(a)) {\n"
+   "      failArray(std::string(\"Arrays \") + an + \" and \", bn, \" cannot be multiplied\");\n"
+   "   }\n"
+   "   long long rows = rowsOf(a);\n"
+   "   int inner = columnsOf(a);\n"
+   "   int columns = columnsOf(b);\n"
+   "   if (rows * columns > INT_MAX / (long long) sizeof(int)) failArray(\"Array \", cn, \" is too large\");\n"
+   "   std::vector<int> product(rows * columns);\n"
+   "   for (int i = 0; i < rows; i++) {\n"
+   "      for (int k = 0; k < inner; k++) {\n"
+   "         int factor = a.data[(size_t) i * inner + k];\n"
+   "         for (int j = 0; j < columns; j++) {\n"
+   "            int & sum = product[(size_t) i * columns + j];\n"
+   "            sum = wrapAdd(sum, wrapMul(factor, b.data[(size_t) k * columns + j]));\n"
+   "         }\n"
+   "      }\n"
+   "   }\n"
+   "   reshape(c, cn, rows - 1, (b.extent[1] != 0) ? columns - 1 : -1);\n"
+   "   std::memcpy(c.data, product.data(), product.size() * sizeof(int));\n"
+   "}\n"
+   "\n"
+   "static void matTranspose(Array & c, const char *cn, Array & a, const char *an) {\n"
+   "   need(a, an);\n"
+   "   if (a.extent[1] == 0) failArray(\"Array \", an, \" is not two-dimensional\");\n"
+   "   int rows = rowsOf(a);\n"
+   "   int columns = columnsOf(a);\n"
+   "   std::vector<int> transpose((size_t) rows * columns);\n"
+   "   for (int i = 0; i < rows; i++) {\n"
+   "      for (int j = 0; j < columns; j++) {\n"
+   "         transpose[(size_t) j * rows + i] = a.data[(size_t) i * columns + j];\n"
+   "      }\n"
+   "   }\n"
+   "   reshape(c, cn, columns - 1, rows - 1);\n"
+   "   std::memcpy(c.data, transpose.data(), transpose.size() * sizeof(int));\n"
+   "}\n";
+
+/*
+ * Type: Emitter
+ * -------------
+ * The state of one translation: the stream, the next temporary number,
+ * the variables and arrays found so far, in order of first appearance,
+ * and how the lines being emitted are labeled.  The lines of a PARALLEL
+ * FOR body have a prefix of their own, and their exit label ends the
+ * iteration rather than the program.
+ */
+
+struct Emitter {
+   ostream *out;
+   int temps;
+   string prefix;
+   string exitLabel;
+   HashMap<string,bool> seen;
+   Vector<string> variables;
+   HashMap<string,bool> arraySeen;
+   Vector<string> arrays;
+};
+
+/*
+ * Constant: RETURN_NODE
+ * ---------------------
+ * The successor of a RETURN line, whose label is the block that jumps
+ * to the line after the latest GOSUB.
+ */
+
+static const int RETURN_NODE = -3;
+
+/* Private function prototypes */
+
+static void findVariables(Expression *exp, Emitter & em);
+static void findVariables(CompiledLine & line, Emitter & em);
+static string emitExpression(Expression *exp, Emitter & em);
+static void emitLine(CompiledLine & line, int index, Emitter & em);
+static void emitParallelFor(CompiledLine & line, int index, Emitter & em);
+static string label(int index, Emitter & em);
+static void addVariable(string name, Emitter & em);
+static void addArray(string name, Emitter & em);
+static string emitElement(ArrayExp *element, Emitter & em);
+static string emitInteger(Expression *exp, const char *what, Emitter & em);
+static string emitInt(Expression *exp, const char *what, Emitter & em);
+static string arrayArgument(string name);
+static string variableName(string name);
+static string definedName(string name);
+
+/*
+ * Implementation notes: emitCpp
+ * -----------------------------
+ * The lines appear in the order of the compiled program, which is line
+ * order, so most lines fall through to the next one without a goto.
+ * Each line's code is a block of its own, which lets a goto jump past
+ * the temporaries of the lines it skips.  A GOSUB pushes the index of
+ * the line it returns to onto a static array, and every RETURN jumps
+ * to one block that switches on the index it pops.  ON becomes a switch
+ * as well, which the C++ compiler turns into a jump table.
+ */
+
+void emitCpp(Program & program, ostream & out, string name) {
+   if (program.isEmpty()) error("Program cannot be run");
+   CompiledProgram & code = program.compile();
+   CompiledLine *lines = code.getLines();
+   int entry = code.getEntry(program.getFirstLineNumber());
+   Emitter em;
+   em.out = &out;
+   em.temps = 0;
+   em.prefix = "L";
+   em.exitLabel = "done";
+   for (int i = 0; i < code.size(); i++) {
+      findVariables(lines[i], em);
+   }
+   out << "/*" << endl;
+   out << " * File generated from " << name << " by basic --emit-cpp."
+       << endl;
+   out << " */" << endl << endl;
+   out << RUNTIME << endl;
+   out << "int main() {" << endl;
+   HashMap<string,bool> integers;
+   for (string var : code.getIntegerVariables()) {
+      integers.put(var, true);
+   }
+   for (string var : em.variables) {
+      if (integers.containsKey(var)) {
+         out << "   long long " << variableName(var) << " = 0;" << endl;
+      } else if (isStringName(var)) {
+         out << "   std::string " << variableName(var) << ";" << endl;
+      } else {
+         out << "   Value " << variableName(var) << ";" << endl;
+      }
+      out << "   bool " << definedName(var) << " = false;" << endl;
+   }
+   for (string array : em.arrays) {
+      out << "   static Array a_" << array << ";" << endl;
+   }
+   Vector<int> returnLines;
+   HashMap<int,bool> returnSeen;
+   bool calls = false;
+   for (int i = 0; i < code.size(); i++) {
+      bool call = lines[i].type == GOSUB_STMT || lines[i].type == ON_GOSUB_STMT;
+      if (call && !returnSeen.containsKey(lines[i].next)) {
+         returnSeen.put(lines[i].next, true);
+         returnLines.add(lines[i].next);
+      }
+      if (call || lines[i].type == RETURN_STMT) calls = true;
+   }
+   if (calls) {
+      out << "   static int returns[" << getReturnStackLimit() << "];" << endl;
+      out << "   int depth = 0;" << endl;
+   }
+   out << "   goto " << label(entry, em) << ";" << endl;
+   for (int i = 0; i < code.size(); i++) {
+      emitLine(lines[i], i, em);
+   }
+   if (calls) {
+      out << label(RETURN_NODE, em) << ":" << endl;
+      out << "   if (depth == 0) fail(\"RETURN without GOSUB\");" << endl;
+      out << "   switch (returns[--depth]) {" << endl;
+      for (int next : returnLines) {
+         out << "    case " << next << ": goto " << label(next, em) << ";" << endl;
+      }
+      out << "   }" << endl;
+   }
+   out << "missing:" << endl;
+   out << "   fail(\"Cannot access key\");" << endl;
+   out << "done:" << endl;
+   out << "   std::fflush(stdout);" << endl;
+   out << "   return 0;" << endl;
+   out << "}" << endl;
+}
+
+/*
+ * Implementation notes: emitLine
+ * ------------------------------
+ * LOOP_ENTRY nodes only matter to the interpreter's caches, so they
+ * produce no code beyond their label.  An IF with an operator that
+ * IfStmt::test does not know evaluates both sides and then ends the
+ * program, as the interpreter does.  A LET that appends to a string
+ * checks its base before it evaluates the rest, as LetStmt::execute
+ * does, and becomes a +=.
+ */
+
+static void emitLine(CompiledLine & line, int index, Emitter & em) {
+   ostream & out = *em.out;
+   out << label(index, em) << ": {  // " << line.lineNumber << endl;
+   int next = line.next;
+   switch (line.type) {
+    case PRINT_STMT: {
+      string value = emitExpression(((PrintStmt *) line.stmt)->getExp(), em);
+      out << "   print(" << value << ");" << endl;
+      break;
+    }
+    case LET_STMT: {
+      LetStmt *stmt = (LetStmt *) line.stmt;
+      string op = " = ";
+      if (stmt->getBase() != NULL) {
+         emitExpression(stmt->getBase(), em);
+         op = " += ";
+      }
+      string value = emitExpression(stmt->getExp(), em);
+      if (stmt->getElement() != NULL) {
+         string element = emitElement(stmt->getElement(), em);
+         if (!isIntegerExpression(stmt->getExp())) {
+            value = "integerOf(" + value + ", \"Array element\")";
+         }
+         out << "   " << element << " = intOf(" << value << ", \"Array element\");"
+             << endl;
+         break;
+      }
+      string var = stmt->getVariable()->getName();
+      out << "   " << variableName(var) << op << value << ";" << endl;
+      out << "   " << definedName(var) << " = true;" << endl;
+      break;
+    }
+    case INPUT_STMT: {
+      string var = ((InputStmt *) line.stmt)->getVariable()->getName();
+      string read = isStringName(var) ? "readLine()" : "readValue()";
+      out << "   " << variableName(var) << " = " << read << ";" << endl;
+      out << "   " << definedName(var) << " = true;" << endl;
+      break;
+    }
+    case DIM_STMT: {
+      DimStmt *stmt = (DimStmt *) line.stmt;
+      string name = stmt->getName();
+      string first = emitInt(stmt->getFirst(), "Array dimension", em);
+      string second = "-1";
+      if (stmt->getSecond() != NULL) {
+         second = emitInt(stmt->getSecond(), "Array dimension", em);
+         out << "   if (" << second << " < 0) failArray(\"Illegal dimension for array \", \""
+             << name << "\", \"\");" << endl;
+      }
+      out << "   dim(a_" << name << ", \"" << name << "\", " << first << ", "
+          << second << ");" << endl;
+      break;
+    }
+    case MAT_STMT: {
+      MatStmt *stmt = (MatStmt *) line.stmt;
+      string name = stmt->getName();
+      string target = arrayArgument(name);
+      string left = arrayArgument(stmt->getLeft());
+      string right = arrayArgument(stmt->getRight());
+      switch (stmt->getOperation()) {
+       case MAT_ZERO:
+       case MAT_ONE:
+         if (stmt->getFirst() != NULL) {
+            string first = emitInt(stmt->getFirst(), "Array dimension", em);
+            string second = "-1";
+            if (stmt->getSecond() != NULL) {
+               second = emitInt(stmt->getSecond(), "Array dimension", em);
+               out << "   if (" << second << " < 0) failArray(\"Illegal dimension for array \", \""
+                   << name << "\", \"\");" << endl;
+            }
+            out << "   reshape(" << target << ", " << first << ", " << second << ");"
+                << endl;
+         }
+         out << "   matFill(" << target << ", "
+             << (stmt->getOperation() == MAT_ONE ? 1 : 0) << ");" << endl;
+         break;
+       case MAT_COPY:
+         out << "   matCopy(" << target << ", " << left << ");" << endl;
+         break;
+       case MAT_ADD:
+       case MAT_SUBTRACT:
+         out << "   matAdd(" << target << ", " << left << ", " << right << ", "
+             << (stmt->getOperation() == MAT_SUBTRACT ? "true" : "false") << ");"
+             << endl;
+         break;
+       case MAT_MULTIPLY:
+         out << "   matMultiply(" << target << ", " << left << ", " << right << ");"
+             << endl;
+         break;
+       case MAT_SCALE: {
+         string factor = emitInt(stmt->getScale(), "Scale factor", em);
+         out << "   matScale(" << target << ", " << factor << ", " << left << ");"
+             << endl;
+         break;
+       }
+       case MAT_TRANSPOSE:
+         out << "   matTranspose(" << target << ", " << left << ");" << endl;
+         break;
+      }
+      break;
+    }
+    case GOTO_STMT:
+    case END_STMT:
+      next = line.target;
+      break;
+    case GOSUB_STMT: {
+      int limit = getReturnStackLimit();
+      out << "   if (depth == " << limit << ") fail(\"GOSUB calls nested more than "
+          << limit << " deep\");" << endl;
+      out << "   returns[depth++] = " << line.next << ";" << endl;
+      next = line.target;
+      break;
+    }
+    case RETURN_STMT:
+      next = RETURN_NODE;
+      break;
+    case PARALLEL_FOR_STMT:
+      emitParallelFor(line, index, em);
+      break;
+    case ON_GOTO_STMT:
+    case ON_GOSUB_STMT: {
+      string value = emitInteger(((OnStmt *) line.stmt)->getExp(), "ON value", em);
+      string indent = "   ";
+      if (line.type == ON_GOSUB_STMT) {
+         int limit = getReturnStackLimit();
+         out << "   if (" << value << " >= 1 && " << value << " <= "
+             << line.tableSize << ") {" << endl;
+         out << "      if (depth == " << limit << ") fail(\"GOSUB calls nested more than "
+             << limit << " deep\");" << endl;
+         out << "      returns[depth++] = " << line.next << ";" << endl;
+         indent = "      ";
+      }
+      out << indent << "switch (" << value << ") {" << endl;
+      for (int i = 0; i < line.tableSize; i++) {
+         out << indent << " case " << i + 1 << ": goto " << label(line.table[i], em)
+             << ";" << endl;
+      }
+      out << indent << "}" << endl;
+      if (line.type == ON_GOSUB_STMT) out << "   }" << endl;
+      break;
+    }
+    case IF_STMT: {
+      IfStmt *stmt = (IfStmt *) line.stmt;
+      string lhs = emitExpression(stmt->getLHS(), em);
+      string rhs = emitExpression(stmt->getRHS(), em);
+      string op = stmt->getOp();
+      string test;
+      bool strings = isStringExpression(stmt->getLHS());
+      if (strings || (isIntegerExpression(stmt->getLHS())
+                      && isIntegerExpression(stmt->getRHS()))) {
+         if (op == "=") op = "==";
+         if (op == "==" || op == "<" || op == ">") test = lhs + " " + op + " " + rhs;
+      } else if (op == "=") {
+         test = "valEqual(" + lhs + ", " + rhs + ")";
+      } else if (op == "<") {
+         test = "valLess(" + lhs + ", " + rhs + ")";
+      } else if (op == ">") {
+         test = "valLess(" + rhs + ", " + lhs + ")";
+      }
+      if (test != "") {
+         out << "   if (" << test << ") goto " << label(line.target, em) << ";" << endl;
+      } else {
+         next = EXIT_NODE;
+      }
+      break;
+    }
+    default:
+      break;
+   }
+   if (next != index + 1) out << "   goto " << label(next, em) << ";" << endl;
+   out << "}" << endl;
+}
+
+/*
+ * Implementation notes: emitParallelFor
+ * -------------------------------------
+ * The loop runs its iterations in order, which is one of the orders the
+ * interpreter allows, so the private variables and the reductions need
+ * nothing special.  The bounds are evaluated once, into temporaries
+ * unless they are constants, as the interpreter evaluates them once.  A body line that ends the iteration jumps to
+ * the label at the bottom of the loop.
+ */
+
+static void emitParallelFor(CompiledLine & line, int index, Emitter & em) {
+   ostream & out = *em.out;
+   ParallelForStmt *stmt = (ParallelForStmt *) line.stmt;
+   ParallelLoop *loop = line.loop;
+   string var = stmt->getVariable()->getName();
+   string first = emitInt(stmt->getFirst(), "Loop bound", em);
+   string last = emitInt(stmt->getLast(), "Loop bound", em);
+   for (Reduction & reduction : loop->getReductions()) {
+      out << "   if (" << first << " <= " << last << " && !"
+          << definedName(reduction.name) << ") undefined(\"" << reduction.name
+          << "\");" << endl;
+   }
+   string counter = "p" + integerToString(index);
+   out << "   for (long long " << counter << " = " << first << "; " << counter << " <= "
+       << last << "; " << counter << "++) {" << endl;
+   out << "   " << variableName(var) << " = " << counter << ";" << endl;
+   out << "   " << definedName(var) << " = true;" << endl;
+   string prefix = em.prefix;
+   string exitLabel = em.exitLabel;
+   em.prefix = "P" + integerToString(index) + "_";
+   em.exitLabel = em.prefix + "next";
+   if (loop->getEntry() != 0) out << "   goto " << label(loop->getEntry(), em) << ";" << endl;
+   for (int k = 0; k < loop->size(); k++) {
+      emitLine(loop->getLines()[k], k, em);
+   }
+   out << em.exitLabel << ": ;" << endl;
+   em.prefix = prefix;
+   em.exitLabel = exitLabel;
+   out << "   }" << endl;
+   out << "   " << variableName(var) << " = (" << first << " <= " << last << ") ? "
+       << last << " + 1LL : " << first << ";" << endl;
+   out << "   " << definedName(var) << " = true;" << endl;
+}
+
+/*
+ * Implementation notes: emitExpression
+ * ------------------------------------
+ * Every compound expression gets a temporary, declared after those of
+ * its operands, which fixes the order of evaluation.  A CachedExp is
+ * translated as the expression it wraps, since the host compiler does
+ * its own loop-invariant code motion.  A FlatExp is translated through
+ * its tree view.  An integer expression, as isIntegerExpression decides
+ * it, is computed in long longs; strings are computed in std::strings
+ * and the other expressions in Values.  An integer constant too large
+ * for a long long ends the program where it is evaluated.
+ */
+
+static string emitExpression(Expression *exp, Emitter & em) {
+   ostream & out = *em.out;
+   switch (exp->getType()) {
+    case CONSTANT: {
+      Value value = ((ConstantExp *) exp)->getValue();
+      if (value.isBig()) {
+         out << "   fail(\"Integer overflow\");" << endl;
+         return "0";
+      }
+      if (value.isString()) return "std::string(" + quoteString(value) + ")";
+      if (value.isReal()) return "Value(" + value.toString() + ")";
+      long long integer = value.getInteger();
+      if (integer == (int) integer) return value.toString();
+      if (integer == LLONG_MIN) return "LLONG_MIN";
+      return value.toString() + "LL";
+    }
+    case IDENTIFIER: {
+      IdentifierExp *var = (IdentifierExp *) exp;
+      string name = var->getName();
+      if (var->isChecked()) {
+         out << "   if (!" << definedName(name) << ") undefined(\"" << name << "\");"
+             << endl;
+      }
+      return variableName(name);
+    }
+    case CACHED:
+      return emitExpression(((CachedExp *) exp)->getExp(), em);
+    case INDEX: {
+      IndexExp *index = (IndexExp *) exp;
+      string subscript = emitInteger(index->getSubscript(), "Subscript", em);
+      string temp = "t" + integerToString(em.temps++);
+      out << "   int " << temp << " = offset(a_" << index->getArray() << ", \""
+          << index->getArray() << "\", " << index->getPosition() << ", "
+          << subscript << ");" << endl;
+      return temp;
+    }
+    case ARRAY: {
+      string element = emitElement((ArrayExp *) exp, em);
+      string temp = "t" + integerToString(em.temps++);
+      out << "   int " << temp << " = " << element << ";" << endl;
+      return temp;
+    }
+    case FLAT:
+      return emitExpression(((FlatExp *) exp)->getTree(), em);
+    case COMPOUND: {
+      CompoundExp *compound = (CompoundExp *) exp;
+      string lhs = emitExpression(compound->getLHS(), em);
+      string rhs = emitExpression(compound->getRHS(), em);
+      string op = compound->getOp();
+      string temp = "t" + integerToString(em.temps++);
+      if (isStringExpression(compound)) {
+         out << "   std::string " << temp << " = " << lhs << " + " << rhs << ";" << endl;
+         return temp;
+      }
+      bool integer = isIntegerExpression(compound);
+      string type = integer ? "long long" : "Value";
+      string fn;
+      if (op == "+") fn = "Add";
+      else if (op == "-") fn = "Sub";
+      else if (op == "*") fn = "Mul";
+      else if (op == "/") fn = "Div";
+      if (fn == "") {
+         out << "   fail(\"Illegal operator in expression\");" << endl;
+         out << "   " << type << " " << temp << " = 0;" << endl;
+      } else {
+         out << "   " << type << " " << temp << " = " << (integer ? "op" : "val")
+             << fn << "(" << lhs << ", " << rhs << ");" << endl;
+      }
+      return temp;
+    }
+    case CALL: {
+      CallExp *call = (CallExp *) exp;
+      string str = emitExpression(call->getArg(0), em);
+      if (call->getFunction() == FN_LEN) {
+         return "Value((long long) " + str + ".size())";
+      }
+      const char *what = (call->getFunction() == FN_MID) ? "String position"
+                                                         : "String length";
+      string args = str + ", " + emitInteger(call->getArg(1), what, em);
+      if (call->getFunction() == FN_MID) {
+         args += ", ";
+         if (call->getArgCount() == 3) {
+            args += emitInteger(call->getArg(2), "String length", em);
+         } else {
+            args += "LLONG_MAX";
+         }
+      }
+      string fn = "strMid";
+      if (call->getFunction() == FN_LEFT) fn = "strLeft";
+      if (call->getFunction() == FN_RIGHT) fn = "strRight";
+      string temp = "t" + integerToString(em.temps++);
+      out << "   std::string " << temp << " = " << fn << "(" << args << ");" << endl;
+      return temp;
+    }
+   }
+   return "0";
+}
+
+/*
+ * Implementation notes: emitInteger, emitInt
+ * ------------------------------------------
+ * Emit an expression whose value must be an integer, or for emitInt an
+ * integer that fits in an int.  A value that may not be one is checked
+ * at once, in a temporary, so the check comes where the interpreter
+ * makes it, before anything that follows is evaluated.
+ */
+
+static string emitInteger(Expression *exp, const char *what, Emitter & em) {
+   string value = emitExpression(exp, em);
+   if (isIntegerExpression(exp)) return value;
+   string temp = "t" + integerToString(em.temps++);
+   *em.out << "   long long " << temp << " = integerOf(" << value << ", \"" << what
+           << "\");" << endl;
+   return temp;
+}
+
+static string emitInt(Expression *exp, const char *what, Emitter & em) {
+   Expression *tree = (exp->getType() == FLAT) ? ((FlatExp *) exp)->getTree() : exp;
+   if (tree->getType() == CONSTANT) {
+      Value value = ((ConstantExp *) tree)->getValue();
+      if (value.isInteger() && value.getInteger() == (int) value.getInteger()) {
+         return value.toString();
+      }
+   }
+   string value = emitInteger(exp, what, em);
+   string temp = "t" + integerToString(em.temps++);
+   *em.out << "   int " << temp << " = intOf(" << value << ", \"" << what << "\");"
+           << endl;
+   return temp;
+}
+
+/*
+ * Implementation notes: emitElement
+ * ---------------------------------
+ * Computes the offsets of an element and returns the element as an
+ * lvalue, so that it can be read or assigned.
+ */
+
+static string emitElement(ArrayExp *element, Emitter & em) {
+   string offset = emitExpression(element->getFirst(), em);
+   if (element->getSecond() != NULL) {
+      offset += " + " + emitExpression(element->getSecond(), em);
+   }
+   return "a_" + element->getName() + ".data[" + offset + "]";
+}
+
+/*
+ * Implementation notes: findVariables
+ * -----------------------------------
+ * All variables are declared at the top of main, because a goto may not
+ * jump past the declaration of a variable it later uses.
+ */
+
+static void findVariables(CompiledLine & line, Emitter & em) {
+   switch (line.type) {
+    case PRINT_STMT:
+      findVariables(((PrintStmt *) line.stmt)->getExp(), em);
+      break;
+    case LET_STMT:
+      if (((LetStmt *) line.stmt)->getElement() != NULL) {
+         findVariables(((LetStmt *) line.stmt)->getElement(), em);
+      } else {
+         addVariable(((LetStmt *) line.stmt)->getVariable()->getName(), em);
+      }
+      findVariables(((LetStmt *) line.stmt)->getExp(), em);
+      break;
+    case DIM_STMT:
+      addArray(((DimStmt *) line.stmt)->getName(), em);
+      findVariables(((DimStmt *) line.stmt)->getFirst(), em);
+      if (((DimStmt *) line.stmt)->getSecond() != NULL) {
+         findVariables(((DimStmt *) line.stmt)->getSecond(), em);
+      }
+      break;
+    case MAT_STMT: {
+      MatStmt *stmt = (MatStmt *) line.stmt;
+      addArray(stmt->getName(), em);
+      if (stmt->getLeft() != "") addArray(stmt->getLeft(), em);
+      if (stmt->getRight() != "") addArray(stmt->getRight(), em);
+      if (stmt->getScale() != NULL) findVariables(stmt->getScale(), em);
+      if (stmt->getFirst() != NULL) findVariables(stmt->getFirst(), em);
+      if (stmt->getSecond() != NULL) findVariables(stmt->getSecond(), em);
+      break;
+    }
+    case PARALLEL_FOR_STMT: {
+      ParallelForStmt *stmt = (ParallelForStmt *) line.stmt;
+      addVariable(stmt->getVariable()->getName(), em);
+      findVariables(stmt->getFirst(), em);
+      findVariables(stmt->getLast(), em);
+      for (int k = 0; k < line.loop->size(); k++) {
+         findVariables(line.loop->getLines()[k], em);
+      }
+      break;
+    }
+    case ON_GOTO_STMT:
+    case ON_GOSUB_STMT:
+      findVariables(((OnStmt *) line.stmt)->getExp(), em);
+      break;
+    case INPUT_STMT:
+      addVariable(((InputStmt *) line.stmt)->getVariable()->getName(), em);
+      break;
+    case IF_STMT:
+      findVariables(((IfStmt *) line.stmt)->getLHS(), em);
+      findVariables(((IfStmt *) line.stmt)->getRHS(), em);
+      break;
+    default:
+      break;
+   }
+}
+
+static void findVariables(Expression *exp, Emitter & em) {
+   if (exp->getType() == IDENTIFIER) {
+      addVariable(((IdentifierExp *) exp)->getName(), em);
+   } else if (exp->getType() == INDEX) {
+      addArray(((IndexExp *) exp)->getArray(), em);
+      findVariables(((IndexExp *) exp)->getSubscript(), em);
+   } else if (exp->getType() == ARRAY) {
+      addArray(((ArrayExp *) exp)->getName(), em);
+      findVariables(((ArrayExp *) exp)->getFirst(), em);
+      if (((ArrayExp *) exp)->getSecond() != NULL) {
+         findVariables(((ArrayExp *) exp)->getSecond(), em);
+      }
+   } else if (exp->getType() == COMPOUND) {
+      findVariables(((CompoundExp *) exp)->getLHS(), em);
+      findVariables(((CompoundExp *) exp)->getRHS(), em);
+   } else if (exp->getType() == CALL) {
+      CallExp *call = (CallExp *) exp;
+      for (int i = 0; i < call->getArgCount(); i++) {
+         findVariables(call->getArg(i), em);
+      }
+   } else if (exp->getType() == CACHED) {
+      findVariables(((CachedExp *) exp)->getExp(), em);
+   } else if (exp->getType() == FLAT) {
+      findVariables(((FlatExp *) exp)->getTree(), em);
+   }
+}
+
+static void addVariable(string name, Emitter & em) {
+   if (em.seen.containsKey(name)) return;
+   em.seen.put(name, true);
+   em.variables.add(name);
+}
+
+static void addArray(string name, Emitter & em) {
+   if (em.arraySeen.containsKey(name)) return;
+   em.arraySeen.put(name, true);
+   em.arrays.add(name);
+}
+
+/*
+ * Implementation notes: arrayArgument
+ * -----------------------------------
+ * The runtime's MAT functions take each array together with its name,
+ * which they need for their error messages.
+ */
+
+static string arrayArgument(string name) {
+   return "a_" + name + ", \"" + name + "\"";
+}
+
+/*
+ * Implementation notes: variableName, definedName
+ * -----------------------------------------------
+ * A variable becomes v_ and its name, and the flag that says whether it
+ * is defined becomes d_ and its name.  A name cannot contain an
+ * underscore, so writing the $ of a string variable as _S cannot make
+ * two names collide.
+ */
+
+static string variableName(string name) {
+   if (isStringName(name)) name = name.substr(0, name.length() - 1) + "_S";
+   return "v_" + name;
+}
+
+static string definedName(string name) {
+   return "d_" + variableName(name).substr(2);
+}
+
+static string label(int index, Emitter & em) {
+   if (index == EXIT_NODE) return em.exitLabel;
+   if (index == MISSING_NODE) return "missing";
+   if (index == RETURN_NODE) return "dispatch";
+   return em.prefix + integerToString(index);
+}
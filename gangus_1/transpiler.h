@@ -0,0 +1,47 @@
+/*
+ * File: transpiler.h
+ * ------------------
+ * This interface exports emitCpp, which translates a BASIC program into
+ * a standalone C++ translation unit.  The generated file needs nothing
+ * but the C++ standard library, so it builds with the host compiler:
+ *
+ *    basic --emit-cpp=prog.cpp prog.bas
+ *    g++ -O2 -o prog prog.cpp
+ *
+ * The native program behaves like running the file with the interpreter
+ * in batch mode.  It prints the same output, and it stops with the same
+ * "Error: " message on cerr and exit status 1 for undefined variables,
+ * division by zero and missing lines.  INPUT reads from standard input
+ * after the same " ? " prompt.  The one difference is that the native
+ * program has no big integers: an integer result that needs more than
+ * 64 bits stops it with the error "Integer overflow".
+ */
+
+#ifndef _transpiler_h
+#define _transpiler_h
+
+#include <iostream>
+#include <string>
+#include "program.h"
+
+/*
+ * Function: emitCpp
+ * Usage: emitCpp(program, out, name);
+ * -----------------------------------
+ * Writes the C++ translation of program to out.  The translation starts
+ * from the compiled form of the program, so dead lines are left out and
+ * reads that must follow an assignment skip the undefined-variable
+ * check.  Each variable becomes a local with a flag recording whether it
+ * has been assigned, a long long if the compiler found that it only ever
+ * holds integers and a tagged Value otherwise; each line becomes a
+ * label; GOTO and IF become goto
+ * statements.  Expressions are flattened into temporaries so that their
+ * operands are evaluated left to right, as the interpreter does, and an
+ * expression with two undefined variables names the same one.  The name
+ * appears only in the comment at the top of the file.  This function
+ * raises an error if the program is empty.
+ */
+
+void emitCpp(Program & program, std::ostream & out, std::string name);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * File: value.cpp
+ * ---------------
+ * This file implements the value.h interface.
+ */
+
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include "bigint.h"
+#include "error.h"
+#include "stringvalue.h"
+#include "strlib.h"
+#include "value.h"
+using namespace std;
+
+/*
+ * Implementation notes: Value(chars, length)
+ * ------------------------------------------
+ * A buffer made here has no room to spare; appendString gives a buffer
+ * room to grow once a string is actually being built.
+ */
+
+Value::Value(const char *chars, int length) {
+   type = STRING_VALUE;
+   if (length <= SHORT_STRING) {
+      size = length;
+      memcpy(payload.chars, chars, length);
+   } else {
+      size = LONG_STRING;
+      payload.buffer = newStringBuffer(chars, length, length);
+   }
+}
+
+/*
+ * Implementation notes: toString
+ * ------------------------------
+ * to_chars with no precision gives the shortest form that reads back as
+ * the same double.  A real with an integral value comes out as digits
+ * alone, so it gets ".0"; the other forms already have a point or an
+ * exponent, or are inf or nan.
+ */
+
+string Value::toString() const {
+   if (type == BIG_VALUE) return bigToString(payload.big);
+   if (type == STRING_VALUE) return string(getChars(), getLength());
+   char buffer[32];
+   char *end;
+   if (type == INTEGER_VALUE) {
+      end = to_chars(buffer, buffer + sizeof buffer, payload.integer).ptr;
+      return string(buffer, end);
+   }
+   end = to_chars(buffer, buffer + sizeof buffer, payload.real).ptr;
+   string str(buffer, end);
+   if (str.find_first_of(".ein") == string::npos) str += ".0";
+   return str;
+}
+
+/*
+ * Implementation notes: combineValues, divideValues
+ * -------------------------------------------------
+ * An integer operand converts to double before a real operation, which
+ * is exact up to 53 bits.  Two integers that did not stay on the inline
+ * path go to combineIntegers, which works on integers of any size.  The
+ * parser only lets + have strings as operands, and only two of them, but
+ * a program restored from a checkpoint is not parsed against the values
+ * of its variables, so a mismatch still raises an error here.
+ */
+
+Value combineValues(char op, const Value & x, const Value & y) {
+   if (x.isString() || y.isString()) {
+      if (op != '+' || !x.isString() || !y.isString()) error("Type mismatch");
+      return concatStrings(x, y);
+   }
+   if (!x.isReal() && !y.isReal()) return combineIntegers(op, x, y);
+   double left = x.toReal();
+   double right = y.toReal();
+   if (op == '+') return Value(left + right);
+   if (op == '-') return Value(left - right);
+   return Value(left * right);
+}
+
+Value divideValues(const Value & x, const Value & y) {
+   if (x.isString() || y.isString()) error("Type mismatch");
+   if (x.isReal() || y.isReal()) {
+      if (y.toReal() == 0) error("Division by zero");
+      return Value(x.toReal() / y.toReal());
+   }
+   if (y.isInteger() && y.getInteger() == 0) error("Division by zero");
+   if (x.isInteger() && y.isInteger()
+       && !(x.getInteger() == LLONG_MIN && y.getInteger() == -1)) {
+      return Value(x.getInteger() / y.getInteger());
+   }
+   return combineIntegers('/', x, y);
+}
+
+void integerExpected(const char *what) {
+   error(string(what) + " must be an integer");
+}
+
+void integerOutOfRange(const char *what) {
+   error(string(what) + " is out of range");
+}
+
+/*
+ * Implementation notes: scanValue, stringToValue
+ * ----------------------------------------------
+ * Text made of digits, after an optional minus sign, is an integer,
+ * which becomes a big integer if it does not fit in 64 bits.  Anything
+ * else goes to from_chars as a real, which must use all of the text and
+ * be finite, so inf and nan, which from_chars accepts, are not numbers
+ * here.
+ */
+
+bool scanValue(const char *start, const char *end, Value & value) {
+   if (start == end) return false;
+   const char *cp = (*start == '-') ? start + 1 : start;
+   bool digits = cp < end;
+   for (const char *p = cp; p < end; p++) {
+      if (!isdigit((unsigned char) *p)) digits = false;
+   }
+   if (digits) {
+      long long integer;
+      from_chars_result result = from_chars(start, end, integer);
+      if (result.ec == errc::result_out_of_range) {
+         value = scanBigInteger(start, end);
+         return true;
+      }
+      if (result.ptr != end || result.ec != errc()) return false;
+      value = Value(integer);
+      return true;
+   }
+   double real;
+   from_chars_result result = from_chars(start, end, real);
+   if (result.ptr != end || result.ec != errc() || !isfinite(real)) return false;
+   value = Value(real);
+   return true;
+}
+
+Value stringToValue(const string & str) {
+   Value value;
+   if (!scanValue(str.data(), str.data() + str.length(), value)) {
+      error("Illegal number " + str);
+   }
+   return value;
+}
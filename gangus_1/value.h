@@ -0,0 +1,433 @@
+/*
+ * File: value.h
+ * -------------
+ * This interface exports the Value type, which holds the value of a
+ * BASIC expression or variable: an integer, a real number or a string.
+ * A Value is a type tag followed by a 64-bit payload and is passed
+ * around by value.  The arithmetic functions test both tags inline and stay on
+ * integer instructions when both operands are integers; only an
+ * operation that involves a real number or overflows 64 bits leaves
+ * the inline path.
+ *
+ * Integers are exact.  They are held in 64 bits, and a result that
+ * does not fit moves to a big integer (see bigint.h), which grows as
+ * far as it needs to; a big integer that shrinks back into range goes
+ * back to 64 bits, so an integer has only one form.  Division truncates
+ * toward zero.  As soon as one operand is real, the operation is done in
+ * double precision, so 7 / 2 is 3 but 7.0 / 2 is 3.5.
+ *
+ * A string of up to SHORT_STRING characters lives in the payload itself;
+ * a longer one is held in a StringBuffer (see stringvalue.h) that its
+ * copies share.  Strings and numbers never mix: the parser gives every
+ * expression one of the two types, and + on two strings concatenates.
+ */
+
+#ifndef _value_h
+#define _value_h
+
+#include <string>
+
+/*
+ * Type: ValueType
+ * ---------------
+ * The kinds of value a Value can hold.  An INTEGER_VALUE fits in 64
+ * bits and a BIG_VALUE never does.  The kinds from BIG_VALUE on may
+ * hold a reference, which the copy operations test for with a single
+ * comparison.
+ */
+
+enum ValueType { INTEGER_VALUE, REAL_VALUE, BIG_VALUE, STRING_VALUE };
+
+/*
+ * Type: BigInt
+ * ------------
+ * The digits of a big integer, which bigint.cpp defines.
+ */
+
+struct BigInt;
+
+void retainBig(BigInt *big);
+void releaseBig(BigInt *big);
+double bigToReal(const BigInt *big);
+
+/*
+ * Type: StringBuffer
+ * ------------------
+ * The characters of a long string, which stringvalue.cpp defines.
+ */
+
+struct StringBuffer;
+
+void retainString(StringBuffer *buffer);
+void releaseString(StringBuffer *buffer);
+const char *getBufferChars(const StringBuffer *buffer);
+int getBufferLength(const StringBuffer *buffer);
+
+/*
+ * Class: Value
+ * ------------
+ * An integer, a real number or a string.  The default value is the
+ * integer 0, which is what an undefined variable or a new array element
+ * holds.  A Value that holds a big integer or a long string shares it
+ * with the copies made of it, which the copy operations keep count of.
+ */
+
+class Value {
+
+public:
+
+/*
+ * Constant: SHORT_STRING
+ * ----------------------
+ * The longest string that is stored inline, in the payload.
+ */
+
+   static const int SHORT_STRING = 8;
+
+/*
+ * Constructors: Value
+ * Usage: Value value;
+ *        Value value = 42;
+ *        Value value = 2.5;
+ *        Value value(chars, length);
+ * ------------------------------------
+ * Create the integer 0, an integer, a real number or a string.  A
+ * string is copied, inline if it is short and otherwise into a new
+ * buffer.  The forms that take a BigInt or a StringBuffer, which only
+ * bigint.cpp and stringvalue.cpp use, take over the reference they hold.
+ */
+
+   Value() {
+      type = INTEGER_VALUE;
+      size = 0;
+      payload.integer = 0;
+   }
+
+   Value(int integer) {
+      type = INTEGER_VALUE;
+      size = 0;
+      payload.integer = integer;
+   }
+
+   Value(long long integer) {
+      type = INTEGER_VALUE;
+      size = 0;
+      payload.integer = integer;
+   }
+
+   Value(double real) {
+      type = REAL_VALUE;
+      size = 0;
+      payload.real = real;
+   }
+
+   Value(const char *chars, int length);
+
+   explicit Value(BigInt *big) {
+      type = BIG_VALUE;
+      size = 0;
+      payload.big = big;
+   }
+
+   explicit Value(StringBuffer *buffer) {
+      type = STRING_VALUE;
+      size = LONG_STRING;
+      payload.buffer = buffer;
+   }
+
+/*
+ * Copying and destruction
+ * -----------------------
+ * Only a big integer or a long string needs anything beyond copying the
+ * payload; a number never gets past the first test of the type.
+ */
+
+   Value(const Value & src) {
+      type = src.type;
+      size = src.size;
+      payload = src.payload;
+      if (type >= BIG_VALUE) retain();
+   }
+
+   Value(Value && src) {
+      type = src.type;
+      size = src.size;
+      payload = src.payload;
+      src.type = INTEGER_VALUE;
+   }
+
+   Value & operator=(const Value & src) {
+      if (src.type >= BIG_VALUE) src.retain();
+      if (type >= BIG_VALUE) release();
+      type = src.type;
+      size = src.size;
+      payload = src.payload;
+      return *this;
+   }
+
+   Value & operator=(Value && src) {
+      if (this != &src) {
+         if (type >= BIG_VALUE) release();
+         type = src.type;
+         size = src.size;
+         payload = src.payload;
+         src.type = INTEGER_VALUE;
+      }
+      return *this;
+   }
+
+   ~Value() {
+      if (type >= BIG_VALUE) release();
+   }
+
+/*
+ * Methods: getType, isInteger, isReal, isBig, isString
+ * Usage: if (value.isInteger()) . . .
+ * -----------------------------------
+ * Return the kind of value this is.  isInteger is true only for an
+ * integer that fits in 64 bits; a number is an integer of either size
+ * if it is not real.
+ */
+
+   ValueType getType() const {
+      return type;
+   }
+
+   bool isInteger() const {
+      return type == INTEGER_VALUE;
+   }
+
+   bool isReal() const {
+      return type == REAL_VALUE;
+   }
+
+   bool isBig() const {
+      return type == BIG_VALUE;
+   }
+
+   bool isString() const {
+      return type == STRING_VALUE;
+   }
+
+/*
+ * Methods: getInteger, getReal, getBig
+ * Usage: long long n = value.getInteger();
+ * ----------------------------------------
+ * Return the payload, which must be of the kind asked for.
+ */
+
+   long long getInteger() const {
+      return payload.integer;
+   }
+
+   double getReal() const {
+      return payload.real;
+   }
+
+   BigInt *getBig() const {
+      return payload.big;
+   }
+
+/*
+ * Methods: getChars, getLength, getBuffer
+ * Usage: const char *chars = value.getChars();
+ * --------------------------------------------
+ * Return the characters and the length of a string, which are not
+ * terminated by a null.  getBuffer returns the buffer of a long string
+ * and NULL for a short one.  The characters of a short string are
+ * inside the Value, so they last only as long as it does.
+ */
+
+   const char *getChars() const {
+      if (size != LONG_STRING) return payload.chars;
+      return getBufferChars(payload.buffer);
+   }
+
+   int getLength() const {
+      if (size != LONG_STRING) return size;
+      return getBufferLength(payload.buffer);
+   }
+
+   StringBuffer *getBuffer() const {
+      return (size == LONG_STRING) ? payload.buffer : NULL;
+   }
+
+/*
+ * Method: toReal
+ * Usage: double x = value.toReal();
+ * ---------------------------------
+ * Returns the value as a real number, converting an integer, which is
+ * rounded if it has more than 53 bits.
+ */
+
+   double toReal() const {
+      if (type == REAL_VALUE) return payload.real;
+      if (type == INTEGER_VALUE) return (double) payload.integer;
+      return bigToReal(payload.big);
+   }
+
+/*
+ * Method: toString
+ * Usage: string str = value.toString();
+ * -------------------------------------
+ * Returns the value as PRINT shows it.  A real number is written in the
+ * fewest digits that read back as the same number and always contains a
+ * decimal point or an exponent, so 2.0 does not look like the integer 2.
+ * A string is its characters, without quotes.
+ */
+
+   std::string toString() const;
+
+private:
+
+/*
+ * Constant: LONG_STRING
+ * ---------------------
+ * The size of a string whose characters are in a buffer.  The size of
+ * a short string is its length, and sits in the padding after the tag,
+ * so a Value stays 16 bytes.
+ */
+
+   static const unsigned char LONG_STRING = 0xFF;
+
+   void retain() const {
+      if (type == BIG_VALUE) {
+         retainBig(payload.big);
+      } else if (size == LONG_STRING) {
+         retainString(payload.buffer);
+      }
+   }
+
+   void release() {
+      if (type == BIG_VALUE) {
+         releaseBig(payload.big);
+      } else if (size == LONG_STRING) {
+         releaseString(payload.buffer);
+      }
+   }
+
+   ValueType type;
+   unsigned char size;
+   union {
+      long long integer;
+      double real;
+      BigInt *big;
+      StringBuffer *buffer;
+      char chars[SHORT_STRING];
+   } payload;
+
+};
+
+/*
+ * Functions: addValues, subtractValues, multiplyValues, divideValues
+ * Usage: Value sum = addValues(x, y);
+ * -----------------------------------
+ * The arithmetic operators on values.  divideValues raises an error if
+ * the divisor is zero, whether it is an integer or a real number.  The
+ * inline functions go to combineValues for anything but two 64-bit
+ * integers whose result fits in 64 bits.
+ */
+
+Value combineValues(char op, const Value & x, const Value & y);
+
+inline Value addValues(const Value & x, const Value & y) {
+   long long result;
+   if (x.isInteger() && y.isInteger()
+       && !__builtin_add_overflow(x.getInteger(), y.getInteger(), &result)) {
+      return Value(result);
+   }
+   return combineValues('+', x, y);
+}
+
+inline Value subtractValues(const Value & x, const Value & y) {
+   long long result;
+   if (x.isInteger() && y.isInteger()
+       && !__builtin_sub_overflow(x.getInteger(), y.getInteger(), &result)) {
+      return Value(result);
+   }
+   return combineValues('-', x, y);
+}
+
+inline Value multiplyValues(const Value & x, const Value & y) {
+   long long result;
+   if (x.isInteger() && y.isInteger()
+       && !__builtin_mul_overflow(x.getInteger(), y.getInteger(), &result)) {
+      return Value(result);
+   }
+   return combineValues('*', x, y);
+}
+
+Value divideValues(const Value & x, const Value & y);
+
+/*
+ * Functions: valuesEqual, valueLess
+ * Usage: if (valueLess(x, y)) . . .
+ * ---------------------------------
+ * Compare two numbers by value, so the integer 2 equals the real 2.0,
+ * or two strings by their characters.  Integers of any size compare
+ * exactly.
+ */
+
+int compareIntegers(const Value & x, const Value & y);
+int compareStrings(const Value & x, const Value & y);
+
+inline bool valuesEqual(const Value & x, const Value & y) {
+   if (x.isInteger() && y.isInteger()) return x.getInteger() == y.getInteger();
+   if (x.isReal() || y.isReal()) return x.toReal() == y.toReal();
+   if (x.isString()) return compareStrings(x, y) == 0;
+   return compareIntegers(x, y) == 0;
+}
+
+inline bool valueLess(const Value & x, const Value & y) {
+   if (x.isInteger() && y.isInteger()) return x.getInteger() < y.getInteger();
+   if (x.isReal() || y.isReal()) return x.toReal() < y.toReal();
+   if (x.isString()) return compareStrings(x, y) < 0;
+   return compareIntegers(x, y) < 0;
+}
+
+/*
+ * Functions: checkInteger, checkInt
+ * Usage: long long subscript = checkInteger(value, "Subscript");
+ *        int bound = checkInt(value, "Array dimension");
+ * --------------------------------------------------------------
+ * Return the integer in value, or raise the error "what must be an
+ * integer" if value is a real number or a string.  Subscripts, array
+ * elements, dimensions, string positions and the other places that count
+ * things only take integers.  checkInteger raises "what is out of range"
+ * for a big integer, and checkInt also for an integer that does not fit
+ * in an int, which is what arrays store and measure.
+ */
+
+void integerExpected(const char *what);
+void integerOutOfRange(const char *what);
+
+inline long long checkInteger(const Value & value, const char *what) {
+   if (!value.isInteger()) {
+      if (value.isBig()) integerOutOfRange(what);
+      integerExpected(what);
+   }
+   return value.getInteger();
+}
+
+inline int checkInt(const Value & value, const char *what) {
+   long long integer = checkInteger(value, what);
+   if (integer != (int) integer) integerOutOfRange(what);
+   return (int) integer;
+}
+
+/*
+ * Functions: scanValue, stringToValue
+ * Usage: if (scanValue(start, end, value)) . . .
+ *        Value value = stringToValue(token);
+ * ----------------------------------------------
+ * Read a number written as an integer, with an optional minus sign, or
+ * as a real number with a decimal point or an exponent.  An integer may
+ * have any number of digits.  scanValue returns false unless the
+ * characters from start up to end are exactly one such number and a
+ * real one is in range; stringToValue raises an error instead.
+ */
+
+bool scanValue(const char *start, const char *end, Value & value);
+Value stringToValue(const std::string & str);
+
+#endif